@@ -0,0 +1,231 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#ifndef SECURECLOUDSTORAGE_ALLOCATION_STRATEGY_H
+#define SECURECLOUDSTORAGE_ALLOCATION_STRATEGY_H
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <pkw/pprf/ggm_pprf.h>
+
+namespace secure_cloud_storage {
+
+    /**
+     * Decides where in the tag space the identifier of a new file is placed.
+     *
+     * The key of a flat PKW holds the co-path nodes of its punctured tags. Puncturing every tag below a node removes the
+     * node's co-path nodes from the key, while a dead tag next to live ones costs a co-path node on every level where
+     * they part. Hence, the key stays small if files that are deleted together get adjacent tags.
+     *
+     * A strategy hands out counters, which are unique and never reused; the id provider turns them into tags. It is
+     * not thread-safe, the id provider serializes the calls.
+     */
+    class AllocationStrategy {
+        public:
+            virtual ~AllocationStrategy() = default;
+
+            /**
+             * @param path the file the counter is allocated for (empty if the file is not known)
+             * @return a counter that has not been allocated before
+             */
+            virtual Tag next(const std::filesystem::path &path) = 0;
+
+            /**
+             * Informs the strategy of a counter allocated before, e.g. when a lookup table is loaded.
+             */
+            virtual void mark_used(const std::filesystem::path &path, const Tag &counter) = 0;
+
+            /**
+             * Informs the strategy that the counters 1 to last are in use and no others, e.g. after the local ids are
+             * compacted.
+             */
+            virtual void restart(const Tag &last) = 0;
+
+            /**
+             * @return false if no counter in [first, last] will be allocated anymore
+             */
+            virtual bool may_allocate_between(const Tag &first, const Tag &last) = 0;
+
+            /**
+             * @return a copy of the strategy in its current state, e.g. to try out allocations without consuming
+             * counters
+             */
+            [[nodiscard]] virtual std::unique_ptr<AllocationStrategy> clone() const = 0;
+
+        protected:
+            static Tag increment(const Tag &t) {
+                Tag res = t;
+                // inspired by https://stackoverflow.com/questions/10362991/add-1-to-c-bitset?rq=3
+                for (size_t i = 0; i < MAX_TAG_LEN; ++i) {
+                    if (res[i] == 0) {
+                        res.set(i, true);
+                        break;
+                    }
+                    res.set(i, false);
+                }
+                return res;
+            }
+
+            static bool less(const Tag &a, const Tag &b) {
+                for (size_t i = MAX_TAG_LEN; i-- > 0;) {
+                    if (a[i] != b[i]) {
+                        return b[i];
+                    }
+                }
+                return false;
+            }
+    };
+
+    /**
+     * Allocates the counters 1, 2, 3, ... in order.
+     */
+    class SequentialAllocation : public AllocationStrategy {
+        private:
+            Tag counter = Tag(0);
+            Tag max_counter;
+
+        public:
+            explicit SequentialAllocation(int tagLen) : max_counter(~Tag() >> (MAX_TAG_LEN - tagLen)) {}
+
+            Tag next(const std::filesystem::path &) override {
+                if (counter == max_counter) {
+                    throw std::runtime_error("Identifiers are used up");
+                }
+                counter = increment(counter);
+                return counter;
+            }
+
+            void mark_used(const std::filesystem::path &, const Tag &c) override {
+                if (less(counter, c)) {
+                    counter = c;
+                }
+            }
+
+            void restart(const Tag &last) override {
+                counter = last;
+            }
+
+            bool may_allocate_between(const Tag &, const Tag &last) override {
+                // the counter only increases
+                return !less(last, counter);
+            }
+
+            [[nodiscard]] std::unique_ptr<AllocationStrategy> clone() const override {
+                return std::make_unique<SequentialAllocation>(*this);
+            }
+    };
+
+    /**
+     * Groups the files into clusters, by default by their directory, and gives each cluster its own region of
+     * 2^region_bits consecutive counters, i.e. a subtree of the GGM tree. Once a region is full, the cluster continues in
+     * a fresh region. A cluster whose files are deleted together, e.g. when its directory is removed, leaves a dead
+     * subtree that costs no key nodes, instead of dead tags scattered between the live tags of other clusters.
+     *
+     * The cluster function may also group files by their expected lifetime, e.g. by their extension, so that the
+     * regions of short-lived files die as a whole.
+     */
+    class ClusteredAllocation : public AllocationStrategy {
+        public:
+            using ClusterFunction = std::function<std::string(const std::filesystem::path &)>;
+
+            static std::string by_directory(const std::filesystem::path &path) {
+                return path.parent_path().string();
+            }
+
+        private:
+            // the counters of a region not allocated yet, from next to last
+            struct Region {
+                Tag next;
+                Tag last;
+            };
+
+            int region_bits;
+            ClusterFunction cluster_of;
+            std::map<std::string, Region> open_regions;
+            // the index of the first region not assigned to any cluster
+            Tag next_region = Tag(0);
+            Tag max_region;
+
+        public:
+            /**
+             * @param tagLen the tag length
+             * @param regionBits the size of a region is 2^regionBits counters
+             * @param clusterOf maps a file to its cluster
+             */
+            explicit ClusteredAllocation(int tagLen, int regionBits = 8, ClusterFunction clusterOf = by_directory)
+                    : region_bits(regionBits),
+                      cluster_of(std::move(clusterOf)),
+                      max_region(~Tag() >> (MAX_TAG_LEN - tagLen + regionBits)) {
+                if (regionBits < 0 || regionBits >= tagLen) {
+                    throw std::invalid_argument("The region must be smaller than the tag space");
+                }
+            }
+
+            Tag next(const std::filesystem::path &path) override {
+                std::string cluster = cluster_of(path);
+                auto it = open_regions.find(cluster);
+                if (it == open_regions.end()) {
+                    if (less(max_region, next_region)) {
+                        throw std::runtime_error("Identifiers are used up");
+                    }
+                    Tag first = next_region << region_bits;
+                    next_region = increment(next_region);
+                    it = open_regions.insert({cluster, {first, first | ~Tag() >> (MAX_TAG_LEN - region_bits)}}).first;
+                }
+                Tag c = it->second.next;
+                if (c == it->second.last) {
+                    open_regions.erase(it);
+                } else {
+                    it->second.next = increment(c);
+                }
+                return c;
+            }
+
+            void mark_used(const std::filesystem::path &, const Tag &c) override {
+                // the regions are not assigned to their clusters again, every cluster continues in a fresh region
+                Tag region = c >> region_bits;
+                if (!less(region, next_region)) {
+                    next_region = increment(region);
+                }
+            }
+
+            void restart(const Tag &last) override {
+                open_regions.clear();
+                next_region = increment(last >> region_bits);
+            }
+
+            bool may_allocate_between(const Tag &first, const Tag &last) override {
+                if (!less(last, next_region << region_bits)) {
+                    return true;
+                }
+                return std::any_of(open_regions.begin(), open_regions.end(), [&](const auto &p) {
+                    return !less(last, p.second.next) && !less(p.second.last, first);
+                });
+            }
+
+            [[nodiscard]] std::unique_ptr<AllocationStrategy> clone() const override {
+                return std::make_unique<ClusteredAllocation>(*this);
+            }
+    };
+}
+
+#endif //SECURECLOUDSTORAGE_ALLOCATION_STRATEGY_H
@@ -0,0 +1,156 @@
+// Copyright 2023. Younis Khalil
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+//  persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+//  Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+//  BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+//  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#include "../allocation_strategy.h"
+#include "../flat_id_provider.h"
+#include "git_history.h"
+#include <pkw/pprf/ggm_pprf.h>
+#include <chrono>
+#include <functional>
+
+/**
+ * Replays the git histories under each allocation strategy of the flat id provider and reports the size of the
+ * resulting key. Only the identifiers and the punctures are simulated: the key size does not depend on the files'
+ * contents, and the PPRF is used without wrapping any file keys.
+ */
+
+namespace scs = secure_cloud_storage;
+
+static const int TAG_LEN = 64;
+static const int KEY_LEN = 128;
+
+struct Strategy {
+    std::string name;
+    std::function<std::shared_ptr<scs::AllocationStrategy>()> create;
+};
+
+struct Result {
+    std::string history;
+    std::string strategy;
+    size_t nodes;
+    size_t peakNodes;
+    double averageNodes;
+    size_t serializedBytes;
+    // the number of bits of the largest tag, i.e. the tag length a growing key needs
+    size_t tagBits;
+    double time;
+};
+
+static size_t bit_width(const Tag &t) {
+    for (size_t i = MAX_TAG_LEN; i-- > 0;) {
+        if (t[i]) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+Result replay(const std::string &history, const std::vector<FileAction> &actions, const Strategy &strategy) {
+    scs::FlatIdProvider idProvider(TAG_LEN, 0, strategy.create());
+    GGM_PPRF prf(PPRFKey(KEY_LEN, TAG_LEN, PRGType::FIXED_KEY_AES));
+    size_t peakNodes = 0;
+    double sumNodes = 0;
+    size_t tagBits = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto &ac: actions) {
+        if (ac.action == ADD || ac.action == MODIFY) {
+            tagBits = std::max(tagBits, bit_width(idProvider.get_id(ac.fileName).getLocalId()));
+        } else if (ac.action == DELETE && idProvider.exists_file(ac.fileName)) {
+            Id<Tag> id = idProvider.get_id(ac.fileName);
+            prf.punc(id.getLocalId());
+            idProvider.remove(id);
+        } else if (ac.action == DIR_DELETE) {
+            std::string dir = ac.fileName + "/";
+            std::vector<Id<Tag>> deleted;
+            std::vector<Tag> tags;
+            for (auto &id: idProvider.list_ids()) {
+                if (idProvider.get_file_path(id).string().starts_with(dir)) {
+                    deleted.push_back(id);
+                    tags.push_back(id.getLocalId());
+                }
+            }
+            prf.puncBatch(tags);
+            for (auto &id: deleted) {
+                idProvider.remove(id);
+            }
+        }
+        const size_t nodes = prf.keyStats().nodes;
+        peakNodes = std::max(peakNodes, nodes);
+        sumNodes += nodes;
+    }
+    std::chrono::nanoseconds time = std::chrono::high_resolution_clock::now() - start;
+    return {history, strategy.name, prf.keyStats().nodes, peakNodes, sumNodes / actions.size(),
+            prf.serializeKey().size(), tagBits, time.count() / 1e6};
+}
+
+std::string get_date_string() {
+    auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    char date_string[100];
+    std::strftime(date_string, 100, "%Y_%m_%d_%Hh%M", std::localtime(&now));
+    return date_string;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> histories;
+    for (int i = 1; i < argc; ++i) {
+        histories.emplace_back(argv[i]);
+    }
+    if (histories.empty()) {
+        for (auto &entry: fs::directory_iterator("resources")) {
+            histories.push_back(entry.path().filename().string());
+        }
+        std::sort(histories.begin(), histories.end());
+    }
+
+    std::vector<Strategy> strategies = {
+            {"sequential",   [] { return std::make_shared<scs::SequentialAllocation>(TAG_LEN); }},
+            {"directory_4",  [] { return std::make_shared<scs::ClusteredAllocation>(TAG_LEN, 4); }},
+            {"directory_8",  [] { return std::make_shared<scs::ClusteredAllocation>(TAG_LEN, 8); }},
+            {"top_level_12", [] {
+                return std::make_shared<scs::ClusteredAllocation>(TAG_LEN, 12, [](const fs::path &p) {
+                    return p.begin() == p.end() ? std::string() : p.begin()->string();
+                });
+            }},
+            {"extension_8",  [] {
+                return std::make_shared<scs::ClusteredAllocation>(TAG_LEN, 8, [](const fs::path &p) {
+                    return p.extension().string();
+                });
+            }},
+    };
+
+    std::vector<Result> results;
+    for (auto &history: histories) {
+        std::vector<FileAction> actions = loadGitHistory("resources/" + history);
+        for (auto &strategy: strategies) {
+            Result res = replay(history, actions, strategy);
+            std::cout << res.history << ", " << res.strategy << ":\t " << res.nodes << " nodes (peak " << res.peakNodes
+                      << ", average " << res.averageNodes << "),\t " << res.serializedBytes << "B,\t " << res.tagBits
+                      << " tag bits,\t " << res.time << "ms" << std::endl;
+            results.push_back(res);
+        }
+    }
+
+    auto outputDir = fs::path("git_bench_results");
+    fs::create_directories(outputDir);
+    auto outFile = std::ofstream(outputDir / ("allocation_" + get_date_string() + ".csv"));
+    outFile << "history" << "," << "strategy" << "," << "key_nodes" << "," << "peak_key_nodes" << ","
+            << "average_key_nodes" << "," << "key_size" << "," << "tag_bits" << "," << "time_ms" << std::endl;
+    for (auto &res: results) {
+        outFile << res.history << "," << res.strategy << "," << res.nodes << "," << res.peakNodes << ","
+                << res.averageNodes << "," << res.serializedBytes << "," << res.tagBits << "," << res.time
+                << std::endl;
+    }
+    return 0;
+}
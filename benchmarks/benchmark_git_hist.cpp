@@ -15,67 +15,12 @@
 //  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "../client_operator.h"
 #include "benchmark_local_hierarch_client.h"
+#include "git_history.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <utility>
 
-namespace fs = std::filesystem;
-
-
-static const std::string ADD = "A";
-static const std::string MODIFY = "M";
-static const std::string DELETE = "D";
-static const std::string RENAME = "R100";
-static const std::string DIR_DELETE = "DD";
-
-
-struct FileAction {
-    std::string action;
-    std::string fileName;
-
-    FileAction(std::string a, std::string fname) : action(std::move(a)), fileName(std::move(fname)) {};
-};
-
-
-std::vector<FileAction> loadGitHistory(const std::string &path) {
-    if (!fs::exists(path) || !fs::is_regular_file(path)) {
-        throw std::runtime_error("File does not exist: " + path);
-    }
-
-    auto actions = std::vector<FileAction>();
-
-    std::ifstream infile(path, std::ios::in);
-    std::string line;
-    int lcount = 0;
-    while (std::getline(infile, line)) {
-        lcount++;
-        std::istringstream iss(line);
-        std::string mode_string;
-        std::string filename;
-        std::string filenameNew;
-        if (!(iss >> mode_string >> filename)) {
-            std::cerr << "Something went wrong at line " << lcount << std::endl;
-        }
-        std::string mode = mode_string;
-        if (mode == RENAME) {
-            if (!(iss >> filenameNew)) {
-                std::cerr << "Something went wrong at line " << lcount << std::endl;
-            }
-        }
-        if (mode == ADD || mode == MODIFY || mode == DELETE || mode == DIR_DELETE) {
-            actions.emplace_back(mode, filename);
-        } else if (mode == RENAME) {
-            actions.emplace_back(DELETE, filename);
-            actions.emplace_back(ADD, filenameNew);
-        } else {
-            std::cerr << "Unknown mode: " << line << std::endl;
-        }
-
-    }
-    return actions;
-}
-
 std::vector<unsigned char> empty;
 
 std::string get_date_string() {
@@ -88,16 +33,18 @@ std::string get_date_string() {
     return date_copy;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     auto co = scs_benchmarks::BenchmarkLocalClientOperator(256);
     auto outputDir = fs::path("git_bench_results");
     fs::create_directories(outputDir);
-    std::string gitHistFileName = "freeCodeCamp_git_hist_with_dir_deletes.txt";
+    std::string gitHistFileName = argc > 1 ? argv[1] : "freeCodeCamp_git_hist_with_dir_deletes.txt";
 
     std::vector<FileAction> gitHistory = loadGitHistory("resources/" + gitHistFileName);
 
     auto outFile = std::ofstream(outputDir / (gitHistFileName + "_" + get_date_string() + ".csv"));
-    outFile << "action" << "," << "t" << "," << "filename" << "," << "key_size" << "," << "numDirs" << std::endl;
+    outFile << "action" << "," << "t" << "," << "filename" << "," << "key_size" << "," << "numDirs" << ","
+            << "key_nodes" << "," << "resident_bytes" << "," << "avg_match_depth" << "," << "predicted_eval_prg_calls"
+            << std::endl;
 
     unsigned long key_size = co.export_key().size();
     int i = 0;
@@ -123,8 +70,12 @@ int main() {
         }
         ++i;
 
+        // maintained incrementally, unlike key_size which requires serializing the key
+        const KeyStats stats = co.key_stats();
         outFile << ac.action << "," << diff.count() << "," << ac.fileName
-                << "," << key_size << "," << co.get_number_dirs() << std::endl;
+                << "," << key_size << "," << co.get_number_dirs() << "," << stats.nodes << ","
+                << stats.residentBytes << "," << stats.averageMatchDepth << "," << stats.expectedEvalDerivations
+                << std::endl;
     }
 
     auto outKey = std::ofstream(outputDir / (gitHistFileName + "_" + get_date_string() + "_key.bin"));
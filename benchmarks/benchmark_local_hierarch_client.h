@@ -34,6 +34,10 @@ namespace scs_benchmarks {
                                                                                std::make_shared<HPPRF_AEAD_PKW>(
                                                                                        keyLen)) {}
 
+            KeyStats key_stats() const {
+                return std::dynamic_pointer_cast<HPPRF_AEAD_PKW>(pkw)->keyStats();
+            }
+
             size_t get_number_dirs() const {
                 return std::dynamic_pointer_cast<secure_cloud_storage::HierarchIdProvider>(
                         id_provider)->get_number_dirs();
@@ -0,0 +1,85 @@
+// Copyright 2023. Younis Khalil
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+//  persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+//  Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+//  BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+//  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#ifndef SECURECLOUDSTORAGE_GIT_HISTORY_H
+#define SECURECLOUDSTORAGE_GIT_HISTORY_H
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const std::string ADD = "A";
+static const std::string MODIFY = "M";
+static const std::string DELETE = "D";
+static const std::string RENAME = "R100";
+static const std::string DIR_DELETE = "DD";
+
+
+struct FileAction {
+    std::string action;
+    std::string fileName;
+
+    FileAction(std::string a, std::string fname) : action(std::move(a)), fileName(std::move(fname)) {};
+};
+
+
+/**
+ * Reads a history extracted by github_history_extract_command.txt, a rename is split into a delete and an add.
+ */
+inline std::vector<FileAction> loadGitHistory(const std::string &path) {
+    if (!fs::exists(path) || !fs::is_regular_file(path)) {
+        throw std::runtime_error("File does not exist: " + path);
+    }
+
+    auto actions = std::vector<FileAction>();
+
+    std::ifstream infile(path, std::ios::in);
+    std::string line;
+    int lcount = 0;
+    while (std::getline(infile, line)) {
+        lcount++;
+        std::istringstream iss(line);
+        std::string mode_string;
+        std::string filename;
+        std::string filenameNew;
+        if (!(iss >> mode_string >> filename)) {
+            std::cerr << "Something went wrong at line " << lcount << std::endl;
+        }
+        std::string mode = mode_string;
+        if (mode == RENAME) {
+            if (!(iss >> filenameNew)) {
+                std::cerr << "Something went wrong at line " << lcount << std::endl;
+            }
+        }
+        if (mode == ADD || mode == MODIFY || mode == DELETE || mode == DIR_DELETE) {
+            actions.emplace_back(mode, filename);
+        } else if (mode == RENAME) {
+            actions.emplace_back(DELETE, filename);
+            actions.emplace_back(ADD, filenameNew);
+        } else {
+            std::cerr << "Unknown mode: " << line << std::endl;
+        }
+
+    }
+    return actions;
+}
+
+#endif //SECURECLOUDSTORAGE_GIT_HISTORY_H
@@ -49,6 +49,13 @@ class MockCloudCommunicator : public secure_cloud_storage::CloudCommunicator<T>
 
         }
 
+        void write_lookup_table_to_cloud(const std::string &encrypted) override {
+        }
+
+        std::string read_lookup_table_from_cloud() override {
+            return {};
+        }
+
         std::string read_from_cloud(const std::string &name) override {
             return {};
         }
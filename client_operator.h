@@ -27,6 +27,9 @@
 #include <future>
 #include "cloud_communicator.h"
 #include "id_provider.h"
+#include "rotation_policy.h"
+#include "util/rate_limiter.h"
+#include "util/rotation_checkpoint.h"
 
 #include <cstddef>
 #include "client_operator.h"
@@ -38,8 +41,23 @@
 #include <algorithm>
 #include <utility>
 #include <pkw/pkw/exceptions.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
 
 #define MAX_RETRIES 10
+#define EPOCH_LEN 4
+#define EPOCH_HEADER_VERSION 1
+#define WRAP_TAG_LEN 16
+#define DEFAULT_ROTATION_BATCH_SIZE 256
+#define DEFAULT_REKEY_MIN_KEY_NODES 64
 
 namespace secure_cloud_storage {
 
@@ -53,6 +71,11 @@ namespace secure_cloud_storage {
     class ClientOperator {
         protected:
             std::shared_ptr<AbstractPKW<T, ciphertext>> pkw;
+            // the key of the previous epoch while its headers are being rewrapped, null otherwise
+            std::shared_ptr<AbstractPKW<T, ciphertext>> previous_pkw;
+            // the number of rotations of the key; headers written in epoch e > 0 start with EPOCH_HEADER_VERSION and e, as
+            // big-endian value
+            uint32_t epoch = 0;
             int key_len;
             int tag_len;
 
@@ -68,10 +91,11 @@ namespace secure_cloud_storage {
              * @param id_provider the lookup table, linking local file names with the random identifiers of the cloud.
              * @param tag_len the length of tags.
              * @param key_len the length of keys.
+             * @param epoch the epoch of the key, as returned by get_epoch when it was exported.
              */
             ClientOperator(std::shared_ptr<AbstractPKW<T, ciphertext>> pkw,
                            std::shared_ptr<IdProvider<T>> id_provider, int tag_len, int key_len,
-                           std::shared_ptr<CloudCommunicator<T>> cloud_comm);
+                           std::shared_ptr<CloudCommunicator<T>> cloud_comm, uint32_t epoch = 0);
 
             /**
              * Construct an object with fresh secrets.
@@ -85,6 +109,9 @@ namespace secure_cloud_storage {
                                                                                     comm(std::move(comm)),
                                                                                     id_provider(id_provider),
                                                                                     pkw(pkw) {};
+
+            ~ClientOperator();
+
             /**
              * Return the used key length.
              * @return key length.
@@ -122,10 +149,134 @@ namespace secure_cloud_storage {
 
             /**
              * Rotate the keys used to encrypt individual files. Used to improve performance after repeated `shred` operations.
+             * Other operations may continue during the rotation, see start_rotation.
+             * <br>
+             * Optionally, the files are assigned dense local ids under the new key, in the order of their remote ids,
+             * which keep their objects in the cloud: the tree of the new key only spans the live files, and local ids
+             * are allocated from the start again. Operations wait for such a rotation to complete, and ids obtained
+             * before are to be looked up again by get_id. Requires an id provider supporting compaction.
              * @param the new pkw object to use
+             * @param compact_tags whether to assign the files dense local ids.
              * @return the number of files affected by the operation.
+             * @throws std::runtime_error if compact_tags is set and the id provider does not support compaction.
+             */
+            size_t rotate_keys(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw, bool compact_tags = false);
+
+            /**
+             * Start rotating the keys in the background, and return immediately. The new key starts a new epoch: files put
+             * from now on are wrapped under it, while reads pick the key by the epoch stored in the header and shreds
+             * puncture both keys. The headers of the previous epoch are rewrapped one at a time, after which the previous
+             * key is destroyed. A rotation which is still in progress is completed first.
+             * @param new_pkw the new pkw object to use
+             */
+            void start_rotation(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw);
+
+            /**
+             * Wait for a rotation started by start_rotation to complete.
+             * @return the number of files.
+             */
+            size_t wait_for_rotation();
+
+            /**
+             * Return the number of headers the running rotation has not yet rewrapped.
+             * @return the number of headers, 0 if no rotation is running.
+             */
+            size_t remaining_headers() const { return rotation->remaining_headers; }
+
+            /**
+             * Persist the progress of rotations. Headers are rewrapped in batches of batch_size, in the order of their
+             * remote ids; after each batch, the store receives both keys and the last remote id of the batch. It
+             * receives both keys after each shred during a rotation as well, which punctures them. The checkpoint of a
+             * completed rotation is kept, it is to be cleared once the new key has been stored.
+             * @param store the store of the checkpoints, or null to not store checkpoints.
+             * @param batch_size the number of headers rewrapped at a time, which bounds the memory used by a rotation.
+             */
+            void set_rotation_checkpoints(std::shared_ptr<RotationCheckpointStore> store,
+                                          size_t batch_size = DEFAULT_ROTATION_BATCH_SIZE);
+
+            /**
+             * Resume a rotation that was interrupted, from a checkpoint. The object holds the key of the epoch before
+             * the checkpoint, the headers following the last remote id of the checkpoint are rewrapped.
+             * @param new_pkw the pkw object of the key of the checkpoint.
+             * @param last_remote_id the last remote id of the checkpoint.
+             * @param compact_tags whether the rotation of the checkpoint assigns dense local ids.
+             * @return the number of files.
              */
-            size_t rotate_keys(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw);
+            size_t resume_rotation(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw,
+                                   const std::string &last_remote_id, bool compact_tags = false);
+
+            /**
+             * Persist the key whenever wrapping grows it, e.g. when its tree grows to fit a new local id. Unlike
+             * punctures, which only make the key forget, a growth adds nodes every header wrapped afterwards may depend
+             * on: the key is persisted after the wrap and before the header is written. While a rotation is running,
+             * the rotation checkpoint is written instead, if any.
+             * @param persist_key stores the key, e.g. by journaling its changes.
+             */
+            void set_key_growth_handler(std::function<void()> persist_key);
+
+            /**
+             * Re-key the subtrees of the tag space holding the most nodes of the key per file inside them: the files of
+             * a subtree are moved to fresh local ids, keeping their objects in the cloud, and the subtree is punctured
+             * as a whole, which removes all of its nodes from the key. Unlike rotate_keys, only the headers of the moved
+             * files are rewritten. Subtrees holding fewer nodes of the key than files, and subtrees in which the id
+             * provider may still allocate ids are left alone.
+             * Operations wait for the re-keying to complete, and ids of moved files obtained before are to be looked up
+             * again by get_id. Nothing is re-keyed unless the key is made of the nodes of a tree and the id provider
+             * supports moving ids.
+             * The moves are stored in the re-keying checkpoint, if any, before a header is written under a new local
+             * id; the checkpoint is to be cleared once the lookup table and the key have been stored.
+             * @param max_subtrees the maximal number of subtrees to re-key.
+             * @param min_key_nodes the minimal number of nodes of the key in a subtree worth re-keying.
+             * @return the number of files moved.
+             */
+            size_t rekey_subtrees(size_t max_subtrees = 1, size_t min_key_nodes = DEFAULT_REKEY_MIN_KEY_NODES);
+
+            /**
+             * Persist the files moved by rekey_subtrees, such that the moves can be completed after a crash.
+             * @param store the store of the checkpoints, or null to not store checkpoints.
+             */
+            void set_rekey_checkpoints(std::shared_ptr<RekeyCheckpointStore<T>> store);
+
+            /**
+             * Complete the moves of an interrupted rekey_subtrees, from a checkpoint. The object holds the lookup table
+             * and the key stored before the checkpoint: the files still listed under their previous local ids are
+             * moved, their headers are rewritten unless they were written before the crash, and the subtrees are
+             * punctured.
+             * @param checkpoint the checkpoint.
+             * @return the number of files moved.
+             */
+            size_t resume_rekey(const RekeyCheckpoint<T> &checkpoint);
+
+            /**
+             * Return the epoch of the current key, to be stored along with it.
+             * @return the epoch.
+             */
+            uint32_t get_epoch();
+
+            /**
+             * Rotate the keys automatically, whenever the key has grown beyond the thresholds of the policy. After each
+             * `shred` a background thread measures the key (at most once per check interval) and, once a rotation is
+             * due and the client has been idle for the idle window, rotates to a fresh key. Operations issued during
+             * the rotation wait for it to complete.
+             * @param policy the thresholds and limits of the rotation.
+             * @param new_pkw returns a PKW with a fresh key.
+             * @param on_rotated called after each automatic rotation with the new PKW and the number of files, e.g. to
+             * store the new key. It must not disable the automatic rotation.
+             */
+            void enable_auto_rotation(const RotationPolicy &policy,
+                                      std::function<std::shared_ptr<AbstractPKW<T, ciphertext>>()> new_pkw,
+                                      std::function<void(std::shared_ptr<AbstractPKW<T, ciphertext>>, size_t)> on_rotated = {});
+
+            /**
+             * Stop rotating keys automatically. Waits for a running rotation to complete.
+             */
+            void disable_auto_rotation();
+
+            /**
+             * Measure the current key.
+             * @return the number of punctures, nodes and the size of the key.
+             */
+            KeyGrowth key_growth();
 
             /**
              * Lookup the local name of the file stored under id.
@@ -163,14 +314,464 @@ namespace secure_cloud_storage {
 
             std::vector<unsigned char> eps = {0};
             const int nonce_len = 16;
+
+        private:
+            struct RotationState {
+                // held shared by all operations, and exclusively while the keys are replaced
+                std::shared_mutex operations;
+                // guards id_provider
+                std::mutex lookup;
+                // a header is only written by one operation at a time; ids are mapped onto the locks by their hash
+                std::array<std::mutex, 64> headers;
+                // held while a rotation is started or completed
+                std::mutex rotating;
+                std::future<size_t> migration;
+                std::atomic<size_t> remaining_headers = 0;
+                // the headers up to this remote id have been rewrapped; written while operations are excluded
+                std::string migrated_until;
+                size_t batch_size = DEFAULT_ROTATION_BATCH_SIZE;
+                std::shared_ptr<RotationCheckpointStore> checkpoints;
+                // serializes the checkpoints written by concurrent shreds
+                std::mutex checkpoint;
+                // persists the key after it grew, see set_key_growth_handler
+                std::function<void()> persist_grown_key;
+                // the growths of the current key persisted so far, guarded by growth
+                size_t persisted_growths = 0;
+                std::mutex growth;
+                // the files moved by rekey_subtrees are stored here before their headers are written
+                std::shared_ptr<RekeyCheckpointStore<T>> rekey_checkpoints;
+                // set while a rotation assigns dense local ids; it holds operations exclusively until it completes
+                bool compacting = false;
+                // the number of ids assigned dense local ids so far
+                size_t compacted = 0;
+                // the shredded objects found by the compaction, by their compacted ids
+                std::vector<Id<T>> compacted_orphans;
+                // guards the remaining members
+                std::mutex mutex;
+                std::condition_variable wakeup;
+                std::thread worker;
+                bool stopping = false;
+                bool punctured = false;
+                std::chrono::steady_clock::time_point last_activity = std::chrono::steady_clock::now();
+                RotationPolicy policy;
+                std::function<std::shared_ptr<AbstractPKW<T, ciphertext>>()> new_pkw;
+                std::function<void(std::shared_ptr<AbstractPKW<T, ciphertext>>, size_t)> on_rotated;
+            };
+            std::unique_ptr<RotationState> rotation = std::make_unique<RotationState>();
+
+            void record_activity(bool punctured);
+
+            void auto_rotation_loop();
+
+            size_t rotate_keys(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw, RateLimiter &header_rewrites,
+                               bool compact_tags = false);
+
+            std::unique_lock<std::shared_mutex> begin_compaction(bool compact_tags, const std::string &migrated_until);
+
+            std::shared_lock<std::shared_mutex> share_operations();
+
+            std::unique_lock<std::shared_mutex> exclude_operations();
+
+            void complete_rotation();
+
+            void begin_epoch(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw, const std::string &migrated_until = "");
+
+            std::vector<Id<T>> list_written_ids(const std::string &after);
+
+            size_t migrate_headers(RateLimiter &header_rewrites);
+
+            void save_checkpoint();
+
+            void write_checkpoint();
+
+            void persist_key_growth();
+
+            std::vector<bool> rewrap_headers(const std::vector<Id<T>> &ids, RateLimiter &header_rewrites);
+
+            size_t rekey_subtree(const T &first, const T &last, RekeyCheckpoint<T> &checkpoint);
+
+            size_t move_local_ids(const T &first, const T &last, const std::vector<Id<T>> &ids,
+                                  const std::vector<T> &new_tags, bool resumed);
+
+            std::mutex &header_lock(const Id<T> &id);
+
+            std::vector<unsigned char> header_aad(uint32_t header_epoch) const;
+
+            std::vector<unsigned char> encode_header(uint32_t header_epoch, const ciphertext &wrapped_key) const;
+
+            std::pair<uint32_t, ciphertext> decode_header(const std::string &header) const;
+
+            std::shared_ptr<AbstractPKW<T, ciphertext>> pkw_of_epoch(uint32_t header_epoch) const;
     };
     // private functions, not part of API
 
+    template<class T>
+    void ClientOperator<T>::record_activity(bool punctured) {
+        {
+            std::lock_guard<std::mutex> lock(rotation->mutex);
+            rotation->last_activity = std::chrono::steady_clock::now();
+            rotation->punctured |= punctured;
+        }
+        if (punctured) {
+            rotation->wakeup.notify_all();
+        }
+    }
+
+    template<class T>
+    std::mutex &ClientOperator<T>::header_lock(const Id<T> &id) {
+        return rotation->headers[std::hash<std::string>{}(id.getRemoteId()) % rotation->headers.size()];
+    }
+
+    template<class T>
+    std::vector<unsigned char> ClientOperator<T>::header_aad(uint32_t header_epoch) const {
+        // the epoch is authenticated, such that a header cannot be moved to another epoch
+        std::vector<unsigned char> aad(eps);
+        if (header_epoch > 0) {
+            aad.push_back(EPOCH_HEADER_VERSION);
+            for (int i = EPOCH_LEN - 1; i >= 0; --i) {
+                aad.push_back(static_cast<unsigned char>(header_epoch >> (8 * i)));
+            }
+        }
+        return aad;
+    }
+
+    template<class T>
+    std::vector<unsigned char> ClientOperator<T>::encode_header(uint32_t header_epoch,
+                                                                const ciphertext &wrapped_key) const {
+        std::vector<unsigned char> header;
+        if (header_epoch > 0) {
+            header = header_aad(header_epoch);
+            header.erase(header.begin(), header.begin() + static_cast<long>(eps.size()));
+        }
+        header.insert(header.end(), wrapped_key.begin(), wrapped_key.end());
+        return header;
+    }
+
+    template<class T>
+    std::pair<uint32_t, ciphertext> ClientOperator<T>::decode_header(const std::string &header) const {
+        // headers of epoch 0 were written before epochs existed and are a bare wrapped key, whose bytes are arbitrary;
+        // headers of later epochs are told apart by their length, the version only leaves room for other formats
+        const size_t wrapped_key_len = static_cast<size_t>(key_len / 8 + WRAP_TAG_LEN);
+        if (header.size() == 1 + EPOCH_LEN + wrapped_key_len &&
+            static_cast<unsigned char>(header[0]) == EPOCH_HEADER_VERSION) {
+            uint32_t header_epoch = 0;
+            for (int i = 1; i <= EPOCH_LEN; ++i) {
+                header_epoch = header_epoch << 8 | static_cast<unsigned char>(header[i]);
+            }
+            return {header_epoch, ciphertext(header.begin() + 1 + EPOCH_LEN, header.end())};
+        }
+        return {0, ciphertext(header.begin(), header.end())};
+    }
+
+    template<class T>
+    std::shared_ptr<AbstractPKW<T, ciphertext>> ClientOperator<T>::pkw_of_epoch(uint32_t header_epoch) const {
+        if (header_epoch == epoch) {
+            return pkw;
+        }
+        if (previous_pkw && header_epoch == epoch - 1) {
+            return previous_pkw;
+        }
+        throw std::runtime_error("The header was written in epoch " + std::to_string(header_epoch) +
+                                 ", whose key is no longer held.");
+    }
+
+    template<class T>
+    void ClientOperator<T>::complete_rotation() {
+        if (rotation->migration.valid()) {
+            try {
+                rotation->migration.get();
+            } catch (std::exception &e) {
+                // retried below
+            }
+        }
+        // a rotation that failed is retried, the headers of the previous key must not be left behind
+        if (previous_pkw) {
+            std::unique_lock<std::shared_mutex> compaction(rotation->operations, std::defer_lock);
+            if (rotation->compacting) {
+                compaction.lock();
+            }
+            RateLimiter unlimited(0);
+            migrate_headers(unlimited);
+        }
+    }
+
+    template<class T>
+    void ClientOperator<T>::begin_epoch(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw,
+                                        const std::string &migrated_until) {
+        {
+            std::unique_lock<std::shared_mutex> operation = exclude_operations();
+            previous_pkw = pkw;
+            pkw = std::move(new_pkw);
+            ++epoch;
+            // the checkpoint below stores the new key as it is
+            rotation->persisted_growths = pkw->getNumGrowths();
+            rotation->migrated_until = migrated_until;
+            std::lock_guard<std::mutex> lookup(rotation->lookup);
+            rotation->remaining_headers = id_provider->size();
+        }
+        // the new key is stored before anything is wrapped under it
+        save_checkpoint();
+    }
+
+    template<class T>
+    void ClientOperator<T>::save_checkpoint() {
+        if (!rotation->checkpoints) {
+            return;
+        }
+        // the keys are consistent with the headers, which are not modified meanwhile
+        std::unique_lock<std::shared_mutex> operation = exclude_operations();
+        write_checkpoint();
+    }
+
+    template<class T>
+    void ClientOperator<T>::write_checkpoint() {
+        // operations are held, such that the keys are not replaced meanwhile
+        std::lock_guard<std::mutex> guard(rotation->checkpoint);
+        RotationCheckpoint checkpoint;
+        checkpoint.epoch = epoch;
+        checkpoint.compact_tags = rotation->compacting;
+        checkpoint.last_remote_id = rotation->migrated_until;
+        checkpoint.previous_key = previous_pkw->serializeKey();
+        checkpoint.key = pkw->serializeKey();
+        rotation->checkpoints->save(checkpoint);
+    }
+
+    template<class T>
+    void ClientOperator<T>::persist_key_growth() {
+        // operations are held, such that the keys are not replaced meanwhile; a growth is read once it is published,
+        // the key persisted afterwards holds it
+        const size_t growths = pkw->getNumGrowths();
+        std::lock_guard<std::mutex> guard(rotation->growth);
+        if (growths <= rotation->persisted_growths) {
+            return;
+        }
+        if (previous_pkw) {
+            if (rotation->checkpoints) {
+                write_checkpoint();
+            }
+        } else if (rotation->persist_grown_key) {
+            rotation->persist_grown_key();
+        }
+        rotation->persisted_growths = growths;
+    }
+
+    template<class T>
+    std::vector<Id<T>> ClientOperator<T>::list_written_ids(const std::string &after) {
+        // no put is in progress, every listed id has a header
+        std::unique_lock<std::shared_mutex> operation = exclude_operations();
+        std::lock_guard<std::mutex> lookup(rotation->lookup);
+        return id_provider->list_ids_after(after, rotation->batch_size);
+    }
+
+    template<class T>
+    std::vector<bool> ClientOperator<T>::rewrap_headers(const std::vector<Id<T>> &ids, RateLimiter &header_rewrites) {
+        // read the headers in parallel
+        using Header = std::pair<uint32_t, ciphertext>;
+        std::vector<std::future<std::optional<Header>>> reads;
+        for (const Id<T> &id: ids) {
+            reads.emplace_back(std::async(std::launch::async, [this, id]() -> std::optional<Header> {
+                std::shared_lock<std::shared_mutex> operation = share_operations();
+                std::lock_guard<std::mutex> header_guard(header_lock(id));
+                {
+                    std::lock_guard<std::mutex> lookup(rotation->lookup);
+                    if (!id_provider->exists_id(id)) {
+                        // shredded in the meantime
+                        return std::nullopt;
+                    }
+                }
+                return decode_header(comm->read_from_cloud(comm->id_to_cloud_header(id)));
+            }));
+        }
+        std::vector<bool> rewrapped(ids.size(), true);
+        std::vector<size_t> pending;
+        std::vector<T> tags;
+        std::vector<T> new_tags;
+        std::vector<std::vector<unsigned char>> old_aads;
+        std::vector<ciphertext> wrapped_keys;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto header = reads[i].get();
+            // headers put in the meantime are wrapped under the new key already
+            if (header && header->first != epoch) {
+                pending.push_back(i);
+                tags.push_back(ids[i].getLocalId());
+                new_tags.push_back(rotation->compacting ? *id_provider->compacted_local_id(rotation->compacted + i)
+                                                        : ids[i].getLocalId());
+                old_aads.push_back(header_aad(header->first));
+                wrapped_keys.push_back(std::move(header->second));
+            }
+        }
+
+        // unwrap all headers in one traversal of the previous key and wrap them in one traversal of the new key
+        std::vector<ciphertext> new_wrapped_keys(pending.size());
+        {
+            std::shared_lock<std::shared_mutex> operation = share_operations();
+            auto keys = previous_pkw->unwrapLiveBatch(tags, old_aads, wrapped_keys);
+            std::vector<T> live_tags;
+            std::vector<std::vector<unsigned char>> live_keys;
+            std::vector<size_t> live;
+            for (size_t j = 0; j < pending.size(); ++j) {
+                if (keys[j]) {
+                    live.push_back(j);
+                    live_tags.push_back(new_tags[j]);
+                    live_keys.push_back(std::move(*keys[j]));
+                } else {
+                    // if a header cannot be decrypted, it was shredded
+                    rewrapped[pending[j]] = false;
+                }
+            }
+            std::vector<std::vector<unsigned char>> aads(live.size(), header_aad(epoch));
+            try {
+                std::vector<ciphertext> wrapped = pkw->wrapBatch(live_tags, aads, live_keys);
+                for (size_t k = 0; k < live.size(); ++k) {
+                    new_wrapped_keys[live[k]] = std::move(wrapped[k]);
+                }
+            } catch (PuncturableKeyWrappingException &e) {
+                // one of the files was shredded in the meantime, its header is not written below
+                for (size_t k = 0; k < live.size(); ++k) {
+                    try {
+                        new_wrapped_keys[live[k]] = pkw->wrap(live_tags[k], aads[k], live_keys[k]);
+                    } catch (PuncturableKeyWrappingException &) {}
+                }
+            }
+            persist_key_growth();
+        }
+
+        // write the headers in parallel
+        std::vector<std::future<void>> writes;
+        for (size_t j = 0; j < pending.size(); ++j) {
+            if (!rewrapped[pending[j]] || new_wrapped_keys[j].empty()) {
+                continue;
+            }
+            writes.emplace_back(std::async(std::launch::async, [this, &ids, &pending, &new_wrapped_keys, j,
+                                                                &header_rewrites]() {
+                const Id<T> &id = ids[pending[j]];
+                header_rewrites.acquire();
+                std::shared_lock<std::shared_mutex> operation = share_operations();
+                std::lock_guard<std::mutex> header_guard(header_lock(id));
+                {
+                    std::lock_guard<std::mutex> lookup(rotation->lookup);
+                    if (!id_provider->exists_id(id)) {
+                        // shredded in the meantime
+                        return;
+                    }
+                }
+                comm->write_header_to_cloud(id, encode_header(epoch, new_wrapped_keys[j]));
+            }));
+        }
+        for (auto &write: writes) {
+            write.get();
+        }
+        return rewrapped;
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::migrate_headers(RateLimiter &header_rewrites) {
+        // iterate over all headers (wrapped keys) in batches and re-wrap them
+        for (std::vector<Id<T>> batch = list_written_ids(rotation->migrated_until); !batch.empty();
+             batch = list_written_ids(rotation->migrated_until)) {
+            std::vector<bool> rewrapped = rewrap_headers(batch, header_rewrites);
+            // ids put during the rotation are listed as well
+            size_t remaining = rotation->remaining_headers;
+            while (!rotation->remaining_headers.compare_exchange_weak(
+                    remaining, remaining - std::min(remaining, batch.size()))) {}
+
+            {
+                std::unique_lock<std::shared_mutex> operation = exclude_operations();
+                std::lock_guard<std::mutex> lookup(rotation->lookup);
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    // delete header & file of shredded objects
+                    if (!rewrapped[i] && id_provider->exists_id(batch[i])) {
+                        comm->enqueue_delete(batch[i]);
+
+                        //delete entries from lookup tables; a compaction keeps them until the ids are reassigned
+                        if (rotation->compacting) {
+                            rotation->compacted_orphans.emplace_back(
+                                    *id_provider->compacted_local_id(rotation->compacted + i), batch[i].getRemoteId());
+                        } else {
+                            id_provider->remove(batch[i]);
+                        }
+                    }
+                }
+                rotation->compacted += batch.size();
+                rotation->migrated_until = batch.back().getRemoteId();
+            }
+            save_checkpoint();
+        }
+
+        std::unique_lock<std::shared_mutex> operation = exclude_operations();
+        comm->handle_delete_queue();
+
+        // no header is wrapped under the previous key anymore, destroy it
+        previous_pkw->secureTeardown();
+        previous_pkw.reset();
+        rotation->remaining_headers = 0;
+        std::lock_guard<std::mutex> lookup(rotation->lookup);
+        if (rotation->compacting) {
+            // all headers are wrapped under the compacted ids, the lookup table follows at once
+            id_provider->compact_local_ids();
+            for (const Id<T> &orphan: rotation->compacted_orphans) {
+                id_provider->remove(orphan);
+            }
+            rotation->compacted_orphans.clear();
+            rotation->compacting = false;
+        }
+        return id_provider->size();
+    }
+
+    template<class T>
+    void ClientOperator<T>::auto_rotation_loop() {
+        std::unique_lock<std::mutex> lock(rotation->mutex);
+        while (true) {
+            rotation->wakeup.wait(lock, [this] { return rotation->stopping || rotation->punctured; });
+            if (rotation->stopping) {
+                return;
+            }
+            rotation->punctured = false;
+            const RotationPolicy policy = rotation->policy;
+            lock.unlock();
+            const bool due = policy.is_due(key_growth());
+            lock.lock();
+            if (!due) {
+                // punctures until then are measured together
+                rotation->wakeup.wait_for(lock, policy.check_interval, [this] { return rotation->stopping; });
+                continue;
+            }
+            // postpone the rotation until the client is idle
+            while (!rotation->stopping && std::chrono::steady_clock::now() < rotation->last_activity + policy.idle_window) {
+                rotation->wakeup.wait_until(lock, rotation->last_activity + policy.idle_window);
+            }
+            if (rotation->stopping) {
+                return;
+            }
+            auto new_pkw = rotation->new_pkw;
+            auto on_rotated = rotation->on_rotated;
+            lock.unlock();
+            try {
+                RateLimiter header_rewrites(policy.max_header_rewrites_per_second);
+                auto rotated_pkw = new_pkw();
+                const size_t files = rotate_keys(rotated_pkw, header_rewrites);
+                if (on_rotated) {
+                    on_rotated(rotated_pkw, files);
+                }
+                lock.lock();
+            } catch (std::exception &e) {
+                // the old key is still in use, try again after the next check interval
+                lock.lock();
+                rotation->punctured = true;
+                rotation->wakeup.wait_for(lock, policy.check_interval, [this] { return rotation->stopping; });
+            }
+        }
+    }
+
 // public functions, part of API
 
     template<class T>
     Id<T> ClientOperator<T>::put(const std::filesystem::path &file_name, std::vector<unsigned char> &file_content) {
+        std::shared_lock<std::shared_mutex> operation(rotation->operations);
+        record_activity(false);
+        std::unique_lock<std::mutex> lookup(rotation->lookup);
         Id<T> id = id_provider->get_id(file_name);
+        lookup.unlock();
 
         std::vector<unsigned char> dek(
                 key_len / 8); // pkw library doesn't support SecureByteBuffer as key-to-be-wrapped, add?
@@ -178,24 +779,29 @@ namespace secure_cloud_storage {
         CryptoPP::RDRAND prng;
         // generate a data encryption key
         prng.GenerateBlock(dek.data(), dek.size());
-        // Wrap the data encryption key using the random tag, with the constant eps as additional data (header)
+        // Wrap the data encryption key using the random tag, with the constant eps and the epoch as additional data (header)
+        std::vector<unsigned char> aad = header_aad(epoch);
         bool wrapping_failed = false;
         int wrap_tries = 0;
         std::vector<unsigned char> wrapped_key;
         do {
             // the random tag could have been punctured before, so
             try {
-                wrapped_key = pkw->wrap(id.getLocalId(), eps, dek);
+                wrapped_key = pkw->wrap(id.getLocalId(), aad, dek);
                 wrap_tries++;
             } catch (std::exception &e) {
                 if (wrap_tries > MAX_RETRIES) {
                     throw std::runtime_error("Could not wrap after " + std::to_string(MAX_RETRIES) +
                                              " attempts, you may want to rotate keys.");
                 }
+                lookup.lock();
                 id = id_provider->get_id(file_name);
+                lookup.unlock();
                 wrapping_failed = true;
             }
         } while (wrapping_failed);
+        // the header must not be written before the nodes it depends on are stored
+        persist_key_growth();
 
         // Encrypt file
         std::vector<unsigned char> file_content_copy(file_content);
@@ -206,21 +812,28 @@ namespace secure_cloud_storage {
         const std::vector<unsigned char> encrypted_file = encrypt(plaintext, data_key, nonce, eps);
 
         // push to cloud
-        comm->write_to_cloud(id, wrapped_key, encrypted_file, nonce);
+        std::lock_guard<std::mutex> header_guard(header_lock(id));
+        comm->write_to_cloud(id, encode_header(epoch, wrapped_key), encrypted_file, nonce);
 
         return id;
     }
 
     template<class T>
     std::vector<unsigned char> ClientOperator<T>::get(const Id<T> &id) {
+        std::shared_lock<std::shared_mutex> operation(rotation->operations);
+        record_activity(false);
         // check file exists
-        if (!id_provider->exists_id(id)) {
-            throw std::runtime_error("File does not exist");
+        {
+            std::lock_guard<std::mutex> lookup(rotation->lookup);
+            if (!id_provider->exists_id(id)) {
+                throw std::runtime_error("File does not exist");
+            }
         }
         std::string nonce_and_file = comm->read_from_cloud(comm->id_to_cloud_name(id));
-        std::string header = comm->read_from_cloud(comm->id_to_cloud_header(id));
-        std::vector<unsigned char> header_buffer = std::vector<unsigned char>{header.begin(), header.end()};
-        auto dek = pkw->unwrap(id.getLocalId(), eps, header_buffer);
+        // during a rotation the header may be wrapped under either key
+        auto [header_epoch, header_buffer] = decode_header(comm->read_from_cloud(comm->id_to_cloud_header(id)));
+        std::vector<unsigned char> aad = header_aad(header_epoch);
+        auto dek = pkw_of_epoch(header_epoch)->unwrap(id.getLocalId(), aad, header_buffer);
         auto nonce = std::vector<unsigned char>(nonce_and_file.begin(), nonce_and_file.begin() + nonce_len);
         auto ctxt = std::vector<unsigned char>(nonce_and_file.begin() + nonce_len, nonce_and_file.end());
 
@@ -234,6 +847,7 @@ namespace secure_cloud_storage {
 
     template<class T>
     std::string ClientOperator<T>::get_file_name(Id<T> id) {
+        std::lock_guard<std::mutex> lookup(rotation->lookup);
         if (!id_provider->exists_id(id)) {
             throw std::runtime_error("File not found.");
         }
@@ -242,31 +856,212 @@ namespace secure_cloud_storage {
 
     template<class T>
     Id<T> ClientOperator<T>::get_id(const std::string &file_name) {
+        std::lock_guard<std::mutex> lookup(rotation->lookup);
         if (!id_provider->exists_file(file_name)) {
             throw std::runtime_error("File not found.");
         }
         return id_provider->get_id(file_name);
     }
 
+    template<class T>
+    size_t ClientOperator<T>::rekey_subtrees(size_t max_subtrees, size_t min_key_nodes) {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        complete_rotation();
+        // local ids change, no operation may use them meanwhile
+        std::unique_lock<std::shared_mutex> operation(rotation->operations);
+        size_t moved = 0;
+        RekeyCheckpoint<T> checkpoint;
+        for (size_t i = 0; i < max_subtrees; ++i) {
+            // the key changes with each subtree, the remaining ones are measured again
+            std::optional<typename AbstractPKW<T, ciphertext>::Subtree> worst;
+            {
+                std::lock_guard<std::mutex> lookup(rotation->lookup);
+                std::vector<T> tags;
+                for (const Id<T> &id: id_provider->list_ids()) {
+                    tags.push_back(id.getLocalId());
+                }
+                for (const auto &subtree: pkw->keySubtrees(tags, min_key_nodes)) {
+                    // the most nodes removed per header rewritten, at least one; of equal ones, the enclosing subtree
+                    // is listed last
+                    if (subtree.keyNodes >= subtree.tags &&
+                        (!worst || subtree.keyNodes * (worst->tags + 1) >= worst->keyNodes * (subtree.tags + 1)) &&
+                        !id_provider->may_allocate_between(subtree.first, subtree.last)) {
+                        worst = subtree;
+                    }
+                }
+            }
+            if (!worst) {
+                break;
+            }
+            moved += rekey_subtree(worst->first, worst->last, checkpoint);
+        }
+        comm->handle_delete_queue();
+        return moved;
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::resume_rekey(const RekeyCheckpoint<T> &checkpoint) {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        std::unique_lock<std::shared_mutex> operation(rotation->operations);
+        size_t moved = 0;
+        for (const auto &subtree: checkpoint.subtrees) {
+            std::vector<Id<T>> ids;
+            std::vector<T> new_tags;
+            {
+                std::lock_guard<std::mutex> lookup(rotation->lookup);
+                // files no longer listed inside the subtree were moved before the lookup table was stored; a file may
+                // have been moved into a later subtree by an earlier one, which is completed first
+                std::map<std::string, Id<T>> listed;
+                for (const Id<T> &id: id_provider->list_ids_between(subtree.first, subtree.last)) {
+                    listed.insert({id.getRemoteId(), id});
+                }
+                for (const Id<T> &id: subtree.moved) {
+                    auto it = listed.find(id.getRemoteId());
+                    if (it != listed.end()) {
+                        ids.push_back(it->second);
+                        new_tags.push_back(id.getLocalId());
+                    }
+                }
+            }
+            moved += move_local_ids(subtree.first, subtree.last, ids, new_tags, true);
+        }
+        comm->handle_delete_queue();
+        return moved;
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::rekey_subtree(const T &first, const T &last, RekeyCheckpoint<T> &checkpoint) {
+        std::vector<Id<T>> ids;
+        std::vector<T> new_tags;
+        {
+            std::lock_guard<std::mutex> lookup(rotation->lookup);
+            ids = id_provider->list_ids_between(first, last);
+            std::optional<std::vector<T>> tags = id_provider->allocate_local_ids(ids.size());
+            if (!tags) {
+                return 0;
+            }
+            new_tags = std::move(*tags);
+        }
+        // the lookup table still holds the previous local ids until it is stored, the moves of all subtrees so far
+        // are stored before the first header is written
+        if (rotation->rekey_checkpoints) {
+            std::vector<Id<T>> moved;
+            moved.reserve(ids.size());
+            for (size_t i = 0; i < ids.size(); ++i) {
+                moved.emplace_back(new_tags[i], ids[i].getRemoteId());
+            }
+            checkpoint.subtrees.push_back({first, last, std::move(moved)});
+            rotation->rekey_checkpoints->save(checkpoint);
+        }
+        return move_local_ids(first, last, ids, new_tags, false);
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::move_local_ids(const T &first, const T &last, const std::vector<Id<T>> &ids,
+                                             const std::vector<T> &new_tags, bool resumed) {
+        // read the headers in parallel
+        std::vector<std::future<std::string>> reads;
+        for (const Id<T> &id: ids) {
+            reads.emplace_back(std::async(std::launch::async, [this, id]() {
+                return comm->read_from_cloud(comm->id_to_cloud_header(id));
+            }));
+        }
+        std::vector<T> tags;
+        std::vector<std::vector<unsigned char>> aads;
+        std::vector<ciphertext> wrapped_keys;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto header = decode_header(reads[i].get());
+            tags.push_back(ids[i].getLocalId());
+            aads.push_back(header_aad(header.first));
+            wrapped_keys.push_back(std::move(header.second));
+        }
+
+        // the keys are wrapped under the fresh local ids before anything is written
+        auto keys = pkw->unwrapLiveBatch(tags, aads, wrapped_keys);
+        std::vector<size_t> live;
+        std::vector<T> live_tags;
+        std::vector<std::vector<unsigned char>> live_keys;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (keys[i]) {
+                live.push_back(i);
+                live_tags.push_back(new_tags[i]);
+                live_keys.push_back(std::move(*keys[i]));
+            }
+        }
+        size_t moved = live.size();
+        std::vector<std::vector<unsigned char>> new_aads(live.size(), header_aad(epoch));
+        std::vector<ciphertext> new_wrapped_keys = pkw->wrapBatch(live_tags, new_aads, live_keys);
+        persist_key_growth();
+
+        // write the headers in parallel, the objects keep their remote ids
+        std::vector<std::future<void>> writes;
+        for (size_t k = 0; k < live.size(); ++k) {
+            writes.emplace_back(std::async(std::launch::async, [this, &ids, &live, &new_wrapped_keys, k]() {
+                comm->write_header_to_cloud(ids[live[k]], encode_header(epoch, new_wrapped_keys[k]));
+            }));
+        }
+        for (auto &write: writes) {
+            write.get();
+        }
+
+        {
+            std::lock_guard<std::mutex> lookup(rotation->lookup);
+            for (size_t i = 0, k = 0; i < ids.size(); ++i) {
+                if (k < live.size() && live[k] == i) {
+                    id_provider->reassign_local_id(ids[i], new_tags[i]);
+                    ++k;
+                } else if (resumed) {
+                    // the header was written under the new local id before the crash
+                    id_provider->reassign_local_id(ids[i], new_tags[i]);
+                    ++moved;
+                } else {
+                    // if a header cannot be decrypted, it was shredded
+                    comm->enqueue_delete(ids[i]);
+                    id_provider->remove(ids[i]);
+                }
+            }
+        }
+        // no header is wrapped under a tag of the subtree anymore
+        pkw->puncRange(first, last);
+        return moved;
+    }
+
     template<class T>
     void ClientOperator<T>::shred(const Id<T> &id) {
+        std::shared_lock<std::shared_mutex> operation(rotation->operations);
+        std::lock_guard<std::mutex> header_guard(header_lock(id));
+        std::unique_lock<std::mutex> lookup(rotation->lookup);
         // check whether id is known
         if (!id_provider->exists_id(id)) {
             return;
         }
+        lookup.unlock();
 
-        // delete from lookup table
+        // the header may still be wrapped under the previous key
         pkw->punc(id.getLocalId());
+        if (previous_pkw) {
+            previous_pkw->punc(id.getLocalId());
+            // a rotation resumed from the last checkpoint would hold keys which still derive the tag
+            if (rotation->checkpoints) {
+                write_checkpoint();
+            }
+        }
 
+        // delete from lookup table
+        lookup.lock();
         id_provider->remove(id);
+        lookup.unlock();
 
         // delete file from cloud storage
         comm->enqueue_delete(id);
+
+        record_activity(true);
     }
 
 
     template<class T>
     std::vector<std::string> ClientOperator<T>::list_files() {
+        std::lock_guard<std::mutex> lookup(rotation->lookup);
         std::vector<std::string> files;
         for (auto &id: id_provider->list_ids()) {
             files.emplace_back(id_provider->get_file_path(id));
@@ -276,71 +1071,190 @@ namespace secure_cloud_storage {
 
     template<class T>
     size_t ClientOperator<T>::clean() {
-        return comm->clean_storage(id_provider->list_ids());
+        std::vector<Id<T>> ids;
+        {
+            std::lock_guard<std::mutex> lookup(rotation->lookup);
+            ids = id_provider->list_ids();
+        }
+        return comm->clean_storage(ids);
     }
 
 
     template<class T>
     ClientOperator<T>::ClientOperator(std::shared_ptr<AbstractPKW<T, ciphertext>> pkw,
                                       std::shared_ptr<IdProvider<T>> id_provider, int tag_len, int key_len,
-                                      std::shared_ptr<CloudCommunicator<T>> cloud_comm)
-            : pkw(std::move(pkw)), id_provider(std::move(id_provider)), tag_len(tag_len), key_len(key_len),
-              comm(std::move(cloud_comm)) {}
+                                      std::shared_ptr<CloudCommunicator<T>> cloud_comm, uint32_t epoch)
+            : pkw(std::move(pkw)), epoch(epoch), id_provider(std::move(id_provider)), tag_len(tag_len),
+              key_len(key_len), comm(std::move(cloud_comm)) {}
+
+    template<class T>
+    ClientOperator<T>::~ClientOperator() {
+        disable_auto_rotation();
+        try {
+            wait_for_rotation();
+        } catch (std::exception &e) {
+            // the headers not rewrapped yet are lost along with the previous key
+        }
+    }
 
     template<class T>
     SecureByteBuffer ClientOperator<T>::export_key() {
+        std::shared_lock<std::shared_mutex> operation(rotation->operations);
         return pkw->serializeKey();
     }
 
     template<class T>
-    size_t ClientOperator<T>::rotate_keys(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw) {
-        // iterate over all headers (wrapped keys) and re-wrap them
-        std::vector<std::future<void>> results;
-        std::vector<Id<T>> orphaned_objects;
-        for (Id<T> &id: id_provider->list_ids()) {
-            results.emplace_back(
-                    std::async(std::launch::async,
-                               [new_pkw, this, id, &orphaned_objects]() -> void {
-                                   // get key wrapped under current pkw key
-                                   std::string old_head = comm->read_from_cloud(comm->id_to_cloud_header(id));
-                                   std::vector<unsigned char> old_wrapped_key{
-                                           old_head.begin(),
-                                           old_head.end()};
-
-                                   try {
-                                       auto unwrapped_key = pkw->unwrap(id.getLocalId(), eps, old_wrapped_key);
-                                       // wrap the key under the new pkw key
-                                       auto new_wrapped_key = new_pkw->wrap(id.getLocalId(), eps,
-                                                                            unwrapped_key);
-                                       comm->write_header_to_cloud(id, new_wrapped_key);
-                                       return;
-                                   } catch (PuncturableKeyWrappingException &e) {
-                                       // if a header cannot be decrypted, it was shredded: delete header & file
-                                       orphaned_objects.emplace_back(id);
-                                   }
-                               }
-                    )
-            );
-        }
-
-        // wait for parallel operations to complete
-        for (auto &res: results) {
-            res.wait();
-        }
-
-        for (auto &id: orphaned_objects) {
-            comm->enqueue_delete(id);
-
-            //delete entries from lookup tables
-            id_provider->remove(id);
+    KeyGrowth ClientOperator<T>::key_growth() {
+        std::shared_lock<std::shared_mutex> operation(rotation->operations);
+        return measure_key_growth(*pkw, tag_len, key_len);
+    }
+
+    template<class T>
+    void ClientOperator<T>::enable_auto_rotation(const RotationPolicy &policy,
+                                                 std::function<std::shared_ptr<AbstractPKW<T, ciphertext>>()> new_pkw,
+                                                 std::function<void(std::shared_ptr<AbstractPKW<T, ciphertext>>, size_t)> on_rotated) {
+        disable_auto_rotation();
+        std::lock_guard<std::mutex> lock(rotation->mutex);
+        rotation->policy = policy;
+        rotation->new_pkw = std::move(new_pkw);
+        rotation->on_rotated = std::move(on_rotated);
+        rotation->stopping = false;
+        // the key may already be due
+        rotation->punctured = true;
+        rotation->worker = std::thread(&ClientOperator<T>::auto_rotation_loop, this);
+    }
+
+    template<class T>
+    void ClientOperator<T>::disable_auto_rotation() {
+        {
+            std::lock_guard<std::mutex> lock(rotation->mutex);
+            if (!rotation->worker.joinable()) {
+                return;
+            }
+            rotation->stopping = true;
         }
-        comm->handle_delete_queue();
+        rotation->wakeup.notify_all();
+        rotation->worker.join();
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::rotate_keys(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw, bool compact_tags) {
+        RateLimiter unlimited(0);
+        return rotate_keys(std::move(new_pkw), unlimited, compact_tags);
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::rotate_keys(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw,
+                                          RateLimiter &header_rewrites, bool compact_tags) {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        complete_rotation();
+        std::unique_lock<std::shared_mutex> compaction = begin_compaction(compact_tags, "");
+        begin_epoch(std::move(new_pkw));
+        return migrate_headers(header_rewrites);
+    }
 
-        // replace old pkw object (with old key)
-        pkw = new_pkw;
+    template<class T>
+    std::unique_lock<std::shared_mutex> ClientOperator<T>::begin_compaction(bool compact_tags,
+                                                                             const std::string &migrated_until) {
+        std::unique_lock<std::shared_mutex> compaction(rotation->operations, std::defer_lock);
+        if (!compact_tags) {
+            return compaction;
+        }
+        if (!id_provider->compacted_local_id(0)) {
+            throw std::runtime_error("The id provider does not support compacting local ids.");
+        }
+        // no operation may allocate or look up local ids until all ids are reassigned
+        compaction.lock();
+        rotation->compacting = true;
+        rotation->compacted = 0;
+        rotation->compacted_orphans.clear();
+        // the ids up to migrated_until were assigned the first compacted ids
+        std::lock_guard<std::mutex> lookup(rotation->lookup);
+        for (std::vector<Id<T>> ids = id_provider->list_ids_after("", rotation->batch_size);
+             !ids.empty() && ids.front().getRemoteId() <= migrated_until;
+             ids = id_provider->list_ids_after(ids.back().getRemoteId(), rotation->batch_size)) {
+            rotation->compacted += std::count_if(ids.begin(), ids.end(), [&migrated_until](const Id<T> &id) {
+                return id.getRemoteId() <= migrated_until;
+            });
+        }
+        return compaction;
+    }
 
+    template<class T>
+    std::shared_lock<std::shared_mutex> ClientOperator<T>::share_operations() {
+        // a compaction holds the lock exclusively for the whole rotation
+        if (rotation->compacting) {
+            return std::shared_lock<std::shared_mutex>(rotation->operations, std::defer_lock);
+        }
+        return std::shared_lock<std::shared_mutex>(rotation->operations);
+    }
 
+    template<class T>
+    std::unique_lock<std::shared_mutex> ClientOperator<T>::exclude_operations() {
+        // a compaction holds the lock exclusively for the whole rotation
+        if (rotation->compacting) {
+            return std::unique_lock<std::shared_mutex>(rotation->operations, std::defer_lock);
+        }
+        return std::unique_lock<std::shared_mutex>(rotation->operations);
+    }
+
+    template<class T>
+    void ClientOperator<T>::start_rotation(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw) {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        complete_rotation();
+        begin_epoch(std::move(new_pkw));
+        rotation->migration = std::async(std::launch::async, [this]() -> size_t {
+            RateLimiter unlimited(0);
+            return migrate_headers(unlimited);
+        });
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::wait_for_rotation() {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        if (rotation->migration.valid()) {
+            return rotation->migration.get();
+        }
+        std::lock_guard<std::mutex> lookup(rotation->lookup);
         return id_provider->size();
     }
+
+    template<class T>
+    void ClientOperator<T>::set_rotation_checkpoints(std::shared_ptr<RotationCheckpointStore> store,
+                                                     size_t batch_size) {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        complete_rotation();
+        rotation->checkpoints = std::move(store);
+        rotation->batch_size = std::max<size_t>(batch_size, 1);
+    }
+
+    template<class T>
+    size_t ClientOperator<T>::resume_rotation(std::shared_ptr<AbstractPKW<T, ciphertext>> new_pkw,
+                                              const std::string &last_remote_id, bool compact_tags) {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        complete_rotation();
+        std::unique_lock<std::shared_mutex> compaction = begin_compaction(compact_tags, last_remote_id);
+        begin_epoch(std::move(new_pkw), last_remote_id);
+        RateLimiter unlimited(0);
+        return migrate_headers(unlimited);
+    }
+
+    template<class T>
+    void ClientOperator<T>::set_rekey_checkpoints(std::shared_ptr<RekeyCheckpointStore<T>> store) {
+        std::lock_guard<std::mutex> rotating(rotation->rotating);
+        rotation->rekey_checkpoints = std::move(store);
+    }
+
+    template<class T>
+    void ClientOperator<T>::set_key_growth_handler(std::function<void()> persist_key) {
+        std::lock_guard<std::mutex> guard(rotation->growth);
+        rotation->persist_grown_key = std::move(persist_key);
+    }
+
+    template<class T>
+    uint32_t ClientOperator<T>::get_epoch() {
+        std::shared_lock<std::shared_mutex> operation(rotation->operations);
+        return epoch;
+    }
 }
 #endif //SECURECLOUDSTORAGE_CLIENT_OPERATOR_H
\ No newline at end of file
@@ -161,6 +161,16 @@ namespace secure_cloud_storage {
                 return l;
             };
 
+            std::vector<Id<Tag>> list_ids_after(const std::string &after, size_t max) override {
+                // the reverse lookup table is ordered by remote ids
+                std::vector<Id<Tag>> l;
+                for (auto it = reverse_lookup_table.upper_bound(Id<Tag>(Tag(), after));
+                     it != reverse_lookup_table.end() && l.size() < max; ++it) {
+                    l.emplace_back(it->first);
+                }
+                return l;
+            }
+
 
     };
 }
@@ -19,8 +19,11 @@
 #ifndef SECURECLOUDSTORAGE_FLAT_ID_PROVIDER_H
 #define SECURECLOUDSTORAGE_FLAT_ID_PROVIDER_H
 
+#include <algorithm>
 #include <map>
 #include <filesystem>
+#include <memory>
+#include "allocation_strategy.h"
 #include "id_provider.h"
 #include "util/tag_util.h"
 #include <pkw/pprf/ggm_pprf.h>
@@ -35,45 +38,88 @@ namespace secure_cloud_storage {
 
             int tag_len;
 
-            Tag id_counter = Tag(0);
+            /*
+             * the number of shards of the PKW is 2^shard_bits: consecutive identifiers are spread round-robin over the
+             * shards, given by the top shard_bits bits of a tag
+             */
+            int shard_bits;
+
+            // decides where new identifiers are placed, guarded by id_mutex
+            std::shared_ptr<AllocationStrategy> strategy;
             std::mutex id_mutex;
 
-            Tag get_and_increase_id_count() {
-                Tag curr_id = id_counter;
-                if (curr_id.all()) {
-                    throw std::runtime_error("Identifiers are used up");
+            Tag get_and_increase_id_count(const std::filesystem::path &path) {
+                std::lock_guard<std::mutex> lock(id_mutex);
+                return counter_to_tag(strategy->next(path));
+            }
+
+            /**
+             * Moves the lowest shard_bits bits of the counter to the top of the tag.
+             */
+            Tag counter_to_tag(const Tag &counter) const {
+                if (shard_bits == 0) {
+                    return counter;
+                }
+                Tag low_mask = ~Tag() >> (MAX_TAG_LEN - tag_len + shard_bits);
+                Tag shard = counter & (~Tag() >> (MAX_TAG_LEN - shard_bits));
+                return (counter >> shard_bits & low_mask) | shard << (tag_len - shard_bits);
+            }
+
+            Tag tag_to_counter(const Tag &tag) const {
+                if (shard_bits == 0) {
+                    return tag;
                 }
-                id_mutex.lock();
-                Tag id = id_counter;
-                // inspired by https://stackoverflow.com/questions/10362991/add-1-to-c-bitset?rq=3
-                for (int i = 0; i < tag_len; ++i) {
-                    if (id[i] == 0) {
-                        id = id.set(i, true);
-                        break;
-                    } else {
-                        id = id.set(i, false);
+                Tag low_mask = ~Tag() >> (MAX_TAG_LEN - tag_len + shard_bits);
+                return (tag & low_mask) << shard_bits | tag >> (tag_len - shard_bits);
+            }
+
+            // skips the local ids in use, the caller holds id_mutex
+            std::vector<Tag> allocate_counters(AllocationStrategy &from, size_t count) {
+                std::vector<Tag> tags;
+                tags.reserve(count);
+                while (tags.size() < count) {
+                    Tag t = counter_to_tag(from.next({}));
+                    if (std::none_of(reverse_lookup_table.begin(), reverse_lookup_table.end(), [&t](const auto &p) {
+                        return p.first.getLocalId() == t;
+                    })) {
+                        tags.push_back(t);
                     }
                 }
-                id_counter = id;
-                id_mutex.unlock();
-                return id;
+                return tags;
+            }
+
+            static bool less(const Tag &a, const Tag &b) {
+                for (size_t i = MAX_TAG_LEN; i-- > 0;) {
+                    if (a[i] != b[i]) {
+                        return b[i];
+                    }
+                }
+                return false;
             }
 
         public:
 
-            explicit FlatIdProvider(int tagLen) : tag_len(tagLen) {}
+            /**
+             * @param tagLen the tag length
+             * @param shardBits the number of top tag bits selecting the shard of a sharded PKW (0 if the PKW is not
+             * sharded); consecutive identifiers are allocated in different shards
+             * @param allocationStrategy places the identifiers of new files, sequential allocation if null
+             */
+            explicit FlatIdProvider(int tagLen, int shardBits = 0,
+                                    std::shared_ptr<AllocationStrategy> allocationStrategy = nullptr)
+                    : tag_len(tagLen),
+                      shard_bits(shardBits),
+                      strategy(allocationStrategy ? std::move(allocationStrategy)
+                                                  : std::make_shared<SequentialAllocation>(tagLen)) {}
 
-            FlatIdProvider(const std::map<std::filesystem::path, Id<Tag>> &lookupTable, int tagLen)
-                    : lookup_table(lookupTable),
-                      tag_len(tagLen) {
-                Id<Tag> max = {0, ""};
+            FlatIdProvider(const std::map<std::filesystem::path, Id<Tag>> &lookupTable, int tagLen, int shardBits = 0,
+                           std::shared_ptr<AllocationStrategy> allocationStrategy = nullptr)
+                    : FlatIdProvider(tagLen, shardBits, std::move(allocationStrategy)) {
+                lookup_table = lookupTable;
                 for (auto &p: lookup_table) {
                     reverse_lookup_table.insert({p.second, p.first});
-                    if (max < p.second) {
-                        max = p.second;
-                    }
+                    strategy->mark_used(p.first, tag_to_counter(p.second.getLocalId()));
                 }
-                id_counter = max.getLocalId();
             }
 
             Id<Tag> get_id(const std::filesystem::path &path_to_file) override {
@@ -84,11 +130,13 @@ namespace secure_cloud_storage {
                     // generate a fresh id
                     Tag t;
                     do {
-                        t = get_and_increase_id_count();
+                        t = get_and_increase_id_count(path_to_file);
                     } while (std::any_of(reverse_lookup_table.begin(), reverse_lookup_table.end(),
                                          [&t](const auto &p) {
                                              return p.first.getLocalId() == t;
-                                         }));
+                                         }) ||
+                             // after a compaction, remote ids no longer follow from the local ids
+                             reverse_lookup_table.count(Id<Tag>(t, tag_to_base64(t))));
                     id = {t, tag_to_base64(t)};
                     lookup_table.insert({path_to_file, id});
 //                    lookup_table[path_to_file] = id;
@@ -137,6 +185,85 @@ namespace secure_cloud_storage {
                 return l;
             }
 
+            std::vector<Id<Tag>> list_ids_after(const std::string &after, size_t max) override {
+                // the reverse lookup table is ordered by remote ids
+                std::vector<Id<Tag>> l;
+                for (auto it = reverse_lookup_table.upper_bound(Id<Tag>(Tag(), after));
+                     it != reverse_lookup_table.end() && l.size() < max; ++it) {
+                    l.emplace_back(it->first);
+                }
+                return l;
+            }
+
+            std::optional<Tag> compacted_local_id(size_t rank) override {
+                // the counter is increased before an id is allocated, the first id is 1
+                return counter_to_tag(Tag(rank + 1));
+            }
+
+            bool may_allocate_between(const Tag &first, const Tag &last) override {
+                std::lock_guard<std::mutex> lock(id_mutex);
+                if (first >> (tag_len - shard_bits) != last >> (tag_len - shard_bits)) {
+                    return true;
+                }
+                // the counters of a shard end in the shard's bits, the range covers the counters in between
+                const Tag low_mask = ~Tag() >> (MAX_TAG_LEN - tag_len + shard_bits);
+                const Tag shard_mask = ~Tag() >> (MAX_TAG_LEN - shard_bits);
+                return strategy->may_allocate_between((first & low_mask) << shard_bits,
+                                                      (last & low_mask) << shard_bits | shard_mask);
+            }
+
+            std::vector<Id<Tag>> list_ids_between(const Tag &first, const Tag &last) override {
+                std::vector<Id<Tag>> l;
+                for (auto &p: reverse_lookup_table) {
+                    const Tag &t = p.first.getLocalId();
+                    if (!less(t, first) && !less(last, t)) {
+                        l.push_back(p.first);
+                    }
+                }
+                return l;
+            }
+
+            std::optional<std::vector<Tag>> allocate_local_ids(size_t count) override {
+                std::lock_guard<std::mutex> lock(id_mutex);
+                // a strategy running out of counters midway would lose the ones handed out before, the allocation is
+                // tried on a copy first
+                try {
+                    std::unique_ptr<AllocationStrategy> trial = strategy->clone();
+                    allocate_counters(*trial, count);
+                } catch (std::runtime_error &e) {
+                    return std::nullopt;
+                }
+                return allocate_counters(*strategy, count);
+            }
+
+            void reassign_local_id(const Id<Tag> &id, const Tag &local_id) override {
+                auto it = reverse_lookup_table.find(id);
+                if (it == reverse_lookup_table.end()) {
+                    return;
+                }
+                std::filesystem::path path = it->second;
+                reverse_lookup_table.erase(it);
+                Id<Tag> moved(local_id, id.getRemoteId());
+                reverse_lookup_table.insert({moved, path});
+                lookup_table[path] = moved;
+                // a local id stored in a checkpoint, allocated before a lookup table stored earlier was loaded
+                std::lock_guard<std::mutex> lock(id_mutex);
+                strategy->mark_used(path, tag_to_counter(local_id));
+            }
+
+            void compact_local_ids() override {
+                std::lock_guard<std::mutex> lock(id_mutex);
+                std::map<Id<Tag>, std::filesystem::path> compacted;
+                size_t rank = 0;
+                for (auto &p: reverse_lookup_table) {
+                    Id<Tag> id(*compacted_local_id(rank++), p.first.getRemoteId());
+                    compacted.insert({id, p.second});
+                    lookup_table[p.second] = id;
+                }
+                reverse_lookup_table = std::move(compacted);
+                strategy->restart(Tag(rank));
+            }
+
 
     };
 }
@@ -20,7 +20,12 @@
 #define SECURECLOUDSTORAGE_ID_PROVIDER_H
 
 #include "id.h"
+#include <algorithm>
 #include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 
 namespace secure_cloud_storage {
@@ -41,6 +46,79 @@ namespace secure_cloud_storage {
             virtual size_t size() = 0;
 
             virtual std::vector<Id<T>> list_ids() = 0;
+
+            /**
+             * List the ids in the order of their remote ids, a batch at a time.
+             * The default implementation sorts the result of list_ids.
+             * @param after the remote id of the last id of the previous batch, empty for the first batch.
+             * @param max the maximal number of ids to list.
+             * @return the ids following after, at most max.
+             */
+            virtual std::vector<Id<T>> list_ids_after(const std::string &after, size_t max) {
+                std::vector<Id<T>> ids = list_ids();
+                std::sort(ids.begin(), ids.end());
+                auto first = std::upper_bound(ids.begin(), ids.end(), after, [](const std::string &remote_id,
+                                                                                const Id<T> &id) {
+                    return remote_id < id.getRemoteId();
+                });
+                auto last = first + static_cast<long>(std::min(max, static_cast<size_t>(ids.end() - first)));
+                return {first, last};
+            }
+
+            /**
+             * Return the local id compact_local_ids assigns to the id of the given rank in the order of remote ids.
+             * The default implementation does not support compaction.
+             * @param rank the position of the id in the order of remote ids.
+             * @return the local id, or none if the provider does not support compaction.
+             */
+            virtual std::optional<T> compacted_local_id(size_t) {
+                return std::nullopt;
+            }
+
+            /**
+             * Assign all ids dense local ids in the order of their remote ids, see compacted_local_id. The remote ids
+             * are kept, fresh local ids are allocated after the compacted ones.
+             * The default implementation does not support compaction.
+             * @throws std::runtime_error if the provider does not support compaction.
+             */
+            virtual void compact_local_ids() {
+                throw std::runtime_error("The id provider does not support compacting local ids.");
+            }
+
+            /**
+             * Return whether local ids allocated in the future may lie in [first, last]; such ranges must not be
+             * punctured. The default implementation assumes they may.
+             */
+            virtual bool may_allocate_between(const T &, const T &) {
+                return true;
+            }
+
+            /**
+             * List the ids whose local ids lie in [first, last]. The default implementation lists none.
+             */
+            virtual std::vector<Id<T>> list_ids_between(const T &, const T &) {
+                return {};
+            }
+
+            /**
+             * Allocate fresh local ids without assigning them to files, see reassign_local_id. Either all of them are
+             * allocated or none, such that no id is lost if the provider runs out of ids.
+             * The default implementation does not support moving ids.
+             * @param count the number of local ids.
+             * @return the local ids, or none if the provider does not support moving ids or cannot allocate count ids.
+             */
+            virtual std::optional<std::vector<T>> allocate_local_ids(size_t) {
+                return std::nullopt;
+            }
+
+            /**
+             * Assign the file of id a local id obtained from allocate_local_ids, keeping its remote id.
+             * The default implementation does not support moving ids.
+             * @throws std::runtime_error if the provider does not support moving ids.
+             */
+            virtual void reassign_local_id(const Id<T> &, const T &) {
+                throw std::runtime_error("The id provider does not support moving ids.");
+            }
     };
 }
 
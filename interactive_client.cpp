@@ -21,9 +21,13 @@
 #include <cli/loopscheduler.h>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
 #include "client_operator.h"
 #include "interactive_client.h"
 #include "util/file_util.h"
+#include "util/key_journal.h"
+#include "util/rekey_checkpoint.h"
+#include "util/rotation_checkpoint.h"
 #include "gcs_cloud_communicator.h"
 #include "flat_id_provider.h"
 #include <pkw/pkw/pprf_aead_pkw.h>
@@ -31,6 +35,8 @@
 #include <cryptopp/hkdf.h>
 #include <cryptopp/sha.h>
 #include <cryptopp/osrng.h>
+#include <termios.h>
+#include <unistd.h>
 
 using namespace secure_cloud_storage;
 namespace fs = std::filesystem;
@@ -39,6 +45,39 @@ const std::string bucket_name = "secure-cloud-storage";
 
 std::string settings_dir = default_settings_dir;
 
+// the PKW used by the client operator, its punctures are journaled; while a rotation is running, it is the key of the
+// previous epoch and the rotation checkpoint holds the new one
+std::shared_ptr<PPRF_AEAD_PKW> journaled_pkw;
+// the epoch of journaled_pkw, stored along with it
+uint32_t journaled_epoch = 0;
+std::unique_ptr<KeyJournal> key_journal;
+// encrypts the journal and the checkpoints, unlocked with the password at startup
+SecureByteBuffer journal_key;
+// the progress of key rotations, to resume them after a crash
+std::shared_ptr<RotationCheckpointStore> rotation_checkpoints;
+// the files moved by re-keying subtrees, to complete the moves after a crash
+std::shared_ptr<RekeyCheckpointStore<Tag>> rekey_checkpoints;
+// guards journaled_pkw and the stored key, which are replaced by automatic rotations in the background
+std::mutex key_mutex;
+
+void store_key();
+
+void store_properties(ClientOperator<Tag> &co);
+
+void journal_key_changes(ClientOperator<Tag> &co);
+
+void use_rotated_key(ClientOperator<Tag> &co, const std::shared_ptr<PPRF_AEAD_PKW> &new_pkw);
+
+void store_lookup_table(ClientOperator<Tag> &co);
+
+std::shared_ptr<RekeyCheckpointStore<Tag>> get_rekey_checkpoints();
+
+// a fresh key whose tree grows with the largest id in use, up to tag_len bits
+std::shared_ptr<PPRF_AEAD_PKW> fresh_pkw(int tag_len, int key_len) {
+    return std::make_shared<PPRF_AEAD_PKW>(std::min(initial_tag_len, tag_len), key_len, PRGType::HKDF_SHA256, 2,
+                                           tag_len);
+}
+
 void list_files(std::ostream &out, const std::string &path) {
     for (auto &item: fs::directory_iterator(fs::path(path))) {
         out << item.path().filename().string() << (fs::is_directory(item) ? "/" : "") << std::endl;
@@ -99,6 +138,7 @@ void insert_commands(ClientOperator<Tag> &co, const std::unique_ptr<cli::Menu> &
                 // translate the path to the id
                 Id<Tag> id = co.get_id(cloud_path);
                 co.shred(id);
+                journal_key_changes(co);
             },
             "Shred a file in the cloud",
             {"cloud_path"});
@@ -115,11 +155,90 @@ void insert_commands(ClientOperator<Tag> &co, const std::unique_ptr<cli::Menu> &
             "rotate-keys",
             [&co](std::ostream &out) {
                 out << "Rekeying files." << std::endl;
-                out << "Number of affected objects: " << co.rotate_keys(
-                        std::make_shared<PPRF_AEAD_PKW>(co.get_tag_len(), co.get_key_len())) << std::endl;
+                auto new_pkw = fresh_pkw(co.get_tag_len(), co.get_key_len());
+                out << "Number of affected objects: " << co.rotate_keys(new_pkw) << std::endl;
+                use_rotated_key(co, new_pkw);
             },
             "Generate a fresh secret key and rotate wrapped keys.");
 
+    rootMenu->Insert(
+            "rotate-keys-compact",
+            [&co](std::ostream &out) {
+                out << "Rekeying files and compacting their local ids." << std::endl;
+                auto new_pkw = fresh_pkw(co.get_tag_len(), co.get_key_len());
+                out << "Number of affected objects: " << co.rotate_keys(new_pkw, true) << std::endl;
+                // the stored lookup table holds the previous local ids
+                store_lookup_table(co);
+                use_rotated_key(co, new_pkw);
+            },
+            "Generate a fresh secret key, rotate wrapped keys and assign the files dense local ids.");
+
+    rootMenu->Insert(
+            "rekey-subtrees",
+            [&co](std::ostream &out, size_t max_subtrees) {
+                const size_t nodes = co.key_growth().nodes;
+                out << "Number of moved objects: " << co.rekey_subtrees(max_subtrees) << std::endl;
+                out << "Key nodes: " << nodes << " -> " << co.key_growth().nodes << std::endl;
+                // the moved files are found under their new ids before their previous ones are punctured for good
+                store_lookup_table(co);
+                journal_key_changes(co);
+                get_rekey_checkpoints()->clear();
+            },
+            "Move the files of up to <max_subtrees> heavily shredded regions to fresh ids and puncture the regions",
+            {"max_subtrees"});
+
+    rootMenu->Insert(
+            "auto-rotate",
+            [&co](std::ostream &out, size_t max_key_nodes, unsigned int idle_seconds) {
+                RotationPolicy policy;
+                policy.max_nodes = max_key_nodes;
+                policy.idle_window = std::chrono::seconds(idle_seconds);
+                policy.max_header_rewrites_per_second = auto_rotation_header_rewrites_per_second;
+                co.enable_auto_rotation(
+                        policy,
+                        [&co]() -> std::shared_ptr<AbstractPKW<Tag, ciphertext>> {
+                            return fresh_pkw(co.get_tag_len(), co.get_key_len());
+                        },
+                        [&co](const std::shared_ptr<AbstractPKW<Tag, ciphertext>> &new_pkw, size_t) {
+                            use_rotated_key(co, std::dynamic_pointer_cast<PPRF_AEAD_PKW>(new_pkw));
+                        });
+                out << "Keys are rotated once the key holds " << max_key_nodes << " nodes, after " << idle_seconds
+                    << "s without operations." << std::endl;
+            },
+            "Rotate keys in the background once the secret key holds <max_key_nodes> nodes and the client was idle "
+            "for <idle_seconds>",
+            {"max_key_nodes", "idle_seconds"});
+
+    rootMenu->Insert(
+            "auto-rotate-off",
+            [&co](std::ostream &out) {
+                co.disable_auto_rotation();
+            },
+            "Stop rotating keys automatically");
+
+    rootMenu->Insert(
+            "stats",
+            [](std::ostream &out) {
+                std::lock_guard<std::mutex> lock(key_mutex);
+                // maintained incrementally by the PKW, the key is not serialized
+                const KeyStats stats = journaled_pkw->keyStats();
+                out << "Punctures: " << journaled_pkw->getNumPuncs() << std::endl;
+                out << "Key nodes: " << stats.nodes << std::endl;
+                out << "Resident bytes: " << stats.residentBytes << std::endl;
+                out << "Average matching-prefix depth: " << stats.averageMatchDepth << " of " << stats.tagLen
+                    << std::endl;
+                out << "Predicted PRG calls per read/put: " << stats.expectedEvalDerivations << std::endl;
+                out << "Predicted key growth per shred: " << stats.expectedPuncGrowth << " nodes" << std::endl;
+                out << "Nodes per depth:";
+                for (size_t d = 0; d < stats.depthHistogram.size(); ++d) {
+                    if (stats.depthHistogram[d] > 0) {
+                        out << " " << d << ":" << stats.depthHistogram[d];
+                    }
+                }
+                out << std::endl;
+            },
+            "Show statistics on the secret key");
+
     rootMenu->Insert(
             "lls",
             [](std::ostream &out) {
@@ -145,6 +264,117 @@ std::vector<unsigned char> getOrInitRatchetKey() {
     return ratchet_key;
 }
 
+/**
+ * Reads a password from the terminal, without echoing it.
+ */
+std::string read_password() {
+    std::cout << "Password: " << std::flush;
+    termios settings{};
+    const bool terminal = tcgetattr(STDIN_FILENO, &settings) == 0;
+    if (terminal) {
+        termios hidden = settings;
+        hidden.c_lflag &= ~static_cast<tcflag_t>(ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &hidden);
+    }
+    std::string password;
+    std::getline(std::cin, password);
+    if (terminal) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &settings);
+        std::cout << std::endl;
+    }
+    return password;
+}
+
+/**
+ * Unlocks the key encrypting the journal and the rotation checkpoints, which hold key material. It is stored
+ * encrypted under the password; a key stored in plaintext by earlier versions is encrypted on the first unlock.
+ * @throws ImportException if the password is wrong
+ */
+void unlock_journal_key(const std::string &password) {
+    if (!fs::exists(settings_dir)) {
+        fs::create_directories(settings_dir);
+    }
+    const fs::path key_path = fs::path(settings_dir) / key_journal_key_filename;
+    if (!fs::exists(key_path)) {
+        journal_key = SecureByteBuffer(default_key_len / 8);
+        CryptoPP::OS_GenerateRandomBlock(false, journal_key.data(), journal_key.size());
+    } else {
+        std::vector<unsigned char> contents = FileUtil::read_file(key_path);
+        SecureByteBuffer stored(contents);
+        if (stored.size() != default_key_len / 8) {
+            journal_key = decryptExport(stored, password);
+            return;
+        }
+        journal_key = std::move(stored);
+    }
+    SecureByteBuffer encrypted = encryptExport(journal_key, password);
+    std::vector<unsigned char> contents(encrypted.begin(), encrypted.end());
+    FileUtil::write_file(contents, true, key_path);
+}
+
+KeyJournal &get_key_journal() {
+    if (!key_journal) {
+        key_journal = std::make_unique<KeyJournal>(fs::path(settings_dir) / key_journal_filename,
+                                                   SecureByteBuffer(journal_key));
+    }
+    return *key_journal;
+}
+
+std::shared_ptr<RotationCheckpointStore> get_rotation_checkpoints() {
+    if (!rotation_checkpoints) {
+        rotation_checkpoints = std::make_shared<FileRotationCheckpointStore>(
+                fs::path(settings_dir) / rotation_checkpoint_filename, SecureByteBuffer(journal_key));
+    }
+    return rotation_checkpoints;
+}
+
+std::shared_ptr<RekeyCheckpointStore<Tag>> get_rekey_checkpoints() {
+    if (!rekey_checkpoints) {
+        rekey_checkpoints = std::make_shared<FileRekeyCheckpointStore>(
+                fs::path(settings_dir) / rekey_checkpoint_filename, SecureByteBuffer(journal_key));
+    }
+    return rekey_checkpoints;
+}
+
+/**
+ * Completes a rotation that was interrupted by a crash. The stored key is the one of the previous epoch, the key of
+ * the checkpoint becomes the current one once all headers are rewrapped.
+ */
+void resume_interrupted_rotation(ClientOperator<Tag> &co) {
+    std::optional<RotationCheckpoint> checkpoint = get_rotation_checkpoints()->load();
+    if (!checkpoint) {
+        return;
+    }
+    if (checkpoint->epoch == co.get_epoch() + 1) {
+        std::cout << "Resuming the interrupted key rotation." << std::endl;
+        auto new_pkw = std::make_shared<PPRF_AEAD_PKW>(std::move(checkpoint->key));
+        co.resume_rotation(new_pkw, checkpoint->last_remote_id, checkpoint->compact_tags);
+        if (checkpoint->compact_tags) {
+            store_lookup_table(co);
+        }
+        use_rotated_key(co, new_pkw);
+    } else {
+        // the key of the completed rotation was stored
+        get_rotation_checkpoints()->clear();
+    }
+}
+
+/**
+ * Completes a re-keying of subtrees that was interrupted by a crash. The stored lookup table may still hold the
+ * previous local ids of the moved files, whose subtrees the stored key may not have been punctured on.
+ */
+void resume_interrupted_rekey(ClientOperator<Tag> &co) {
+    std::optional<RekeyCheckpoint<Tag>> checkpoint = get_rekey_checkpoints()->load();
+    if (!checkpoint) {
+        return;
+    }
+    std::cout << "Completing the interrupted re-keying of subtrees." << std::endl;
+    co.resume_rekey(*checkpoint);
+    store_lookup_table(co);
+    journal_key_changes(co);
+    get_rekey_checkpoints()->clear();
+}
+
 
 std::map<std::string, std::string> read_tab_separated_map(const fs::path &properties_path) {
     std::ifstream properties_file_stream(properties_path, std::ios::in);
@@ -166,14 +396,18 @@ ClientOperator<Tag> getClientOperatorFromSettings() {
     const fs::path key_path = settings / key_filename;
     const fs::path properties_path = settings / properties_filename;
     if (fs::exists(settings) && fs::exists(key_path) && fs::exists(properties_path)) {
-        std::ifstream key_file_stream(key_path, std::ios::in);
-        // read key file and construct PKW object
-        std::vector<unsigned char> file_buffer((std::istreambuf_iterator<char>(key_file_stream)),
-                                               std::istreambuf_iterator<char>());
+        // read key file and construct PKW object; a key in the compact format is not parsed until it is punctured
+        std::ifstream key_file_stream(key_path, std::ios::in | std::ios::binary);
+        SecureByteBuffer key_file(fs::file_size(key_path));
+        key_file_stream.read(reinterpret_cast<char *>(key_file.data()), static_cast<std::streamsize>(key_file.size()));
         key_file_stream.close();
-        PPRF_AEAD_PKW_Factory factory;
-        SecureByteBuffer key_file(file_buffer);
-        auto pkw = factory.fromSerialized(key_file);
+        auto pkw = std::make_shared<PPRF_AEAD_PKW>(std::move(key_file));
+        // replay the punctures performed since the snapshot was stored
+        for (auto &delta: get_key_journal().read()) {
+            pkw->applyKeyDelta(delta);
+        }
+        pkw->trackKeyChanges();
+        journaled_pkw = pkw;
 
         // read lookup_table
         std::string enc_lookup_table;
@@ -216,25 +450,81 @@ ClientOperator<Tag> getClientOperatorFromSettings() {
         std::map<std::string, std::string> properties = read_tab_separated_map(properties_path);
         int key_len = std::stoi(properties["key_len"]);
         int tag_len = std::stoi(properties["tag_len"]);
+        // settings stored before keys had epochs have none, their headers carry no epoch either
+        uint32_t epoch = properties.count("epoch") ? std::stoul(properties["epoch"]) : 0;
+        journaled_epoch = epoch;
 
         // Use stored settings to initialize object
         return {pkw,
                 std::make_shared<secure_cloud_storage::FlatIdProvider>(lookup_table, tag_len), tag_len, key_len,
-                std::make_shared<secure_cloud_storage::GCSCloudCommunicator<Tag>>(bucket_name)};
+                std::make_shared<secure_cloud_storage::GCSCloudCommunicator<Tag>>(bucket_name), epoch};
     } else {
         // construct fresh object
+        journaled_pkw = fresh_pkw(default_tag_len, default_key_len);
+        journaled_pkw->trackKeyChanges();
         return {default_tag_len, default_key_len,
                 std::make_unique<secure_cloud_storage::GCSCloudCommunicator<Tag>>(bucket_name),
                 std::make_unique<FlatIdProvider>(default_tag_len),
-                std::make_unique<PPRF_AEAD_PKW>(default_tag_len, default_key_len)};
+                journaled_pkw};
     }
 }
 
-void store_key(ClientOperator<Tag> &co) {
-    SecureByteBuffer key = co.export_key();
-    std::ofstream key_file_stream(fs::path(settings_dir) / key_filename);
-    key_file_stream << std::string(key.begin(), key.end());
+void store_key() {
+    if (!fs::exists(settings_dir)) {
+        fs::create_directories(settings_dir);
+    }
+    // punctures running concurrently are contained either in the snapshot or in the deltas journaled after it; the
+    // deltas journaled before must not be replayed on it, e.g. a growth of the tree would be applied twice
+    SecureByteBuffer key = journaled_pkw->serializeKeyAndResetDelta();
+    // replace the previous snapshot only once the new one is durable
+    const fs::path key_path = fs::path(settings_dir) / key_filename;
+    const fs::path tmp_path = fs::path(settings_dir) / (key_filename + ".tmp");
+    std::ofstream key_file_stream(tmp_path, std::ios::out | std::ios::trunc | std::ios::binary);
+    key_file_stream.write(reinterpret_cast<const char *>(key.data()), static_cast<std::streamsize>(key.size()));
     key_file_stream.close();
+    if (!key_file_stream) {
+        throw std::runtime_error("Could not write the key: " + tmp_path.string());
+    }
+    FileUtil::sync(tmp_path);
+    fs::rename(tmp_path, key_path);
+    FileUtil::sync(settings_dir);
+    get_key_journal().clear();
+}
+
+/**
+ * Persists the changes of the key made by a shred, or by a put which grew its tree. Instead of rewriting the whole key,
+ * only the changed nodes are appended to the journal, which is compacted into a new snapshot every
+ * journal_compaction_interval punctures.
+ * While a rotation is running, the journal holds the changes of the previous key; the client operator persists the
+ * punctured new key in the rotation checkpoint.
+ */
+void journal_key_changes(ClientOperator<Tag> &co) {
+    std::lock_guard<std::mutex> lock(key_mutex);
+    KeyJournal &journal = get_key_journal();
+    if (!fs::exists(fs::path(settings_dir) / key_filename) || journal.size() >= journal_compaction_interval) {
+        store_key();
+        store_properties(co);
+        return;
+    }
+    SecureByteBuffer delta = journaled_pkw->takeKeyDelta();
+    journal.append(delta);
+}
+
+/**
+ * Switches the journal over to a key the client operator has rotated to: the journal holds changes of the old key, it
+ * starts over with a snapshot of the new one.
+ */
+void use_rotated_key(ClientOperator<Tag> &co, const std::shared_ptr<PPRF_AEAD_PKW> &new_pkw) {
+    // a put holding the operations of the client operator may wait for the lock to journal a growth of the key
+    const uint32_t epoch = co.get_epoch();
+    std::lock_guard<std::mutex> lock(key_mutex);
+    journaled_pkw = new_pkw;
+    journaled_epoch = epoch;
+    journaled_pkw->trackKeyChanges();
+    store_key();
+    store_properties(co);
+    // the new key is stored, the rotation needs no resumption
+    get_rotation_checkpoints()->clear();
 }
 
 void store_lookup_table(ClientOperator<Tag> &co) {
@@ -258,6 +548,7 @@ void store_properties(ClientOperator<Tag> &co) {
     std::ofstream properties_filestream(fs::path(settings_dir) / properties_filename);
     properties_filestream << "key_len" << "\t" << co.get_key_len() << std::endl;
     properties_filestream << "tag_len" << "\t" << co.get_tag_len() << std::endl;
+    properties_filestream << "epoch" << "\t" << journaled_epoch << std::endl;
     properties_filestream.close();
 }
 
@@ -270,7 +561,19 @@ int main(int argc, [[maybe_unused]] char *argv[]) {
         settings_dir = default_settings_dir;
     }
 
+    try {
+        unlock_journal_key(read_password());
+    } catch (ImportException &e) {
+        std::cout << "Wrong password." << std::endl;
+        return 1;
+    }
     ClientOperator<Tag> co = getClientOperatorFromSettings(); // TODO store/load pkw key with password
+    co.set_rotation_checkpoints(get_rotation_checkpoints(), rotation_batch_size);
+    // a put growing the tree of the key journals the new nodes before its header is written
+    co.set_key_growth_handler([&co] { journal_key_changes(co); });
+    co.set_rekey_checkpoints(get_rekey_checkpoints());
+    resume_interrupted_rekey(co);
+    resume_interrupted_rotation(co);
     auto rootMenu = std::make_unique<cli::Menu>("cli");
     insert_commands(co, rootMenu);
 
@@ -283,9 +586,13 @@ int main(int argc, [[maybe_unused]] char *argv[]) {
         if (!fs::exists(settings_dir)) {
             fs::create_directory(settings_dir);
         }
-        store_key(co);
+        co.disable_auto_rotation();
+        {
+            std::lock_guard<std::mutex> lock(key_mutex);
+            store_key();
+            store_properties(co);
+        }
         store_lookup_table(co);
-        store_properties(co);
         scheduler.Stop();
     });
     cli::CliLocalTerminalSession input(cli, scheduler, std::cout);
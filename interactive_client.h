@@ -28,10 +28,22 @@
 namespace secure_cloud_storage {
     const std::string default_settings_dir = ".cli/";
     const std::string key_filename = "pkw.key";
+    const std::string key_journal_filename = "pkw.journal";
+    const std::string key_journal_key_filename = "journal.key";
     const std::string lookup_table_ratchet_key_filename = "lookup.key";
     const std::string properties_filename = "properties.cli";
+    const std::string rotation_checkpoint_filename = "rotation.checkpoint";
+    const std::string rekey_checkpoint_filename = "rekey.checkpoint";
     const int default_key_len = 256;
     const int default_tag_len = 256;
+    // the tag length fresh keys start with, their tree grows up to default_tag_len as ids are handed out
+    const int initial_tag_len = 16;
+    // number of journaled punctures after which a new snapshot of the key is stored
+    const size_t journal_compaction_interval = 256;
+    // headers rewritten per second by automatic key rotations, to leave bandwidth to the user
+    const double auto_rotation_header_rewrites_per_second = 50;
+    // headers rewrapped by a key rotation between two checkpoints
+    const size_t rotation_batch_size = 256;
 } // namespace secure_cloud_storage
 
 #endif //SECURECLOUDSTORAGE_INTERACTIVE_CLIENT_H
\ No newline at end of file
@@ -0,0 +1,106 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#include "aead_wrap.h"
+#include "../exceptions.h"
+#include <cryptopp/aes.h>
+#include <cryptopp/cryptlib.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/gcm.h>
+
+const int DIGEST_SIZE = 16;
+using std::vector;
+
+/**
+ * from https://cryptopp.com/wiki/GCM_Mode#AEAD
+ */
+vector<unsigned char> aeadWrap(const SecureByteBuffer &wrappingKey, const vector<unsigned char> &header,
+                               const vector<unsigned char> &key) {
+    try {
+        CryptoPP::GCM<CryptoPP::AES>::Encryption e;
+        vector<unsigned char> iv(16, 0);
+        e.SetKeyWithIV(wrappingKey.data(), wrappingKey.size(), iv.data(), iv.size());
+        vector<unsigned char> cipher;
+        CryptoPP::AuthenticatedEncryptionFilter ef(e,
+                                                   new CryptoPP::VectorSink(cipher), false,
+                                                   DIGEST_SIZE /* MAC_AT_END */);
+        ef.ChannelPut(CryptoPP::AAD_CHANNEL, header.data(), header.size());
+        ef.ChannelMessageEnd(CryptoPP::AAD_CHANNEL);
+
+        // Confidential data comes after authenticated data.
+        // This is a limitation due to CCM mode, not GCM mode.
+        ef.ChannelPut(CryptoPP::DEFAULT_CHANNEL, key.data(), key.size());
+        ef.ChannelMessageEnd(CryptoPP::DEFAULT_CHANNEL);
+        return cipher;
+    } catch (CryptoPP::Exception &e) {
+        throw WrappingException();
+    }
+}
+
+/**
+ * from https://cryptopp.com/wiki/GCM_Mode#AEAD
+ */
+vector<unsigned char> aeadUnwrap(const SecureByteBuffer &wrappingKey, const vector<unsigned char> &header,
+                                 const vector<unsigned char> &c) {
+    if (c.size() < DIGEST_SIZE) {
+        throw UnwrappingException();
+    }
+    try {
+        CryptoPP::GCM<CryptoPP::AES>::Decryption d;
+        vector<unsigned char> iv(16, 0);
+        d.SetKeyWithIV(wrappingKey.data(), wrappingKey.size(), iv.data(), iv.size());
+        vector<unsigned char> enc(c.begin(), c.end() - DIGEST_SIZE);
+        vector<unsigned char> mac(c.end() - DIGEST_SIZE, c.end());
+        CryptoPP::AuthenticatedDecryptionFilter df(d,
+                                                   NULL, CryptoPP::AuthenticatedDecryptionFilter::MAC_AT_BEGIN |
+                                                         CryptoPP::AuthenticatedDecryptionFilter::THROW_EXCEPTION,
+                                                   DIGEST_SIZE /* MAC_AT_END */);
+        // The order of the following calls are important
+        df.ChannelPut(CryptoPP::DEFAULT_CHANNEL, mac.data(), mac.size());
+        df.ChannelPut(CryptoPP::AAD_CHANNEL, header.data(), header.size());
+        df.ChannelPut(CryptoPP::DEFAULT_CHANNEL, enc.data(), enc.size());
+
+        // If the object throws, it will most likely occur
+        //   during ChannelMessageEnd()
+        df.ChannelMessageEnd(CryptoPP::AAD_CHANNEL);
+        df.ChannelMessageEnd(CryptoPP::DEFAULT_CHANNEL);
+
+        // If the object does not throw, here's the only
+        //  opportunity to check the data's integrity
+        if (!df.GetLastResult()) {
+            throw UnwrappingException();
+        }
+
+        // Remove data from channel
+        vector<unsigned char> retrieved;
+
+        // Plain text recovered from enc.data()
+        df.SetRetrievalChannel(CryptoPP::DEFAULT_CHANNEL);
+        size_t n = (size_t) df.MaxRetrievable();
+        retrieved.resize(n);
+
+        if (n > 0) {
+            df.Get((unsigned char *) retrieved.data(), n);
+        }
+        return retrieved;
+    } catch (CryptoPP::Exception &e) {
+        throw UnwrappingException();
+    }
+}
@@ -0,0 +1,41 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_AEAD_WRAP_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_AEAD_WRAP_H
+#include "../../secure_byte_buffer.h"
+#include <vector>
+
+/**
+ * Wraps key with AES-GCM under wrappingKey, authenticating header. As every wrapping key is only used once, the IV is
+ * fixed.
+ * @throws WrappingException if the encryption fails
+ */
+std::vector<unsigned char> aeadWrap(const SecureByteBuffer &wrappingKey, const std::vector<unsigned char> &header,
+                                    const std::vector<unsigned char> &key);
+
+/**
+ * Unwraps a ciphertext created by aeadWrap.
+ * @throws UnwrappingException if the ciphertext or header were modified or a wrong wrapping key is used
+ */
+std::vector<unsigned char> aeadUnwrap(const SecureByteBuffer &wrappingKey, const std::vector<unsigned char> &header,
+                                      const std::vector<unsigned char> &c);
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_AEAD_WRAP_H
@@ -0,0 +1,76 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_VERSIONED_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_VERSIONED_H
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Holds the current version of a value, such that readers can keep using an immutable snapshot while a writer
+ * prepares the next version (read-copy-update).
+ * <br>
+ * A writer copies the current version, modifies the copy and publishes it. Readers holding an older snapshot are not
+ * affected; an old version is destroyed once the last reader releases its snapshot, so T has to clear its secrets on
+ * destruction.
+ * Writers are serialized by a mutex. Loading a snapshot does not wait for writers.
+ */
+template<class T>
+class Versioned {
+    public:
+        explicit Versioned(T value) : current(std::make_shared<const T>(std::move(value))) {
+        }
+
+        /**
+         * @return the current version, which is not modified anymore
+         */
+        std::shared_ptr<const T> snapshot() const {
+            return current.load(std::memory_order_acquire);
+        }
+
+        /**
+         * Applies modify to a copy of the current version and publishes the copy. If modify throws, the current
+         * version is kept.
+         * @param modify a function taking a T &
+         * @return the result of modify
+         */
+        template<class F>
+        std::invoke_result_t<F, T &> update(F &&modify) {
+            std::lock_guard<std::mutex> lock(writer);
+            auto next = std::make_shared<T>(*current.load(std::memory_order_relaxed));
+            if constexpr (std::is_void_v<std::invoke_result_t<F, T &>>) {
+                modify(*next);
+                current.store(std::move(next), std::memory_order_release);
+            } else {
+                auto res = modify(*next);
+                current.store(std::move(next), std::memory_order_release);
+                return res;
+            }
+        }
+
+    private:
+        std::atomic<std::shared_ptr<const T>> current;
+        std::mutex writer;
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_VERSIONED_H
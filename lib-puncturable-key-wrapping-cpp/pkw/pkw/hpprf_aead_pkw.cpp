@@ -21,110 +21,134 @@
 #include "hpprf_aead_pkw.h"
 #include "../pprf/pprf_exceptions.h"
 #include "exceptions.h"
-#include <cryptopp/aes.h>
-#include <cryptopp/cryptlib.h>
-#include <cryptopp/filters.h>
-#include <cryptopp/gcm.h>
+#include "helpers/aead_wrap.h"
 
 using std::vector;
-const int DIGEST_SIZE = 16;
 
-/**
- * from https://cryptopp.com/wiki/GCM_Mode#AEAD
- */
 ciphertext HPPRF_AEAD_PKW::wrap(Tag tag, vector<unsigned char> &header, vector<unsigned char> &key) {
     try {
-        SecureByteBuffer wrapping_key = pprf.eval(tag);
-        CryptoPP::GCM<CryptoPP::AES>::Encryption e;
-        vector<unsigned char> iv(16, 0);
-        e.SetKeyWithIV(wrapping_key.data(), wrapping_key.size(), iv.data(), iv.size());
-        ciphertext cipher;
-        CryptoPP::AuthenticatedEncryptionFilter ef(e,
-                                                   new CryptoPP::VectorSink(cipher), false,
-                                                   DIGEST_SIZE /* MAC_AT_END */);
-        ef.ChannelPut(CryptoPP::AAD_CHANNEL, header.data(), header.size());
-        ef.ChannelMessageEnd(CryptoPP::AAD_CHANNEL);
-
-        // Confidential data comes after authenticated data.
-        // This is a limitation due to CCM mode, not GCM mode.
-        ef.ChannelPut(CryptoPP::DEFAULT_CHANNEL, key.data(), key.size());
-        ef.ChannelMessageEnd(CryptoPP::DEFAULT_CHANNEL);
-        return cipher;
-    } catch (CryptoPP::Exception &e) {
-        throw WrappingException();
+        return aeadWrap(pprf.snapshot()->eval(tag), header, key);
     } catch (TagException &e) {
         throw IllegalTagException();
     }
 }
 
-/**
- * from https://cryptopp.com/wiki/GCM_Mode#AEAD
- */
 vector<unsigned char> HPPRF_AEAD_PKW::unwrap(Tag tag, vector<unsigned char> &header, ciphertext &c) {
     try {
-        SecureByteBuffer wrapping_key = pprf.eval(tag);
-        CryptoPP::GCM<CryptoPP::AES>::Decryption d;
-        vector<unsigned char> iv(16, 0);
-        d.SetKeyWithIV(wrapping_key.data(), wrapping_key.size(), iv.data(), iv.size());
-        vector<unsigned char> enc(c.begin(), c.end() - DIGEST_SIZE);
-        vector<unsigned char> mac(c.end() - DIGEST_SIZE, c.end());
-        CryptoPP::AuthenticatedDecryptionFilter df(d,
-                                                   NULL, CryptoPP::AuthenticatedDecryptionFilter::MAC_AT_BEGIN |
-                                                         CryptoPP::AuthenticatedDecryptionFilter::THROW_EXCEPTION,
-                                                   DIGEST_SIZE /* MAC_AT_END */);
-        // The order of the following calls are important
-        df.ChannelPut(CryptoPP::DEFAULT_CHANNEL, mac.data(), mac.size());
-        df.ChannelPut(CryptoPP::AAD_CHANNEL, header.data(), header.size());
-        df.ChannelPut(CryptoPP::DEFAULT_CHANNEL, enc.data(), enc.size());
-
-        // If the object throws, it will most likely occur
-        //   during ChannelMessageEnd()
-        df.ChannelMessageEnd(CryptoPP::AAD_CHANNEL);
-        df.ChannelMessageEnd(CryptoPP::DEFAULT_CHANNEL);
-
-        // If the object does not throw, here's the only
-        //  opportunity to check the data's integrity
-        if (!df.GetLastResult()) {
-            throw UnwrappingException();
-        }
-
-        // Remove data from channel
-        vector<unsigned char> retrieved;
-
-        // Plain text recovered from enc.data()
-        df.SetRetrievalChannel(CryptoPP::DEFAULT_CHANNEL);
-        size_t n = (size_t) df.MaxRetrievable();
-        retrieved.resize(n);
-
-        if (n > 0) {
-            df.Get((byte *) retrieved.data(), n);
-        }
-        return retrieved;
-    } catch (CryptoPP::Exception &e) {
+        return aeadUnwrap(pprf.snapshot()->eval(tag), header, c);
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+}
+
+std::vector<ciphertext> HPPRF_AEAD_PKW::wrapBatch(std::span<const Tag> tags, std::span<vector<unsigned char>> headers,
+                                          std::span<vector<unsigned char>> keys) {
+    if (headers.size() != tags.size() || keys.size() != tags.size()) {
+        throw WrappingException();
+    }
+    std::vector<SecureByteBuffer> wrappingKeys;
+    try {
+        wrappingKeys = pprf.snapshot()->evalBatch(tags);
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+    std::vector<ciphertext> res;
+    res.reserve(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        res.push_back(aeadWrap(wrappingKeys[i], headers[i], keys[i]));
+    }
+    return res;
+}
+
+std::vector<vector<unsigned char>> HPPRF_AEAD_PKW::unwrapBatch(std::span<const Tag> tags, std::span<vector<unsigned char>> headers,
+                                                       std::span<ciphertext> cs) {
+    if (headers.size() != tags.size() || cs.size() != tags.size()) {
+        throw UnwrappingException();
+    }
+    std::vector<SecureByteBuffer> wrappingKeys;
+    try {
+        wrappingKeys = pprf.snapshot()->evalBatch(tags);
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+    std::vector<vector<unsigned char>> res;
+    res.reserve(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        res.push_back(aeadUnwrap(wrappingKeys[i], headers[i], cs[i]));
+    }
+    return res;
+}
+
+std::vector<std::optional<vector<unsigned char>>>
+HPPRF_AEAD_PKW::unwrapLiveBatch(std::span<const Tag> tags, std::span<vector<unsigned char>> headers, std::span<ciphertext> cs) {
+    if (headers.size() != tags.size() || cs.size() != tags.size()) {
         throw UnwrappingException();
+    }
+    std::vector<std::optional<vector<unsigned char>>> res(tags.size());
+    try {
+        pprf.snapshot()->forEachLiveLeaf(tags, [&](size_t i, const SecureByteBuffer &wrappingKey) {
+            try {
+                res[i] = aeadUnwrap(wrappingKey, headers[i], cs[i]);
+            } catch (UnwrappingException &e) {
+                // the ciphertext does not belong to the tag, e.g. it was overwritten
+            }
+        });
     } catch (TagException &e) {
         throw IllegalTagException();
     }
+    return res;
 }
 
 void HPPRF_AEAD_PKW::punc(Tag tag) {
     try {
-        pprf.punc(tag);
+        pprf.update([&tag](GGM_HPPRF &prf) { prf.punc(tag); });
     } catch (TagException &t) {
         throw IllegalTagException();
     }
 }
 
 long HPPRF_AEAD_PKW::getNumPuncs() {
-    return pprf.getNumPuncs();
+    return pprf.snapshot()->getNumPuncs();
+}
+
+size_t HPPRF_AEAD_PKW::getNumKeyNodes() {
+    return pprf.snapshot()->keyStats().nodes;
 }
 
 /* Not needed because of use of SecureByteBuffer */
 void HPPRF_AEAD_PKW::secureTeardown() {
 }
 
+void HPPRF_AEAD_PKW::trackKeyChanges() {
+    pprf.update([](GGM_HPPRF &prf) { prf.trackChanges(); });
+}
+
+SecureByteBuffer HPPRF_AEAD_PKW::takeKeyDelta() {
+    return pprf.update([](GGM_HPPRF &prf) { return prf.takeDelta(); });
+}
+
+void HPPRF_AEAD_PKW::applyKeyDelta(const SecureByteBuffer &delta) {
+    try {
+        pprf.update([&delta](GGM_HPPRF &prf) { prf.applyDelta(delta); });
+    } catch (PPRFDeserializationError &e) {
+        throw DeserializationError();
+    }
+}
+
+void HPPRF_AEAD_PKW::enableCache(size_t memoryBudget) {
+    pprf.update([memoryBudget](GGM_HPPRF &prf) { prf.enableCache(memoryBudget); });
+}
+
+KeyStats HPPRF_AEAD_PKW::keyStats() const {
+    return pprf.snapshot()->keyStats();
+}
+
+NodeCache::Stats HPPRF_AEAD_PKW::cacheStats() const {
+    return pprf.snapshot()->cacheStats();
+}
+
 SecureByteBuffer HPPRF_AEAD_PKW::serializeKey() {
-    return pprf.serializeKey();
+    return pprf.snapshot()->serializeKey();
 }
 
 SecureByteBuffer HPPRF_AEAD_PKW::serializeAndEncryptKey(const std::string &password) {
@@ -132,9 +156,9 @@ SecureByteBuffer HPPRF_AEAD_PKW::serializeAndEncryptKey(const std::string &passw
     return encryptExport(serialized, password);
 }
 
-HPPRF_AEAD_PKW::HPPRF_AEAD_PKW(int keyLen) : pprf(PPRFKey(keyLen, 1)) {}
+HPPRF_AEAD_PKW::HPPRF_AEAD_PKW(int keyLen, PRGType prg) : pprf(GGM_HPPRF(PPRFKey(keyLen, 1, prg))) {}
 
-HPPRF_AEAD_PKW::HPPRF_AEAD_PKW(SecureByteBuffer serializedKey) : pprf(PPRFKey::fromSerialized(serializedKey)) {}
+HPPRF_AEAD_PKW::HPPRF_AEAD_PKW(SecureByteBuffer serializedKey) : pprf(GGM_HPPRF(PPRFKey::fromSerialized(serializedKey))) {}
 
 std::shared_ptr<AbstractPKW<Tag, ciphertext>> HPPRF_AEAD_PKW_Factory::fromSerialized(SecureByteBuffer &serialized) {
     return std::shared_ptr<AbstractPKW<Tag, ciphertext>>(new HPPRF_AEAD_PKW(serialized));
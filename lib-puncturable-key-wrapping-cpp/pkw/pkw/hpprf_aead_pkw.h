@@ -23,6 +23,7 @@
 
 
 #include "../pprf/ggm_hpprf.h"
+#include "helpers/versioned.h"
 #include "pkw.h"
 #include <vector>
 
@@ -32,6 +33,9 @@ using ciphertext = std::vector<unsigned char>;
  * Hierarchically Puncturable Key Wrapping instantiated using composition of a hierarchically Puncturable Pseudo-Random Function (hPPRF) and an AEAD scheme
  * <br>
  * <div class="csl-entry">Backendal, M., Günther, F., &#38; Paterson, K. G. (2022). Puncturable Key Wrapping and Its Applications. <i>Cryptology EPrint Archive</i>.</div>
+ * <br>
+ * All operations are thread-safe; as for PPRF_AEAD_PKW, wrapping and unwrapping evaluate a snapshot of the HPPRF and
+ * are not blocked by punctures.
  */
 class HPPRF_AEAD_PKW : public AbstractPKW<Tag, ciphertext> {
     public:
@@ -39,8 +43,9 @@ class HPPRF_AEAD_PKW : public AbstractPKW<Tag, ciphertext> {
          * Constructs a fresh instance of the PKW.
          * @param tagLen the size of the tag space in number of bits.
          * @param keyLen the size of the key space in number of bits.
+         * @param prg the PRG used by the underlying HPPRF.
          */
-        HPPRF_AEAD_PKW(int keyLen);
+        HPPRF_AEAD_PKW(int keyLen, PRGType prg = PRGType::HKDF_SHA256);
 
         /**
          * Reconstructs a previous instance using the serialized key as input
@@ -52,18 +57,81 @@ class HPPRF_AEAD_PKW : public AbstractPKW<Tag, ciphertext> {
 
         std::vector<unsigned char> unwrap(Tag tag, std::vector<unsigned char> &header, ciphertext &c) override;
 
+        /**
+         * Wraps several keys at once, deriving the parts of the PPRF paths shared by the tags only once.
+         * @throws IllegalTagException if any of the tags is punctured or invalid; no key is wrapped in this case.
+         */
+        std::vector<ciphertext> wrapBatch(std::span<const Tag> tags, std::span<std::vector<unsigned char>> headers,
+                                          std::span<std::vector<unsigned char>> keys) override;
+
+        /**
+         * Unwraps several keys at once, deriving the parts of the PPRF paths shared by the tags only once.
+         * @throws IllegalTagException if any of the tags is punctured or invalid.
+         */
+        std::vector<std::vector<unsigned char>> unwrapBatch(std::span<const Tag> tags,
+                                                            std::span<std::vector<unsigned char>> headers,
+                                                            std::span<ciphertext> cs) override;
+
+        /**
+         * Unwraps several keys at once, visiting the tags which are not punctured in a single traversal of the tree.
+         */
+        std::vector<std::optional<std::vector<unsigned char>>>
+        unwrapLiveBatch(std::span<const Tag> tags, std::span<std::vector<unsigned char>> headers,
+                        std::span<ciphertext> cs) override;
+
         void punc(Tag tag) override;
 
         long getNumPuncs() override;
 
+        size_t getNumKeyNodes() override;
+
         void secureTeardown() override;
 
         SecureByteBuffer serializeKey() override;
 
         SecureByteBuffer serializeAndEncryptKey(const std::string &password) override;
 
+        /**
+         * Starts recording the changes made to the key by punctures, such that the key can be persisted
+         * incrementally, e.g. in an append-only journal: the deltas returned by takeKeyDelta can be replayed on the
+         * previously serialized key using applyKeyDelta. A delta of a single puncture takes O(tagLen) bytes.
+         */
+        void trackKeyChanges();
+
+        /**
+         * @return the changes made to the key since tracking started or since the last call, serialized. The delta
+         * contains key material and has to be stored as securely as the key.
+         */
+        SecureByteBuffer takeKeyDelta();
+
+        /**
+         * Replays a delta taken from a copy of this PKW.
+         * @param delta the serialized delta
+         * @throws DeserializationError if the delta is malformed
+         */
+        void applyKeyDelta(const SecureByteBuffer &delta);
+
+        /**
+         * Enables a bounded cache of the nodes derived when wrapping and unwrapping keys with single tags, which speeds
+         * up repeated operations on nearby tags. Punctures evict all cached nodes from which a punctured tag can be
+         * derived.
+         * @param memoryBudget the maximum memory used by the cache, in bytes
+         */
+        void enableCache(size_t memoryBudget);
+
+        /**
+         * @return hits, misses and size of the cache
+         */
+        NodeCache::Stats cacheStats() const;
+
+        /**
+         * @return statistics on the key of the current version: its nodes, their depths, the memory it holds and the
+         * predicted cost of wrapping and puncturing
+         */
+        KeyStats keyStats() const;
+
     private:
-        GGM_HPPRF pprf;
+        Versioned<GGM_HPPRF> pprf;
 };
 
 class HPPRF_AEAD_PKW_Factory : public AbstractPKWFactory<Tag, ciphertext> {
@@ -19,7 +19,6 @@
  **********************************************************************************************************************/
 
 #include "naive_pkw.h"
-#include "../secure_memzero.h"
 #include "exceptions.h"
 #include "helpers/password_encrypt.h"
 #include <cmath>
@@ -28,8 +27,6 @@
 #include <utility>
 
 using byte = unsigned char;
-using std::array;
-using std::pair;
 using std::vector;
 
 NaivePKW::NaivePKW(SecureByteBuffer serializedKey) {
@@ -39,19 +36,17 @@ NaivePKW::NaivePKW(SecureByteBuffer serializedKey) {
 
 NaivePKW::NaivePKW(int tagLen) : numPunctures(0) {
     for (long i = 0; i < powl(2, tagLen); ++i) {
-        this->keys[i] = new array<byte, KEY_LEN>;
+        this->keys[i].emplace();
         CryptoPP::OS_GenerateRandomBlock(true, this->keys[i]->data(), this->keys[i]->size());
     }
 }
 
 void NaivePKW::punc(long tag) {
     checkTag(tag);
-    if (this->keys[tag] == nullptr) {
+    if (!this->keys[tag]) {
         return;
     }
-    secure_memzero(this->keys[tag]->data(), KEY_LEN);
-    delete this->keys[tag];
-    this->keys[tag] = nullptr;
+    this->keys[tag].reset();
     this->numPunctures += 1;
 }
 
@@ -81,11 +76,10 @@ NaivePKW::unwrap(long tag, vector<byte> &header, vector<byte> &c) {
 
 byte *NaivePKW::getAndCheckKey(long tag) {
     checkTag(tag);
-    byte *kek = keys[tag]->data();
-    if (kek == nullptr) {
+    if (!keys[tag]) {
         throw IllegalTagException();
     }
-    return kek;
+    return keys[tag]->data();
 }
 
 void NaivePKW::checkTag(long tag) const {
@@ -95,12 +89,8 @@ void NaivePKW::checkTag(long tag) const {
 }
 
 void NaivePKW::secureTeardown() {
-    for (pair<const long, array<byte, KEY_LEN> *> &p: this->keys) {
-        if (p.second != nullptr) {
-            secure_memzero(p.second->data(), KEY_LEN);
-            delete p.second;
-            p.second = nullptr;
-        }
+    for (auto &p: this->keys) {
+        p.second.reset();
     }
 }
 
@@ -172,9 +162,9 @@ SecureByteBuffer NaivePKWSerializer::serialize() {
     vector<unsigned char> buffer;
     writeT(buffer, puncs);
     for (auto &entry: keys) {
-        if (entry.second != nullptr) {
+        if (entry.second) {
             writeT(buffer, entry.first);
-            copy(buffer, entry.second->begin(), entry.second->size());
+            copy(buffer, entry.second->data(), entry.second->size());
         }
     }
     return SecureByteBuffer(buffer);
@@ -184,8 +174,10 @@ Key NaivePKWSerializer::deserializeKey(SecureByteBuffer &serialized, size_t offs
     while (offset + sizeof(long) < serialized.size()) {
         long index = getLong(serialized, offset);
         offset += sizeof(long);
-        key[index] = new std::array<unsigned char, KEY_LEN>;
-        std::copy(serialized.begin() + offset, serialized.begin() + offset + KEY_LEN, key[index]->begin());
+        if (serialized.size() < offset + KEY_LEN) {
+            throw DeserializationError();
+        }
+        key[index].emplace(serialized.data() + offset);
         offset += KEY_LEN;
     }
     return key;
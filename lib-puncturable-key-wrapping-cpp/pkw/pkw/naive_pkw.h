@@ -21,16 +21,20 @@
 #ifndef PUNCTURABLE_KEY_WRAPPING_CPP_NAIVE_PKW_H
 #define PUNCTURABLE_KEY_WRAPPING_CPP_NAIVE_PKW_H
 
+#include "../secure_key.h"
 #include "exceptions.h"
 #include "pkw.h"
-#include <array>
 #include <map>
+#include <optional>
 
 #define MAC_LEN 12
 #define NONCE_LEN 16
 #define KEY_LEN 16
 
-using Key = std::map<long, std::array<unsigned char, KEY_LEN> *>;
+/**
+ * The key of every tag, or none if the tag was punctured.
+ */
+using Key = std::map<long, std::optional<SecureKey<KEY_LEN>>>;
 
 class NaivePKW : public AbstractPKW<long, std::vector<unsigned char>> {
     public:
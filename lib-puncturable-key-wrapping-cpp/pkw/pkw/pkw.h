@@ -21,8 +21,11 @@
 #ifndef PUNCTURABLE_KEY_WRAPPING_CPP_ABSTRACT_PKW_H
 #define PUNCTURABLE_KEY_WRAPPING_CPP_ABSTRACT_PKW_H
 #include "../secure_byte_buffer.h"
+#include "exceptions.h"
 #include "helpers/password_encrypt.h"
 #include <memory>
+#include <optional>
+#include <span>
 #include <vector>
 
 /**
@@ -33,6 +36,17 @@
 template<class T, class C>
 class AbstractPKW {
     public:
+        /**
+         * A subtree of the tag space: the tags in [first, last], the number of nodes of the key inside it and the
+         * number of tags of a given set inside it.
+         */
+        struct Subtree {
+            T first;
+            T last;
+            size_t keyNodes;
+            size_t tags;
+        };
+
         /**
          * A function to wrap a key, using the tag and a header.
          * @param tag the tag
@@ -53,18 +67,132 @@ class AbstractPKW {
         virtual std::vector<unsigned char>
         unwrap(T tag, std::vector<unsigned char> &header, C &c) = 0;
 
+        /**
+         * Wraps several keys, keys[i] using tags[i] and headers[i]. Implementations may share work between the tags.
+         * The default implementation calls wrap for each tag.
+         * @param tags the tags
+         * @param headers the headers
+         * @param keys the keys to be wrapped
+         * @return the ciphertexts, in the order of the tags
+         */
+        virtual std::vector<C>
+        wrapBatch(std::span<const T> tags, std::span<std::vector<unsigned char>> headers,
+                  std::span<std::vector<unsigned char>> keys) {
+            std::vector<C> res;
+            res.reserve(tags.size());
+            for (size_t i = 0; i < tags.size(); ++i) {
+                res.push_back(wrap(tags[i], headers[i], keys[i]));
+            }
+            return res;
+        }
+
+        /**
+         * Unwraps several keys, cs[i] using tags[i] and headers[i]. Implementations may share work between the tags.
+         * The default implementation calls unwrap for each tag.
+         * @param tags the tags with which the keys were wrapped
+         * @param headers the headers with which the keys were wrapped
+         * @param cs the ciphertexts
+         * @return the wrapped keys, in the order of the tags
+         */
+        virtual std::vector<std::vector<unsigned char>>
+        unwrapBatch(std::span<const T> tags, std::span<std::vector<unsigned char>> headers, std::span<C> cs) {
+            std::vector<std::vector<unsigned char>> res;
+            res.reserve(tags.size());
+            for (size_t i = 0; i < tags.size(); ++i) {
+                res.push_back(unwrap(tags[i], headers[i], cs[i]));
+            }
+            return res;
+        }
+
+        /**
+         * Unwraps several keys like unwrapBatch, but keys whose tag was punctured on or which cannot be unwrapped are
+         * skipped instead of failing the whole batch, e.g. to enumerate all files that are still accessible.
+         * The default implementation calls unwrap for each tag.
+         * @param tags the tags with which the keys were wrapped
+         * @param headers the headers with which the keys were wrapped
+         * @param cs the ciphertexts
+         * @return the wrapped keys in the order of the tags, empty for keys that cannot be unwrapped
+         */
+        virtual std::vector<std::optional<std::vector<unsigned char>>>
+        unwrapLiveBatch(std::span<const T> tags, std::span<std::vector<unsigned char>> headers, std::span<C> cs) {
+            std::vector<std::optional<std::vector<unsigned char>>> res(tags.size());
+            for (size_t i = 0; i < tags.size(); ++i) {
+                try {
+                    res[i] = unwrap(tags[i], headers[i], cs[i]);
+                } catch (PuncturableKeyWrappingException &e) {
+                    // punctured or shredded, skipped
+                }
+            }
+            return res;
+        }
+
         /**
          * Punctures on tag. Subsequent calls to wrap or unwrap with this tag will fail.
          * @param tag the tag
          */
         virtual void punc(T tag) = 0;
 
+        /**
+         * Punctures on several tags. Implementations may share work between the tags.
+         * The default implementation calls punc for each tag.
+         * @param tags the tags
+         */
+        virtual void puncBatch(std::span<const T> tags) {
+            for (auto &tag: tags) {
+                punc(tag);
+            }
+        }
+
         /**
          * Returns the number punctures that have been performed.
          * @return the number of punctures
          */
         virtual long getNumPuncs() = 0;
 
+        /**
+         * Returns the number of nodes the key consists of, for keys made of the nodes of a tree. Together with the
+         * number of punctures, it tells when the key should be rotated.
+         * The default implementation returns 0, for keys without nodes.
+         * @return the number of nodes of the key
+         */
+        virtual size_t getNumKeyNodes() {
+            return 0;
+        }
+
+        /**
+         * Returns the number of times wrap has grown the key, for keys whose tree grows with the tags in use. Unlike a
+         * puncture, a growth happens implicitly, the grown key has to be persisted before a key wrapped under it is.
+         * The default implementation returns 0, for keys that do not grow.
+         * @return the number of growths of the key
+         */
+        virtual size_t getNumGrowths() {
+            return 0;
+        }
+
+        /**
+         * Lists the subtrees of the tag space in which the nodes of the key branch, for keys made of the nodes of a
+         * tree, and counts the given tags inside each. Puncturing such a subtree with puncRange removes its nodes
+         * from the key without adding any.
+         * The default implementation lists none, for keys without nodes.
+         * @param tags the tags to count, e.g. the tags that are in use
+         * @param minKeyNodes the minimal number of nodes of the key in a listed subtree
+         * @return the subtrees holding at least minKeyNodes nodes of the key
+         */
+        virtual std::vector<Subtree> keySubtrees(std::span<const T>, size_t) {
+            return {};
+        }
+
+        /**
+         * Punctures on all tags in [lo, hi]. Subsequent calls to wrap or unwrap with any of these tags will fail.
+         * The default implementation does not support ranges.
+         * @param lo the first tag of the range
+         * @param hi the last tag of the range
+         * @throws PuncturingException if ranges are not supported.
+         */
+        virtual void puncRange(const T &, const T &) {
+            throw PuncturingException();
+        }
+
         /**
          * Securely erases all sensitive material.
          */
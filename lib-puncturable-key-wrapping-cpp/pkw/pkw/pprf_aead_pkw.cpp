@@ -21,110 +21,238 @@
 #include "pprf_aead_pkw.h"
 #include "../pprf/pprf_exceptions.h"
 #include "exceptions.h"
-#include <cryptopp/aes.h>
-#include <cryptopp/cryptlib.h>
-#include <cryptopp/filters.h>
-#include <cryptopp/gcm.h>
+#include "helpers/aead_wrap.h"
+#include <bit>
 
-const int DIGEST_SIZE = 16;
 using std::vector;
 
-/**
- * from https://cryptopp.com/wiki/GCM_Mode#AEAD
- */
 ciphertext PPRF_AEAD_PKW::wrap(Tag tag, vector<unsigned char> &header, vector<unsigned char> &key) {
+    growToFit(std::span<const Tag>(&tag, 1));
     try {
-        SecureByteBuffer wrapping_key = pprf.eval(tag);
-        CryptoPP::GCM<CryptoPP::AES>::Encryption e;
-        vector<unsigned char> iv(16, 0);
-        e.SetKeyWithIV(wrapping_key.data(), wrapping_key.size(), iv.data(), iv.size());
-        ciphertext cipher;
-        CryptoPP::AuthenticatedEncryptionFilter ef(e,
-                                                   new CryptoPP::VectorSink(cipher), false,
-                                                   DIGEST_SIZE /* MAC_AT_END */);
-        ef.ChannelPut(CryptoPP::AAD_CHANNEL, header.data(), header.size());
-        ef.ChannelMessageEnd(CryptoPP::AAD_CHANNEL);
-
-        // Confidential data comes after authenticated data.
-        // This is a limitation due to CCM mode, not GCM mode.
-        ef.ChannelPut(CryptoPP::DEFAULT_CHANNEL, key.data(), key.size());
-        ef.ChannelMessageEnd(CryptoPP::DEFAULT_CHANNEL);
-        return cipher;
-    } catch (CryptoPP::Exception &e) {
-        throw WrappingException();
+        return aeadWrap(evalWithCursor(tag), header, key);
     } catch (TagException &e) {
         throw IllegalTagException();
     }
 }
 
-/**
- * from https://cryptopp.com/wiki/GCM_Mode#AEAD
- */
+SecureByteBuffer PPRF_AEAD_PKW::evalWithCursor(const Tag &tag) {
+    std::unique_lock<std::mutex> lock(cursorMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return pprf.snapshot()->eval(tag);
+    }
+    /* punctures publish their version and invalidate the path while holding the lock, such that the path never holds
+     * a node the loaded snapshot removed */
+    return cursor.eval(*pprf.snapshot(), tag);
+}
+
+void PPRF_AEAD_PKW::growToFit(std::span<const Tag> tags) {
+    std::shared_ptr<const GGM_PPRF> snapshot = pprf.snapshot();
+    const int maxTagLen = snapshot->maxTagLen();
+    int needed = snapshot->tagLen();
+    if (maxTagLen == needed) {
+        return;
+    }
+    for (const Tag &tag: tags) {
+        while ((tag >> needed).any()) {
+            if (++needed > maxTagLen) {
+                return; /* wrapping fails on the tag */
+            }
+        }
+    }
+    /* the tree grows by whole levels */
+    const int levelBits = std::countr_zero(static_cast<unsigned>(snapshot->arity()));
+    needed = (needed + levelBits - 1) / levelBits * levelBits;
+    if (needed == snapshot->tagLen()) {
+        return;
+    }
+    bool grown = false;
+    pprf.update([needed, &grown](GGM_PPRF &prf) {
+        if (prf.tagLen() < needed) {
+            prf.growTagLen(needed);
+            grown = true;
+        }
+    });
+    if (grown) {
+        ++growths;
+    }
+}
+
 vector<unsigned char> PPRF_AEAD_PKW::unwrap(Tag tag, vector<unsigned char> &header, ciphertext &c) {
     try {
-        SecureByteBuffer wrapping_key = pprf.eval(tag);
-        CryptoPP::GCM<CryptoPP::AES>::Decryption d;
-        vector<unsigned char> iv(16, 0);
-        d.SetKeyWithIV(wrapping_key.data(), wrapping_key.size(), iv.data(), iv.size());
-        vector<unsigned char> enc(c.begin(), c.end() - DIGEST_SIZE);
-        vector<unsigned char> mac(c.end() - DIGEST_SIZE, c.end());
-        CryptoPP::AuthenticatedDecryptionFilter df(d,
-                                                   NULL, CryptoPP::AuthenticatedDecryptionFilter::MAC_AT_BEGIN |
-                                                         CryptoPP::AuthenticatedDecryptionFilter::THROW_EXCEPTION,
-                                                   DIGEST_SIZE /* MAC_AT_END */);
-        // The order of the following calls are important
-        df.ChannelPut(CryptoPP::DEFAULT_CHANNEL, mac.data(), mac.size());
-        df.ChannelPut(CryptoPP::AAD_CHANNEL, header.data(), header.size());
-        df.ChannelPut(CryptoPP::DEFAULT_CHANNEL, enc.data(), enc.size());
-
-        // If the object throws, it will most likely occur
-        //   during ChannelMessageEnd()
-        df.ChannelMessageEnd(CryptoPP::AAD_CHANNEL);
-        df.ChannelMessageEnd(CryptoPP::DEFAULT_CHANNEL);
-
-        // If the object does not throw, here's the only
-        //  opportunity to check the data's integrity
-        if (!df.GetLastResult()) {
-            throw UnwrappingException();
-        }
+        return aeadUnwrap(pprf.snapshot()->eval(tag), header, c);
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+}
 
-        // Remove data from channel
-        vector<unsigned char> retrieved;
+std::vector<ciphertext> PPRF_AEAD_PKW::wrapBatch(std::span<const Tag> tags, std::span<vector<unsigned char>> headers,
+                                          std::span<vector<unsigned char>> keys) {
+    if (headers.size() != tags.size() || keys.size() != tags.size()) {
+        throw WrappingException();
+    }
+    growToFit(tags);
+    std::vector<SecureByteBuffer> wrappingKeys;
+    try {
+        wrappingKeys = pprf.snapshot()->evalBatch(tags);
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+    std::vector<ciphertext> res;
+    res.reserve(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        res.push_back(aeadWrap(wrappingKeys[i], headers[i], keys[i]));
+    }
+    return res;
+}
 
-        // Plain text recovered from enc.data()
-        df.SetRetrievalChannel(CryptoPP::DEFAULT_CHANNEL);
-        size_t n = (size_t) df.MaxRetrievable();
-        retrieved.resize(n);
+std::vector<vector<unsigned char>> PPRF_AEAD_PKW::unwrapBatch(std::span<const Tag> tags, std::span<vector<unsigned char>> headers,
+                                                       std::span<ciphertext> cs) {
+    if (headers.size() != tags.size() || cs.size() != tags.size()) {
+        throw UnwrappingException();
+    }
+    std::vector<SecureByteBuffer> wrappingKeys;
+    try {
+        wrappingKeys = pprf.snapshot()->evalBatch(tags);
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+    std::vector<vector<unsigned char>> res;
+    res.reserve(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        res.push_back(aeadUnwrap(wrappingKeys[i], headers[i], cs[i]));
+    }
+    return res;
+}
 
-        if (n > 0) {
-            df.Get((byte *) retrieved.data(), n);
-        }
-        return retrieved;
-    } catch (CryptoPP::Exception &e) {
+std::vector<std::optional<vector<unsigned char>>>
+PPRF_AEAD_PKW::unwrapLiveBatch(std::span<const Tag> tags, std::span<vector<unsigned char>> headers, std::span<ciphertext> cs) {
+    if (headers.size() != tags.size() || cs.size() != tags.size()) {
         throw UnwrappingException();
+    }
+    std::vector<std::optional<vector<unsigned char>>> res(tags.size());
+    try {
+        pprf.snapshot()->forEachLiveLeaf(tags, [&](size_t i, const SecureByteBuffer &wrappingKey) {
+            try {
+                res[i] = aeadUnwrap(wrappingKey, headers[i], cs[i]);
+            } catch (UnwrappingException &e) {
+                // the ciphertext does not belong to the tag, e.g. it was overwritten
+            }
+        });
     } catch (TagException &e) {
         throw IllegalTagException();
     }
+    return res;
 }
 
 void PPRF_AEAD_PKW::punc(Tag tag) {
+    std::lock_guard<std::mutex> lock(cursorMutex);
+    try {
+        pprf.update([&tag](GGM_PPRF &prf) { prf.punc(tag); });
+    } catch (TagException &t) {
+        throw IllegalTagException();
+    }
+    cursor.invalidate(tag);
+}
+
+void PPRF_AEAD_PKW::puncBatch(std::span<const Tag> tags) {
+    std::lock_guard<std::mutex> lock(cursorMutex);
+    try {
+        pprf.update([tags](GGM_PPRF &prf) { prf.puncBatch(tags); });
+    } catch (TagException &t) {
+        throw IllegalTagException();
+    }
+    for (const Tag &tag: tags) {
+        cursor.invalidate(tag);
+    }
+}
+
+void PPRF_AEAD_PKW::puncRange(const Tag &lo, const Tag &hi) {
+    std::lock_guard<std::mutex> lock(cursorMutex);
     try {
-        pprf.punc(tag);
+        pprf.update([&lo, &hi](GGM_PPRF &prf) { prf.puncRange(lo, hi); });
     } catch (TagException &t) {
         throw IllegalTagException();
     }
+    cursor.invalidate(lo, hi);
 }
 
 long PPRF_AEAD_PKW::getNumPuncs() {
-    return pprf.getNumPuncs();
+    return pprf.snapshot()->getNumPuncs();
 }
 
-/* Not needed because of use of SecureByteBuffer */
+size_t PPRF_AEAD_PKW::getNumKeyNodes() {
+    return pprf.snapshot()->keyStats().nodes;
+}
+
+size_t PPRF_AEAD_PKW::getNumGrowths() {
+    return growths;
+}
+
+std::vector<PPRF_AEAD_PKW::Subtree> PPRF_AEAD_PKW::keySubtrees(std::span<const Tag> tags, size_t minKeyNodes) {
+    std::vector<GGM_PPRF::Subtree> subtrees;
+    try {
+        subtrees = pprf.snapshot()->keySubtrees(tags, minKeyNodes);
+    } catch (TagException &t) {
+        throw IllegalTagException();
+    }
+    std::vector<Subtree> res;
+    res.reserve(subtrees.size());
+    for (const auto &subtree: subtrees) {
+        res.push_back({subtree.first, subtree.last, subtree.keyNodes, subtree.tags});
+    }
+    return res;
+}
+
+/* The key is erased by SecureByteBuffer, only the path of the cursor is held beyond the lifetime of a snapshot */
 void PPRF_AEAD_PKW::secureTeardown() {
+    std::lock_guard<std::mutex> lock(cursorMutex);
+    cursor.reset();
+}
+
+void PPRF_AEAD_PKW::trackKeyChanges() {
+    pprf.update([](GGM_PPRF &prf) { prf.trackChanges(); });
+}
+
+SecureByteBuffer PPRF_AEAD_PKW::takeKeyDelta() {
+    return pprf.update([](GGM_PPRF &prf) { return prf.takeDelta(); });
+}
+
+SecureByteBuffer PPRF_AEAD_PKW::serializeKeyAndResetDelta() {
+    return pprf.update([](GGM_PPRF &prf) {
+        prf.takeDelta();
+        return prf.serializeKey();
+    });
+}
+
+void PPRF_AEAD_PKW::applyKeyDelta(const SecureByteBuffer &delta) {
+    try {
+        pprf.update([&delta](GGM_PPRF &prf) { prf.applyDelta(delta); });
+    } catch (PPRFDeserializationError &e) {
+        throw DeserializationError();
+    }
+    std::lock_guard<std::mutex> lock(cursorMutex);
+    cursor.reset();
+}
+
+void PPRF_AEAD_PKW::enableCache(size_t memoryBudget) {
+    pprf.update([memoryBudget](GGM_PPRF &prf) { prf.enableCache(memoryBudget); });
+}
+
+KeyStats PPRF_AEAD_PKW::keyStats() const {
+    return pprf.snapshot()->keyStats();
+}
+
+NodeCache::Stats PPRF_AEAD_PKW::cacheStats() const {
+    return pprf.snapshot()->cacheStats();
+}
+
+EvalCursor::Stats PPRF_AEAD_PKW::cursorStats() const {
+    std::lock_guard<std::mutex> lock(cursorMutex);
+    return cursor.stats();
 }
 
 SecureByteBuffer PPRF_AEAD_PKW::serializeKey() {
-    return pprf.serializeKey();
+    return pprf.snapshot()->serializeKey();
 }
 
 SecureByteBuffer PPRF_AEAD_PKW::serializeAndEncryptKey(const std::string &password) {
@@ -132,9 +260,10 @@ SecureByteBuffer PPRF_AEAD_PKW::serializeAndEncryptKey(const std::string &passwo
     return encryptExport(serialized, password);
 }
 
-PPRF_AEAD_PKW::PPRF_AEAD_PKW(int tagLen, int keyLen) : pprf(PPRFKey(keyLen, tagLen)) {}
+PPRF_AEAD_PKW::PPRF_AEAD_PKW(int tagLen, int keyLen, PRGType prg, int arity, int maxTagLen)
+    : pprf(GGM_PPRF(PPRFKey(keyLen, tagLen, prg, arity, maxTagLen))) {}
 
-PPRF_AEAD_PKW::PPRF_AEAD_PKW(SecureByteBuffer serializedKey) : pprf(PPRFKey::fromSerialized(serializedKey)) {}
+PPRF_AEAD_PKW::PPRF_AEAD_PKW(SecureByteBuffer serializedKey) : pprf(GGM_PPRF::fromSerialized(std::move(serializedKey))) {}
 
 std::shared_ptr<AbstractPKW<Tag, ciphertext>> PPRF_AEAD_PKW_Factory::fromSerialized(SecureByteBuffer &serialized) {
     return std::shared_ptr<AbstractPKW<Tag, ciphertext>>(new PPRF_AEAD_PKW(serialized));
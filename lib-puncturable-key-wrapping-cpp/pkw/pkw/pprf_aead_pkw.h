@@ -22,8 +22,12 @@
 #define PUNCTURABLE_KEY_WRAPPING_CPP_PPRF_AEAD_PKW_H
 
 
+#include "../pprf/eval_cursor.h"
 #include "../pprf/ggm_pprf.h"
+#include "helpers/versioned.h"
 #include "pkw.h"
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 using ciphertext = std::vector<unsigned char>;
@@ -32,6 +36,18 @@ using ciphertext = std::vector<unsigned char>;
  * Puncturable Key Wrapping instantiated using composition of a Puncturable Pseudo-Random Function (PPRF) and an AEAD scheme
  * <br>
  * <div class="csl-entry">Backendal, M., Günther, F., &#38; Paterson, K. G. (2022). Puncturable Key Wrapping and Its Applications. <i>Cryptology EPrint Archive</i>.</div>
+ * <br>
+ * All operations are thread-safe. Wrapping and unwrapping evaluate a snapshot of the PPRF without locking, such that
+ * they are not blocked by punctures: a puncture modifies a copy of the PPRF and publishes it when done. The nodes
+ * removed from the key are zeroed once the last snapshot holding them is released.
+ * <br>
+ * Wrapping keeps the path to the last wrapped tag in an EvalCursor, such that wrapping with consecutive tags, as
+ * handed out by sequential allocation, derives two nodes per tag on average instead of tagLen. Punctures erase the path
+ * if a punctured tag can be derived from it, holding the cursor until then; wrapping meanwhile evaluates the snapshot.
+ * <br>
+ * The tag length may grow: a PKW constructed with a maximal tag length starts with a short tree and extends it (see
+ * GGM_PPRF::growTagLen) whenever a key is wrapped with a tag that does not fit, such that wrapping, unwrapping and
+ * puncturing cost O(log(largest tag)) derivations. Keys wrapped before keep their tags and ciphertexts.
  */
 class PPRF_AEAD_PKW : public AbstractPKW<Tag, ciphertext> {
     public:
@@ -39,25 +55,142 @@ class PPRF_AEAD_PKW : public AbstractPKW<Tag, ciphertext> {
          * Constructs a fresh instance of the PKW.
          * @param tagLen the size of the tag space in number of bits.
          * @param keyLen the size of the key space in number of bits.
+         * @param prg the PRG used by the underlying PPRF.
+         * @param arity the arity of the GGM tree of the underlying PPRF, see PPRFKey.
+         * @param maxTagLen the tag length up to which the tree grows, tagLen being the initial one; 0 for a fixed tag
+         * length.
          */
-        PPRF_AEAD_PKW(int tagLen, int keyLen);
+        PPRF_AEAD_PKW(int tagLen, int keyLen, PRGType prg = PRGType::HKDF_SHA256, int arity = 2, int maxTagLen = 0);
 
         /**
-         * Reconstructs a previous instance using the serialized key as input
+         * Reconstructs a previous instance using the serialized key as input. A key in the compact format is kept in
+         * locked memory and only loaded once it is punctured, such that wrapping and unwrapping can start right away.
          * @param serializedKey the serialized key
          */
         explicit PPRF_AEAD_PKW(SecureByteBuffer serializedKey);
 
+        /**
+         * Wraps key, starting the derivation from the path to the previously wrapped tag where possible. If another
+         * thread is wrapping, the path is not used. Grows the tree if the tag does not fit and the tag length may grow.
+         */
         ciphertext wrap(Tag tag, std::vector<unsigned char> &header, std::vector<unsigned char> &key) override;
         std::vector<unsigned char> unwrap(Tag tag, std::vector<unsigned char> &header, ciphertext &c) override;
+        /**
+         * Wraps several keys at once, deriving the parts of the PPRF paths shared by the tags only once. Grows the tree
+         * like wrap.
+         * @throws IllegalTagException if any of the tags is punctured or invalid; no key is wrapped in this case.
+         */
+        std::vector<ciphertext> wrapBatch(std::span<const Tag> tags, std::span<std::vector<unsigned char>> headers,
+                                          std::span<std::vector<unsigned char>> keys) override;
+
+        /**
+         * Unwraps several keys at once, deriving the parts of the PPRF paths shared by the tags only once.
+         * @throws IllegalTagException if any of the tags is punctured or invalid.
+         */
+        std::vector<std::vector<unsigned char>> unwrapBatch(std::span<const Tag> tags,
+                                                            std::span<std::vector<unsigned char>> headers,
+                                                            std::span<ciphertext> cs) override;
+
+        /**
+         * Unwraps several keys at once, visiting the tags which are not punctured in a single traversal of the tree.
+         */
+        std::vector<std::optional<std::vector<unsigned char>>>
+        unwrapLiveBatch(std::span<const Tag> tags, std::span<std::vector<unsigned char>> headers,
+                        std::span<ciphertext> cs) override;
+
         void punc(Tag tag) override;
+
+        /**
+         * Punctures on several tags, adding only the minimal co-path of all tags to the key.
+         * @throws IllegalTagException if one of the tags is invalid; the key is not modified in this case.
+         */
+        void puncBatch(std::span<const Tag> tags) override;
+
+        /**
+         * Punctures on all tags in [lo, hi]. Subsequent calls to wrap or unwrap with any of these tags will fail.
+         * The size of the key only grows by O(tagLen) nodes, independent of the size of the range.
+         * @param lo the first tag of the range
+         * @param hi the last tag of the range
+         * @throws IllegalTagException if hi < lo or one of the tags is invalid.
+         */
+        void puncRange(const Tag &lo, const Tag &hi) override;
         long getNumPuncs() override;
+        size_t getNumKeyNodes() override;
+        size_t getNumGrowths() override;
+
+        /**
+         * Lists the subtrees of the tag space in which the nodes of the key of the current version branch.
+         * @throws IllegalTagException if one of the tags is invalid.
+         */
+        std::vector<Subtree> keySubtrees(std::span<const Tag> tags, size_t minKeyNodes) override;
         void secureTeardown() override;
         SecureByteBuffer serializeKey() override;
         SecureByteBuffer serializeAndEncryptKey(const std::string &password) override;
 
+        /**
+         * Starts recording the changes made to the key by punctures, such that the key can be persisted
+         * incrementally, e.g. in an append-only journal: the deltas returned by takeKeyDelta can be replayed on the
+         * previously serialized key using applyKeyDelta. A delta of a single puncture takes O(tagLen) bytes.
+         */
+        void trackKeyChanges();
+
+        /**
+         * @return the changes made to the key since tracking started or since the last call, serialized. The delta
+         * contains key material and has to be stored as securely as the key.
+         */
+        SecureByteBuffer takeKeyDelta();
+
+        /**
+         * Serializes the key and discards the changes recorded so far in one step, such that each puncture is
+         * contained either in the serialized key or in the deltas taken afterwards.
+         * @return the serialized key
+         */
+        SecureByteBuffer serializeKeyAndResetDelta();
+
+        /**
+         * Replays a delta taken from a copy of this PKW.
+         * @param delta the serialized delta
+         * @throws DeserializationError if the delta is malformed
+         */
+        void applyKeyDelta(const SecureByteBuffer &delta);
+
+        /**
+         * Enables a bounded cache of the nodes derived when wrapping and unwrapping keys with single tags, which speeds
+         * up repeated operations on nearby tags. Punctures evict all cached nodes from which a punctured tag can be
+         * derived.
+         * @param memoryBudget the maximum memory used by the cache, in bytes
+         */
+        void enableCache(size_t memoryBudget);
+
+        /**
+         * @return hits, misses and size of the cache
+         */
+        NodeCache::Stats cacheStats() const;
+
+        /**
+         * @return statistics on the key of the current version: its nodes, their depths, the memory it holds and the
+         * predicted cost of wrapping and puncturing
+         */
+        KeyStats keyStats() const;
+
+        /**
+         * @return the number of derivations made by wrap and how often it had to start from a node of the key
+         */
+        EvalCursor::Stats cursorStats() const;
+
     private:
-        GGM_PPRF pprf;
+        Versioned<GGM_PPRF> pprf;
+        EvalCursor cursor;
+        mutable std::mutex cursorMutex;
+        // counted once the grown key is published
+        std::atomic<size_t> growths = 0;
+
+        SecureByteBuffer evalWithCursor(const Tag &tag);
+
+        /**
+         * Grows the tree to the smallest tag length fitting all tags, unless it fits them already or cannot grow to it.
+         */
+        void growToFit(std::span<const Tag> tags);
 };
 
 class PPRF_AEAD_PKW_Factory : public AbstractPKWFactory<Tag, ciphertext> {
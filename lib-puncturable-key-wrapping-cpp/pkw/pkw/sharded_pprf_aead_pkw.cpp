@@ -0,0 +1,352 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+#include "sharded_pprf_aead_pkw.h"
+#include "../pprf/byte_cursor.h"
+#include "../pprf/pprf_exceptions.h"
+#include "exceptions.h"
+#include "helpers/aead_wrap.h"
+#include <algorithm>
+
+using std::vector;
+
+namespace {
+    const uint64_t SHARDED_FORMAT_MAGIC = 0xFF00000000005348;
+}// namespace
+
+ShardedPPRF_AEAD_PKW::ShardedPPRF_AEAD_PKW(int tagLen, int keyLen, int shardBits, PRGType prg)
+    : ShardedPPRF_AEAD_PKW(tagLen, keyLen, shardBits, prg,
+                           GGM_PPRF(PPRFKey(keyLen, std::clamp(shardBits, 1, MAX_SHARD_BITS), prg))) {
+    /* the tag length of the root is clamped, such that invalid shard bits are reported by the delegated constructor */
+}
+
+ShardedPPRF_AEAD_PKW::ShardedPPRF_AEAD_PKW(int tagLen, int keyLen, int shardBits, PRGType prg, GGM_PPRF root)
+    : tagLen(tagLen), keyLen(keyLen), shardBits(shardBits), prg(prg), root(std::move(root)) {
+    if (shardBits < 1 || shardBits >= tagLen || shardBits > MAX_SHARD_BITS || tagLen > static_cast<int>(MAX_TAG_LEN) ||
+        this->root.tagLen() != shardBits) {
+        throw InitializationException();
+    }
+    shards = std::make_unique<Shard[]>(numShards());
+}
+
+size_t ShardedPPRF_AEAD_PKW::numShards() const {
+    return size_t(1) << shardBits;
+}
+
+size_t ShardedPPRF_AEAD_PKW::shardOf(const Tag &tag) const {
+    return (tag >> (tagLen - shardBits)).to_ulong() & (numShards() - 1);
+}
+
+Tag ShardedPPRF_AEAD_PKW::localTag(const Tag &tag) const {
+    return tag & (~Tag() >> (MAX_TAG_LEN - tagLen + shardBits));
+}
+
+void ShardedPPRF_AEAD_PKW::checkTag(const Tag &tag) const {
+    if ((tag >> tagLen).any()) {
+        throw IllegalTagException();
+    }
+}
+
+void ShardedPPRF_AEAD_PKW::deriveShard(size_t shard) {
+    if (shards[shard].prf) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(rootMutex);
+    SecureByteBuffer seed = root.eval(Tag(shard));
+    /* once the shard is punctured, the root must not be able to derive its tags anymore */
+    root.punc(Tag(shard));
+    NodeStore nodes(keyLen / 8);
+    nodes.insert("", seed);
+    shards[shard].prf.emplace(PPRFKey(keyLen, tagLen - shardBits, 0, std::move(nodes), prg));
+}
+
+template<class F>
+auto ShardedPPRF_AEAD_PKW::readShard(size_t shard, F f) {
+    try {
+        {
+            std::shared_lock<std::shared_mutex> lock(shards[shard].mutex);
+            if (shards[shard].prf) {
+                return f(static_cast<const GGM_PPRF &>(*shards[shard].prf));
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(shards[shard].mutex);
+        deriveShard(shard);
+        return f(static_cast<const GGM_PPRF &>(*shards[shard].prf));
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+}
+
+template<class F>
+void ShardedPPRF_AEAD_PKW::modifyShard(size_t shard, F f) {
+    std::unique_lock<std::shared_mutex> lock(shards[shard].mutex);
+    try {
+        deriveShard(shard);
+        f(*shards[shard].prf);
+    } catch (TagException &e) {
+        throw IllegalTagException();
+    }
+}
+
+ciphertext ShardedPPRF_AEAD_PKW::wrap(Tag tag, vector<unsigned char> &header, vector<unsigned char> &key) {
+    checkTag(tag);
+    const Tag local = localTag(tag);
+    return aeadWrap(readShard(shardOf(tag), [&local](const GGM_PPRF &prf) { return prf.eval(local); }), header, key);
+}
+
+vector<unsigned char> ShardedPPRF_AEAD_PKW::unwrap(Tag tag, vector<unsigned char> &header, ciphertext &c) {
+    checkTag(tag);
+    const Tag local = localTag(tag);
+    return aeadUnwrap(readShard(shardOf(tag), [&local](const GGM_PPRF &prf) { return prf.eval(local); }), header, c);
+}
+
+std::vector<std::vector<size_t>> ShardedPPRF_AEAD_PKW::groupByShard(std::span<const Tag> tags) const {
+    std::vector<std::vector<size_t>> groups(numShards());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        checkTag(tags[i]);
+        groups[shardOf(tags[i])].push_back(i);
+    }
+    return groups;
+}
+
+std::vector<SecureByteBuffer> ShardedPPRF_AEAD_PKW::evalBatch(std::span<const Tag> tags) {
+    std::vector<std::vector<size_t>> groups = groupByShard(tags);
+    std::vector<SecureByteBuffer> res(tags.size());
+    for (size_t shard = 0; shard < groups.size(); ++shard) {
+        if (groups[shard].empty()) {
+            continue;
+        }
+        std::vector<Tag> local;
+        local.reserve(groups[shard].size());
+        for (size_t i: groups[shard]) {
+            local.push_back(localTag(tags[i]));
+        }
+        std::vector<SecureByteBuffer> keys = readShard(shard, [&local](const GGM_PPRF &prf) { return prf.evalBatch(local); });
+        for (size_t j = 0; j < keys.size(); ++j) {
+            res[groups[shard][j]] = std::move(keys[j]);
+        }
+    }
+    return res;
+}
+
+std::vector<ciphertext> ShardedPPRF_AEAD_PKW::wrapBatch(std::span<const Tag> tags, std::span<vector<unsigned char>> headers,
+                                                        std::span<vector<unsigned char>> keys) {
+    if (headers.size() != tags.size() || keys.size() != tags.size()) {
+        throw WrappingException();
+    }
+    std::vector<SecureByteBuffer> wrappingKeys = evalBatch(tags);
+    std::vector<ciphertext> res;
+    res.reserve(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        res.push_back(aeadWrap(wrappingKeys[i], headers[i], keys[i]));
+    }
+    return res;
+}
+
+std::vector<vector<unsigned char>> ShardedPPRF_AEAD_PKW::unwrapBatch(std::span<const Tag> tags,
+                                                                     std::span<vector<unsigned char>> headers,
+                                                                     std::span<ciphertext> cs) {
+    if (headers.size() != tags.size() || cs.size() != tags.size()) {
+        throw UnwrappingException();
+    }
+    std::vector<SecureByteBuffer> wrappingKeys = evalBatch(tags);
+    std::vector<vector<unsigned char>> res;
+    res.reserve(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        res.push_back(aeadUnwrap(wrappingKeys[i], headers[i], cs[i]));
+    }
+    return res;
+}
+
+void ShardedPPRF_AEAD_PKW::punc(Tag tag) {
+    checkTag(tag);
+    const Tag local = localTag(tag);
+    modifyShard(shardOf(tag), [&local](GGM_PPRF &prf) { prf.punc(local); });
+}
+
+void ShardedPPRF_AEAD_PKW::puncBatch(std::span<const Tag> tags) {
+    std::vector<std::vector<size_t>> groups = groupByShard(tags);
+    for (size_t shard = 0; shard < groups.size(); ++shard) {
+        if (groups[shard].empty()) {
+            continue;
+        }
+        std::vector<Tag> local;
+        local.reserve(groups[shard].size());
+        for (size_t i: groups[shard]) {
+            local.push_back(localTag(tags[i]));
+        }
+        modifyShard(shard, [&local](GGM_PPRF &prf) { prf.puncBatch(local); });
+    }
+}
+
+long ShardedPPRF_AEAD_PKW::getNumPuncs() {
+    long puncs = 0;
+    for (size_t shard = 0; shard < numShards(); ++shard) {
+        std::shared_lock<std::shared_mutex> lock(shards[shard].mutex);
+        if (shards[shard].prf) {
+            puncs += shards[shard].prf->getNumPuncs();
+        }
+    }
+    return puncs;
+}
+
+KeyStats ShardedPPRF_AEAD_PKW::keyStats() {
+    std::vector<uint64_t> histogram(tagLen + 1);
+    size_t residentBytes = 0;
+    auto add = [&histogram, &residentBytes](const KeyStats &stats, size_t depth) {
+        for (size_t d = 0; d < stats.depthHistogram.size() && depth + d < histogram.size(); ++d) {
+            histogram[depth + d] += stats.depthHistogram[d];
+        }
+        residentBytes += stats.residentBytes;
+    };
+    for (size_t shard = 0; shard < numShards(); ++shard) {
+        std::shared_lock<std::shared_mutex> lock(shards[shard].mutex);
+        if (shards[shard].prf) {
+            add(shards[shard].prf->keyStats(), shardBits);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(rootMutex);
+        add(root.keyStats(), 0);
+    }
+    return KeyStats::fromHistogram(tagLen, histogram, residentBytes);
+}
+
+size_t ShardedPPRF_AEAD_PKW::getNumKeyNodes() {
+    return keyStats().nodes;
+}
+
+size_t ShardedPPRF_AEAD_PKW::usedShards() {
+    std::lock_guard<std::mutex> lock(rootMutex);
+    return root.getNumPuncs();
+}
+
+/* Not needed because of use of SecureByteBuffer */
+void ShardedPPRF_AEAD_PKW::secureTeardown() {
+}
+
+/*
+ * The serialized key consists of the magic number, the tag length, key length, number of shard bits and PRG, followed
+ * by the serialized root and the serialized key of each shard, each prefixed with its length. Shards which were not
+ * used have length 0.
+ */
+SecureByteBuffer ShardedPPRF_AEAD_PKW::serializeKey() {
+    /* shards are locked before the root, as in deriveShard */
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(numShards());
+    for (size_t shard = 0; shard < numShards(); ++shard) {
+        locks.emplace_back(shards[shard].mutex);
+    }
+    std::lock_guard<std::mutex> rootLock(rootMutex);
+    std::vector<SecureByteBuffer> parts;
+    parts.reserve(numShards() + 1);
+    parts.push_back(root.serializeKey());
+    size_t size = sizeof(uint64_t) + 3 * sizeof(uint32_t) + 1;
+    for (size_t shard = 0; shard < numShards(); ++shard) {
+        parts.push_back(shards[shard].prf ? shards[shard].prf->serializeKey() : SecureByteBuffer());
+    }
+    for (auto &part: parts) {
+        size += sizeof(uint64_t) + part.size();
+    }
+    SecureByteBuffer serialized(size);
+    ByteWriter out(serialized);
+    out.writeUInt64(SHARDED_FORMAT_MAGIC);
+    out.writeUInt32(tagLen);
+    out.writeUInt32(keyLen);
+    out.writeUInt32(shardBits);
+    out.writeByte(static_cast<uint8_t>(prg));
+    for (auto &part: parts) {
+        out.writeUInt64(part.size());
+        out.writeBytes(part.data(), part.size());
+    }
+    return serialized;
+}
+
+SecureByteBuffer ShardedPPRF_AEAD_PKW::serializeAndEncryptKey(const std::string &password) {
+    auto serialized = serializeKey();
+    return encryptExport(serialized, password);
+}
+
+namespace {
+    SecureByteBuffer readPart(ByteReader &in) {
+        std::span<const uint8_t> bytes = in.readBytes(in.readUInt64());
+        SecureByteBuffer part(bytes.size());
+        std::copy(bytes.begin(), bytes.end(), part.data());
+        return part;
+    }
+}// namespace
+
+ShardedPPRF_AEAD_PKW::Parsed ShardedPPRF_AEAD_PKW::parse(const SecureByteBuffer &serialized) {
+    try {
+        ByteReader in(std::span<const uint8_t>(serialized.data(), serialized.size()));
+        if (in.readUInt64() != SHARDED_FORMAT_MAGIC) {
+            throw DeserializationError();
+        }
+        const int tagLen = static_cast<int>(in.readUInt32());
+        const int keyLen = static_cast<int>(in.readUInt32());
+        const int shardBits = static_cast<int>(in.readUInt32());
+        const auto prg = static_cast<PRGType>(in.readByte());
+        GGM_PRG::forType(prg);
+        if (prg == PRGType::STRUCTURE_ONLY || shardBits < 1 || shardBits >= tagLen || shardBits > MAX_SHARD_BITS || tagLen > static_cast<int>(MAX_TAG_LEN)) {
+            throw DeserializationError();
+        }
+        Parsed parsed{tagLen, keyLen, shardBits, prg, GGM_PPRF::fromSerialized(readPart(in)), {}};
+        /* all keys must have the parameters of the header */
+        auto matches = [keyLen, prg](const GGM_PPRF &pprf, int expectedTagLen) {
+            return pprf.tagLen() == expectedTagLen && pprf.keyLen() == keyLen && pprf.prg() == prg;
+        };
+        if (!matches(parsed.root, shardBits)) {
+            throw DeserializationError();
+        }
+        for (size_t shard = 0; shard < (size_t(1) << shardBits); ++shard) {
+            SecureByteBuffer part = readPart(in);
+            if (part.size() == 0) {
+                parsed.shards.emplace_back();
+                continue;
+            }
+            parsed.shards.emplace_back(GGM_PPRF::fromSerialized(std::move(part)));
+            if (!matches(*parsed.shards.back(), tagLen - shardBits)) {
+                throw DeserializationError();
+            }
+        }
+        if (in.remaining() != 0) {
+            throw DeserializationError();
+        }
+        return parsed;
+    } catch (PPRFDeserializationError &e) {
+        throw DeserializationError();
+    } catch (InitializationException &e) {
+        throw DeserializationError();
+    }
+}
+
+ShardedPPRF_AEAD_PKW::ShardedPPRF_AEAD_PKW(const SecureByteBuffer &serializedKey)
+    : ShardedPPRF_AEAD_PKW(parse(serializedKey)) {
+}
+
+ShardedPPRF_AEAD_PKW::ShardedPPRF_AEAD_PKW(Parsed parsed)
+    : ShardedPPRF_AEAD_PKW(parsed.tagLen, parsed.keyLen, parsed.shardBits, parsed.prg, std::move(parsed.root)) {
+    for (size_t shard = 0; shard < numShards(); ++shard) {
+        shards[shard].prf = std::move(parsed.shards[shard]);
+    }
+}
+
+std::shared_ptr<AbstractPKW<Tag, ciphertext>> ShardedPPRF_AEAD_PKW_Factory::fromSerialized(SecureByteBuffer &serialized) {
+    return std::make_shared<ShardedPPRF_AEAD_PKW>(serialized);
+}
@@ -0,0 +1,191 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_SHARDED_PPRF_AEAD_PKW_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_SHARDED_PPRF_AEAD_PKW_H
+
+
+#include "../pprf/ggm_pprf.h"
+#include "pkw.h"
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+using ciphertext = std::vector<unsigned char>;
+
+/**
+ * Puncturable Key Wrapping using a PPRF whose tag space is split into 2^shardBits shards by the most significant
+ * shardBits bits of a tag. Each shard is the subtree of the GGM tree below the node given by its shard bits and is
+ * locked independently, such that wrapping, unwrapping and puncturing in different shards run in parallel.
+ * <br>
+ * The key of a shard is derived from the root of the tree when the shard is used for the first time; the root is
+ * punctured on the shard at the same time. Untouched shards thus cost no memory, and a key with a single shard in use
+ * holds the same secrets as an unsharded key. Tags should be allocated round-robin over the shards to spread the load
+ * (see FlatIdProvider).
+ */
+class ShardedPPRF_AEAD_PKW : public AbstractPKW<Tag, ciphertext> {
+    public:
+        /**
+         * the largest supported number of shard bits
+         */
+        static constexpr int MAX_SHARD_BITS = 16;
+
+        /**
+         * Constructs a fresh instance of the PKW.
+         * @param tagLen the size of the tag space in number of bits.
+         * @param keyLen the size of the key space in number of bits.
+         * @param shardBits the number of most significant tag bits selecting the shard
+         * @param prg the PRG used by the underlying PPRF.
+         * @throws InitializationException if shardBits is not in [1, min(tagLen - 1, MAX_SHARD_BITS)]
+         */
+        ShardedPPRF_AEAD_PKW(int tagLen, int keyLen, int shardBits, PRGType prg = PRGType::HKDF_SHA256);
+
+        /**
+         * Reconstructs a previous instance using the serialized key as input.
+         * @param serializedKey the serialized key
+         * @throws DeserializationError if the key is malformed
+         */
+        explicit ShardedPPRF_AEAD_PKW(const SecureByteBuffer &serializedKey);
+
+        ciphertext wrap(Tag tag, std::vector<unsigned char> &header, std::vector<unsigned char> &key) override;
+        std::vector<unsigned char> unwrap(Tag tag, std::vector<unsigned char> &header, ciphertext &c) override;
+
+        /**
+         * Wraps several keys at once. The tags are grouped by shard and each shard derives the parts of the PPRF paths
+         * shared by its tags only once.
+         * @throws IllegalTagException if any of the tags is punctured or invalid; no key is wrapped in this case.
+         */
+        std::vector<ciphertext> wrapBatch(std::span<const Tag> tags, std::span<std::vector<unsigned char>> headers,
+                                          std::span<std::vector<unsigned char>> keys) override;
+
+        /**
+         * Unwraps several keys at once, see wrapBatch.
+         * @throws IllegalTagException if any of the tags is punctured or invalid.
+         */
+        std::vector<std::vector<unsigned char>> unwrapBatch(std::span<const Tag> tags,
+                                                            std::span<std::vector<unsigned char>> headers,
+                                                            std::span<ciphertext> cs) override;
+
+        void punc(Tag tag) override;
+
+        /**
+         * Punctures on several tags, locking each shard once.
+         * @throws IllegalTagException if one of the tags is invalid; the key is not modified in this case.
+         */
+        void puncBatch(std::span<const Tag> tags) override;
+        long getNumPuncs() override;
+        size_t getNumKeyNodes() override;
+        void secureTeardown() override;
+        SecureByteBuffer serializeKey() override;
+        SecureByteBuffer serializeAndEncryptKey(const std::string &password) override;
+
+        /**
+         * @return the number of shards
+         */
+        size_t numShards() const;
+
+        /**
+         * @return the shard of tag, given by its most significant shardBits bits
+         */
+        size_t shardOf(const Tag &tag) const;
+
+        /**
+         * @return the number of shards whose key was derived from the root
+         */
+        size_t usedShards();
+
+        /**
+         * @return statistics on the keys of the root and the shards, combined as if they were a single key: the nodes
+         * of a shard are deeper by shardBits
+         */
+        KeyStats keyStats();
+
+    private:
+        struct Shard {
+            std::shared_mutex mutex;
+            /**
+             * the PPRF on the tags of the shard without their shard bits, empty until the shard is used
+             */
+            std::optional<GGM_PPRF> prf;
+        };
+
+        int tagLen;
+        int keyLen;
+        int shardBits;
+        PRGType prg;
+        /**
+         * the PPRF on the shard bits, whose outputs are the roots of the shards
+         */
+        GGM_PPRF root;
+        std::mutex rootMutex;
+        std::unique_ptr<Shard[]> shards;
+
+        /**
+         * the contents of a serialized key
+         */
+        struct Parsed {
+            int tagLen;
+            int keyLen;
+            int shardBits;
+            PRGType prg;
+            GGM_PPRF root;
+            std::vector<std::optional<GGM_PPRF>> shards;
+        };
+
+        ShardedPPRF_AEAD_PKW(int tagLen, int keyLen, int shardBits, PRGType prg, GGM_PPRF root);
+        explicit ShardedPPRF_AEAD_PKW(Parsed parsed);
+        static Parsed parse(const SecureByteBuffer &serialized);
+        Tag localTag(const Tag &tag) const;
+        void checkTag(const Tag &tag) const;
+        /**
+         * Derives the key of the shard from the root, if it was not derived yet. The caller holds the lock of the shard
+         * exclusively.
+         */
+        void deriveShard(size_t shard);
+        /**
+         * @return f(const GGM_PPRF &) of the shard, called holding the lock of the shard shared (exclusively if the
+         * shard has to be derived first)
+         */
+        template<class F>
+        auto readShard(size_t shard, F f);
+        /**
+         * Calls f(GGM_PPRF &) of the shard holding the lock of the shard exclusively.
+         */
+        template<class F>
+        void modifyShard(size_t shard, F f);
+        /**
+         * @return the wrapping keys of the tags
+         * @throws IllegalTagException if any of the tags is punctured or invalid
+         */
+        std::vector<SecureByteBuffer> evalBatch(std::span<const Tag> tags);
+        /**
+         * @return the indices of the tags, grouped by shard
+         */
+        std::vector<std::vector<size_t>> groupByShard(std::span<const Tag> tags) const;
+};
+
+class ShardedPPRF_AEAD_PKW_Factory : public AbstractPKWFactory<Tag, ciphertext> {
+    public:
+        std::shared_ptr<AbstractPKW<Tag, ciphertext>> fromSerialized(SecureByteBuffer &serialized) override;
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_SHARDED_PPRF_AEAD_PKW_H
@@ -0,0 +1,142 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_BYTE_CURSOR_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_BYTE_CURSOR_H
+
+#include "../secure_byte_buffer.h"
+#include "pprf_exceptions.h"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+
+/**
+ * A cursor over a serialized key. Every read is bounds-checked and throws a PPRFDeserializationError if the input is
+ * too short; the read bytes are returned as views into the input.
+ */
+class ByteReader {
+    public:
+        explicit ByteReader(std::span<const uint8_t> bytes, size_t offset = 0) : bytes(bytes), offset(offset) {}
+
+        uint64_t readUInt64() { return readBigEndian<uint64_t>(); }
+
+        uint32_t readUInt32() { return readBigEndian<uint32_t>(); }
+
+        uint8_t readByte() { return readBytes(1)[0]; }
+
+        /**
+         * Reads an unsigned integer encoded in 7 bit groups, least significant group first, where the highest bit of
+         * a byte marks that another byte follows.
+         */
+        uint64_t readVarInt() {
+            uint64_t ret = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                uint8_t byte = readByte();
+                ret |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0) {
+                    return ret;
+                }
+            }
+            throw PPRFDeserializationError();
+        }
+
+        std::span<const uint8_t> readBytes(size_t n) {
+            if (n > remaining()) {
+                throw PPRFDeserializationError();
+            }
+            std::span<const uint8_t> ret = bytes.subspan(offset, n);
+            offset += n;
+            return ret;
+        }
+
+        size_t position() const { return offset; }
+
+        size_t remaining() const { return bytes.size() - offset; }
+
+    private:
+        std::span<const uint8_t> bytes;
+        size_t offset;
+
+        template<class T>
+        T readBigEndian() {
+            T ret = 0;
+            for (uint8_t byte: readBytes(sizeof(T))) {
+                ret = (ret << 8) | byte;
+            }
+            return ret;
+        }
+};
+
+/**
+ * Writes into a buffer whose size was computed beforehand, such that the buffer never has to grow.
+ */
+class ByteWriter {
+    public:
+        explicit ByteWriter(SecureByteBuffer &buffer) : begin(buffer.data()), out(buffer.data()) {}
+
+        void writeUInt64(uint64_t i) { writeBigEndian(i); }
+
+        void writeUInt32(uint32_t i) { writeBigEndian(i); }
+
+        void writeByte(uint8_t b) { *out++ = b; }
+
+        void writeVarInt(uint64_t i) {
+            while (i >= 0x80) {
+                *out++ = (i & 0x7F) | 0x80;
+                i >>= 7;
+            }
+            *out++ = i;
+        }
+
+        static size_t varIntSize(uint64_t i) {
+            size_t size = 1;
+            while (i >= 0x80) {
+                i >>= 7;
+                ++size;
+            }
+            return size;
+        }
+
+        void writeBytes(const unsigned char *bytes, size_t n) { out = std::copy_n(bytes, n, out); }
+
+        /**
+         * Reserves the next n bytes, which the caller writes directly.
+         */
+        unsigned char *skip(size_t n) {
+            unsigned char *ret = out;
+            out += n;
+            return ret;
+        }
+
+        size_t position() const { return out - begin; }
+
+    private:
+        unsigned char *begin;
+        unsigned char *out;
+
+        template<class T>
+        void writeBigEndian(T i) {
+            for (int shift = 8 * (sizeof(T) - 1); shift >= 0; shift -= 8) {
+                *out++ = (i >> shift) & 0xFF;
+            }
+        }
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_BYTE_CURSOR_H
@@ -0,0 +1,144 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#include "compact_key_view.h"
+#include "../secure_memzero.h"
+#include "pprf_exceptions.h"
+#include "pprf_key_serializer.h"
+#include <sys/mman.h>
+
+namespace {
+    /**
+     * @return whether prefix is not greater than path in lexicographic order, where a prefix precedes its extensions
+     */
+    bool notGreater(const BitPrefix &prefix, const BitPrefix &path, bool &isPrefix) {
+        size_t common = prefix.commonPrefixLength(path);
+        isPrefix = common == prefix.size();
+        return isPrefix || (common < path.size() && !prefix[common]);
+    }
+}// namespace
+
+bool CompactKeyView::isCompact(std::span<const uint8_t> serialized) {
+    ByteReader in(serialized);
+    return in.remaining() >= sizeof(uint64_t) && in.readUInt64() == (PPRFKeySerializer::FORMAT_MAGIC | FORMAT_VERSION);
+}
+
+CompactKeyView::CompactKeyView(std::span<const uint8_t> serialized) : serialized(serialized) {
+    readHeader();
+}
+
+CompactKeyView::CompactKeyView(SecureByteBuffer serialized) {
+    auto *buffer = new SecureByteBuffer(std::move(serialized));
+    const bool locked = mlock(buffer->data(), buffer->size()) == 0;
+    owned = std::shared_ptr<const SecureByteBuffer>(buffer, [locked](const SecureByteBuffer *b) {
+        if (locked) {
+            /* erase the key before the memory can be swapped out */
+            secure_memzero(const_cast<unsigned char *>(b->data()), b->size());
+            munlock(b->data(), b->size());
+        }
+        delete b;
+    });
+    this->serialized = std::span<const uint8_t>(owned->data(), owned->size());
+    readHeader();
+}
+
+void CompactKeyView::readHeader() {
+    ByteReader in(serialized);
+    if (in.readUInt64() != (PPRFKeySerializer::FORMAT_MAGIC | FORMAT_VERSION)) {
+        throw PPRFDeserializationError();
+    }
+    PPRFKeySerializer::readPRGWord(in.readUInt64(), prgType, arityLog, maxTagBits);
+    tagBits = static_cast<int>(in.readUInt64());
+    keyBits = static_cast<int>(in.readUInt64());
+    numPuncs = static_cast<int>(in.readUInt64());
+    numNodes = in.readUInt64();
+    indexInterval = in.readUInt64();
+    if (keyBits < 0 || indexInterval == 0 || tagBits % arityLog != 0 ||
+        (maxTagBits != 0 && (maxTagBits < tagBits || maxTagBits % arityLog != 0))) {
+        throw PPRFDeserializationError();
+    }
+    const uint64_t indexEntries = numNodes == 0 ? 0 : (numNodes - 1) / indexInterval + 1;
+    if (indexEntries > in.remaining() / sizeof(uint64_t)) {
+        throw PPRFDeserializationError();
+    }
+    indexOffset = in.position();
+    nodesOffset = indexOffset + indexEntries * sizeof(uint64_t);
+    /* the binary search relies on an increasing index */
+    for (size_t i = 0; i < indexEntries; ++i) {
+        size_t entry = indexEntry(i);
+        if ((i == 0 && entry != 0) || (i > 0 && entry <= indexEntry(i - 1)) || entry >= serialized.size() - nodesOffset) {
+            throw PPRFDeserializationError();
+        }
+    }
+}
+
+size_t CompactKeyView::indexEntry(size_t i) const {
+    return ByteReader(serialized, indexOffset + i * sizeof(uint64_t)).readUInt64();
+}
+
+size_t CompactKeyView::findPrefixOf(const BitPrefix &path, size_t &depth) const {
+    const size_t indexEntries = numNodes == 0 ? 0 : (numNodes - 1) / indexInterval + 1;
+    BitPrefix prefix;
+    bool isPrefix;
+    /* find the last indexed node not greater than path */
+    size_t lo = 0;
+    size_t hi = indexEntries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        ByteReader in(serialized, nodesOffset + indexEntry(mid));
+        readNode(in, prefix, true);
+        if (notGreater(prefix, path, isPrefix)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NONE;
+    }
+    /* then the last node not greater than path in its block, which is the only candidate for a prefix of path */
+    const uint64_t first = (lo - 1) * indexInterval;
+    const uint64_t end = std::min(numNodes, first + indexInterval);
+    ByteReader in(serialized, nodesOffset + indexEntry(lo - 1));
+    size_t found = NONE;
+    for (uint64_t i = first; i < end; ++i) {
+        const uint8_t *value = readNode(in, prefix, i == first);
+        if (!notGreater(prefix, path, isPrefix)) {
+            break;
+        }
+        found = isPrefix ? value - serialized.data() : NONE;
+        depth = prefix.size();
+    }
+    return found;
+}
+
+const uint8_t *CompactKeyView::readNode(ByteReader &in, BitPrefix &prefix, bool indexed) const {
+    uint64_t shared = in.readVarInt();
+    uint64_t further = in.readVarInt();
+    if (shared > prefix.size() || (indexed && shared != 0) || further > in.remaining() * 8) {
+        throw PPRFDeserializationError();
+    }
+    std::span<const uint8_t> bits = in.readBytes((further + 7) / 8);
+    prefix.truncate(shared);
+    for (uint64_t i = 0; i < further; ++i) {
+        prefix.push_back((bits[i / 8] >> (7 - i % 8)) & 1);
+    }
+    return in.readBytes(keyBits / 8).data();
+}
@@ -0,0 +1,155 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_COMPACT_KEY_VIEW_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_COMPACT_KEY_VIEW_H
+
+#include "../secure_byte_buffer.h"
+#include "byte_cursor.h"
+#include "ggm_prg.h"
+#include "node_store.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+
+/**
+ * Read access to a key serialized in the compact format, without parsing it. The nodes are stored sorted by their
+ * prefixes, each prefix bit-packed and front-coded against the prefix of the previous node:
+ * <br>
+ * magic and format version | PRG id and tree shape | tagLen | keyLen | puncs | number of nodes | index interval | index | nodes
+ * (bits shared with the previous prefix | number of further bits | further bits, packed | value)
+ * <br>
+ * where the bit counts are variable-length integers. Every index interval-th node shares no bits with its predecessor
+ * and the index holds the offsets of these nodes relative to the first node, such that the node matching a tag is
+ * found by a binary search over the index followed by a scan of at most index interval nodes.
+ * <br>
+ * The nodes of a GGM key are prefix-free, i.e. the node a tag can be derived from is the last node whose prefix is not
+ * greater than the tag.
+ */
+class CompactKeyView {
+    public:
+        static constexpr uint64_t FORMAT_VERSION = 2;
+        static constexpr uint64_t INDEX_INTERVAL = 64;
+
+        /**
+         * @return whether the serialized key is in the compact format
+         */
+        static bool isCompact(std::span<const uint8_t> serialized);
+
+        /**
+         * Reads the header and the index of a key serialized in the compact format. The view does not own the key.
+         * @throws PPRFDeserializationError if the header or the index are malformed
+         */
+        explicit CompactKeyView(std::span<const uint8_t> serialized);
+
+        /**
+         * Takes ownership of a key serialized in the compact format. The memory holding the key is locked, if the
+         * limits of the process allow for it, such that it is not written to swap.
+         * @throws PPRFDeserializationError if the header or the index are malformed
+         */
+        explicit CompactKeyView(SecureByteBuffer serialized);
+
+        int keyLen() const { return keyBits; }
+
+        int tagLen() const { return tagBits; }
+
+        int puncs() const { return numPuncs; }
+
+        PRGType prg() const { return prgType; }
+
+        /**
+         * @return log2 of the arity of the GGM tree
+         */
+        int arityBits() const { return arityLog; }
+
+        /**
+         * @return the tag length up to which the tree may grow, 0 if it is fixed
+         */
+        int maxTagLen() const { return maxTagBits; }
+
+        /**
+         * @return the number of nodes of the key
+         */
+        size_t size() const { return numNodes; }
+
+        /**
+         * @return the serialized key
+         */
+        std::span<const uint8_t> bytes() const { return serialized; }
+
+        /**
+         * Finds the node of the key which is a prefix of path.
+         * @param path the path, e.g. the bits of a tag
+         * @param depth set to the length of the prefix of the node found
+         * @return the offset of the value of the node in the serialized key, or NONE if no node is a prefix of path
+         * @throws PPRFDeserializationError if the nodes are malformed
+         */
+        size_t findPrefixOf(const BitPrefix &path, size_t &depth) const;
+
+        /**
+         * @return the value at an offset returned by findPrefixOf
+         */
+        const uint8_t *valueAt(size_t offset) const { return serialized.data() + offset; }
+
+        /**
+         * Calls f(const BitPrefix &prefix, const unsigned char *value) for each node, in the order of the prefixes.
+         * @throws PPRFDeserializationError if the nodes are malformed
+         */
+        template<class F>
+        void forEach(F f) const {
+            ByteReader in(serialized, nodesOffset);
+            BitPrefix prefix;
+            for (uint64_t i = 0; i < numNodes; ++i) {
+                f(static_cast<const BitPrefix &>(prefix), readNode(in, prefix, i % indexInterval == 0));
+            }
+            if (in.remaining() != 0) {
+                throw PPRFDeserializationError();
+            }
+        }
+
+        static constexpr size_t NONE = SIZE_MAX;
+
+    private:
+        std::shared_ptr<const SecureByteBuffer> owned;
+        std::span<const uint8_t> serialized;
+        int keyBits;
+        int tagBits;
+        int numPuncs;
+        PRGType prgType;
+        int arityLog;
+        int maxTagBits;
+        uint64_t numNodes;
+        uint64_t indexInterval;
+        size_t indexOffset;
+        size_t nodesOffset;
+
+        void readHeader();
+        size_t indexEntry(size_t i) const;
+
+        /**
+         * Reads the node at the position of in, replacing prefix by the prefix of the node.
+         * @param indexed whether the node is referenced by the index, i.e. does not share bits with its predecessor
+         * @return the value of the node
+         */
+        const uint8_t *readNode(ByteReader &in, BitPrefix &prefix, bool indexed) const;
+};
+
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_COMPACT_KEY_VIEW_H
@@ -0,0 +1,124 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+#include "eval_cursor.h"
+#include "../secure_memzero.h"
+#include "ggm_prg.h"
+#include "pprf_exceptions.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+    /**
+     * @return the index of the most significant bit in which a and b differ, or MAX_TAG_LEN if they are equal
+     */
+    size_t highestDifference(const Tag &a, const Tag &b) {
+        const Tag diff = a ^ b;
+        for (size_t w = MAX_TAG_LEN / 64; w-- > 0;) {
+            const uint64_t word = ((diff >> (64 * w)) & Tag(UINT64_MAX)).to_ullong();
+            if (word != 0) {
+                return 64 * w + 63 - std::countl_zero(word);
+            }
+        }
+        return MAX_TAG_LEN;
+    }
+
+    /**
+     * @return the length of the common prefix of two tags of length tagLen
+     */
+    size_t commonPrefix(const Tag &a, const Tag &b, size_t tagLen) {
+        const size_t highest = highestDifference(a, b);
+        return highest == MAX_TAG_LEN ? tagLen : tagLen - 1 - highest;
+    }
+
+    bool less(const Tag &a, const Tag &b) {
+        const size_t highest = highestDifference(a, b);
+        return highest != MAX_TAG_LEN && b[highest];
+    }
+}// namespace
+
+SecureByteBuffer EvalCursor::eval(const GGM_PPRF &prf, const Tag &tag) {
+    const PPRFKey &key = prf.key;
+    if ((tag >> key.tagLen).any()) {
+        throw TagException();
+    }
+    if (key.arityBits > 1) {
+        /* the path is only kept for binary trees */
+        return prf.eval(tag);
+    }
+    if (valid && (tagLen != static_cast<size_t>(key.tagLen) || valueLen != static_cast<size_t>(key.keyLen / 8) ||
+                  prg != key.prg)) {
+        reset();
+    }
+    size_t depth = valid ? commonPrefix(tag, this->tag, tagLen) : 0;
+    if (!valid || depth < anchorDepth) {
+        SecureByteBuffer anchor = prf.matchingNode(tag, depth);
+        reset();
+        tagLen = key.tagLen;
+        valueLen = key.keyLen / 8;
+        prg = key.prg;
+        if (path.size() != (tagLen + 1) * valueLen) {
+            path = SecureByteBuffer((tagLen + 1) * valueLen);
+        }
+        std::copy_n(anchor.data(), valueLen, node(depth));
+        anchorDepth = depth;
+        stats_.anchors++;
+    }
+
+    /* the path is inconsistent until all nodes below the common prefix are derived */
+    valid = false;
+    this->tag = tag;
+    const GGM_PRG &gen = GGM_PRG::forType(prg);
+    for (size_t d = depth; d < tagLen; ++d) {
+        gen.deriveChild(node(d), valueLen, tag[tagLen - 1 - d], node(d + 1));
+    }
+    valid = true;
+    stats_.derivations += tagLen - depth;
+
+    SecureByteBuffer res(valueLen);
+    std::copy_n(node(tagLen), valueLen, res.data());
+    return res;
+}
+
+void EvalCursor::invalidate(const Tag &tag) {
+    if (valid && !(tag >> tagLen).any() && commonPrefix(tag, this->tag, tagLen) >= anchorDepth) {
+        reset();
+    }
+}
+
+void EvalCursor::invalidate(const Tag &lo, const Tag &hi) {
+    if (!valid) {
+        return;
+    }
+    /* the tags derivable from the path are those in the subtree of its first node */
+    const Tag subtree = Tag().set() >> (MAX_TAG_LEN - (tagLen - anchorDepth));
+    const Tag first = this->tag & ~subtree;
+    const Tag last = first | subtree;
+    if (!less(hi, first) && !less(last, lo)) {
+        reset();
+    }
+}
+
+void EvalCursor::reset() {
+    if (path.size() > 0) {
+        secure_memzero(path.data(), path.size());
+    }
+    tag.reset();
+    valid = false;
+}
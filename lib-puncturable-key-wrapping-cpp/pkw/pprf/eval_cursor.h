@@ -0,0 +1,91 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_EVAL_CURSOR_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_EVAL_CURSOR_H
+
+#include "../secure_byte_buffer.h"
+#include "ggm_pprf.h"
+#include <cstdint>
+
+/**
+ * Keeps the path from a node of the key to the last evaluated leaf of a GGM_PPRF, like an iterator over the GGM tree.
+ *
+ * An evaluation on a tag sharing a prefix with the previous tag below the node of the key only derives the nodes after
+ * the shared prefix. Evaluating consecutive tags, as handed out by sequential allocation, thus takes two derivations
+ * per tag on average instead of tagLen.
+ * <br>
+ * The path holds secret material: whenever the PPRF is punctured, the cursor has to be invalidated if a punctured tag
+ * can be derived from it (see invalidate). The path is kept in a single buffer that is zeroed on invalidation.
+ * <br>
+ * Keys of a tree of higher arity are evaluated without a path, as with GGM_PPRF::eval.
+ * <br>
+ * The cursor is not thread-safe.
+ */
+class EvalCursor {
+    public:
+        struct Stats {
+            /* evaluations starting from a node of the key */
+            uint64_t anchors = 0;
+            uint64_t derivations = 0;
+        };
+
+        /**
+         * Evaluates prf on tag, reusing the path of the previous evaluation if it was made on the same key.
+         * @param prf the PPRF, which must not have been punctured on a tag derivable from the path since the previous
+         * evaluation without invalidating the cursor
+         * @param tag the tag
+         * @return the value of the PPRF on tag
+         * @throws TagException if the PPRF was punctured on tag or the size of the tag exceeds the key's tag length
+         */
+        SecureByteBuffer eval(const GGM_PPRF &prf, const Tag &tag);
+
+        /**
+         * Erases the path if tag can be derived from it.
+         */
+        void invalidate(const Tag &tag);
+
+        /**
+         * Erases the path if any tag in [lo, hi] can be derived from it.
+         */
+        void invalidate(const Tag &lo, const Tag &hi);
+
+        /**
+         * Erases the path.
+         */
+        void reset();
+
+        Stats stats() const { return stats_; }
+
+    private:
+        /* path[d] holds the node at depth d on the path to tag, for anchorDepth <= d <= tagLen */
+        SecureByteBuffer path;
+        Tag tag;
+        size_t tagLen = 0;
+        size_t valueLen = 0;
+        size_t anchorDepth = 0;
+        PRGType prg = PRGType::HKDF_SHA256;
+        bool valid = false;
+        Stats stats_;
+
+        unsigned char *node(size_t depth) { return path.data() + depth * valueLen; }
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_EVAL_CURSOR_H
@@ -19,122 +19,225 @@
  **********************************************************************************************************************/
 
 #include "ggm_hpprf.h"
+#include "ggm_prg.h"
 #include "pprf_exceptions.h"
 #include "pprf_key_serializer.h"
-#include <cryptopp/hkdf.h>
-#include <cryptopp/sha.h>
-#include <deque>
-
-static const std::vector<unsigned char> RIGHT({'r'});
-static const std::vector<unsigned char> LEFT({'l'});
-static const std::vector<unsigned char> OUT({'o'});
+#include <algorithm>
+#include <mutex>
+#include <numeric>
 
 GGM_HPPRF::GGM_HPPRF(PPRFKey key) : key(std::move(key)) {
 }
 
-SecureByteBuffer GGM_HPPRF::eval(Tag tag) {
-    std::string nodePrefix = findMatchingPrefix(tag);
-    SecretRoot &node = key.nodes[nodePrefix];
+GGM_HPPRF GGM_HPPRF::dryRun(int keyLen) {
+    return GGM_HPPRF(PPRFKey::structureOnly(keyLen, 1));
+}
+
+SecureByteBuffer GGM_HPPRF::eval(Tag tag) const {
+    size_t depth;
+    NodeStore::Handle node = findMatchingNode(tag, depth);
 
-    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
-    SecureByteBuffer res(node.getValue());
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+    SecureByteBuffer res(key.nodes.getValue(node));
+    auto bitAt = [&tag](size_t i) { return tag[i]; };
+    cache.use([&](NodeCache &c) {
+        size_t cachedDepth;
+        NodeStore::Handle cached = c.lookup(tag.size(), bitAt, cachedDepth);
+        if (cached != NodeStore::NONE && cachedDepth > depth) {
+            res = c.getValue(cached);
+            depth = cachedDepth;
+        }
+    });
+    /* the derivation runs without holding the lock of the cache */
     SecureByteBuffer derived(res);
-    for (size_t i = node.getPrefix().size(); i < tag.size(); i++) {
-        const std::vector<unsigned char> &direction = tag[i] ? RIGHT : LEFT;
-        hkdf.DeriveKey(derived.data(), derived.size(), res.data(), res.size(), nullptr, 0, direction.data(),
-                       direction.size());
+    std::vector<SecureByteBuffer> path;
+    for (size_t i = depth; i < tag.size(); i++) {
+        prg.deriveChild(res.data(), res.size(), tag[i], derived.data());
         res = derived;
+        if (cache) {
+            path.push_back(res);
+        }
     }
+    /* the cache may have changed since the lookup, so the path is walked from the root */
+    cache.use([&](NodeCache &c) { c.insertPath(bitAt, depth + 1, path); });
 //    Before output of the value, we need to derive one more time, so as not to leak internal GGM state
-    hkdf.DeriveKey(derived.data(), derived.size(), res.data(), res.size(), nullptr, 0, OUT.data(),
-                   OUT.size());
+    prg.deriveOutput(res.data(), res.size(), derived.data());
     res = derived;
     return res;
 }
 
-std::string GGM_HPPRF::findMatchingPrefix(const Tag &tag) {
-    std::string tagString = tag_to_string(tag);
-    for (int i = 0; i <= tagString.size(); ++i) {
-        std::string prefix = tagString.substr(0, i);
-        if (key.nodes.count(prefix) > 0) {
-            return prefix;
+std::vector<SecureByteBuffer> GGM_HPPRF::evalBatch(std::span<const Tag> tags) const {
+    std::vector<SecureByteBuffer> res(tags.size());
+    visitLeaves(tags, false, [&res](size_t i, const SecureByteBuffer &value) { res[i] = value; });
+    return res;
+}
+
+void GGM_HPPRF::forEachLiveLeaf(std::span<const Tag> tags, const LeafVisitor &visit) const {
+    visitLeaves(tags, true, visit);
+}
+
+void GGM_HPPRF::visitLeaves(std::span<const Tag> tags, bool skipPunctured, const LeafVisitor &visit) const {
+    std::vector<size_t> order(tags.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&tags](size_t a, size_t b) { return tags[a] < tags[b]; });
+
+    /* the children of the nodes on the current path, two per depth, and the output of the current node, such that no
+     * node is allocated while traversing; the tags are not bounded by the tag length of the key */
+    size_t maxLen = 0;
+    for (const Tag &tag: tags) {
+        maxLen = std::max(maxLen, tag.size());
+    }
+    std::vector<SecureByteBuffer> scratch(2 * maxLen + 1, SecureByteBuffer(key.keyLen / 8));
+    size_t begin = 0;
+    while (begin < order.size()) {
+        size_t depth;
+        NodeStore::Handle node;
+        try {
+            node = findMatchingNode(tags[order[begin]], depth);
+        } catch (TagException &e) {
+            if (!skipPunctured) {
+                throw;
+            }
+            ++begin;
+            continue;
+        }
+        /* the tags below node form a contiguous range of the sorted tags, those sharing its prefix */
+        const Tag &first = tags[order[begin]];
+        auto below = [&tags, &first, depth](size_t i) {
+            return tags[i].size() >= depth && std::equal(first.begin(), first.begin() + depth, tags[i].begin());
+        };
+        size_t end = std::partition_point(order.begin() + begin + 1, order.end(), below) - order.begin();
+        evalSubtree(key.nodes.getValue(node), depth, tags, order, begin, end, scratch, visit);
+        begin = end;
+    }
+}
+
+void GGM_HPPRF::evalSubtree(const SecureByteBuffer &value, size_t depth, std::span<const Tag> tags,
+                            const std::vector<size_t> &order, size_t begin, size_t end,
+                            std::vector<SecureByteBuffer> &scratch, const LeafVisitor &visit) const {
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+    /* tags ending at this node are ordered before their extensions */
+    if (tags[order[begin]].size() == depth) {
+        SecureByteBuffer &out = scratch.back();
+        prg.deriveOutput(value.data(), value.size(), out.data());
+        while (begin < end && tags[order[begin]].size() == depth) {
+            visit(order[begin++], out);
         }
     }
-    throw TagException();
+    if (begin == end) {
+        return;
+    }
+    size_t mid = std::partition_point(order.begin() + begin, order.begin() + end,
+                                      [&tags, depth](size_t i) { return !tags[i][depth]; }) -
+                 order.begin();
+    SecureByteBuffer &left = scratch[2 * depth];
+    SecureByteBuffer &right = scratch[2 * depth + 1];
+    if (mid > begin && mid < end) {
+        prg.expand(value.data(), value.size(), left.data(), right.data());
+    } else if (mid > begin) {
+        prg.deriveChild(value.data(), value.size(), false, left.data());
+    } else {
+        prg.deriveChild(value.data(), value.size(), true, right.data());
+    }
+    if (mid > begin) {
+        evalSubtree(left, depth + 1, tags, order, begin, mid, scratch, visit);
+    }
+    if (mid < end) {
+        evalSubtree(right, depth + 1, tags, order, mid, end, scratch, visit);
+    }
+}
+
+NodeStore::Handle GGM_HPPRF::findMatchingNode(const Tag &tag, size_t &depth) const {
+    NodeStore::Handle node = key.nodes.findLongestPrefix(tag.size(), [&tag](size_t i) { return tag[i]; }, depth);
+    if (node == NodeStore::NONE) {
+        throw TagException();
+    }
+    return node;
 }
 
 void GGM_HPPRF::punc(const Tag &tag) {
-    std::string nodeIndex;
+    /* the cached nodes on the path and below the punctured node */
+    cache.modify([&tag](NodeCache &c) { c.evict(tag.size(), [&tag](size_t i) { return tag[i]; }); });
+    size_t depth;
+    NodeStore::Handle node;
     try {
-        nodeIndex = findMatchingPrefix(tag);
+        node = findMatchingNode(tag, depth);
     } catch (TagException &t) {
         /* Could be hierarchichal puncture: remove all nodes from key with tag as prefix */
-        auto tag_string = tag_to_string(tag);
-        std::erase_if(key.nodes, [&tag_string](const auto &item) {
-            return item.first.starts_with(tag_string);
-        });
+        NodeStore::Handle subtree = key.nodes.find(tag.size(), [&tag](size_t i) { return tag[i]; });
+        if (subtree != NodeStore::NONE) {
+            key.nodes.eraseSubtree(subtree);
+        }
         return; /* already punctured */
     }
 
-    SecretRoot &node = key.nodes[nodeIndex];
     key.puncs += 1;
-    std::vector<SecretRoot> coPath;
-    evalAndGetCoPath(tag, node, coPath);
-    key.nodes.erase(nodeIndex);
-    for (auto &n: coPath) {
-        key.nodes.insert({n.getPrefix(), {n.getPrefix(), n.getValue()}});
-    }
+    SecureByteBuffer coPath = evalCoPath(tag, node, depth);
+    key.nodes.replaceByCoPath(node, depth, tag.size(), [&tag](size_t i) { return tag[i]; }, coPath.data());
 }
 
-SecureByteBuffer
-GGM_HPPRF::evalAndGetCoPath(const Tag &tag, const SecretRoot &node, std::vector<SecretRoot> &coPath) const {
-    const int keyLenByte = key.keyLen / 8;
-    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
-
-    std::deque<SecretRoot> left;
-    std::deque<SecretRoot> right;
+SecureByteBuffer GGM_HPPRF::evalCoPath(const Tag &tag, NodeStore::Handle node, size_t depth) const {
+    const size_t len = key.keyLen / 8;
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
 
-    SecureByteBuffer curr(node.getValue());
-    SecureByteBuffer derived_right(keyLenByte);
-    SecureByteBuffer derived_left(keyLenByte);
-    std::string pref = node.getPrefix();
-    for (size_t i = node.getPrefix().size(); i < tag.size(); i++) {
-        hkdf.DeriveKey(derived_right.data(), derived_right.size(), curr.data(), curr.size(), nullptr, 0, RIGHT.data(),
-                       RIGHT.size());
-        hkdf.DeriveKey(derived_left.data(), derived_left.size(), curr.data(), curr.size(), nullptr, 0, LEFT.data(),
-                       LEFT.size());
+    SecureByteBuffer buffers[2] = {key.nodes.getValue(node), SecureByteBuffer(len)};
+    unsigned char *curr = buffers[0].data();
+    unsigned char *next = buffers[1].data();
+    SecureByteBuffer coPath((tag.size() - depth) * len);
+    for (size_t i = depth; i < tag.size(); i++) {
+        unsigned char *sibling = coPath.data() + (i - depth) * len;
         if (tag[i]) {
-            left.emplace_back(pref + "0", derived_left);
-            curr = derived_right;
-            pref += "1";
+            prg.expand(curr, len, sibling, next);
         } else {
-            right.emplace_front(pref + "1", derived_right);
-            curr = derived_left;
-            pref += "0";
+            prg.expand(curr, len, next, sibling);
         }
+        std::swap(curr, next);
     }
-    coPath.insert(coPath.end(), left.begin(), left.end());
-    coPath.insert(coPath.end(), right.begin(), right.end());
-    return curr;
+    return coPath;
+}
+
+void GGM_HPPRF::trackChanges() {
+    key.nodes.trackChanges(true);
+}
+
+SecureByteBuffer GGM_HPPRF::takeDelta() {
+    return key.takeDelta();
+}
+
+void GGM_HPPRF::applyDelta(const SecureByteBuffer &delta) {
+    cache.clear();
+    key.applyDelta(delta);
 }
 
-int GGM_HPPRF::getNumPuncs() {
+void GGM_HPPRF::enableCache(size_t memoryBudget) {
+    cache = SharedNodeCache(key.keyLen / 8, memoryBudget);
+}
+
+void GGM_HPPRF::disableCache() {
+    cache = SharedNodeCache();
+}
+
+KeyStats GGM_HPPRF::keyStats() const {
+    return KeyStats::fromHistogram(key.tagLen, key.nodes.depthHistogram(),
+                                   key.nodes.residentBytes() + cacheStats().bytes);
+}
+
+NodeCache::Stats GGM_HPPRF::cacheStats() const {
+    return cache.stats();
+}
+
+int GGM_HPPRF::getNumPuncs() const {
     return key.puncs;
 }
 
-int GGM_HPPRF::tagLen() {
+int GGM_HPPRF::tagLen() const {
     return key.tagLen;
 }
 
-SecureByteBuffer GGM_HPPRF::serializeKey() {
+SecureByteBuffer GGM_HPPRF::serializeKey() const {
     return key.serialize();
 }
 
-std::string GGM_HPPRF::tag_to_string(const Tag &tag) {
-    std::string ret;
-    ret.reserve(tag.size());
-    for (auto i: tag) {
-        ret.append(i ? "1" : "0");
-    }
-    return ret;
-}
\ No newline at end of file
+size_t GGM_HPPRF::serializedKeySize() const {
+    return PPRFKeySerializer(key).serializedSize();
+}
@@ -23,7 +23,12 @@
 
 #include "../secure_byte_buffer.h"
 #include "ggm_pprf_key.h"
+#include "key_stats.h"
+#include "node_cache.h"
 #include <bitset>
+#include <functional>
+#include <optional>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -36,9 +41,17 @@ using byte = unsigned char;
  *
  * <div class="csl-entry">Goldreich, O., Goldwasser, S., &#38; Micali, S. (1986). How to construct random functions. <i>Journal of the ACM (JACM)</i>, <i>33</i>(4), 792–807. https://doi.org/10.1145/6490.6503</div>
 * <br>
+ * The const member functions, e.g. eval, may be called concurrently. Modifications must not run concurrently with any
+ * other call; to keep evaluating while the key is punctured, puncture a copy and publish it once done: copies share
+ * the nodes of the key until either of them modifies them.
  */
 class GGM_HPPRF {
     public:
+        /**
+         * Receives the index of a tag and the evaluation of the HPPRF on it.
+         */
+        using LeafVisitor = std::function<void(size_t, const SecureByteBuffer &)>;
+
         /**
          * Punctures the HPPRF on tag. If tag was already punctured on, no exception is thrown.
          * @param tag the tag on which the HPPRF is to be punctured
@@ -52,7 +65,25 @@ class GGM_HPPRF {
          * @return a SecureByteBuffer
          * @throws IllegalTagException if the HPPRF was punctured on tag or the size of the tag exceeds the key's tag length.
          */
-        SecureByteBuffer eval(Tag tag);
+        SecureByteBuffer eval(Tag tag) const;
+
+        /**
+         * Evaluates the HPPRF on several tags. The tags are sorted and the tree is traversed depth-first, such that each
+         * node on the paths to the tags is derived only once.
+         * @param tags the tags
+         * @return the results of the evaluations, in the order of the tags
+         * @throws IllegalTagException if the HPPRF was punctured on one of the tags.
+         */
+        std::vector<SecureByteBuffer> evalBatch(std::span<const Tag> tags) const;
+
+        /**
+         * Visits the outputs of several tags in one depth-first traversal of the tree, such that each node on the paths
+         * to the tags is derived only once; unlike evalBatch, tags the HPPRF was punctured on, or on a prefix of, are
+         * skipped. The outputs are visited in ascending order of the tags and are not kept.
+         * @param tags the tags
+         * @param visit called with the index of each tag the HPPRF was not punctured on and the evaluation on it
+         */
+        void forEachLiveLeaf(std::span<const Tag> tags, const LeafVisitor &visit) const;
 
         /**
          * Constructs a HPPRF instance using the key.
@@ -60,33 +91,100 @@ class GGM_HPPRF {
          */
         explicit GGM_HPPRF(PPRFKey key);
 
+        /**
+         * Constructs a HPPRF which keeps only the structure of its key and derives no node, see GGM_PPRF::dryRun.
+         * @param keyLen the size of the key space in number of bits
+         * @return the HPPRF
+         */
+        static GGM_HPPRF dryRun(int keyLen);
+
         /**
          * Getter for number of punctures performed on the HPPRF.
          * @return number of punctures
          */
-        int getNumPuncs();
+        int getNumPuncs() const;
 
         /**
          * Getter the tag length of HPPRF
          * @return tag length
          */
-        int tagLen();
+        int tagLen() const;
 
         /**
          * Serializes the key.
          * @return a secureByteBuffer holding the serialized key.
          */
-        SecureByteBuffer serializeKey();
+        SecureByteBuffer serializeKey() const;
+
+        /**
+         * @return the size of serializeKey() in bytes, computed without serializing the key
+         */
+        size_t serializedKeySize() const;
+
+        /**
+         * Starts recording the changes made to the key by punctures, such that the key can be persisted
+         * incrementally: the deltas returned by takeDelta can be replayed on a previously serialized key using
+         * applyDelta.
+         */
+        void trackChanges();
+
+        /**
+         * @return the changes made to the key since tracking started or since the last call, serialized
+         */
+        SecureByteBuffer takeDelta();
+
+        /**
+         * Replays a delta taken from a copy of this HPPRF.
+         * @param delta the serialized delta
+         * @throws PPRFDeserializationError if the delta is malformed
+         */
+        void applyDelta(const SecureByteBuffer &delta);
+
+        /**
+         * Enables a cache of the nodes derived by eval, such that evaluations on tags sharing a prefix with a
+         * previously evaluated tag start from the deepest cached node. Punctures evict all cached nodes from which a
+         * punctured tag can be derived. Replaces an existing cache.
+         * The cache is not part of the serialized key. Copies of the PPRF share the cache, see SharedNodeCache.
+         * @param memoryBudget the maximum memory used by the cache, in bytes
+         */
+        void enableCache(size_t memoryBudget);
+
+        /**
+         * Disables the cache, erasing all cached nodes.
+         */
+        void disableCache();
+
+        /**
+         * @return hits, misses and size of the cache, all zero if the cache is disabled
+         */
+        NodeCache::Stats cacheStats() const;
+
+        /**
+         * @return the number of nodes of the key, their depths, the memory held by the key and the cache, and the
+         * predicted cost of evaluations and punctures. The statistics are maintained incrementally, the key is not
+         * serialized. The tag length is the maximal length of a tag.
+         */
+        KeyStats keyStats() const;
 
     private:
         PPRFKey key;
+        /**
+         * filled by the const evaluations and shared with the copies of the PPRF
+         */
+        SharedNodeCache cache;
+
+        NodeStore::Handle findMatchingNode(const Tag &tag, size_t &depth) const;
 
-        std::string findMatchingPrefix(const Tag &tag);
+        /**
+         * @return the siblings of the path to tag below node, derived one after another into a single buffer
+         */
+        SecureByteBuffer evalCoPath(const Tag &tag, NodeStore::Handle node, size_t depth) const;
 
-        SecureByteBuffer
-        evalAndGetCoPath(const Tag &tag, const SecretRoot &node, std::vector<SecretRoot> &coPath) const;
+        void visitLeaves(std::span<const Tag> tags, bool skipPunctured, const LeafVisitor &visit) const;
 
-        static std::string tag_to_string(const Tag &tag);
+        void evalSubtree(const SecureByteBuffer &value, size_t depth, std::span<const Tag> tags,
+                         const std::vector<size_t> &order, size_t begin, size_t end,
+                         std::vector<SecureByteBuffer> &scratch, const LeafVisitor &visit) const;
 };
 
 
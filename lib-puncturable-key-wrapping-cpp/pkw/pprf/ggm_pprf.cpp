@@ -19,109 +19,875 @@
  **********************************************************************************************************************/
 
 #include "ggm_pprf.h"
+#include "ggm_prg.h"
 #include "pprf_exceptions.h"
 #include "pprf_key_serializer.h"
-#include <bitset>
-#include <cryptopp/hkdf.h>
-#include <cryptopp/sha.h>
-#include <deque>
+#include <algorithm>
+#include <array>
+#include <cryptopp/osrng.h>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
 
-static const std::vector<unsigned char> RIGHT({'r'});
-static const std::vector<unsigned char> LEFT({'l'});
+namespace {
+    /**
+     * A tag as array of 64 bit words, least significant word first.
+     */
+    using NativeTagWords = std::array<uint64_t, MAX_TAG_LEN / 64>;
+
+    /* std::bitset does not expose its words, but the common standard libraries store them least significant first */
+    const bool NATIVE_TAG_LAYOUT = [] {
+        if constexpr (sizeof(Tag) == sizeof(NativeTagWords) && std::is_trivially_copyable_v<Tag>) {
+            const Tag probe = Tag(1) << 64 | Tag(3);
+            NativeTagWords words;
+            std::memcpy(words.data(), &probe, sizeof(words));
+            return words == NativeTagWords{3, 1, 0, 0};
+        }
+        return false;
+    }();
+
+    NativeTagWords loadWords(const Tag &tag) {
+        NativeTagWords words;
+        if constexpr (sizeof(Tag) == sizeof(NativeTagWords) && std::is_trivially_copyable_v<Tag>) {
+            if (NATIVE_TAG_LAYOUT) {
+                std::memcpy(words.data(), &tag, sizeof(words));
+                return words;
+            }
+        }
+        for (size_t w = 0; w < words.size(); ++w) {
+            words[w] = ((tag >> (64 * w)) & Tag(UINT64_MAX)).to_ullong();
+        }
+        return words;
+    }
+
+    /**
+     * A tag as array of 64 bit words, most significant word first. Compares like the numerical value of the tag.
+     */
+    using TagWords = std::array<uint64_t, MAX_TAG_LEN / 64>;
+
+    TagWords toWords(const Tag &tag) {
+        NativeTagWords native = loadWords(tag);
+        TagWords words;
+        std::reverse_copy(native.begin(), native.end(), words.begin());
+        return words;
+    }
+
+    /**
+     * The bits of a tag of a length known at compile time, read from the native words of the tag. Depth i of the tree
+     * corresponds to bit TagBits - 1 - i of the tag.
+     */
+    template<size_t TagBits>
+    class FixedBits {
+        public:
+            explicit FixedBits(const Tag &tag) : words(loadWords(tag)) {}
+
+            static constexpr size_t length() { return TagBits; }
+
+            bool tooLarge() const {
+                for (size_t w = TagBits / 64; w < words.size(); ++w) {
+                    const uint64_t high = w == TagBits / 64 ? ~uint64_t(0) << (TagBits % 64) : ~uint64_t(0);
+                    if (words[w] & high) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool operator()(size_t depth) const {
+                const size_t i = TagBits - 1 - depth;
+                return (words[i / 64] >> (i % 64)) & 1;
+            }
+
+        private:
+            NativeTagWords words;
+    };
+
+    /**
+     * The bits of a tag of any length.
+     */
+    class DynamicBits {
+        public:
+            DynamicBits(const Tag &tag, size_t tagLen) : tag(tag), tagLen(tagLen) {}
+
+            size_t length() const { return tagLen; }
+
+            bool tooLarge() const { return (tag >> tagLen).any(); }
+
+            bool operator()(size_t depth) const { return tag[tagLen - 1 - depth]; }
+
+        private:
+            const Tag &tag;
+            size_t tagLen;
+    };
+
+    /**
+     * Calls f with the bits of tag, specialized for the common tag lengths, such that the tag length is a constant
+     * when walking the tree.
+     */
+    template<class F>
+    decltype(auto) withTagBits(const Tag &tag, size_t tagLen, F f) {
+        switch (tagLen) {
+            case 32:
+                return f(FixedBits<32>(tag));
+            case 64:
+                return f(FixedBits<64>(tag));
+            case 128:
+                return f(FixedBits<128>(tag));
+            case 256:
+                return f(FixedBits<256>(tag));
+            default:
+                return f(DynamicBits(tag, tagLen));
+        }
+    }
+
+    void setBit(TagWords &words, size_t bit) {
+        words[words.size() - 1 - bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+
+    /**
+     * @return words with the lowest n bits set
+     */
+    TagWords setLowBits(TagWords words, size_t n) {
+        for (size_t w = words.size(); w-- > 0 && n > 0;) {
+            if (n >= 64) {
+                words[w] = UINT64_MAX;
+                n -= 64;
+            } else {
+                words[w] |= (uint64_t(1) << n) - 1;
+                n = 0;
+            }
+        }
+        return words;
+    }
+
+    /**
+     * @return the index of the child on the path given by bits below a node at the given depth of a tree of arity
+     * 2^arityBits
+     */
+    template<class Bits>
+    size_t childIndex(const Bits &bits, size_t depth, size_t arityBits) {
+        size_t index = 0;
+        for (size_t i = depth; i < depth + arityBits; ++i) {
+            index = index << 1 | bits(i);
+        }
+        return index;
+    }
+
+    enum class Overlap {
+        DISJOINT,
+        INSIDE,
+        PARTIAL
+    };
+
+    /**
+     * Compares the tags below a node (given by its smallest tag and its height) with the range [lo, hi].
+     */
+    Overlap overlap(const TagWords &first, size_t height, const TagWords &lo, const TagWords &hi) {
+        TagWords last = setLowBits(first, height);
+        if (last < lo || hi < first) {
+            return Overlap::DISJOINT;
+        }
+        if (lo <= first && last <= hi) {
+            return Overlap::INSIDE;
+        }
+        return Overlap::PARTIAL;
+    }
+}// namespace
 
 GGM_PPRF::GGM_PPRF(PPRFKey key) : key(std::move(key)) {
 }
-SecureByteBuffer GGM_PPRF::eval(Tag tag) {
-    if (tagTooLarge(tag)) {
+
+GGM_PPRF::GGM_PPRF(CompactKeyView key)
+    : key(key.keyLen(), key.tagLen(), key.puncs(), NodeStore(key.keyLen() / 8), key.prg(), 1 << key.arityBits(),
+          key.maxTagLen()),
+      compactKey(std::move(key)) {
+}
+
+GGM_PPRF GGM_PPRF::fromSerialized(SecureByteBuffer serialized) {
+    if (CompactKeyView::isCompact(std::span<const uint8_t>(serialized.data(), serialized.size()))) {
+        return GGM_PPRF(CompactKeyView(std::move(serialized)));
+    }
+    return GGM_PPRF(PPRFKey::fromSerialized(serialized));
+}
+
+void GGM_PPRF::loadKey() {
+    if (!compactKey) {
+        return;
+    }
+    const bool tracking = key.nodes.tracksChanges();
+    key = PPRFKeySerializer::deserialize(compactKey->bytes());
+    key.nodes.trackChanges(tracking);
+    compactKey.reset();
+}
+
+template<class Bits>
+size_t GGM_PPRF::matchingNodeId(const Bits &bits, size_t &depth) const {
+    if (!compactKey) {
+        NodeStore::Handle node = key.nodes.findLongestPrefix(bits.length(), bits, depth);
+        if (node == NodeStore::NONE) {
+            throw TagException();
+        }
+        return node;
+    }
+    BitPrefix path;
+    for (size_t i = 0; i < bits.length(); ++i) {
+        path.push_back(bits(i));
+    }
+    size_t offset = compactKey->findPrefixOf(path, depth);
+    if (offset == CompactKeyView::NONE) {
         throw TagException();
     }
-    std::string nodePrefix = findMatchingPrefix(tag);
-    SecretRoot &node = key.nodes[nodePrefix];
+    return offset;
+}
 
-    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
-    SecureByteBuffer res(node.getValue());
-    SecureByteBuffer derived(res);
-    for (size_t i = node.getPrefix().size(); i < key.tagLen; i++) {
-        Tag mask;
-        mask.set(key.tagLen - i - 1, true);
-        const std::vector<unsigned char> &direction = (mask & tag).count() > 0 ? RIGHT : LEFT;
-        hkdf.DeriveKey(derived.data(), derived.size(), res.data(), res.size(), nullptr, 0, direction.data(), direction.size());
-        res = derived;
+SecureByteBuffer GGM_PPRF::matchingNode(const Tag &tag, size_t &depth) const {
+    return withTagBits(tag, key.tagLen, [this, &depth](const auto &bits) {
+        if (bits.tooLarge()) {
+            throw TagException();
+        }
+        return nodeValue(matchingNodeId(bits, depth));
+    });
+}
+
+SecureByteBuffer GGM_PPRF::nodeValue(size_t id) const {
+    if (!compactKey) {
+        return key.nodes.getValue(id);
+    }
+    SecureByteBuffer value(key.keyLen / 8);
+    std::copy_n(compactKey->valueAt(id), value.size(), value.data());
+    return value;
+}
+SecureByteBuffer GGM_PPRF::eval(Tag tag) const {
+    return withTagBits(tag, key.tagLen, [this](const auto &bits) { return evalPath(bits); });
+}
+
+template<class Bits>
+SecureByteBuffer GGM_PPRF::evalPath(const Bits &bits) const {
+    if (bits.tooLarge()) {
+        throw TagException();
+    }
+    const size_t tagLen = bits.length();
+    size_t depth;
+    size_t node = matchingNodeId(bits, depth);
+    if (key.arityBits > 1) {
+        return evalKaryPath(bits, node, depth);
+    }
+
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+    SecureByteBuffer res(nodeValue(node));
+    cache.use([&](NodeCache &c) {
+        size_t cachedDepth;
+        NodeStore::Handle cached = c.lookup(tagLen, bits, cachedDepth);
+        if (cached != NodeStore::NONE && cachedDepth > depth) {
+            res = c.getValue(cached);
+            depth = cachedDepth;
+        }
+    });
+    /* the derivation runs without holding the lock of the cache; two buffers take turns as input and output */
+    const size_t len = res.size();
+    SecureByteBuffer other(len);
+    unsigned char *curr = res.data();
+    unsigned char *next = other.data();
+    std::vector<SecureByteBuffer> path;
+    for (size_t i = depth; i < tagLen; i++) {
+        prg.deriveChild(curr, len, bits(i), next);
+        std::swap(curr, next);
+        if (cache && i + 1 < tagLen) {
+            path.emplace_back(len);
+            std::copy_n(curr, len, path.back().data());
+        }
+    }
+    /* only inner nodes are cached, the leaves are the output of the PPRF. The cache may have changed since the lookup,
+     * so the path is walked from the root. */
+    cache.use([&](NodeCache &c) { c.insertPath(bits, depth + 1, path); });
+    if (curr != res.data()) {
+        std::copy_n(curr, len, res.data());
     }
     return res;
 }
-bool GGM_PPRF::tagTooLarge(Tag &tag) const {
-    return (tag >> key.tagLen).count() > 0;
+
+template<class Bits>
+SecureByteBuffer GGM_PPRF::evalKaryPath(const Bits &bits, size_t node, size_t depth) const {
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+    SecureByteBuffer res(nodeValue(node));
+    const size_t len = res.size();
+    SecureByteBuffer other(len);
+    unsigned char *curr = res.data();
+    unsigned char *next = other.data();
+    for (size_t i = depth; i < bits.length(); i += key.arityBits) {
+        prg.deriveKaryChild(curr, len, key.arityBits, childIndex(bits, i, key.arityBits), next);
+        std::swap(curr, next);
+    }
+    if (curr != res.data()) {
+        std::copy_n(curr, len, res.data());
+    }
+    return res;
+}
+
+std::vector<size_t> GGM_PPRF::sortTags(std::span<const Tag> tags, bool removeDuplicates) const {
+    std::vector<TagWords> words(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        if (tagTooLarge(tags[i])) {
+            throw TagException();
+        }
+        words[i] = toWords(tags[i]);
+    }
+    std::vector<size_t> order(tags.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&words](size_t a, size_t b) { return words[a] < words[b]; });
+    if (removeDuplicates) {
+        order.erase(std::unique(order.begin(), order.end(), [&words](size_t a, size_t b) { return words[a] == words[b]; }),
+                    order.end());
+    }
+    return order;
+}
+
+std::vector<SecureByteBuffer> GGM_PPRF::evalBatch(std::span<const Tag> tags) const {
+    std::vector<SecureByteBuffer> res(tags.size());
+    visitLeaves(tags, false, [&res](size_t i, const SecureByteBuffer &value) { res[i] = value; });
+    return res;
+}
+
+void GGM_PPRF::forEachLiveLeaf(std::span<const Tag> tags, const LeafVisitor &visit) const {
+    visitLeaves(tags, true, visit);
+}
+
+void GGM_PPRF::visitLeaves(std::span<const Tag> tags, bool skipPunctured, const LeafVisitor &visit) const {
+    std::vector<size_t> order = sortTags(tags, false);
+    if (key.arityBits > 1) {
+        for (size_t i: order) {
+            SecureByteBuffer value;
+            try {
+                value = eval(tags[i]);
+            } catch (TagException &e) {
+                if (!skipPunctured) {
+                    throw;
+                }
+                continue;
+            }
+            visit(i, value);
+        }
+        return;
+    }
+
+    /* the children of the nodes on the current path, two per depth, such that no node is allocated while traversing */
+    std::vector<SecureByteBuffer> scratch(2 * key.tagLen, SecureByteBuffer(key.keyLen / 8));
+    size_t begin = 0;
+    while (begin < order.size()) {
+        size_t depth;
+        size_t node;
+        try {
+            node = matchingNodeId(DynamicBits(tags[order[begin]], key.tagLen), depth);
+        } catch (TagException &e) {
+            if (!skipPunctured) {
+                throw;
+            }
+            ++begin;
+            continue;
+        }
+        /* the tags below node form a contiguous range of the sorted tags, those sharing its prefix */
+        const Tag &first = tags[order[begin]];
+        const size_t shift = key.tagLen - depth;
+        auto below = [&tags, &first, shift](size_t i) { return ((tags[i] ^ first) >> shift).none(); };
+        size_t end = std::partition_point(order.begin() + begin + 1, order.end(), below) - order.begin();
+        evalSubtree(nodeValue(node), depth, tags, order, begin, end, scratch, visit);
+        begin = end;
+    }
+}
+
+void GGM_PPRF::evalSubtree(const SecureByteBuffer &value, size_t depth, std::span<const Tag> tags,
+                           const std::vector<size_t> &order, size_t begin, size_t end,
+                           std::vector<SecureByteBuffer> &scratch, const LeafVisitor &visit) const {
+    if (depth == static_cast<size_t>(key.tagLen)) {
+        for (size_t i = begin; i < end; ++i) {
+            visit(order[i], value);
+        }
+        return;
+    }
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+    if (end - begin == 1) {
+        /* a single tag below this node: derive the rest of its path, the two buffers of a depth take turns */
+        const Tag &tag = tags[order[begin]];
+        const unsigned char *curr = value.data();
+        for (size_t i = depth; i < static_cast<size_t>(key.tagLen); ++i) {
+            unsigned char *next = scratch[2 * depth + (i - depth) % 2].data();
+            prg.deriveChild(curr, value.size(), tag[key.tagLen - i - 1], next);
+            curr = next;
+        }
+        visit(order[begin], scratch[2 * depth + (key.tagLen - depth - 1) % 2]);
+        return;
+    }
+    const size_t bit = key.tagLen - depth - 1;
+    size_t mid = std::partition_point(order.begin() + begin, order.begin() + end,
+                                      [&tags, bit](size_t i) { return !tags[i][bit]; }) -
+                 order.begin();
+    SecureByteBuffer &left = scratch[2 * depth];
+    SecureByteBuffer &right = scratch[2 * depth + 1];
+    if (mid > begin && mid < end) {
+        prg.expand(value.data(), value.size(), left.data(), right.data());
+    } else if (mid > begin) {
+        prg.deriveChild(value.data(), value.size(), false, left.data());
+    } else {
+        prg.deriveChild(value.data(), value.size(), true, right.data());
+    }
+    if (mid > begin) {
+        evalSubtree(left, depth + 1, tags, order, begin, mid, scratch, visit);
+    }
+    if (mid < end) {
+        evalSubtree(right, depth + 1, tags, order, mid, end, scratch, visit);
+    }
+}
+
+void GGM_PPRF::puncBatch(std::span<const Tag> tags) {
+    std::vector<size_t> order = sortTags(tags, true);
+    if (key.arityBits > 1) {
+        for (size_t i: order) {
+            punc(tags[i]);
+        }
+        return;
+    }
+    loadKey();
+    for (size_t i: order) {
+        evictFromCache(DynamicBits(tags[i], key.tagLen));
+    }
+    size_t begin = 0;
+    while (begin < order.size()) {
+        size_t depth;
+        NodeStore::Handle node = lookupNode(tags[order[begin]], depth);
+        if (node == NodeStore::NONE) {
+            ++begin; /* already punctured */
+            continue;
+        }
+        size_t end = begin + 1;
+        size_t endDepth;
+        while (end < order.size() && lookupNode(tags[order[end]], endDepth) == node) {
+            ++end;
+        }
+        key.puncs += end - begin;
+        std::vector<NodeStore::Handle> path{node};
+        puncSubtree(key.nodes.getValue(node), depth, depth, tags, order, begin, end, path);
+        key.nodes.erase(node);
+        begin = end;
+    }
+}
+
+void GGM_PPRF::puncSubtree(const SecureByteBuffer &value, size_t rootDepth, size_t depth, std::span<const Tag> tags,
+                           const std::vector<size_t> &order, size_t begin, size_t end,
+                           std::vector<NodeStore::Handle> &path) {
+    if (depth == static_cast<size_t>(key.tagLen)) {
+        return;
+    }
+    const size_t bit = key.tagLen - depth - 1;
+    size_t mid = std::partition_point(order.begin() + begin, order.begin() + end,
+                                      [&tags, bit](size_t i) { return !tags[i][bit]; }) -
+                 order.begin();
+    SecureByteBuffer left(value.size());
+    SecureByteBuffer right(value.size());
+    GGM_PRG::forType(key.prg).expand(value.data(), value.size(), left.data(), right.data());
+    if (mid == begin || mid == end) {
+        /* all tags continue on the same side, the sibling becomes part of the key */
+        const bool toRight = mid == begin;
+        const Tag &tag = tags[order[begin]];
+        /* trie nodes on the path are only created once a node below them is stored */
+        size_t created = path.size() - 1;
+        while (path[created] == NodeStore::NONE) {
+            --created;
+        }
+        for (; created < path.size() - 1; ++created) {
+            path[created + 1] = key.nodes.findOrCreateChild(path[created], tag[key.tagLen - rootDepth - created - 1]);
+        }
+        key.nodes.setValue(key.nodes.findOrCreateChild(path.back(), !toRight), toRight ? left.data() : right.data());
+    }
+    if (mid > begin) {
+        path.push_back(NodeStore::NONE);
+        puncSubtree(left, rootDepth, depth + 1, tags, order, begin, mid, path);
+        path.pop_back();
+    }
+    if (mid < end) {
+        path.push_back(NodeStore::NONE);
+        puncSubtree(right, rootDepth, depth + 1, tags, order, mid, end, path);
+        path.pop_back();
+    }
+}
+
+void GGM_PPRF::puncRange(const Tag &lo, const Tag &hi) {
+    if (tagTooLarge(lo) || tagTooLarge(hi)) {
+        throw TagException();
+    }
+    const TagWords loWords = toWords(lo);
+    const TagWords hiWords = toWords(hi);
+    if (hiWords < loWords) {
+        throw TagException();
+    }
+    loadKey();
+    cache.clear();
+
+    /* find the subtrees of the key inside the range and the nodes of the key only partially inside */
+    std::vector<NodeStore::Handle> inside;
+    std::vector<std::tuple<NodeStore::Handle, size_t, TagWords>> partial;
+    std::vector<std::tuple<NodeStore::Handle, size_t, TagWords>> stack{{NodeStore::ROOT, 0, TagWords{}}};
+    while (!stack.empty()) {
+        auto [h, depth, first] = stack.back();
+        stack.pop_back();
+        switch (overlap(first, key.tagLen - depth, loWords, hiWords)) {
+            case Overlap::DISJOINT:
+                break;
+            case Overlap::INSIDE:
+                inside.push_back(h);
+                break;
+            case Overlap::PARTIAL:
+                if (key.nodes.hasValue(h)) {
+                    partial.emplace_back(h, depth, first);
+                    break;
+                }
+                for (int bit = 0; bit <= 1; ++bit) {
+                    if (key.nodes.child(h, bit) != NodeStore::NONE) {
+                        TagWords childFirst = first;
+                        if (bit) {
+                            setBit(childFirst, key.tagLen - depth - 1);
+                        }
+                        stack.emplace_back(key.nodes.child(h, bit), depth + 1, childFirst);
+                    }
+                }
+        }
+    }
+
+    /* a node partially inside the range always derives a tag inside it, the trie nodes inside may be empty */
+    const size_t nodesBefore = key.nodes.size();
+    /* split first, as erasing releases trie nodes which may be reused */
+    for (auto &[h, depth, first]: partial) {
+        puncRangeSubtree(h, key.nodes.getValue(h), depth, first, loWords, hiWords);
+        key.nodes.erase(h);
+    }
+    for (auto h: inside) {
+        key.nodes.eraseSubtree(h);
+    }
+    if (!partial.empty() || key.nodes.size() < nodesBefore) {
+        key.puncs += 1;
+    }
+}
+
+void GGM_PPRF::puncRangeSubtree(NodeStore::Handle h, const SecureByteBuffer &value, size_t depth,
+                                const std::array<uint64_t, MAX_TAG_LEN / 64> &first,
+                                const std::array<uint64_t, MAX_TAG_LEN / 64> &lo,
+                                const std::array<uint64_t, MAX_TAG_LEN / 64> &hi) {
+    const size_t arityBits = key.arityBits;
+    std::vector<SecureByteBuffer> children(size_t(1) << arityBits, SecureByteBuffer(value.size()));
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+    if (arityBits == 1) {
+        prg.expand(value.data(), value.size(), children[0].data(), children[1].data());
+    } else {
+        std::vector<unsigned char *> outs;
+        for (auto &child: children) {
+            outs.push_back(child.data());
+        }
+        prg.expandKary(value.data(), value.size(), arityBits, outs.data());
+    }
+    for (size_t index = 0; index < children.size(); ++index) {
+        TagWords childFirst = first;
+        for (size_t i = 0; i < arityBits; ++i) {
+            if ((index >> (arityBits - 1 - i)) & 1) {
+                setBit(childFirst, key.tagLen - depth - 1 - i);
+            }
+        }
+        switch (overlap(childFirst, key.tagLen - depth - arityBits, lo, hi)) {
+            case Overlap::DISJOINT:
+                key.nodes.setValue(findOrCreateKaryChild(h, index), children[index].data());
+                break;
+            case Overlap::INSIDE:
+                break;
+            case Overlap::PARTIAL:
+                puncRangeSubtree(findOrCreateKaryChild(h, index), children[index], depth + arityBits, childFirst, lo,
+                                 hi);
+        }
+    }
 }
 
-std::string GGM_PPRF::findMatchingPrefix(Tag tag) {
-    std::string tagString = tag.to_string().substr(MAX_TAG_LEN - key.tagLen, MAX_TAG_LEN);
-    for (int i = 0; i <= tagString.size(); ++i) {
-        std::string prefix = tagString.substr(0, i);
-        if (key.nodes.count(prefix) > 0) {
-            return prefix;
+NodeStore::Handle GGM_PPRF::findOrCreateKaryChild(NodeStore::Handle h, size_t index) {
+    for (size_t i = key.arityBits; i-- > 0;) {
+        h = key.nodes.findOrCreateChild(h, (index >> i) & 1);
+    }
+    return h;
+}
+
+void GGM_PPRF::growTagLen(int newTagLen) {
+    if (newTagLen < key.tagLen || newTagLen > key.maxTagLen || newTagLen > static_cast<int>(MAX_TAG_LEN) ||
+        (newTagLen - key.tagLen) % key.arityBits != 0) {
+        throw TagException();
+    }
+    const size_t bits = newTagLen - key.tagLen;
+    if (bits == 0) {
+        return;
+    }
+    loadKey();
+    cache.clear();
+    key.nodes.prependZeros(bits);
+    key.tagLen = newTagLen;
+    /* no node of the grown tree may derive the former root, hence the siblings of the path to it are random */
+    SecureByteBuffer value(key.keyLen / 8);
+    NodeStore::Handle h = NodeStore::ROOT;
+    for (size_t depth = 0; depth < bits; depth += key.arityBits) {
+        if (depth > 0) {
+            h = findOrCreateKaryChild(h, 0);
+        }
+        for (size_t index = 1; index < static_cast<size_t>(key.arity()); ++index) {
+            if (key.prg != PRGType::STRUCTURE_ONLY) {
+                CryptoPP::OS_GenerateRandomBlock(true, value.data(), value.size());
+            }
+            key.nodes.setValue(findOrCreateKaryChild(h, index), value.data());
         }
     }
-    throw TagException();
 }
 
-void GGM_PPRF::punc(std::bitset<MAX_TAG_LEN> tag) {
-    if ((tag >> key.tagLen).count() > 0) {
+bool GGM_PPRF::tagTooLarge(const Tag &tag) const {
+    return (tag >> key.tagLen).count() > 0;
+}
+
+NodeStore::Handle GGM_PPRF::lookupNode(const Tag &tag, size_t &depth) const {
+    const size_t tagLen = key.tagLen;
+    return key.nodes.findLongestPrefix(tagLen, [&tag, tagLen](size_t i) { return tag[tagLen - 1 - i]; }, depth);
+}
+
+void GGM_PPRF::punc(Tag tag) {
+    withTagBits(tag, key.tagLen, [this](const auto &bits) { puncPath(bits); });
+}
+
+template<class Bits>
+void GGM_PPRF::puncPath(const Bits &bits) {
+    if (bits.tooLarge()) {
         throw TagException();
     }
-    std::string nodeIndex;
-    try {
-        nodeIndex = findMatchingPrefix(tag);
-    } catch (TagException &t) {
+    loadKey();
+    evictFromCache(bits);
+    size_t depth = 0;
+    NodeStore::Handle node = key.nodes.findLongestPrefix(bits.length(), bits, depth);
+    if (node == NodeStore::NONE) {
         return; /* already punctured */
     }
 
-    SecretRoot &node = key.nodes[nodeIndex];
     key.puncs += 1;
-    std::vector<SecretRoot> coPath;
-    evalAndGetCoPath(tag, node, coPath);
-    key.nodes.erase(nodeIndex);
-    for (auto &n: coPath) {
-        key.nodes.insert({n.getPrefix(), {n.getPrefix(), n.getValue()}});
-    }
-}
-
-SecureByteBuffer GGM_PPRF::evalAndGetCoPath(Tag tag, const SecretRoot &node, std::vector<SecretRoot> &coPath) const {
-    const int keyLenByte = key.keyLen / 8;
-    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
-
-    std::deque<SecretRoot> left;
-    std::deque<SecretRoot> right;
-
-    SecureByteBuffer curr(node.getValue());
-    SecureByteBuffer derived_right(keyLenByte);
-    SecureByteBuffer derived_left(keyLenByte);
-    std::string pref = node.getPrefix();
-    for (size_t i = node.getPrefix().size(); i < key.tagLen; i++) {
-        Tag mask;
-        mask.set(key.tagLen - i - 1, true);
-        hkdf.DeriveKey(derived_right.data(), derived_right.size(), curr.data(), curr.size(), nullptr, 0, RIGHT.data(), RIGHT.size());
-        hkdf.DeriveKey(derived_left.data(), derived_left.size(), curr.data(), curr.size(), nullptr, 0, LEFT.data(), LEFT.size());
-        if ((mask & tag).count() > 0) {
-            left.emplace_back(pref + "0", derived_left);
-            curr = derived_right;
-            pref += "1";
+    if (key.arityBits > 1) {
+        puncKaryPath(bits, node, depth);
+        return;
+    }
+    SecureByteBuffer coPath = evalCoPath(bits, node, depth);
+    key.nodes.replaceByCoPath(node, depth, bits.length(), bits, coPath.data());
+}
+
+template<class Bits>
+void GGM_PPRF::puncKaryPath(const Bits &bits, NodeStore::Handle node, size_t depth) {
+    const size_t arityBits = key.arityBits;
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+    std::vector<SecureByteBuffer> children(size_t(1) << arityBits, SecureByteBuffer(key.keyLen / 8));
+    std::vector<unsigned char *> outs;
+    for (auto &child: children) {
+        outs.push_back(child.data());
+    }
+    SecureByteBuffer curr = key.nodes.getValue(node);
+    NodeStore::Handle h = node;
+    for (size_t i = depth; i < bits.length(); i += arityBits) {
+        prg.expandKary(curr.data(), curr.size(), arityBits, outs.data());
+        const size_t onPath = childIndex(bits, i, arityBits);
+        for (size_t index = 0; index < children.size(); ++index) {
+            if (index != onPath) {
+                key.nodes.setValue(findOrCreateKaryChild(h, index), children[index].data());
+            }
+        }
+        if (i + arityBits < bits.length()) {
+            h = findOrCreateKaryChild(h, onPath);
+            std::swap(curr, children[onPath]);
+            outs[onPath] = children[onPath].data();
+        }
+    }
+    /* the siblings keep the trie node of the former node alive */
+    key.nodes.erase(node);
+}
+
+template<class Bits>
+SecureByteBuffer GGM_PPRF::evalCoPath(const Bits &bits, NodeStore::Handle node, size_t depth) const {
+    const size_t len = key.keyLen / 8;
+    const GGM_PRG &prg = GGM_PRG::forType(key.prg);
+
+    SecureByteBuffer buffers[2] = {key.nodes.getValue(node), SecureByteBuffer(len)};
+    unsigned char *curr = buffers[0].data();
+    unsigned char *next = buffers[1].data();
+    SecureByteBuffer coPath((bits.length() - depth) * len);
+    for (size_t i = depth; i < bits.length(); i++) {
+        /* the sibling is derived directly into the co-path, the child on the path is expanded next */
+        unsigned char *sibling = coPath.data() + (i - depth) * len;
+        if (bits(i)) {
+            prg.expand(curr, len, sibling, next);
         } else {
-            right.emplace_front(pref + "1", derived_right);
-            curr = derived_left;
-            pref += "0";
+            prg.expand(curr, len, next, sibling);
         }
+        std::swap(curr, next);
     }
-    coPath.insert(coPath.end(), left.begin(), left.end());
-    coPath.insert(coPath.end(), right.begin(), right.end());
-    return curr;
+    return coPath;
 }
-int GGM_PPRF::getNumPuncs() {
+
+template<class Bits>
+void GGM_PPRF::evictFromCache(const Bits &bits) {
+    cache.modify([&bits](NodeCache &c) { c.evict(bits.length(), bits); });
+}
+
+void GGM_PPRF::trackChanges() {
+    key.nodes.trackChanges(true);
+}
+
+SecureByteBuffer GGM_PPRF::takeDelta() {
+    return key.takeDelta();
+}
+
+void GGM_PPRF::applyDelta(const SecureByteBuffer &delta) {
+    cache.clear();
+    loadKey();
+    key.applyDelta(delta);
+}
+
+void GGM_PPRF::enableCache(size_t memoryBudget) {
+    cache = SharedNodeCache(key.keyLen / 8, memoryBudget);
+}
+
+void GGM_PPRF::disableCache() {
+    cache = SharedNodeCache();
+}
+
+KeyStats GGM_PPRF::keyStats() const {
+    const size_t cacheBytes = cacheStats().bytes;
+    if (compactKey) {
+        std::vector<uint64_t> histogram(key.tagLen + 1);
+        compactKey->forEach([&histogram](const BitPrefix &prefix, const unsigned char *) {
+            if (prefix.size() < histogram.size()) {
+                histogram[prefix.size()]++;
+            }
+        });
+        return KeyStats::fromHistogram(key.tagLen, histogram, compactKey->bytes().size() + cacheBytes, key.arityBits);
+    }
+    return KeyStats::fromHistogram(key.tagLen, key.nodes.depthHistogram(), key.nodes.residentBytes() + cacheBytes,
+                                   key.arityBits);
+}
+
+std::vector<GGM_PPRF::Subtree> GGM_PPRF::keySubtrees(std::span<const Tag> tags, size_t minKeyNodes) const {
+    std::vector<TagWords> sorted;
+    sorted.reserve(tags.size());
+    for (const Tag &tag: tags) {
+        if (tagTooLarge(tag)) {
+            throw TagException();
+        }
+        sorted.push_back(toWords(tag));
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    /*
+     * The nodes are visited in lexicographic order of their prefixes. The subtrees in which they branch are at the
+     * depths of the longest common prefixes of consecutive nodes; the subtrees containing the previous node are kept on
+     * a stack, by increasing depth, and are completed once a node outside of them is visited.
+     */
+    struct Open {
+        size_t depth;
+        size_t keyNodes;
+    };
+    std::vector<Open> open;
+    std::vector<Subtree> res;
+    BitPrefix previous;
+    bool first = true;
+    /* completes the subtrees deeper than depth, or all of them, and adds the previous node to the remaining ones */
+    auto complete = [&](size_t depth, bool all) {
+        size_t keyNodes = 1;
+        while (!open.empty() && (all || open.back().depth > depth)) {
+            keyNodes += open.back().keyNodes;
+            const size_t subtreeDepth = open.back().depth;
+            open.pop_back();
+            if (keyNodes < minKeyNodes) {
+                continue;
+            }
+            TagWords firstWords{};
+            for (size_t i = 0; i < subtreeDepth; ++i) {
+                if (previous[i]) {
+                    setBit(firstWords, key.tagLen - 1 - i);
+                }
+            }
+            const TagWords lastWords = setLowBits(firstWords, key.tagLen - subtreeDepth);
+            Subtree subtree{Tag(), Tag(), keyNodes,
+                            static_cast<size_t>(std::upper_bound(sorted.begin(), sorted.end(), lastWords) -
+                                                std::lower_bound(sorted.begin(), sorted.end(), firstWords))};
+            for (size_t w = 0; w < firstWords.size(); ++w) {
+                subtree.first |= Tag(firstWords[w]) << (64 * (firstWords.size() - 1 - w));
+                subtree.last |= Tag(lastWords[w]) << (64 * (lastWords.size() - 1 - w));
+            }
+            res.push_back(subtree);
+        }
+        if (all) {
+            return;
+        }
+        if (!open.empty() && open.back().depth == depth) {
+            open.back().keyNodes += keyNodes;
+        } else {
+            open.push_back({depth, keyNodes});
+        }
+    };
+    auto visit = [&](const BitPrefix &prefix, const unsigned char *) {
+        if (!first) {
+            /* the nodes are prefix-free, both lie below their longest common prefix */
+            complete(previous.commonPrefixLength(prefix), false);
+        }
+        first = false;
+        previous = prefix;
+    };
+    if (compactKey) {
+        compactKey->forEach(visit);
+    } else {
+        key.nodes.forEach(visit);
+    }
+    if (!first) {
+        complete(0, true);
+    }
+    return res;
+}
+
+NodeCache::Stats GGM_PPRF::cacheStats() const {
+    return cache.stats();
+}
+
+int GGM_PPRF::getNumPuncs() const {
     return key.puncs;
 }
-int GGM_PPRF::tagLen() {
+int GGM_PPRF::tagLen() const {
     return key.tagLen;
 }
-SecureByteBuffer GGM_PPRF::serializeKey() {
+
+int GGM_PPRF::keyLen() const {
+    return key.keyLen;
+}
+
+PRGType GGM_PPRF::prg() const {
+    return key.prg;
+}
+
+int GGM_PPRF::arity() const {
+    return key.arity();
+}
+
+int GGM_PPRF::maxTagLen() const {
+    return key.maxTagLen;
+}
+GGM_PPRF GGM_PPRF::dryRun(int keyLen, int tagLen, int arity, int maxTagLen) {
+    return GGM_PPRF(PPRFKey::structureOnly(keyLen, tagLen, arity, maxTagLen));
+}
+
+size_t GGM_PPRF::serializedKeySize() const {
+    if (compactKey) {
+        return compactKey->bytes().size();
+    }
+    return PPRFKeySerializer(key).serializedSize();
+}
+
+SecureByteBuffer GGM_PPRF::serializeKey() const {
+    if (compactKey) {
+        std::vector<unsigned char> serialized(compactKey->bytes().begin(), compactKey->bytes().end());
+        return SecureByteBuffer(serialized);
+    }
     return key.serialize();
 }
\ No newline at end of file
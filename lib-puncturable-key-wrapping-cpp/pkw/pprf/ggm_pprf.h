@@ -21,8 +21,15 @@
 #ifndef PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PPRF_H
 #define PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PPRF_H
 #include "../secure_byte_buffer.h"
+#include "compact_key_view.h"
 #include "ggm_pprf_key.h"
+#include "key_stats.h"
+#include "node_cache.h"
+#include <array>
 #include <bitset>
+#include <functional>
+#include <optional>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -36,9 +43,34 @@ using byte = unsigned char;
  *
  * <div class="csl-entry">Goldreich, O., Goldwasser, S., &#38; Micali, S. (1986). How to construct random functions. <i>Journal of the ACM (JACM)</i>, <i>33</i>(4), 792–807. https://doi.org/10.1145/6490.6503</div>
 * <br>
+ * The const member functions, e.g. eval, may be called concurrently. Modifications must not run concurrently with any
+ * other call; to keep evaluating while the key is punctured, puncture a copy and publish it once done: copies share
+ * the nodes of the key until either of them modifies them.
+ * <br>
+ * The tree may have a higher arity k = 2^b (see PPRFKey): each PRG call then derives the child selected by the next b
+ * bits of the tag, such that an evaluation takes tagLen / b derivations, while a puncture adds the k - 1 siblings of
+ * each level to the key. The nodes are still indexed by their prefixes, whose lengths are multiples of b. The cache and
+ * the depth-first batch traversals only apply to binary trees; a tree of higher arity evaluates and punctures the tags
+ * of a batch one after another.
  */
 class GGM_PPRF {
     public:
+        /**
+         * Receives the index of a tag and the evaluation of the PPRF on it.
+         */
+        using LeafVisitor = std::function<void(size_t, const SecureByteBuffer &)>;
+
+        /**
+         * A subtree of the tag space: the tags in [first, last], the number of nodes of the key inside it and the
+         * number of tags of a given set inside it.
+         */
+        struct Subtree {
+            Tag first;
+            Tag last;
+            size_t keyNodes;
+            size_t tags;
+        };
+
         /**
          * Punctures the PPRF on tag. If tag was already punctured on, no exception is thrown.
          * @param tag the tag on which the PPRF is to be punctured
@@ -46,40 +78,267 @@ class GGM_PPRF {
          */
         void punc(Tag tag);
 
+        /**
+         * Punctures the PPRF on several tags at once. The tags are sorted and the tree is traversed depth-first, such that
+         * each node is derived at most once, and only the nodes of the minimal co-path of all tags are added to the key.
+         * Tags that were already punctured on are ignored.
+         * @param tags the tags on which the PPRF is to be punctured
+         * @throws IllegalTagException if the size of one of the tags exceeds the key's tag length; the key is not
+         * modified in this case.
+         */
+        void puncBatch(std::span<const Tag> tags);
+
+        /**
+         * Punctures the PPRF on all tags in [lo, hi]. Only the O(tagLen) nodes at the boundaries of the range are added
+         * to the key, all nodes inside the range are removed.
+         * Counts as a single puncture, unless the PPRF was punctured on all tags of the range before.
+         * @param lo the first tag to puncture on
+         * @param hi the last tag to puncture on
+         * @throws IllegalTagException if hi < lo or the size of one of the tags exceeds the key's tag length.
+         */
+        void puncRange(const Tag &lo, const Tag &hi);
+
+        /**
+         * Extends the tag length up to the maximal tag length of the key, keeping the evaluations on all tags: the
+         * tree becomes the left-most subtree of a deeper tree, such that each tag keeps its numerical value, and the
+         * siblings of the path to the former root are drawn at random. A key that starts short and grows with the
+         * largest tag in use thus evaluates and punctures in O(log(largest tag)) derivations instead of
+         * O(maxTagLen). Takes time linear in the number of nodes of the key and does not count as a puncture.
+         * @param newTagLen the new tag length
+         * @throws IllegalTagException if newTagLen is smaller than the tag length, exceeds the maximal tag length or
+         * cannot be reached by whole levels of the tree.
+         */
+        void growTagLen(int newTagLen);
+
         /**
          * Evaluates the PPRF on input tag and returns the result of the evaluation.
          * @param tag the tag
          * @return a SecureByteBuffer
          * @throws IllegalTagException if the PPRF was punctured on tag or the size of the tag exceeds the key's tag length.
          */
-        SecureByteBuffer eval(Tag tag);
+        SecureByteBuffer eval(Tag tag) const;
+
+        /**
+         * Evaluates the PPRF on several tags. The tags are sorted and the tree is traversed depth-first, such that each
+         * node on the paths to the tags is derived only once.
+         * @param tags the tags
+         * @return the results of the evaluations, in the order of the tags
+         * @throws IllegalTagException if the PPRF was punctured on one of the tags or the size of one of the tags exceeds
+         * the key's tag length.
+         */
+        std::vector<SecureByteBuffer> evalBatch(std::span<const Tag> tags) const;
+
+        /**
+         * Visits the leaves of several tags in one depth-first traversal of the tree, such that each node on the paths
+         * to the tags is derived only once; unlike evalBatch, tags the PPRF was punctured on are skipped. The leaves
+         * are visited in ascending order of the tags and are not kept, such that enumerating all files of a key takes
+         * memory independent of their number.
+         * @param tags the tags
+         * @param visit called with the index of each tag the PPRF was not punctured on and the evaluation on it
+         * @throws IllegalTagException if the size of one of the tags exceeds the key's tag length.
+         */
+        void forEachLiveLeaf(std::span<const Tag> tags, const LeafVisitor &visit) const;
+
         /**
          * Constructs a PPRF instance using the key.
          * @param key the key
          */
         explicit GGM_PPRF(PPRFKey key);
+
+        /**
+         * Constructs a PPRF instance using a key in the compact format without loading it: evaluations search the
+         * serialized nodes. The key is only loaded once it is modified, e.g. by a puncture.
+         * @param key the key
+         */
+        explicit GGM_PPRF(CompactKeyView key);
+
+        /**
+         * Constructs a PPRF instance from a serialized key. Keys in the compact format are not loaded until they are
+         * modified.
+         * @param serialized the serialized key
+         * @return the PPRF
+         * @throws PPRFDeserializationError if the key is malformed
+         */
+        static GGM_PPRF fromSerialized(SecureByteBuffer serialized);
+
+        /**
+         * Constructs a PPRF which keeps only the structure of its key and derives no node (see
+         * PRGType::STRUCTURE_ONLY). Punctures and evaluations take the same paths as those of a real key and the key
+         * grows alike, such that its statistics and serialized size can be predicted quickly for a trace of operations.
+         * Evaluations return zeros.
+         * @param keyLen the size of the key space in number of bits
+         * @param tagLen the size of the tag space in number of bits
+         * @param arity the number of children of each node of the GGM tree
+         * @param maxTagLen the tag length up to which the tree may grow; 0 for a fixed tag length
+         * @return the PPRF
+         * @throws InitializationException if the parameters are invalid
+         */
+        static GGM_PPRF dryRun(int keyLen, int tagLen, int arity = 2, int maxTagLen = 0);
         /**
          * Getter for number of punctures performed on the PPRF.
          * @return number of punctures
          */
-        int getNumPuncs();
+        int getNumPuncs() const;
         /**
          * Getter the tag length of PPRF
          * @return tag length
          */
-        int tagLen();
+        int tagLen() const;
+
+        /**
+         * @return the size of the key space in number of bits
+         */
+        int keyLen() const;
+
+        /**
+         * @return the PRG used to derive the nodes of the GGM tree
+         */
+        PRGType prg() const;
+
+        /**
+         * @return the number of children of each node of the GGM tree
+         */
+        int arity() const;
+
+        /**
+         * @return the tag length up to which the tree may grow, equal to tagLen() if the tag length is fixed
+         */
+        int maxTagLen() const;
 
         /**
          * Serializes the key.
          * @return a secureByteBuffer holding the serialized key.
          */
-        SecureByteBuffer serializeKey();
+        SecureByteBuffer serializeKey() const;
+
+        /**
+         * @return the size of serializeKey() in bytes, computed without serializing the key
+         */
+        size_t serializedKeySize() const;
+
+        /**
+         * Starts recording the changes made to the key by punctures, such that the key can be persisted
+         * incrementally: the deltas returned by takeDelta can be replayed on a previously serialized key using
+         * applyDelta.
+         */
+        void trackChanges();
+
+        /**
+         * @return the changes made to the key since tracking started or since the last call, serialized
+         */
+        SecureByteBuffer takeDelta();
+
+        /**
+         * Replays a delta taken from a copy of this PPRF.
+         * @param delta the serialized delta
+         * @throws PPRFDeserializationError if the delta is malformed
+         */
+        void applyDelta(const SecureByteBuffer &delta);
+
+        /**
+         * Enables a cache of the inner nodes derived by eval, such that evaluations on tags sharing a prefix with a
+         * previously evaluated tag start from the deepest cached node. Punctures evict all cached nodes from which a
+         * punctured tag can be derived. Replaces an existing cache.
+         * The cache is not part of the serialized key. Copies of the PPRF share the cache, see SharedNodeCache.
+         * @param memoryBudget the maximum memory used by the cache, in bytes
+         */
+        void enableCache(size_t memoryBudget);
+
+        /**
+         * Disables the cache, erasing all cached nodes.
+         */
+        void disableCache();
+
+        /**
+         * @return hits, misses and size of the cache, all zero if the cache is disabled
+         */
+        NodeCache::Stats cacheStats() const;
+
+        /**
+         * @return the number of nodes of the key, their depths, the memory held by the key and the cache, and the
+         * predicted cost of evaluations and punctures. The statistics are maintained incrementally, the key is not
+         * serialized. A key in the compact format which is not loaded yet is
+         * scanned once.
+         */
+        KeyStats keyStats() const;
+
+        /**
+         * Lists the subtrees of the tag space in which the nodes of the key branch, i.e. the smallest subtrees holding
+         * a given set of nodes, and counts the given tags inside each. No node of the key covers such a subtree, such
+         * that puncturing it with puncRange removes its nodes from the key without adding any. The subtrees are listed
+         * in ascending order of their last tag, inner subtrees first. A key in the compact format which is not loaded
+         * yet is scanned once.
+         * @param tags the tags to count, e.g. the tags that are in use
+         * @param minKeyNodes the minimal number of nodes of the key in a listed subtree
+         * @return the subtrees holding at least minKeyNodes nodes of the key
+         * @throws IllegalTagException if the size of one of the tags exceeds the key's tag length.
+         */
+        std::vector<Subtree> keySubtrees(std::span<const Tag> tags, size_t minKeyNodes) const;
 
     private:
+        friend class EvalCursor;
+
         PPRFKey key;
-        std::string findMatchingPrefix(Tag tag);
-        SecureByteBuffer evalAndGetCoPath(Tag tag, const SecretRoot &node, std::vector<SecretRoot> &coPath) const;
-        bool tagTooLarge(Tag &tag) const;
+        /**
+         * the serialized key as long as it is not loaded into key, whose nodes are empty in this case
+         */
+        std::optional<CompactKeyView> compactKey;
+        /**
+         * filled by the const evaluations and shared with the copies of the PPRF
+         */
+        SharedNodeCache cache;
+        void loadKey();
+        /**
+         * @return an identifier of the node from which the tag given by bits can be derived, unique among the nodes of
+         * the key: the handle of the node or, if the key is not loaded, the offset of its value in the serialized key
+         * @throws TagException if the PPRF was punctured on the tag
+         */
+        template<class Bits>
+        size_t matchingNodeId(const Bits &bits, size_t &depth) const;
+        SecureByteBuffer nodeValue(size_t id) const;
+        /**
+         * @return the value of the node of the key from which tag can be derived, at the given depth
+         * @throws TagException if the PPRF was punctured on tag or the size of the tag exceeds the key's tag length
+         */
+        SecureByteBuffer matchingNode(const Tag &tag, size_t &depth) const;
+        /**
+         * Evaluates the PPRF on the tag given by bits, a function returning the bit of the tag at a given depth, whose
+         * length() may be a compile-time constant.
+         */
+        template<class Bits>
+        SecureByteBuffer evalPath(const Bits &bits) const;
+        template<class Bits>
+        SecureByteBuffer evalKaryPath(const Bits &bits, size_t node, size_t depth) const;
+        template<class Bits>
+        void puncPath(const Bits &bits);
+        template<class Bits>
+        void puncKaryPath(const Bits &bits, NodeStore::Handle node, size_t depth);
+        /**
+         * @return the trie node of the child with the given index of the node h of a tree of higher arity, created if
+         * it does not exist
+         */
+        NodeStore::Handle findOrCreateKaryChild(NodeStore::Handle h, size_t index);
+        template<class Bits>
+        void evictFromCache(const Bits &bits);
+        NodeStore::Handle lookupNode(const Tag &tag, size_t &depth) const;
+        /**
+         * @return the siblings of the path given by bits below node, derived one after another into a single buffer
+         */
+        template<class Bits>
+        SecureByteBuffer evalCoPath(const Bits &bits, NodeStore::Handle node, size_t depth) const;
+        void visitLeaves(std::span<const Tag> tags, bool skipPunctured, const LeafVisitor &visit) const;
+        void evalSubtree(const SecureByteBuffer &value, size_t depth, std::span<const Tag> tags,
+                         const std::vector<size_t> &order, size_t begin, size_t end,
+                         std::vector<SecureByteBuffer> &scratch, const LeafVisitor &visit) const;
+        void puncSubtree(const SecureByteBuffer &value, size_t rootDepth, size_t depth, std::span<const Tag> tags,
+                         const std::vector<size_t> &order, size_t begin, size_t end,
+                         std::vector<NodeStore::Handle> &path);
+        void puncRangeSubtree(NodeStore::Handle h, const SecureByteBuffer &value, size_t depth,
+                              const std::array<uint64_t, MAX_TAG_LEN / 64> &first,
+                              const std::array<uint64_t, MAX_TAG_LEN / 64> &lo,
+                              const std::array<uint64_t, MAX_TAG_LEN / 64> &hi);
+        std::vector<size_t> sortTags(std::span<const Tag> tags, bool removeDuplicates) const;
+        bool tagTooLarge(const Tag &tag) const;
 };
 
 
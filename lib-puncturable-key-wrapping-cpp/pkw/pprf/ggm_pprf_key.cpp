@@ -25,29 +25,89 @@
 #include <cryptopp/osrng.h>
 
 
-PPRFKey::PPRFKey(int keyLen, int tagLen, int puncs, std::unordered_map<std::string, SecretRoot> nodes) : keyLen(keyLen),
-                                                                                                         tagLen(tagLen),
-                                                                                                         puncs(puncs),
-                                                                                                         nodes(std::move(
-                                                                                                                 nodes)) {
+PPRFKey::PPRFKey(int keyLen, int tagLen, int puncs, const std::unordered_map<std::string, SecretRoot> &nodes,
+                 PRGType prg) : keyLen(keyLen),
+                                tagLen(tagLen),
+                                puncs(puncs),
+                                prg(prg),
+                                maxTagLen(tagLen),
+                                nodes(keyLen / 8, nodes) {
+    checkPRG(prg);
+}
+
+PPRFKey::PPRFKey(int keyLen, int tagLen, int puncs, NodeStore nodes, PRGType prg, int arity, int maxTagLen)
+    : keyLen(keyLen),
+      tagLen(tagLen),
+      puncs(puncs),
+      prg(prg),
+      arityBits(arityBitsOf(arity, tagLen)),
+      nodes(std::move(nodes)) {
+    checkPRG(prg);
+    setMaxTagLen(maxTagLen);
 }
 
 PPRFKey::PPRFKey() {}
 
-SecureByteBuffer PPRFKey::serialize() {
+SecureByteBuffer PPRFKey::serialize() const {
     return PPRFKeySerializer(*this).serialize();
 }
 
+SecureByteBuffer PPRFKey::takeDelta() {
+    return PPRFKeySerializer::serializeDelta(puncs, nodes.takeChanges());
+}
+
+void PPRFKey::applyDelta(const SecureByteBuffer &delta) {
+    PPRFKeySerializer::applyDelta(*this, delta);
+}
+
 PPRFKey PPRFKey::fromSerialized(SecureByteBuffer &serialized) {
     return PPRFKeySerializer::deserialize(serialized);
 }
 
-PPRFKey::PPRFKey(int keyLen, int tagLen) : keyLen(keyLen), tagLen(tagLen), puncs(0) {
+int PPRFKey::arityBitsOf(int arity, int tagLen) {
+    int bits = 1;
+    while (bits < 8 && (1 << bits) < arity) {
+        ++bits;
+    }
+    if ((1 << bits) != arity || tagLen <= 0 || tagLen % bits != 0) {
+        throw InitializationException();
+    }
+    return bits;
+}
+
+void PPRFKey::setMaxTagLen(int maxTagLen) {
+    this->maxTagLen = maxTagLen == 0 ? tagLen : maxTagLen;
+    if (this->maxTagLen < tagLen || this->maxTagLen % arityBits != 0) {
+        throw InitializationException();
+    }
+}
+
+PPRFKey::PPRFKey(int keyLen, int tagLen, PRGType prg, int arity, int maxTagLen)
+    : keyLen(keyLen), tagLen(tagLen), puncs(0), prg(prg), arityBits(arityBitsOf(arity, tagLen)), nodes(keyLen / 8) {
+    checkPRG(prg);
+    setMaxTagLen(maxTagLen);
     if (!(keyLen > 0 && tagLen > 0)) {
         throw InitializationException();
     }
     SecureByteBuffer s(keyLen / 8);
     CryptoPP::OS_GenerateRandomBlock(true, s.data(), s.size());
-    nodes.insert({{""},
-                  {"", s}});
+    nodes.insert("", s);
+}
+
+PPRFKey PPRFKey::structureOnly(int keyLen, int tagLen, int arity, int maxTagLen) {
+    if (!(keyLen > 0 && tagLen > 0)) {
+        throw InitializationException();
+    }
+    NodeStore nodes(keyLen / 8);
+    nodes.insert("", SecureByteBuffer(keyLen / 8));
+    PPRFKey key(keyLen, tagLen, 0, std::move(nodes), PRGType::HKDF_SHA256, arity, maxTagLen);
+    key.prg = PRGType::STRUCTURE_ONLY;
+    return key;
+}
+
+void PPRFKey::checkPRG(PRGType prg) {
+    /* a key without randomness would wrap under all-zero keys */
+    if (prg == PRGType::STRUCTURE_ONLY) {
+        throw InitializationException();
+    }
 }
\ No newline at end of file
@@ -21,6 +21,8 @@
 #ifndef PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PPRF_KEY_H
 #define PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PPRF_KEY_H
 
+#include "ggm_prg.h"
+#include "node_store.h"
 #include "secret_root.h"
 #include <unordered_map>
 /*
@@ -32,8 +34,14 @@ class PPRFKey {
          * Creates a fresh instance of a PPRFKey.
          * @param keyLen the size of the key space in number of bits
          * @param tagLen the size of the tag space in number of bits
+         * @param prg the PRG used to derive the nodes of the GGM tree
+         * @param arity the number of children of each node of the GGM tree, a power of two of at most 256 whose log2
+         * divides tagLen
+         * @param maxTagLen the tag length up to which the tree may grow, see GGM_PPRF::growTagLen; 0 for a fixed tag
+         * length
+         * @throws InitializationException if the parameters are invalid, or the PRG is PRGType::STRUCTURE_ONLY
          */
-        PPRFKey(int keyLen, int tagLen);
+        PPRFKey(int keyLen, int tagLen, PRGType prg = PRGType::HKDF_SHA256, int arity = 2, int maxTagLen = 0);
 
         /**
          * Constructs a PPRFKey from a serialized byte string
@@ -48,8 +56,26 @@ class PPRFKey {
          * @param tagLen the size of the tag space in number of bits
          * @param puncs the number of punctures already performed
          * @param nodes a vector of SecretRoots, defining their respective subtrees
+         * @param prg the PRG used to derive the nodes of the GGM tree
+         * @throws InitializationException if the PRG is PRGType::STRUCTURE_ONLY
          */
-        PPRFKey(int keyLen, int tagLen, int puncs, std::unordered_map<std::string, SecretRoot> nodes);
+        PPRFKey(int keyLen, int tagLen, int puncs, const std::unordered_map<std::string, SecretRoot> &nodes,
+                PRGType prg = PRGType::HKDF_SHA256);
+
+        /**
+         * Creates an instance of a PPRFKey based on the given parameters.
+         * @param keyLen the size of the key space in number of bits
+         * @param tagLen the size of the tag space in number of bits
+         * @param puncs the number of punctures already performed
+         * @param nodes the nodes of the key, stored in a NodeStore
+         * @param prg the PRG used to derive the nodes of the GGM tree
+         * @param arity the number of children of each node of the GGM tree
+         * @param maxTagLen the tag length up to which the tree may grow; 0 for a fixed tag length
+         * @throws InitializationException if the arity or the maximal tag length are invalid, or the PRG is
+         * PRGType::STRUCTURE_ONLY
+         */
+        PPRFKey(int keyLen, int tagLen, int puncs, NodeStore nodes, PRGType prg = PRGType::HKDF_SHA256, int arity = 2,
+                int maxTagLen = 0);
         /**
          * A default constructor, creating an empty key. Used for deserialization.
          */
@@ -66,13 +92,81 @@ class PPRFKey {
          * the number of punctures performed on the PPRF using this key
          */
         int puncs;
+        /**
+         * the PRG used to derive the nodes of the GGM tree
+         */
+        PRGType prg = PRGType::HKDF_SHA256;
+        /**
+         * log2 of the number of children of each node of the GGM tree. Each level of a tree of higher arity consumes
+         * arityBits bits of the tag, hence all nodes of the key have a prefix length that is a multiple of arityBits.
+         */
+        int arityBits = 1;
+        /**
+         * the tag length up to which the tree may grow, equal to tagLen if the tag length is fixed
+         */
+        int maxTagLen = 0;
+
+        /**
+         * @return the number of children of each node of the GGM tree
+         */
+        int arity() const {
+            return 1 << arityBits;
+        }
+
+        /**
+         * Computes log2 of an arity.
+         * @param arity the number of children of each node
+         * @param tagLen the size of the tag space in number of bits
+         * @return log2 of the arity
+         * @throws InitializationException if the arity is not a power of two between 2 and 256 or its log2 does not
+         * divide tagLen
+         */
+        static int arityBitsOf(int arity, int tagLen);
 
-        std::unordered_map<std::string, SecretRoot> nodes;
+        /**
+         * the nodes of the key, indexed by their prefix
+         */
+        NodeStore nodes;
 
         /**
          * Serializes the key for export
          * @return the serialized key
          */
-        SecureByteBuffer serialize();
+        SecureByteBuffer serialize() const;
+
+        /**
+         * Serializes the changes made to the nodes since the last call, which have to be tracked by the NodeStore.
+         * @return the serialized delta
+         */
+        SecureByteBuffer takeDelta();
+
+        /**
+         * Replays a delta taken from a key with the same parameters.
+         * @param delta the serialized delta
+         * @throws PPRFDeserializationError if the delta is malformed
+         */
+        void applyDelta(const SecureByteBuffer &delta);
+
+    private:
+        friend class GGM_PPRF;
+        friend class GGM_HPPRF;
+
+        /**
+         * Creates a key without randomness, whose nodes all hold zeros (see PRGType::STRUCTURE_ONLY). Only dry runs
+         * create such keys, they cannot be constructed or deserialized otherwise.
+         * @throws InitializationException if the parameters are invalid
+         */
+        static PPRFKey structureOnly(int keyLen, int tagLen, int arity = 2, int maxTagLen = 0);
+
+        /**
+         * @throws InitializationException if the PRG must not protect data
+         */
+        static void checkPRG(PRGType prg);
+
+        /**
+         * Sets maxTagLen, tagLen if it is 0.
+         * @throws InitializationException if it is smaller than tagLen or the tree cannot grow to it by whole levels
+         */
+        void setMaxTagLen(int maxTagLen);
 };
 #endif//PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PPRF_KEY_H
\ No newline at end of file
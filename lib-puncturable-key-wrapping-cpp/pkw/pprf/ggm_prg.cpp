@@ -0,0 +1,198 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#include "ggm_prg.h"
+#include "../secure_memzero.h"
+#include "pprf_exceptions.h"
+#include <algorithm>
+#include <cryptopp/aes.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+
+namespace {
+    const unsigned char RIGHT[] = {'r'};
+    const unsigned char LEFT[] = {'l'};
+    const unsigned char OUT[] = {'o'};
+    const unsigned char KARY = 'k';
+
+    class HKDF_PRG : public GGM_PRG {
+        public:
+            void expand(const unsigned char *node, size_t len, unsigned char *left, unsigned char *right) const override {
+                deriveChild(node, len, false, left);
+                deriveChild(node, len, true, right);
+            }
+
+            void deriveChild(const unsigned char *node, size_t len, bool right, unsigned char *child) const override {
+                derive(node, len, right ? RIGHT : LEFT, child);
+            }
+
+            void deriveOutput(const unsigned char *node, size_t len, unsigned char *out) const override {
+                derive(node, len, OUT, out);
+            }
+
+            void expandKary(const unsigned char *node, size_t len, unsigned arityBits,
+                            unsigned char *const *children) const override {
+                for (size_t i = 0; i < (size_t(1) << arityBits); ++i) {
+                    deriveKaryChild(node, len, arityBits, i, children[i]);
+                }
+            }
+
+            /* info "k" | arityBits | index */
+            void deriveKaryChild(const unsigned char *node, size_t len, unsigned arityBits, size_t index,
+                                 unsigned char *child) const override {
+                const unsigned char info[] = {KARY, static_cast<unsigned char>(arityBits),
+                                              static_cast<unsigned char>(index)};
+                CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+                hkdf.DeriveKey(child, len, node, len, nullptr, 0, info, sizeof(info));
+            }
+
+        private:
+            static void derive(const unsigned char *node, size_t len, const unsigned char *info, unsigned char *out) {
+                CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+                hkdf.DeriveKey(out, len, node, len, nullptr, 0, info, 1);
+            }
+    };
+
+    /**
+     * G_f(s) = AES_K(s ^ t_f) ^ s ^ t_f for each 16 byte block of s, where K is fixed and public and the tweak t_f
+     * encodes the output function f (left, right, output, or the index of a child in a tree of higher arity, along
+     * with the arity) and the index of the block.
+     * The blocks of both children are encrypted in a single call, allowing the AES implementation to pipeline them
+     * (Crypto++ uses AES-NI if the CPU supports it, and a portable implementation otherwise).
+     * <br>
+     * The blocks are independent: an output block only depends on the input block at the same index, such that a
+     * node of n blocks is as hard to recover as any one of them, and the security is at most 128 bits for every key
+     * length. Mixing the blocks would not lift the bound, as the AES state is 128 bits wide.
+     */
+    class FixedKeyAES_PRG : public GGM_PRG {
+        public:
+            FixedKeyAES_PRG() {
+                aes.SetKey(FIXED_KEY, sizeof(FIXED_KEY));
+            }
+
+            void expand(const unsigned char *node, size_t len, unsigned char *left, unsigned char *right) const override {
+                unsigned char *outs[] = {left, right};
+                derive(node, len, outs, 2, 0);
+            }
+
+            void deriveChild(const unsigned char *node, size_t len, bool right, unsigned char *child) const override {
+                unsigned char *outs[] = {child};
+                derive(node, len, outs, 1, right ? 1 : 0);
+            }
+
+            void deriveOutput(const unsigned char *node, size_t len, unsigned char *out) const override {
+                unsigned char *outs[] = {out};
+                derive(node, len, outs, 1, 2);
+            }
+
+            void expandKary(const unsigned char *node, size_t len, unsigned arityBits,
+                            unsigned char *const *children) const override {
+                const size_t arity = size_t(1) << arityBits;
+                for (size_t first = 0; first < arity; first += MAX_BLOCKS) {
+                    derive(node, len, children + first, std::min(MAX_BLOCKS, arity - first),
+                           static_cast<unsigned char>(first), static_cast<unsigned char>(arityBits));
+                }
+            }
+
+            void deriveKaryChild(const unsigned char *node, size_t len, unsigned arityBits, size_t index,
+                                 unsigned char *child) const override {
+                unsigned char *outs[] = {child};
+                derive(node, len, outs, 1, static_cast<unsigned char>(index), static_cast<unsigned char>(arityBits));
+            }
+
+        private:
+            static const size_t BLOCK = CryptoPP::AES::BLOCKSIZE;
+            static const size_t MAX_BLOCKS = 8;
+            /* first 128 bits of the fractional part of pi */
+            static constexpr unsigned char FIXED_KEY[16] = {0x24, 0x3f, 0x6a, 0x88, 0x85, 0xa3, 0x08, 0xd3,
+                                                            0x13, 0x19, 0x8a, 0x2e, 0x03, 0x70, 0x73, 0x44};
+            CryptoPP::AES::Encryption aes;
+
+            /**
+             * Computes numOuts outputs for the functions firstFunction, firstFunction + 1, ... of a tree of arity
+             * 2^arityBits; the arity is not part of the tweak of binary trees.
+             */
+            void derive(const unsigned char *node, size_t len, unsigned char *const *outs, size_t numOuts,
+                        unsigned char firstFunction, unsigned char arityBits = 1) const {
+                unsigned char in[MAX_BLOCKS * BLOCK];
+                unsigned char res[MAX_BLOCKS * BLOCK];
+                const size_t blocksPerCall = MAX_BLOCKS / numOuts;
+                const size_t numBlocks = (len + BLOCK - 1) / BLOCK;
+                for (size_t first = 0; first < numBlocks; first += blocksPerCall) {
+                    const size_t blocks = std::min(blocksPerCall, numBlocks - first);
+                    for (size_t o = 0; o < numOuts; ++o) {
+                        for (size_t b = 0; b < blocks; ++b) {
+                            unsigned char *x = in + (o * blocks + b) * BLOCK;
+                            const size_t offset = (first + b) * BLOCK;
+                            const size_t n = std::min(BLOCK, len - offset);
+                            std::copy_n(node + offset, n, x);
+                            std::fill(x + n, x + BLOCK, 0);
+                            x[BLOCK - 1] ^= firstFunction + o;
+                            x[BLOCK - 2] ^= (unsigned char) (first + b);
+                            if (arityBits > 1) {
+                                x[BLOCK - 3] ^= arityBits;
+                            }
+                        }
+                    }
+                    aes.AdvancedProcessBlocks(in, in, res, numOuts * blocks * BLOCK,
+                                              CryptoPP::BlockTransformation::BT_AllowParallel);
+                    for (size_t o = 0; o < numOuts; ++o) {
+                        for (size_t b = 0; b < blocks; ++b) {
+                            const size_t offset = (first + b) * BLOCK;
+                            std::copy_n(res + (o * blocks + b) * BLOCK, std::min(BLOCK, len - offset), outs[o] + offset);
+                        }
+                    }
+                }
+                secure_memzero(in, sizeof(in));
+                secure_memzero(res, sizeof(res));
+            }
+    };
+
+    /**
+     * Leaves the outputs untouched: the buffers of a key without randomness hold zeros only.
+     */
+    class StructureOnlyPRG : public GGM_PRG {
+        public:
+            void expand(const unsigned char *, size_t, unsigned char *, unsigned char *) const override {}
+
+            void deriveChild(const unsigned char *, size_t, bool, unsigned char *) const override {}
+
+            void deriveOutput(const unsigned char *, size_t, unsigned char *) const override {}
+
+            void expandKary(const unsigned char *, size_t, unsigned, unsigned char *const *) const override {}
+
+            void deriveKaryChild(const unsigned char *, size_t, unsigned, size_t, unsigned char *) const override {}
+    };
+}// namespace
+
+const GGM_PRG &GGM_PRG::forType(PRGType type) {
+    static const HKDF_PRG hkdf;
+    static const FixedKeyAES_PRG aes;
+    static const StructureOnlyPRG structureOnly;
+    switch (type) {
+        case PRGType::HKDF_SHA256:
+            return hkdf;
+        case PRGType::FIXED_KEY_AES:
+            return aes;
+        case PRGType::STRUCTURE_ONLY:
+            return structureOnly;
+    }
+    throw InitializationException();
+}
@@ -0,0 +1,116 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PRG_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PRG_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Identifies the length-doubling PRG used to derive the children of a GGM tree node.
+ * The numeric values are part of the serialized key format and must not change.
+ */
+enum class PRGType : uint8_t {
+    /**
+     * HKDF<SHA256>, with info "l" resp. "r" for the children and "o" for the output of a HPPRF.
+     */
+    HKDF_SHA256 = 0,
+    /**
+     * Matyas-Meyer-Oseas compression over AES-128 with a fixed, public key. Each 16 byte block of a node is derived
+     * from the same block of its parent only, so the security is bounded by 128 bits regardless of the key length:
+     * longer keys do not add security over a 128 bit key. Use HKDF_SHA256 where more than 128 bits are required.
+     */
+    FIXED_KEY_AES = 1,
+    /**
+     * Derives nothing, all nodes keep the value zero. Simulates the structure of a key, e.g. to predict its size for a
+     * trace of operations (see GGM_PPRF::dryRun); it must never be used to protect data. Only dry runs create keys
+     * using it, constructing or deserializing such a key fails.
+     */
+    STRUCTURE_ONLY = 2
+};
+
+/**
+ * A length-doubling PRG G(s) = G_0(s) || G_1(s) as used by the GGM construction, plus an additional output function
+ * which is used by the HPPRF to hide the internal state of a leaf.
+ *
+ * Node values are byte strings of arbitrary length; all outputs have the same length as the input.
+ * Output buffers must not overlap with the input.
+ */
+class GGM_PRG {
+    public:
+        virtual ~GGM_PRG() = default;
+
+        /**
+         * Derives both children of a node.
+         * @param node the value of the node
+         * @param len the length of the value in bytes
+         * @param left receives the left child G_0(node)
+         * @param right receives the right child G_1(node)
+         */
+        virtual void expand(const unsigned char *node, size_t len, unsigned char *left, unsigned char *right) const = 0;
+
+        /**
+         * Derives a single child of a node.
+         * @param node the value of the node
+         * @param len the length of the value in bytes
+         * @param right whether the right (or the left) child is derived
+         * @param child receives the child
+         */
+        virtual void deriveChild(const unsigned char *node, size_t len, bool right, unsigned char *child) const = 0;
+
+        /**
+         * Derives the output value of a node.
+         * @param node the value of the node
+         * @param len the length of the value in bytes
+         * @param out receives the output
+         */
+        virtual void deriveOutput(const unsigned char *node, size_t len, unsigned char *out) const = 0;
+
+        /**
+         * Derives all children of a node of a tree of higher arity, in which each node has 2^arityBits children. The
+         * children are derived independently of those of a binary tree.
+         * @param node the value of the node
+         * @param len the length of the value in bytes
+         * @param arityBits log2 of the arity, from 2 to 8
+         * @param children receives the children, children[i] the i-th one
+         */
+        virtual void expandKary(const unsigned char *node, size_t len, unsigned arityBits,
+                                unsigned char *const *children) const = 0;
+
+        /**
+         * Derives a single child of a node of a tree of higher arity, see expandKary.
+         * @param node the value of the node
+         * @param len the length of the value in bytes
+         * @param arityBits log2 of the arity, from 2 to 8
+         * @param index the index of the child, less than 2^arityBits
+         * @param child receives the child
+         */
+        virtual void deriveKaryChild(const unsigned char *node, size_t len, unsigned arityBits, size_t index,
+                                     unsigned char *child) const = 0;
+
+        /**
+         * Returns the (stateless, shared) PRG instance of the given type.
+         * @throws InitializationException if the type is unknown
+         */
+        static const GGM_PRG &forType(PRGType type);
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_GGM_PRG_H
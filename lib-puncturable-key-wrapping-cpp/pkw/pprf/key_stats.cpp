@@ -0,0 +1,48 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+#include "key_stats.h"
+#include <algorithm>
+#include <cmath>
+
+KeyStats KeyStats::fromHistogram(size_t tagLen, const std::vector<uint64_t> &histogram, size_t residentBytes,
+                                 size_t arityBits) {
+    KeyStats stats;
+    stats.tagLen = tagLen;
+    stats.residentBytes = residentBytes;
+    stats.depthHistogram.assign(tagLen + 1, 0);
+    std::copy_n(histogram.begin(), std::min(histogram.size(), tagLen + 1), stats.depthHistogram.begin());
+
+    /* the fraction of the tag space each depth covers */
+    double covered = 0;
+    double weightedDepth = 0;
+    for (size_t d = 0; d <= tagLen; ++d) {
+        stats.nodes += stats.depthHistogram[d];
+        const double share = std::ldexp(static_cast<double>(stats.depthHistogram[d]), -static_cast<int>(d));
+        covered += share;
+        weightedDepth += share * static_cast<double>(d);
+    }
+    if (covered > 0) {
+        stats.averageMatchDepth = weightedDepth / covered;
+        stats.expectedEvalDerivations = (static_cast<double>(tagLen) - stats.averageMatchDepth) / arityBits;
+        /* the node is replaced by its co-path, the siblings of each level */
+        stats.expectedPuncGrowth = stats.expectedEvalDerivations * ((1 << arityBits) - 1) - 1;
+    }
+    return stats;
+}
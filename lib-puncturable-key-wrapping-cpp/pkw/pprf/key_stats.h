@@ -0,0 +1,72 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_KEY_STATS_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_KEY_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The shape of a punctured GGM key and the cost it predicts for evaluations and punctures, obtained without
+ * serializing the key.
+ * <br>
+ * The predictions are for a uniformly random tag which is not punctured: such a tag is derived from a node at depth d
+ * with probability proportional to 2^-d, and takes tagLen - d PRG calls to evaluate. Puncturing it replaces the node by
+ * tagLen - d nodes. In a tree of arity k = 2^b, each PRG call descends b bits and a puncture adds the k - 1 siblings of
+ * each level instead.
+ */
+struct KeyStats {
+    size_t tagLen = 0;
+    size_t nodes = 0;
+    /**
+     * the memory held by the key, in bytes
+     */
+    size_t residentBytes = 0;
+    /**
+     * depthHistogram[d] is the number of nodes at depth d, for d in [0, tagLen]
+     */
+    std::vector<uint64_t> depthHistogram;
+    /**
+     * the expected depth of the node from which a tag is derived
+     */
+    double averageMatchDepth = 0;
+    /**
+     * the expected number of PRG calls to evaluate on a tag
+     */
+    double expectedEvalDerivations = 0;
+    /**
+     * the expected number of nodes a puncture adds to the key
+     */
+    double expectedPuncGrowth = 0;
+
+    /**
+     * Computes the statistics from the number of nodes at each depth.
+     * @param tagLen the tag length of the key
+     * @param histogram the number of nodes at each depth, may be shorter than tagLen + 1
+     * @param residentBytes the memory held by the key
+     * @param arityBits log2 of the arity of the GGM tree
+     */
+    static KeyStats fromHistogram(size_t tagLen, const std::vector<uint64_t> &histogram, size_t residentBytes,
+                                  size_t arityBits = 1);
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_KEY_STATS_H
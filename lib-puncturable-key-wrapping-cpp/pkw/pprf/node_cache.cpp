@@ -0,0 +1,128 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#include "node_cache.h"
+
+NodeCache::NodeCache(size_t valueLen, size_t memoryBudget) : nodes(valueLen),
+                                                               capacity(memoryBudget / (valueLen + ENTRY_OVERHEAD)) {
+}
+
+NodeCache::NodeCache(const NodeCache &other) {
+    *this = other;
+}
+
+NodeCache &NodeCache::operator=(const NodeCache &other) {
+    if (this != &other) {
+        std::scoped_lock lock(mutex_, other.mutex_);
+        nodes = other.nodes;
+        capacity = other.capacity;
+        stats_ = other.stats_;
+        prev = other.prev;
+        next = other.next;
+        head = other.head;
+        tail = other.tail;
+    }
+    return *this;
+}
+
+void NodeCache::pushFront(NodeStore::Handle h) {
+    if (h >= prev.size()) {
+        prev.resize(h + 1, NodeStore::NONE);
+        next.resize(h + 1, NodeStore::NONE);
+    }
+    prev[h] = NodeStore::NONE;
+    next[h] = head;
+    if (head != NodeStore::NONE) {
+        prev[head] = h;
+    }
+    head = h;
+    if (tail == NodeStore::NONE) {
+        tail = h;
+    }
+}
+
+void NodeCache::unlink(NodeStore::Handle h) {
+    if (prev[h] != NodeStore::NONE) {
+        next[prev[h]] = next[h];
+    } else {
+        head = next[h];
+    }
+    if (next[h] != NodeStore::NONE) {
+        prev[next[h]] = prev[h];
+    } else {
+        tail = prev[h];
+    }
+    prev[h] = NodeStore::NONE;
+    next[h] = NodeStore::NONE;
+}
+
+void NodeCache::evictNode(NodeStore::Handle h) {
+    unlink(h);
+    nodes.erase(h);
+}
+
+void NodeCache::evictSubtree(NodeStore::Handle h) {
+    std::vector<NodeStore::Handle> stack{h};
+    while (!stack.empty()) {
+        NodeStore::Handle curr = stack.back();
+        stack.pop_back();
+        if (nodes.hasValue(curr)) {
+            unlink(curr);
+        }
+        for (int bit = 0; bit < 2; ++bit) {
+            if (nodes.child(curr, bit) != NodeStore::NONE) {
+                stack.push_back(nodes.child(curr, bit));
+            }
+        }
+    }
+    nodes.eraseSubtree(h);
+}
+
+void NodeCache::shrink() {
+    while (nodes.size() > capacity) {
+        evictNode(tail);
+    }
+}
+
+void NodeCache::clear() {
+    nodes = NodeStore(nodes.valueLen());
+    prev.clear();
+    next.clear();
+    head = NodeStore::NONE;
+    tail = NodeStore::NONE;
+}
+
+NodeCache::Stats NodeCache::stats() const {
+    Stats s = stats_;
+    s.entries = nodes.size();
+    s.bytes = nodes.size() * (nodes.valueLen() + ENTRY_OVERHEAD);
+    return s;
+}
+
+SharedNodeCache::SharedNodeCache(size_t valueLen, size_t memoryBudget)
+    : shared(std::make_shared<Shared>(valueLen, memoryBudget)), valueLen(valueLen), memoryBudget(memoryBudget) {}
+
+NodeCache::Stats SharedNodeCache::stats() const {
+    if (!shared) {
+        return NodeCache::Stats();
+    }
+    std::lock_guard<std::mutex> lock(shared->cache.mutex());
+    return shared->cache.stats();
+}
@@ -0,0 +1,269 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_NODE_CACHE_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_NODE_CACHE_H
+
+#include "../secure_byte_buffer.h"
+#include "node_store.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * A bounded cache of derived inner nodes of a GGM tree, indexed by their prefix.
+ *
+ * Repeated evaluations on tags sharing a prefix can start from the deepest cached node on the path instead of the
+ * matching key node. When the memory budget is exceeded, the least recently used nodes are evicted.
+ * Evicted node values are erased.
+ * The cache holds secret material: whenever the PPRF is punctured, all cached nodes from which a punctured tag can be
+ * derived have to be evicted (see evict).
+ * <br>
+ * The cache is not thread-safe. Callers sharing it between threads lock mutex() around each access; handles returned
+ * by lookup are only valid while the mutex is held.
+ */
+class NodeCache {
+    public:
+        /**
+         * Approximate memory used by an entry in addition to its value (trie node and LRU links), in bytes.
+         */
+        static const size_t ENTRY_OVERHEAD = 32;
+
+        struct Stats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            size_t entries = 0;
+            size_t bytes = 0;
+
+            double hitRate() const { return hits + misses == 0 ? 0 : double(hits) / double(hits + misses); }
+        };
+
+        /**
+         * Constructs an empty cache.
+         * @param valueLen the size of a node value in bytes
+         * @param memoryBudget the maximum memory used by the entries of the cache, in bytes
+         */
+        NodeCache(size_t valueLen, size_t memoryBudget);
+
+        /**
+         * Copies the cache, holding the mutex of other.
+         */
+        NodeCache(const NodeCache &other);
+        NodeCache &operator=(const NodeCache &other);
+
+        std::mutex &mutex() const { return mutex_; }
+
+        /**
+         * Walks from the root along the path given by bitAt and returns the deepest cached node.
+         * Counts as a hit if a node is found, and marks the node as recently used.
+         * @param len the length of the path
+         * @param bitAt a function returning the bit of the path at a given depth
+         * @param depth is set to the depth of the returned node
+         * @return the handle of the node, or NodeStore::NONE if no node on the path is cached
+         */
+        template<class BitFn>
+        NodeStore::Handle lookup(size_t len, BitFn bitAt, size_t &depth) {
+            NodeStore::Handle h = nodes.findLongestPrefix(len, bitAt, depth);
+            if (h == NodeStore::NONE) {
+                ++stats_.misses;
+            } else {
+                ++stats_.hits;
+                unlink(h);
+                pushFront(h);
+            }
+            return h;
+        }
+
+        SecureByteBuffer getValue(NodeStore::Handle h) const { return nodes.getValue(h); }
+
+        /**
+         * Caches the nodes on the path given by bitAt, starting at the given depth: values[i] is the node at depth
+         * depth + i. Shallower nodes are shared by more tags and are kept longer if the budget does not suffice.
+         * @param start a trie node on the path at depth startDepth <= depth, e.g. the result of the preceding lookup, from
+         * which the path is walked
+         */
+        template<class BitFn>
+        void insertPath(BitFn bitAt, size_t depth, const std::vector<SecureByteBuffer> &values,
+                        NodeStore::Handle start = NodeStore::ROOT, size_t startDepth = 0) {
+            size_t n = std::min(values.size(), capacity);
+            if (n == 0) {
+                return;
+            }
+            std::vector<std::pair<NodeStore::Handle, bool>> path;
+            path.reserve(n);
+            NodeStore::Handle curr = start;
+            for (size_t d = startDepth; d < depth; ++d) {
+                curr = nodes.findOrCreateChild(curr, bitAt(d));
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (i > 0) {
+                    curr = nodes.findOrCreateChild(curr, bitAt(depth + i - 1));
+                }
+                path.emplace_back(curr, nodes.hasValue(curr));
+                nodes.setValue(curr, values[i].data());
+            }
+            for (auto it = path.rbegin(); it != path.rend(); ++it) {
+                if (it->second) {
+                    unlink(it->first);
+                }
+                pushFront(it->first);
+            }
+            shrink();
+        }
+
+        /**
+         * Evicts all cached nodes on the path given by bitAt, including the node at its end, and all cached nodes
+         * below it.
+         */
+        template<class BitFn>
+        void evict(size_t len, BitFn bitAt) {
+            std::vector<NodeStore::Handle> path;
+            NodeStore::Handle curr = NodeStore::ROOT;
+            for (size_t d = 0; curr != NodeStore::NONE; ++d) {
+                if (d == len) {
+                    evictSubtree(curr);
+                    break;
+                }
+                if (nodes.hasValue(curr)) {
+                    path.push_back(curr);
+                }
+                curr = nodes.child(curr, bitAt(d));
+            }
+            /* deepest first, such that erasing a node does not prune the handles of its ancestors */
+            for (auto it = path.rbegin(); it != path.rend(); ++it) {
+                evictNode(*it);
+            }
+        }
+
+        /**
+         * Evicts all cached nodes.
+         */
+        void clear();
+
+        Stats stats() const;
+
+    private:
+        NodeStore nodes;
+        size_t capacity;
+        Stats stats_;
+        /* LRU list, most recently used first, linked by handle */
+        std::vector<NodeStore::Handle> prev;
+        std::vector<NodeStore::Handle> next;
+        NodeStore::Handle head = NodeStore::NONE;
+        NodeStore::Handle tail = NodeStore::NONE;
+        mutable std::mutex mutex_;
+
+        void pushFront(NodeStore::Handle h);
+
+        void unlink(NodeStore::Handle h);
+
+        void evictNode(NodeStore::Handle h);
+
+        void evictSubtree(NodeStore::Handle h);
+
+        void shrink();
+};
+
+/**
+ * A NodeCache shared by the copies of a PPRF, such that copying the PPRF, e.g. for each update of a Versioned PPRF,
+ * does not copy the cache.
+ * <br>
+ * Every modification through a copy advances the generation of the cache, and a copy only reads and fills the cache
+ * while it holds the current generation: an older copy may derive nodes which a newer one punctured, or index nodes by
+ * the prefixes of a shorter tag. A copy modified after another one diverged from it starts over with an empty cache.
+ */
+class SharedNodeCache {
+    public:
+        /**
+         * Constructs a disabled cache.
+         */
+        SharedNodeCache() = default;
+
+        /**
+         * Constructs an empty cache, see NodeCache.
+         */
+        SharedNodeCache(size_t valueLen, size_t memoryBudget);
+
+        explicit operator bool() const { return shared != nullptr; }
+
+        /**
+         * Calls f(NodeCache &) holding the mutex of the cache, unless another copy modified the cache since this copy
+         * last did.
+         */
+        template<class F>
+        void use(F f) const {
+            if (!shared) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(shared->cache.mutex());
+            if (shared->generation == generation) {
+                f(shared->cache);
+            }
+        }
+
+        /**
+         * Calls f(NodeCache &) holding the mutex of the cache and advances its generation, such that the other copies
+         * stop using the cache.
+         */
+        template<class F>
+        void modify(F f) {
+            if (!shared) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(shared->cache.mutex());
+                if (shared->generation == generation) {
+                    f(shared->cache);
+                    generation = ++shared->generation;
+                    return;
+                }
+            }
+            *this = SharedNodeCache(valueLen, memoryBudget);
+        }
+
+        /**
+         * Evicts all cached nodes.
+         */
+        void clear() {
+            modify([](NodeCache &cache) { cache.clear(); });
+        }
+
+        /**
+         * @return hits, misses and size of the cache, all zero if the cache is disabled
+         */
+        NodeCache::Stats stats() const;
+
+    private:
+        struct Shared {
+            NodeCache cache;
+            uint64_t generation = 0;
+
+            Shared(size_t valueLen, size_t memoryBudget) : cache(valueLen, memoryBudget) {}
+        };
+
+        std::shared_ptr<Shared> shared;
+        uint64_t generation = 0;
+        size_t valueLen = 0;
+        size_t memoryBudget = 0;
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_NODE_CACHE_H
@@ -0,0 +1,456 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#include "node_store.h"
+#include "../secure_memzero.h"
+#include "pprf_exceptions.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+BitPrefix::BitPrefix(const std::string &bits) {
+    for (char c: bits) {
+        if (c != '0' && c != '1') {
+            throw PPRFDeserializationError();
+        }
+        push_back(c == '1');
+    }
+}
+
+void BitPrefix::push_back(bool bit) {
+    if ((len & 63) == 0) {
+        words.push_back(0);
+    }
+    if (bit) {
+        words[len >> 6] |= uint64_t(1) << (63 - (len & 63));
+    }
+    ++len;
+}
+
+void BitPrefix::truncate(size_t n) {
+    if (n >= len) {
+        return;
+    }
+    len = n;
+    words.resize((len + 63) >> 6);
+    if ((len & 63) != 0) {
+        words.back() &= ~uint64_t(0) << (64 - (len & 63));
+    }
+}
+
+std::string BitPrefix::toString() const {
+    std::string s;
+    s.reserve(len);
+    for (size_t i = 0; i < len; ++i) {
+        s.push_back((*this)[i] ? '1' : '0');
+    }
+    return s;
+}
+
+bool BitPrefix::operator==(const BitPrefix &rhs) const {
+    return len == rhs.len && words == rhs.words;
+}
+
+size_t BitPrefix::commonPrefixLength(const BitPrefix &other) const {
+    const size_t n = std::min(len, other.len);
+    for (size_t w = 0; w * 64 < n; ++w) {
+        uint64_t diff = words[w] ^ other.words[w];
+        if (diff != 0) {
+            return std::min(n, w * 64 + __builtin_clzll(diff));
+        }
+    }
+    return n;
+}
+
+NodeStore::NodeStore(size_t valueLen) : valLen(valueLen) {
+    reset();
+}
+
+NodeStore::NodeStore(size_t valueLen, const std::unordered_map<std::string, SecretRoot> &roots) : NodeStore(valueLen) {
+    for (auto &root: roots) {
+        insert(root.first, root.second.getValue());
+    }
+}
+
+NodeStore::NodeStore(NodeStore &&other) noexcept : valLen(other.valLen),
+                                                   numValues(other.numValues),
+                                                   trie(std::move(other.trie)),
+                                                   trieSize(other.trieSize),
+                                                   freeNodes(std::move(other.freeNodes)),
+                                                   chunks(std::move(other.chunks)),
+                                                   freeSlots(std::move(other.freeSlots)),
+                                                   usedSlots(other.usedSlots),
+                                                   depthCounts(std::move(other.depthCounts)),
+                                                   tracking(other.tracking),
+                                                   changes(std::move(other.changes)) {
+    other.reset();
+}
+
+NodeStore &NodeStore::operator=(NodeStore &&other) noexcept {
+    if (this != &other) {
+        valLen = other.valLen;
+        numValues = other.numValues;
+        trie = std::move(other.trie);
+        trieSize = other.trieSize;
+        freeNodes = std::move(other.freeNodes);
+        chunks = std::move(other.chunks);
+        freeSlots = std::move(other.freeSlots);
+        usedSlots = other.usedSlots;
+        depthCounts = std::move(other.depthCounts);
+        tracking = other.tracking;
+        changes = std::move(other.changes);
+        other.reset();
+    }
+    return *this;
+}
+
+/**
+ * Leaves the store with only the root, which is empty.
+ */
+void NodeStore::reset() {
+    numValues = 0;
+    trie.clear();
+    trieSize = 0;
+    freeNodes.clear();
+    chunks.clear();
+    freeSlots.clear();
+    usedSlots = 0;
+    depthCounts.clear();
+    changes.clear();
+    allocateNode(NONE);
+}
+
+NodeStore::TrieNode &NodeStore::mutableNode(Handle h) {
+    TrieNode *chunk = trie.mutableChunk(h / NODES_PER_CHUNK, [](const TrieNode *shared) {
+        std::shared_ptr<TrieNode[]> copy(new TrieNode[NODES_PER_CHUNK]);
+        std::copy_n(shared, NODES_PER_CHUNK, copy.get());
+        return copy;
+    });
+    return chunk[h % NODES_PER_CHUNK];
+}
+
+unsigned char *NodeStore::mutableSlotData(uint32_t slot) {
+    unsigned char *chunk = chunks.mutableChunk(slot / SLOTS_PER_CHUNK, [this](const unsigned char *shared) {
+        std::shared_ptr<unsigned char[]> copy = newValueChunk();
+        std::copy_n(shared, SLOTS_PER_CHUNK * valLen, copy.get());
+        return copy;
+    });
+    return chunk + (slot % SLOTS_PER_CHUNK) * valLen;
+}
+
+size_t NodeStore::pageSize() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+size_t NodeStore::valueChunkLen() const {
+    return (SLOTS_PER_CHUNK * valLen + pageSize() - 1) / pageSize() * pageSize();
+}
+
+std::shared_ptr<unsigned char[]> NodeStore::newValueChunk() const {
+    /* chunks occupy whole pages, such that unlocking a chunk does not unlock the values of another one */
+    const size_t pageSize = NodeStore::pageSize();
+    const size_t chunkLen = valueChunkLen();
+    auto *chunk = static_cast<unsigned char *>(std::aligned_alloc(pageSize, chunkLen));
+    if (chunk == nullptr) {
+        throw std::bad_alloc();
+    }
+    /* locking fails once the limit of locked memory (RLIMIT_MEMLOCK) is reached; the values are erased either way */
+    const bool locked = mlock(chunk, chunkLen) == 0;
+    return {chunk, [chunkLen, locked](unsigned char *chunk) {
+                secure_memzero(chunk, chunkLen);
+                if (locked) {
+                    munlock(chunk, chunkLen);
+                }
+                std::free(chunk);
+            }};
+}
+
+void NodeStore::insert(const std::string &prefix, const SecureByteBuffer &value) {
+    if (value.size() != valLen) {
+        throw PPRFDeserializationError();
+    }
+    Handle curr = ROOT;
+    for (char c: prefix) {
+        if (c != '0' && c != '1') {
+            throw PPRFDeserializationError();
+        }
+        curr = findOrCreateChild(curr, c == '1');
+    }
+    setValue(curr, value.data());
+}
+
+NodeStore::Handle NodeStore::findString(const std::string &prefix) const {
+    return find(prefix.size(), [&prefix](size_t i) { return prefix[i] == '1'; });
+}
+
+bool NodeStore::contains(const std::string &prefix) const {
+    Handle h = findString(prefix);
+    return h != NONE && hasValue(h);
+}
+
+SecretRoot NodeStore::operator[](const std::string &prefix) const {
+    Handle h = findString(prefix);
+    if (h == NONE || !hasValue(h)) {
+        return {};
+    }
+    return {prefix, getValue(h)};
+}
+
+bool NodeStore::erase(const std::string &prefix) {
+    Handle h = findString(prefix);
+    if (h == NONE || !hasValue(h)) {
+        return false;
+    }
+    erase(h);
+    return true;
+}
+
+NodeStore::Handle NodeStore::findOrCreateChild(Handle h, bool bit) {
+    if (node(h).child[bit] == NONE) {
+        Handle c = allocateNode(h);
+        mutableNode(h).child[bit] = c;
+    }
+    return node(h).child[bit];
+}
+
+SecureByteBuffer NodeStore::getValue(Handle h) const {
+    SecureByteBuffer v(valLen);
+    std::copy_n(value(h), valLen, v.data());
+    return v;
+}
+
+void NodeStore::setValue(Handle h, const unsigned char *value) {
+    storeValue(h, value);
+    if (tracking) {
+        record(NodeDelta::Op::SET, h, prefixOf(h));
+    }
+}
+
+void NodeStore::storeValue(Handle h, const unsigned char *value) {
+    if (node(h).slot == NONE) {
+        mutableNode(h).slot = allocateSlot();
+        ++numValues;
+        countValue(node(h).depth, 1);
+    }
+    std::copy_n(value, valLen, mutableSlotData(node(h).slot));
+}
+
+void NodeStore::erase(Handle h) {
+    if (tracking && node(h).slot != NONE) {
+        record(NodeDelta::Op::ERASE, h, prefixOf(h));
+    }
+    releaseValue(h);
+    prune(h);
+}
+
+void NodeStore::releaseValue(Handle h) {
+    if (node(h).slot != NONE) {
+        releaseSlot(node(h).slot);
+        mutableNode(h).slot = NONE;
+        --numValues;
+        countValue(node(h).depth, -1);
+    }
+}
+
+void NodeStore::eraseSubtree(Handle h) {
+    if (tracking) {
+        record(NodeDelta::Op::ERASE_SUBTREE, h, prefixOf(h));
+    }
+    std::vector<Handle> stack{h};
+    while (!stack.empty()) {
+        Handle curr = stack.back();
+        stack.pop_back();
+        const TrieNode &n = node(curr);
+        for (Handle c: n.child) {
+            if (c != NONE) {
+                stack.push_back(c);
+            }
+        }
+        if (n.slot != NONE) {
+            releaseSlot(n.slot);
+            --numValues;
+            countValue(n.depth, -1);
+        }
+        if (curr != h) {
+            /* freed trie nodes are reset when they are allocated again */
+            freeNodes.push_back(curr);
+        }
+    }
+    TrieNode &root = mutableNode(h);
+    root.child[0] = NONE;
+    root.child[1] = NONE;
+    root.slot = NONE;
+    prune(h);
+}
+
+void NodeStore::prune(Handle h) {
+    while (h != ROOT && node(h).slot == NONE && node(h).child[0] == NONE && node(h).child[1] == NONE) {
+        Handle parent = node(h).parent;
+        mutableNode(parent).child[node(parent).child[1] == h] = NONE;
+        freeNodes.push_back(h);
+        h = parent;
+    }
+}
+
+NodeStore::Handle NodeStore::allocateNode(Handle parent) {
+    Handle h;
+    if (!freeNodes.empty()) {
+        h = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        if (trieSize == trie.size() * NODES_PER_CHUNK) {
+            trie.push_back(std::shared_ptr<TrieNode[]>(new TrieNode[NODES_PER_CHUNK]));
+        }
+        h = static_cast<Handle>(trieSize++);
+    }
+    TrieNode &n = mutableNode(h);
+    n = TrieNode();
+    n.parent = parent;
+    n.depth = parent == NONE ? 0 : node(parent).depth + 1;
+    return h;
+}
+
+uint32_t NodeStore::allocateSlot() {
+    if (!freeSlots.empty()) {
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    if (usedSlots == chunks.size() * SLOTS_PER_CHUNK) {
+        chunks.push_back(newValueChunk());
+    }
+    return usedSlots++;
+}
+
+void NodeStore::releaseSlot(uint32_t slot) {
+    secure_memzero(mutableSlotData(slot), valLen);
+    freeSlots.push_back(slot);
+}
+
+void NodeStore::countValue(uint32_t depth, int64_t delta) {
+    if (depthCounts.size() <= depth) {
+        depthCounts.resize(depth + 1);
+    }
+    depthCounts[depth] += delta;
+}
+
+size_t NodeStore::residentBytes() const {
+    return chunks.size() * valueChunkLen() + trie.size() * NODES_PER_CHUNK * sizeof(TrieNode) +
+           (freeNodes.capacity() + freeSlots.capacity()) * sizeof(uint32_t);
+}
+
+void NodeStore::trackChanges(bool enabled) {
+    tracking = enabled;
+    changes.clear();
+}
+
+std::vector<NodeDelta> NodeStore::takeChanges() {
+    std::vector<NodeDelta> taken;
+    taken.reserve(changes.size());
+    for (size_t i = 0; i < changes.size(); ++i) {
+        taken.push_back(changes[i]);
+    }
+    changes.clear();
+    return taken;
+}
+
+void NodeStore::apply(const NodeDelta &change) {
+    const BitPrefix &prefix = change.prefix;
+    if (change.op == NodeDelta::Op::SET) {
+        if (change.value.size() != valLen) {
+            throw PPRFDeserializationError();
+        }
+        Handle curr = ROOT;
+        for (size_t i = 0; i < prefix.size(); ++i) {
+            curr = findOrCreateChild(curr, prefix[i]);
+        }
+        setValue(curr, change.value.data());
+        return;
+    }
+    if (change.op == NodeDelta::Op::PREPEND_ZEROS) {
+        prependZeros(prefix.size());
+        return;
+    }
+    Handle h = find(prefix.size(), [&prefix](size_t i) { return prefix[i]; });
+    if (h == NONE) {
+        return;
+    }
+    if (change.op == NodeDelta::Op::ERASE) {
+        erase(h);
+    } else {
+        eraseSubtree(h);
+    }
+}
+
+BitPrefix NodeStore::prefixOf(Handle h) const {
+    std::vector<bool> bits;
+    for (; h != ROOT; h = node(h).parent) {
+        bits.push_back(node(node(h).parent).child[1] == h);
+    }
+    BitPrefix prefix;
+    for (auto it = bits.rbegin(); it != bits.rend(); ++it) {
+        prefix.push_back(*it);
+    }
+    return prefix;
+}
+
+void NodeStore::prependZeros(size_t bits) {
+    if (bits == 0) {
+        return;
+    }
+    /* the nodes are inserted in lexicographic order into a fresh store, reusing the path of the previous node */
+    NodeStore grown(valLen);
+    std::vector<Handle> path{ROOT};
+    for (size_t i = 0; i < bits; ++i) {
+        path.push_back(grown.findOrCreateChild(path.back(), false));
+    }
+    const Handle formerRoot = path.back();
+    BitPrefix previous;
+    forEach([&grown, &path, &previous, bits](const BitPrefix &prefix, const unsigned char *value) {
+        path.resize(bits + prefix.commonPrefixLength(previous) + 1);
+        for (size_t d = path.size() - 1 - bits; d < prefix.size(); ++d) {
+            path.push_back(grown.findOrCreateChild(path.back(), prefix[d]));
+        }
+        grown.setValue(path.back(), value);
+        previous = prefix;
+    });
+    grown.prune(formerRoot);
+    grown.tracking = tracking;
+    grown.changes = std::move(changes);
+    *this = std::move(grown);
+    if (tracking) {
+        BitPrefix zeros;
+        for (size_t i = 0; i < bits; ++i) {
+            zeros.push_back(false);
+        }
+        record(NodeDelta::Op::PREPEND_ZEROS, ROOT, zeros);
+    }
+}
+
+void NodeStore::record(NodeDelta::Op op, Handle h, const BitPrefix &prefix) {
+    NodeDelta change{op, prefix, SecureByteBuffer()};
+    if (op == NodeDelta::Op::SET) {
+        change.value = getValue(h);
+    }
+    changes.push_back(std::move(change));
+}
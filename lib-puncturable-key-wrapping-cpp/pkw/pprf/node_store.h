@@ -0,0 +1,396 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_NODE_STORE_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_NODE_STORE_H
+
+#include "../secure_byte_buffer.h"
+#include "secret_root.h"
+#include "shared_chunks.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A path from the root of a GGM tree, stored as a packed bit string (most significant bit of a word first).
+ */
+class BitPrefix {
+    public:
+        BitPrefix() = default;
+
+        /**
+         * Constructs a BitPrefix from a bit-string, e.g. "0110".
+         * @param bits the bit-string
+         */
+        explicit BitPrefix(const std::string &bits);
+
+        size_t size() const { return len; }
+
+        bool operator[](size_t i) const { return (words[i >> 6] >> (63 - (i & 63))) & 1; }
+
+        void push_back(bool bit);
+
+        /**
+         * Shortens the prefix to its first n bits.
+         */
+        void truncate(size_t n);
+
+        /**
+         * @return the prefix as a bit-string, e.g. "0110"
+         */
+        std::string toString() const;
+
+        bool operator==(const BitPrefix &rhs) const;
+
+        /**
+         * @return the length of the longest common prefix of this and other
+         */
+        size_t commonPrefixLength(const BitPrefix &other) const;
+
+    private:
+        std::vector<uint64_t> words;
+        size_t len = 0;
+};
+
+/**
+ * A change to a NodeStore: a node value set, a node erased, a subtree erased or the prefixes of all nodes extended by
+ * leading zeros, whose number is the length of the prefix of the change.
+ */
+struct NodeDelta {
+    enum class Op : uint8_t {
+        SET = 0,
+        ERASE = 1,
+        ERASE_SUBTREE = 2,
+        PREPEND_ZEROS = 3
+    };
+    Op op;
+    BitPrefix prefix;
+    /**
+     * the new value, only for SET
+     */
+    SecureByteBuffer value;
+};
+
+/**
+ * Stores the nodes of a punctured GGM key in a binary trie.
+ *
+ * Prefixes are not stored explicitly, they are given by the position of a node in the trie. This allows to find the
+ * node matching a tag in a single walk from the root, without allocating, and to drop all nodes below a prefix in
+ * time proportional to the size of the subtree.
+ * Trie nodes are addressed by index (Handle). Trie nodes and node values live in fixed-size chunks which are
+ * never reallocated. Copies of a store share their chunks, free lists and recorded changes until they modify them (see
+ * SharedChunks), such that a copy is cheap and a modification of the copy only duplicates the chunks it touches. Node values are erased when
+ * released, and chunks of values are erased once no copy refers to them.
+ * Chunks of values are page-aligned and locked in memory (mlock) as long as the limit of locked memory permits, such
+ * that they are not swapped out. A stored node takes its value and a 20 byte trie node, e.g. 36 bytes with 128 bit
+ * keys, plus the trie nodes on the path to it which are not shared with other nodes.
+ * <br>
+ * Copies of a store may be read and modified by different threads. A single store is not thread-safe, but concurrent
+ * reads through its const members are.
+ */
+class NodeStore {
+    public:
+        using Handle = uint32_t;
+        static constexpr Handle NONE = UINT32_MAX;
+        static constexpr Handle ROOT = 0;
+
+        /**
+         * Constructs an empty store.
+         * @param valueLen the size of a node value in bytes
+         */
+        explicit NodeStore(size_t valueLen = 0);
+
+        /**
+         * Constructs a store from SecretRoots, indexed by their prefix.
+         */
+        NodeStore(size_t valueLen, const std::unordered_map<std::string, SecretRoot> &roots);
+
+        NodeStore(const NodeStore &other) = default;
+        NodeStore(NodeStore &&other) noexcept;
+        NodeStore &operator=(const NodeStore &other) = default;
+        NodeStore &operator=(NodeStore &&other) noexcept;
+
+        /**
+         * @return the number of stored nodes (trie nodes holding a value)
+         */
+        size_t size() const { return numValues; }
+
+        bool empty() const { return numValues == 0; }
+
+        size_t valueLen() const { return valLen; }
+
+        /**
+         * @return the number of stored nodes at each depth, maintained incrementally; may have trailing zeros
+         */
+        const std::vector<uint64_t> &depthHistogram() const { return depthCounts; }
+
+        /**
+         * @return the memory allocated for the values and the trie, in bytes. Chunks shared with copies of the store
+         * are counted in full.
+         */
+        size_t residentBytes() const;
+
+        /**
+         * Inserts (or overwrites) the node with the given bit-string prefix.
+         */
+        void insert(const std::string &prefix, const SecureByteBuffer &value);
+
+        bool contains(const std::string &prefix) const;
+
+        /**
+         * Returns the node stored under the bit-string prefix, or an empty SecretRoot if there is none.
+         */
+        SecretRoot operator[](const std::string &prefix) const;
+
+        /**
+         * Removes the node stored under the bit-string prefix.
+         * @return whether a node was removed
+         */
+        bool erase(const std::string &prefix);
+
+        /**
+         * Walks from the root along the path given by bitAt and returns the deepest trie node holding a value.
+         * @param len the length of the path
+         * @param bitAt a function returning the bit of the path at a given depth
+         * @param depth is set to the depth of the returned node
+         * @return the handle of the node, or NONE if no node on the path holds a value
+         */
+        template<class BitFn>
+        Handle findLongestPrefix(size_t len, BitFn bitAt, size_t &depth) const {
+            Handle match = NONE;
+            Handle curr = ROOT;
+            size_t d = 0;
+            while (true) {
+                const TrieNode &n = node(curr);
+                if (n.slot != NONE) {
+                    match = curr;
+                    depth = d;
+                }
+                if (d == len) {
+                    break;
+                }
+                Handle next = n.child[bitAt(d)];
+                if (next == NONE) {
+                    break;
+                }
+                curr = next;
+                ++d;
+            }
+            return match;
+        }
+
+        /**
+         * Walks from the root along the path given by bitAt.
+         * @return the handle of the trie node at the end of the path, or NONE if the trie does not contain the path
+         */
+        template<class BitFn>
+        Handle find(size_t len, BitFn bitAt) const {
+            Handle curr = ROOT;
+            for (size_t d = 0; d < len && curr != NONE; ++d) {
+                curr = node(curr).child[bitAt(d)];
+            }
+            return curr;
+        }
+
+        /**
+         * Replaces the node h at the given depth by the co-path of the path given by bitAt: the sibling of the
+         * path at depth i+1 receives the value at coPath + (i - depth) * valueLen().
+         */
+        template<class BitFn>
+        void replaceByCoPath(Handle h, size_t depth, size_t len, BitFn bitAt, const unsigned char *coPath) {
+            /* the prefixes of recorded changes are built along the path instead of walking up from each node */
+            BitPrefix prefix;
+            if (tracking) {
+                prefix = prefixOf(h);
+            }
+            Handle curr = h;
+            for (size_t i = depth; i < len; ++i) {
+                bool bit = bitAt(i);
+                Handle sibling = findOrCreateChild(curr, !bit);
+                storeValue(sibling, coPath + (i - depth) * valLen);
+                if (tracking) {
+                    prefix.push_back(!bit);
+                    record(NodeDelta::Op::SET, sibling, prefix);
+                    prefix.truncate(i);
+                    prefix.push_back(bit);
+                }
+                if (i + 1 < len) {
+                    curr = findOrCreateChild(curr, bit);
+                }
+            }
+            if (tracking && hasValue(h)) {
+                prefix.truncate(depth);
+                record(NodeDelta::Op::ERASE, h, prefix);
+            }
+            releaseValue(h);
+            prune(h);
+        }
+
+        Handle child(Handle h, bool bit) const { return node(h).child[bit]; }
+
+        Handle findOrCreateChild(Handle h, bool bit);
+
+        bool hasValue(Handle h) const { return node(h).slot != NONE; }
+
+        const unsigned char *value(Handle h) const { return slotData(node(h).slot); }
+
+        SecureByteBuffer getValue(Handle h) const;
+
+        void setValue(Handle h, const unsigned char *value);
+
+        /**
+         * Erases the value of h and removes the trie nodes which no longer lead to a value.
+         */
+        void erase(Handle h);
+
+        /**
+         * Erases all values stored in the subtree rooted at h (including h) and removes the subtree.
+         */
+        void eraseSubtree(Handle h);
+
+        /**
+         * Prepends the given number of zero bits to the prefixes of all nodes, such that the nodes become the left-most
+         * subtree of a deeper trie. Takes time linear in the number of nodes.
+         */
+        void prependZeros(size_t bits);
+
+        /**
+         * Starts (or stops) recording the changes made to the store, such that they can be persisted incrementally.
+         * Stopping discards the changes recorded so far.
+         */
+        void trackChanges(bool enabled);
+
+        bool tracksChanges() const { return tracking; }
+
+        /**
+         * @return the changes made since change tracking was enabled or since the last call, in order
+         */
+        std::vector<NodeDelta> takeChanges();
+
+        /**
+         * Applies a change recorded by another store. Erasing a node which is not stored has no effect.
+         * @throws PPRFDeserializationError if the size of the value does not match
+         */
+        void apply(const NodeDelta &change);
+
+        /**
+         * Calls f(const BitPrefix &prefix, const unsigned char *value) for each stored node, in lexicographic order of
+         * the prefixes.
+         */
+        template<class F>
+        void forEach(F f) const {
+            std::vector<std::pair<Handle, size_t>> stack;
+            BitPrefix prefix;
+            stack.emplace_back(ROOT, 0);
+            while (!stack.empty()) {
+                auto [h, d] = stack.back();
+                stack.pop_back();
+                if (d > 0) {
+                    prefix.truncate(d - 1);
+                    prefix.push_back(node(node(h).parent).child[1] == h);
+                }
+                if (node(h).slot != NONE) {
+                    f(static_cast<const BitPrefix &>(prefix), slotData(node(h).slot));
+                }
+                for (int bit = 1; bit >= 0; --bit) {
+                    if (node(h).child[bit] != NONE) {
+                        stack.emplace_back(node(h).child[bit], d + 1);
+                    }
+                }
+            }
+        }
+
+    private:
+        struct TrieNode {
+            Handle child[2] = {NONE, NONE};
+            Handle parent = NONE;
+            uint32_t slot = NONE;
+            uint32_t depth = 0;
+        };
+
+        static const size_t NODES_PER_CHUNK = 256;
+        static const size_t SLOTS_PER_CHUNK = 256;
+
+        size_t valLen;
+        size_t numValues = 0;
+        SharedChunks<TrieNode> trie;
+        size_t trieSize = 0;
+        SharedStack<Handle> freeNodes;
+        SharedChunks<unsigned char> chunks;
+        SharedStack<uint32_t> freeSlots;
+        uint32_t usedSlots = 0;
+        /**
+         * the number of stored values at each depth
+         */
+        std::vector<uint64_t> depthCounts;
+        bool tracking = false;
+        /**
+         * shared with copies like the chunks, such that copying a store which tracks its changes does not copy them
+         */
+        SharedStack<NodeDelta, 64> changes;
+
+        const TrieNode &node(Handle h) const { return trie[h / NODES_PER_CHUNK][h % NODES_PER_CHUNK]; }
+
+        /**
+         * @return the trie node for modification, after copying its chunk if the chunk is shared with another store
+         */
+        TrieNode &mutableNode(Handle h);
+
+        const unsigned char *slotData(uint32_t slot) const {
+            return chunks[slot / SLOTS_PER_CHUNK] + (slot % SLOTS_PER_CHUNK) * valLen;
+        }
+
+        /**
+         * @return the value slot for modification, after copying its chunk if the chunk is shared with another store
+         */
+        unsigned char *mutableSlotData(uint32_t slot);
+
+        static size_t pageSize();
+
+        size_t valueChunkLen() const;
+
+        std::shared_ptr<unsigned char[]> newValueChunk() const;
+
+        void countValue(uint32_t depth, int64_t delta);
+
+        void reset();
+
+        uint32_t allocateSlot();
+
+        void releaseSlot(uint32_t slot);
+
+        Handle allocateNode(Handle parent);
+
+        void prune(Handle h);
+
+        Handle findString(const std::string &prefix) const;
+
+        BitPrefix prefixOf(Handle h) const;
+
+        void record(NodeDelta::Op op, Handle h, const BitPrefix &prefix);
+
+        void storeValue(Handle h, const unsigned char *value);
+
+        void releaseValue(Handle h);
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_NODE_STORE_H
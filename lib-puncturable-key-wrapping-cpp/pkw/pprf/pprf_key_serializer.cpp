@@ -19,100 +19,291 @@
  **********************************************************************************************************************/
 
 #include "pprf_key_serializer.h"
+#include "byte_cursor.h"
+#include "compact_key_view.h"
 #include "pprf_exceptions.h"
 #include "secret_root.h"
-#include <arpa/inet.h>
+#include <algorithm>
 
-SecureByteBuffer PPRFKeySerializer::serialize() {
-    SecureByteBuffer buffer = SecureByteBuffer();
-    std::vector<unsigned char> &underlyingBuffer = buffer.vec;
-    writeInteger(underlyingBuffer, keyToSerialize.tagLen);
-    writeInteger(underlyingBuffer, keyToSerialize.keyLen);
-    writeInteger(underlyingBuffer, keyToSerialize.puncs);
-    writeInteger(underlyingBuffer, keyToSerialize.nodes.size());
-    for (auto &node: keyToSerialize.nodes) {
-        writeNode(underlyingBuffer, node.second);
-    }
-    return buffer;
+static const uint64_t FORMAT_MAGIC_MASK = 0xFF00000000000000;
+static const size_t HEADER_LEN = 6 * sizeof(uint64_t);
+static const size_t DELTA_HEADER_LEN = 2 * sizeof(uint64_t);
+static const size_t DELTA_CHANGE_HEADER_LEN = 1 + 2 * sizeof(uint32_t);
+
+SecureByteBuffer PPRFKeySerializer::serialize(KeyFormat format) const {
+    return format == KeyFormat::COMPACT ? serializeCompact() : serializePlain();
 }
 
-PPRFKey PPRFKeySerializer::deserialize(SecureByteBuffer &serialized) {
-    size_t offset = 0;
-    int tagLen = getInt(serialized, offset);
-    offset += sizeof(uint64_t);
-    int keyLen = getInt(serialized, offset);
-    offset += sizeof(uint64_t);
-    int puncs = getInt(serialized, offset);
-    offset += sizeof(uint64_t);
-    size_t numNodes = getSize(serialized, offset);
-    offset += sizeof(uint64_t);
-    std::unordered_map<std::string, SecretRoot> nodes;
-    for (int i = 0; i < numNodes; ++i) {
-        size_t stringSize = getSize(serialized, offset);
-        offset += sizeof(size_t);
-        std::string prefix = getString(serialized, offset, stringSize);
-        offset += stringSize;
-        int keyBytes = keyLen / 8;
-        SecureByteBuffer value = copyValue(serialized, offset, keyBytes);
-        offset += keyBytes;
-        nodes.insert({prefix, {prefix, value}});
-    }
-    if (offset != serialized.size()) {
-        throw PPRFDeserializationError();
+size_t PPRFKeySerializer::serializedSize(KeyFormat format) const {
+    if (format == KeyFormat::PLAIN) {
+        return plainSize();
     }
-    return {keyLen, tagLen, puncs, nodes};
+    size_t nodeBytes;
+    const size_t indexEntries = compactLayout(nodeBytes).size();
+    return HEADER_LEN + sizeof(uint64_t) * (1 + indexEntries) + nodeBytes;
 }
 
+size_t PPRFKeySerializer::plainSize() const {
+    const NodeStore &nodes = keyToSerialize.nodes;
+    size_t prefixBytes = 0;
+    nodes.forEach([&prefixBytes](const BitPrefix &prefix, const unsigned char *) { prefixBytes += prefix.size(); });
+    return HEADER_LEN + nodes.size() * (sizeof(uint64_t) + nodes.valueLen()) + prefixBytes;
+}
 
-void PPRFKeySerializer::writeNode(std::vector<unsigned char> &buffer, const SecretRoot &node) {
-    writeInteger(buffer, node.getPrefix().size());
-    copy(buffer, (unsigned char *) node.getPrefix().c_str(), node.getPrefix().size());
-    copy(buffer, node.getValue().data(), node.getValue().size());
+std::vector<uint64_t> PPRFKeySerializer::compactLayout(size_t &nodeBytes) const {
+    const NodeStore &nodes = keyToSerialize.nodes;
+    const size_t valueLen = nodes.valueLen();
+    const uint64_t interval = CompactKeyView::INDEX_INTERVAL;
+    /* nodes referenced by the index do not share bits with their predecessor */
+    std::vector<uint64_t> index;
+    index.reserve(nodes.size() == 0 ? 0 : (nodes.size() - 1) / interval + 1);
+    nodeBytes = 0;
+    size_t i = 0;
+    BitPrefix previous;
+    nodes.forEach([&](const BitPrefix &prefix, const unsigned char *) {
+        size_t shared = 0;
+        if (i++ % interval == 0) {
+            index.push_back(nodeBytes);
+        } else {
+            shared = prefix.commonPrefixLength(previous);
+        }
+        nodeBytes += ByteWriter::varIntSize(shared) + ByteWriter::varIntSize(prefix.size() - shared) +
+                     (prefix.size() - shared + 7) / 8 + valueLen;
+        previous = prefix;
+    });
+    return index;
 }
-void PPRFKeySerializer::copy(std::vector<unsigned char> &buffer, const unsigned char *toCopy, size_t size) {
-    for (int i = 0; i < size; ++i) {
-        buffer.push_back(toCopy[i] & 0xFF);
-    }
+
+SecureByteBuffer PPRFKeySerializer::serializePlain() const {
+    const NodeStore &nodes = keyToSerialize.nodes;
+    const size_t valueLen = nodes.valueLen();
+    SecureByteBuffer buffer(plainSize());
+    ByteWriter out(buffer);
+    out.writeUInt64(FORMAT_MAGIC | static_cast<uint64_t>(KeyFormat::PLAIN));
+    out.writeUInt64(prgWord(keyToSerialize));
+    out.writeUInt64(keyToSerialize.tagLen);
+    out.writeUInt64(keyToSerialize.keyLen);
+    out.writeUInt64(keyToSerialize.puncs);
+    out.writeUInt64(nodes.size());
+    nodes.forEach([&out, valueLen](const BitPrefix &prefix, const unsigned char *value) {
+        out.writeUInt64(prefix.size());
+        unsigned char *chars = out.skip(prefix.size());
+        for (size_t i = 0; i < prefix.size(); ++i) {
+            chars[i] = prefix[i] ? '1' : '0';
+        }
+        out.writeBytes(value, valueLen);
+    });
+    return buffer;
 }
 
-void PPRFKeySerializer::writeInteger(std::vector<unsigned char> &underlyingBuffer, uint64_t t1) {
-    uint64_t t2 = htonll(t1);
-    for (int i = 0; i < sizeof(uint64_t); ++i) {
-        unsigned char byte = (t2 >> (8 * i)) & 0xFF;
-        underlyingBuffer.push_back(byte);
+SecureByteBuffer PPRFKeySerializer::serializeCompact() const {
+    const NodeStore &nodes = keyToSerialize.nodes;
+    const size_t valueLen = nodes.valueLen();
+    const uint64_t interval = CompactKeyView::INDEX_INTERVAL;
+    size_t nodeBytes;
+    const std::vector<uint64_t> index = compactLayout(nodeBytes);
+    SecureByteBuffer buffer(HEADER_LEN + sizeof(uint64_t) * (1 + index.size()) + nodeBytes);
+    ByteWriter out(buffer);
+    out.writeUInt64(FORMAT_MAGIC | static_cast<uint64_t>(KeyFormat::COMPACT));
+    out.writeUInt64(prgWord(keyToSerialize));
+    out.writeUInt64(keyToSerialize.tagLen);
+    out.writeUInt64(keyToSerialize.keyLen);
+    out.writeUInt64(keyToSerialize.puncs);
+    out.writeUInt64(nodes.size());
+    out.writeUInt64(interval);
+    for (uint64_t entry: index) {
+        out.writeUInt64(entry);
     }
+    size_t i = 0;
+    BitPrefix previous;
+    nodes.forEach([&](const BitPrefix &prefix, const unsigned char *value) {
+        size_t shared = i++ % interval == 0 ? 0 : prefix.commonPrefixLength(previous);
+        out.writeVarInt(shared);
+        out.writeVarInt(prefix.size() - shared);
+        const size_t bitBytes = (prefix.size() - shared + 7) / 8;
+        unsigned char *bits = out.skip(bitBytes);
+        std::fill_n(bits, bitBytes, 0);
+        for (size_t b = shared; b < prefix.size(); ++b) {
+            bits[(b - shared) / 8] |= prefix[b] << (7 - (b - shared) % 8);
+        }
+        out.writeBytes(value, valueLen);
+        previous = prefix;
+    });
+    return buffer;
 }
 
-
-int PPRFKeySerializer::getInt(SecureByteBuffer b, size_t offset) {
-    uint64_t ret = getUInt64(b, offset);
-    return ntohll(ret);
-}
-size_t PPRFKeySerializer::getSize(SecureByteBuffer b, size_t offset) {
-    uint64_t ret = getUInt64(b, offset);
-    return ntohll(ret);
+PPRFKey PPRFKeySerializer::deserialize(const SecureByteBuffer &serialized) {
+    return deserialize(std::span<const uint8_t>(serialized.data(), serialized.size()));
 }
-size_t PPRFKeySerializer::getUInt64(SecureByteBuffer &b, size_t offset) {
-    if (b.size() < offset + sizeof(uint64_t)) {
+
+PPRFKey PPRFKeySerializer::deserialize(std::span<const uint8_t> serialized) {
+    if (CompactKeyView::isCompact(serialized)) {
+        return deserializeCompact(serialized);
+    }
+    ByteReader in(serialized);
+    PRGType prg = PRGType::HKDF_SHA256;
+    int arityBits = 1;
+    int maxTagLen = 0;
+    uint64_t header = in.readUInt64();
+    if ((header & FORMAT_MAGIC_MASK) == FORMAT_MAGIC) {
+        if ((header & ~FORMAT_MAGIC_MASK) != static_cast<uint64_t>(KeyFormat::PLAIN)) {
+            throw PPRFDeserializationError();
+        }
+        readPRGWord(in.readUInt64(), prg, arityBits, maxTagLen);
+        header = in.readUInt64();
+    }
+    /* otherwise, the key was serialized before versioning was introduced and uses HKDF */
+    int tagLen = static_cast<int>(header);
+    if (tagLen % arityBits != 0 || (maxTagLen != 0 && (maxTagLen < tagLen || maxTagLen % arityBits != 0))) {
         throw PPRFDeserializationError();
     }
-    uint64_t ret = 0;
-    for (int i = 0; i < sizeof(uint64_t); i++) {
-        uint64_t byte = b.data()[offset + i];
-        ret = ret | (byte << (i * 8));
+    int keyLen = static_cast<int>(in.readUInt64());
+    int puncs = static_cast<int>(in.readUInt64());
+    uint64_t numNodes = in.readUInt64();
+    const size_t valueLen = keyLen / 8;
+    NodeStore nodes(valueLen);
+    /* path[d] is the trie node at depth d of the previous prefix; as the nodes are written in lexicographic order,
+     * each node only descends from where its prefix departs from the previous one */
+    std::vector<NodeStore::Handle> path{NodeStore::ROOT};
+    std::span<const uint8_t> previous;
+    for (uint64_t i = 0; i < numNodes; ++i) {
+        std::span<const uint8_t> prefix = in.readBytes(in.readUInt64());
+        if (prefix.size() > static_cast<size_t>(tagLen)) {
+            throw PPRFDeserializationError();
+        }
+        size_t shared = std::mismatch(prefix.begin(), prefix.end(), previous.begin(), previous.end()).first - prefix.begin();
+        path.resize(shared + 1);
+        for (size_t d = shared; d < prefix.size(); ++d) {
+            if (prefix[d] != '0' && prefix[d] != '1') {
+                throw PPRFDeserializationError();
+            }
+            path.push_back(nodes.findOrCreateChild(path.back(), prefix[d] == '1'));
+        }
+        nodes.setValue(path.back(), in.readBytes(valueLen).data());
+        previous = prefix;
     }
-    return ret;
+    if (in.remaining() != 0) {
+        throw PPRFDeserializationError();
+    }
+    return {keyLen, tagLen, puncs, std::move(nodes), prg, 1 << arityBits, maxTagLen};
+}
+
+PPRFKey PPRFKeySerializer::deserializeCompact(std::span<const uint8_t> serialized) {
+    CompactKeyView view(serialized);
+    NodeStore nodes(view.keyLen() / 8);
+    /* path[d] is the trie node at depth d of the previous prefix */
+    std::vector<NodeStore::Handle> path{NodeStore::ROOT};
+    BitPrefix previous;
+    view.forEach([&nodes, &path, &previous](const BitPrefix &prefix, const unsigned char *value) {
+        size_t shared = prefix.commonPrefixLength(previous);
+        path.resize(shared + 1);
+        for (size_t d = shared; d < prefix.size(); ++d) {
+            path.push_back(nodes.findOrCreateChild(path.back(), prefix[d]));
+        }
+        nodes.setValue(path.back(), value);
+        previous = prefix;
+    });
+    return {view.keyLen(), view.tagLen(), view.puncs(), std::move(nodes), view.prg(), 1 << view.arityBits(),
+            view.maxTagLen()};
 }
-std::string PPRFKeySerializer::getString(SecureByteBuffer b, size_t offset, size_t length) {
-    if (b.size() < offset + length) {
+
+uint64_t PPRFKeySerializer::prgWord(const PPRFKey &key) {
+    const uint64_t maxTagLen = key.maxTagLen == key.tagLen ? 0 : key.maxTagLen;
+    return static_cast<uint64_t>(key.prg) | static_cast<uint64_t>(key.arityBits - 1) << 8 | maxTagLen << 16;
+}
+
+void PPRFKeySerializer::readPRGWord(uint64_t word, PRGType &prg, int &arityBits, int &maxTagLen) {
+    const uint64_t prgId = word & 0xFF;
+    const uint64_t bits = (word >> 8 & 0xFF) + 1;
+    /* keys of dry runs (PRGType::STRUCTURE_ONLY) protect nothing and are not accepted */
+    if (prgId > static_cast<uint64_t>(PRGType::FIXED_KEY_AES) || bits > 8 || word >> 32 != 0) {
         throw PPRFDeserializationError();
     }
-    return {b.vec.begin() + offset, b.vec.begin() + offset + length};
+    prg = static_cast<PRGType>(prgId);
+    arityBits = static_cast<int>(bits);
+    maxTagLen = static_cast<int>(word >> 16);
 }
-SecureByteBuffer PPRFKeySerializer::copyValue(SecureByteBuffer from, size_t offset, size_t length) {
-    if (from.size() < offset + length) {
+
+SecureByteBuffer PPRFKeySerializer::serializeDelta(int puncs, const std::vector<NodeDelta> &changes) {
+    std::vector<uint32_t> shared(changes.size());
+    size_t size = DELTA_HEADER_LEN;
+    for (size_t c = 0; c < changes.size(); ++c) {
+        const BitPrefix &prefix = changes[c].prefix;
+        shared[c] = c == 0 ? 0 : prefix.commonPrefixLength(changes[c - 1].prefix);
+        size += DELTA_CHANGE_HEADER_LEN + (prefix.size() - shared[c] + 7) / 8;
+        if (changes[c].op == NodeDelta::Op::SET) {
+            size += changes[c].value.size();
+        }
+    }
+    SecureByteBuffer buffer(size);
+    ByteWriter out(buffer);
+    out.writeUInt64(puncs);
+    out.writeUInt64(changes.size());
+    for (size_t c = 0; c < changes.size(); ++c) {
+        const NodeDelta &change = changes[c];
+        const BitPrefix &prefix = change.prefix;
+        out.writeByte(static_cast<uint8_t>(change.op));
+        out.writeUInt32(shared[c]);
+        out.writeUInt32(prefix.size() - shared[c]);
+        unsigned char bits = 0;
+        for (size_t i = shared[c]; i < prefix.size(); ++i) {
+            bits |= prefix[i] << (7 - (i - shared[c]) % 8);
+            if ((i - shared[c]) % 8 == 7 || i + 1 == prefix.size()) {
+                out.writeByte(bits);
+                bits = 0;
+            }
+        }
+        if (change.op == NodeDelta::Op::SET) {
+            out.writeBytes(change.value.data(), change.value.size());
+        }
+    }
+    return buffer;
+}
+
+void PPRFKeySerializer::applyDelta(PPRFKey &key, const SecureByteBuffer &delta) {
+    ByteReader in(std::span<const uint8_t>(delta.data(), delta.size()));
+    uint64_t puncs = in.readUInt64();
+    uint64_t numChanges = in.readUInt64();
+    const size_t valueLen = key.nodes.valueLen();
+    NodeDelta change;
+    for (uint64_t c = 0; c < numChanges; ++c) {
+        uint8_t op = in.readByte();
+        if (op > static_cast<uint8_t>(NodeDelta::Op::PREPEND_ZEROS)) {
+            throw PPRFDeserializationError();
+        }
+        change.op = static_cast<NodeDelta::Op>(op);
+        uint32_t shared = in.readUInt32();
+        uint32_t further = in.readUInt32();
+        if (shared > change.prefix.size()) {
+            throw PPRFDeserializationError();
+        }
+        /* nodes below the leaves could never be reached by a tree walk */
+        if (change.op != NodeDelta::Op::PREPEND_ZEROS &&
+            static_cast<size_t>(shared) + further > static_cast<size_t>(key.tagLen)) {
+            throw PPRFDeserializationError();
+        }
+        std::span<const uint8_t> bits = in.readBytes((static_cast<size_t>(further) + 7) / 8);
+        change.prefix.truncate(shared);
+        for (uint32_t i = 0; i < further; ++i) {
+            change.prefix.push_back((bits[i / 8] >> (7 - i % 8)) & 1);
+        }
+        if (change.op == NodeDelta::Op::SET) {
+            std::span<const uint8_t> value = in.readBytes(valueLen);
+            change.value = SecureByteBuffer(valueLen);
+            std::copy(value.begin(), value.end(), change.value.data());
+        }
+        if (change.op == NodeDelta::Op::PREPEND_ZEROS) {
+            /* the tree grew, see GGM_PPRF::growTagLen */
+            if (change.prefix.size() > static_cast<size_t>(key.maxTagLen - key.tagLen) ||
+                change.prefix.size() % key.arityBits != 0) {
+                throw PPRFDeserializationError();
+            }
+            key.tagLen += static_cast<int>(change.prefix.size());
+        }
+        key.nodes.apply(change);
+    }
+    if (in.remaining() != 0) {
         throw PPRFDeserializationError();
     }
-    std::vector<unsigned char> res(from.vec.begin() + offset, from.vec.begin() + offset + length);
-    return SecureByteBuffer(res);
-}
\ No newline at end of file
+    key.puncs = static_cast<int>(puncs);
+}
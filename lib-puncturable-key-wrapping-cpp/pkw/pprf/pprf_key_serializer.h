@@ -25,22 +25,117 @@
 #include "../secure_byte_buffer.h"
 #include "ggm_pprf_key.h"
 #include "secret_root.h"
+#include <cstdint>
+#include <span>
+
+/**
+ * The formats a PPRFKey can be serialized in.
+ */
+enum class KeyFormat : uint64_t {
+    /**
+     * every node as prefix length, prefix as bit-string and value
+     */
+    PLAIN = 1,
+    /**
+     * sorted, front-coded and bit-packed nodes with a sparse index, see CompactKeyView
+     */
+    COMPACT = 2
+};
+
+/**
+ * Serializes PPRFKeys. All integers of the header are written as big-endian 64 bit values:
+ * <br>
+ * magic and format version | PRG id and tree shape | tagLen | keyLen | puncs | number of nodes | nodes
+ * <br>
+ * The lowest byte of the second word holds the PRG id, the next byte log2 of the arity of the GGM tree minus one and
+ * the next two bytes the tag length up to which the tree may grow, or 0 if the tag length is fixed, such that keys of
+ * binary trees of a fixed depth are written exactly as before the tree shape was configurable.
+ * <br>
+ * In the plain format, each node is written as prefix length, prefix as bit-string (one byte per bit) and value. The
+ * compact format is described in CompactKeyView; it allows to access the nodes of a key without parsing it.
+ * <br>
+ * Keys serialized before the format was versioned start directly with the tag length; they are still accepted and use
+ * HKDF as PRG.
+ * <br>
+ * Changes to a key (deltas) are serialized as:
+ * <br>
+ * puncs | number of changes | changes (op | bits shared with the previous prefix | number of further bits |
+ * further bits, packed | value, only if a node is set)
+ * <br>
+ * where the op is a single byte and the bit counts are big-endian 32 bit values. As consecutive changes usually concern
+ * neighbouring nodes (e.g. the co-path of a puncture), a delta takes O(tagLen) bytes. Growing the tree (see
+ * GGM_PPRF::growTagLen) is recorded as a change whose prefix holds a zero for each bit added to the tag length.
+ */
 class PPRFKeySerializer {
     public:
-        explicit PPRFKeySerializer(PPRFKey keyToSerialize) : keyToSerialize(std::move(keyToSerialize)) {}
-        SecureByteBuffer serialize();
-        static PPRFKey deserialize(SecureByteBuffer &serialized);
+        static constexpr uint64_t FORMAT_MAGIC = 0xFF00000000000000;
+
+        explicit PPRFKeySerializer(const PPRFKey &keyToSerialize) : keyToSerialize(keyToSerialize) {}
+
+        /**
+         * Serializes the key into a buffer of the exact size, without intermediate copies of the nodes.
+         * @param format the format to write
+         * @return the serialized key
+         */
+        SecureByteBuffer serialize(KeyFormat format = KeyFormat::COMPACT) const;
+
+        /**
+         * Computes the size of the serialized key without serializing it.
+         * @param format the format to write
+         * @return the size of serialize(format) in bytes
+         */
+        size_t serializedSize(KeyFormat format = KeyFormat::COMPACT) const;
+
+        static PPRFKey deserialize(const SecureByteBuffer &serialized);
+
+        /**
+         * Deserializes a key in any format, inserting the nodes directly into the NodeStore of the key. Runs in time
+         * linear in the size of the serialized key if the nodes are ordered lexicographically, as written by serialize.
+         * @param serialized the serialized key
+         * @return the deserialized key
+         * @throws PPRFDeserializationError if the serialized key is malformed
+         */
+        static PPRFKey deserialize(std::span<const uint8_t> serialized);
+
+        /**
+         * Serializes changes made to a key, such that they can be replayed on a copy of the key using applyDelta.
+         * @param puncs the number of punctures of the key after the changes
+         * @param changes the changes, as recorded by the NodeStore of the key
+         * @return the serialized delta
+         */
+        static SecureByteBuffer serializeDelta(int puncs, const std::vector<NodeDelta> &changes);
+
+        /**
+         * Applies a serialized delta to a key.
+         * @throws PPRFDeserializationError if the delta is malformed; the key may be partially modified in this case.
+         */
+        static void applyDelta(PPRFKey &key, const SecureByteBuffer &delta);
+
+        /**
+         * @return the word of the header holding the PRG id and the shape of the tree
+         */
+        static uint64_t prgWord(const PPRFKey &key);
+
+        /**
+         * Parses the word of the header holding the PRG id and the shape of the tree.
+         * @param word the word read from the header
+         * @param prg receives the PRG
+         * @param arityBits receives log2 of the arity
+         * @param maxTagLen receives the tag length up to which the tree may grow, 0 if it is fixed
+         * @throws PPRFDeserializationError if the PRG or the arity are unknown
+         */
+        static void readPRGWord(uint64_t word, PRGType &prg, int &arityBits, int &maxTagLen);
 
     private:
-        PPRFKey keyToSerialize;
-        static int getInt(SecureByteBuffer b, size_t offset);
-        static size_t getSize(SecureByteBuffer buffer, size_t offset);
-        static std::string getString(SecureByteBuffer buffer, size_t offset, size_t length);
-        static SecureByteBuffer copyValue(SecureByteBuffer from, size_t offset, size_t length);
-        static void writeInteger(std::vector<unsigned char> &underlyingBuffer, uint64_t key);
-        void writeNode(std::vector<unsigned char> &buffer, const SecretRoot &node);
-        static void copy(std::vector<unsigned char> &buffer, const unsigned char *toCopy, size_t size);
-        static size_t getUInt64(SecureByteBuffer &b, size_t offset);
+        const PPRFKey &keyToSerialize;
+        SecureByteBuffer serializePlain() const;
+        SecureByteBuffer serializeCompact() const;
+        size_t plainSize() const;
+        /**
+         * Computes the offsets of the nodes referenced by the index of the compact format, and the size of the nodes.
+         */
+        std::vector<uint64_t> compactLayout(size_t &nodeBytes) const;
+        static PPRFKey deserializeCompact(std::span<const uint8_t> serialized);
 };
 
 
@@ -0,0 +1,140 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_SHARED_CHUNKS_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_SHARED_CHUNKS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * A growable sequence of fixed-size chunks which copies share until they modify them (copy-on-write).
+ * <br>
+ * Chunks are grouped in directories of DIRECTORY_SIZE chunks, which are shared as well: a copy takes time proportional
+ * to the number of directories, and the first modification of a chunk after a copy duplicates at most one directory
+ * and the chunk itself. A chunk is destroyed once no copy refers to it anymore.
+ * <br>
+ * Copies may be used by different threads. Concurrent reads of a single instance are safe.
+ */
+template<class T>
+class SharedChunks {
+    public:
+        using Chunk = std::shared_ptr<T[]>;
+        static constexpr size_t DIRECTORY_SIZE = 256;
+
+        /**
+         * @return the number of chunks
+         */
+        size_t size() const { return count; }
+
+        const T *operator[](size_t i) const { return (*directories[i / DIRECTORY_SIZE])[i % DIRECTORY_SIZE].get(); }
+
+        /**
+         * Returns chunk i for modification, after duplicating it if it is shared with a copy.
+         * @param clone a function returning a Chunk holding a copy of the given chunk
+         */
+        template<class CloneFn>
+        T *mutableChunk(size_t i, CloneFn clone) {
+            std::shared_ptr<Directory> &dir = directories[i / DIRECTORY_SIZE];
+            if (dir.use_count() > 1) {
+                dir = std::make_shared<Directory>(*dir);
+            }
+            Chunk &chunk = (*dir)[i % DIRECTORY_SIZE];
+            if (chunk.use_count() > 1) {
+                chunk = clone(static_cast<const T *>(chunk.get()));
+            } else {
+                /* copies may have released the directory or the chunk just now */
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            return chunk.get();
+        }
+
+        void push_back(Chunk chunk) {
+            if (count % DIRECTORY_SIZE == 0) {
+                directories.push_back(std::make_shared<Directory>());
+            } else if (directories.back().use_count() > 1) {
+                directories.back() = std::make_shared<Directory>(*directories.back());
+            }
+            (*directories.back())[count % DIRECTORY_SIZE] = std::move(chunk);
+            ++count;
+        }
+
+        void clear() {
+            directories.clear();
+            count = 0;
+        }
+
+    private:
+        using Directory = std::array<Chunk, DIRECTORY_SIZE>;
+        std::vector<std::shared_ptr<Directory>> directories;
+        size_t count = 0;
+};
+
+/**
+ * A stack kept in SharedChunks of CHUNK_SIZE elements: a copy takes time proportional to the number of directories,
+ * and pushing to or popping from a copy duplicates at most the chunk at the top.
+ * <br>
+ * Popped elements are not destroyed until they are overwritten by a push or the stack is cleared.
+ */
+template<class T, size_t CHUNK_SIZE = 256>
+class SharedStack {
+    public:
+        size_t size() const { return count; }
+
+        bool empty() const { return count == 0; }
+
+        /**
+         * @return the number of elements the allocated chunks hold
+         */
+        size_t capacity() const { return chunks.size() * CHUNK_SIZE; }
+
+        const T &operator[](size_t i) const { return chunks[i / CHUNK_SIZE][i % CHUNK_SIZE]; }
+
+        const T &back() const { return (*this)[count - 1]; }
+
+        void push_back(T value) {
+            if (count == capacity()) {
+                chunks.push_back(std::shared_ptr<T[]>(new T[CHUNK_SIZE]));
+            }
+            T *chunk = chunks.mutableChunk(count / CHUNK_SIZE, [](const T *shared) {
+                std::shared_ptr<T[]> copy(new T[CHUNK_SIZE]);
+                std::copy_n(shared, CHUNK_SIZE, copy.get());
+                return copy;
+            });
+            chunk[count % CHUNK_SIZE] = std::move(value);
+            ++count;
+        }
+
+        void pop_back() { --count; }
+
+        void clear() {
+            chunks.clear();
+            count = 0;
+        }
+
+    private:
+        SharedChunks<T> chunks;
+        size_t count = 0;
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_SHARED_CHUNKS_H
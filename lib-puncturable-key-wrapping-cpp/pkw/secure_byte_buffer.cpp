@@ -20,6 +20,7 @@
 
 #include "secure_byte_buffer.h"
 #include "secure_memzero.h"
+#include <utility>
 
 SecureByteBuffer::~SecureByteBuffer() {
     secure_memzero(vec.data(), vec.size());
@@ -38,18 +39,21 @@ size_t SecureByteBuffer::size() const {
 
 SecureByteBuffer::SecureByteBuffer(const SecureByteBuffer &buff) noexcept : vec(buff.vec) {
 }
-SecureByteBuffer::SecureByteBuffer(SecureByteBuffer &&buff) noexcept : vec(buff.vec) {
-}
 
+/* moving transfers the memory, nothing is left to erase in buff */
+SecureByteBuffer::SecureByteBuffer(SecureByteBuffer &&buff) noexcept : vec(std::move(buff.vec)) {
+    buff.vec.clear();
+}
 
 SecureByteBuffer &SecureByteBuffer::operator=(SecureByteBuffer &&rhs) noexcept {
-    if (vec != rhs.vec) {
+    if (this != &rhs) {
         secure_memzero(vec.data(), vec.size());
-        vec.clear();
-        vec = rhs.vec;
+        vec = std::move(rhs.vec);
+        rhs.vec.clear();
     }
     return *this;
 }
+
 bool SecureByteBuffer::operator==(const SecureByteBuffer &rhs) const {
     return vec == rhs.vec;
 }
@@ -60,4 +64,11 @@ SecureByteBuffer::SecureByteBuffer(std::vector<unsigned char> &vec) : vec(0) {
     this->vec.swap(vec);
 }
 
-SecureByteBuffer &SecureByteBuffer::operator=(const SecureByteBuffer &rhs) noexcept = default;
\ No newline at end of file
+SecureByteBuffer &SecureByteBuffer::operator=(const SecureByteBuffer &rhs) noexcept {
+    if (this != &rhs) {
+        /* the old contents are erased, as the vector may reuse or release its memory */
+        secure_memzero(vec.data(), vec.size());
+        vec = rhs.vec;
+    }
+    return *this;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+/***********************************************************************************************************************
+ * Copyright 2022 Younis Khalil
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ * persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ **********************************************************************************************************************/
+
+#ifndef PUNCTURABLE_KEY_WRAPPING_CPP_SECURE_KEY_H
+#define PUNCTURABLE_KEY_WRAPPING_CPP_SECURE_KEY_H
+#include "secure_byte_buffer.h"
+#include "secure_memzero.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+/**
+ * A secret of N bytes stored inline, which erases its memory before it is destructed.
+ * Unlike SecureByteBuffer, it does not allocate: it can be placed in containers and on the stack without a separate
+ * heap block per key. Moving a key copies the bytes and erases them in the source.
+ * @tparam N the size of the key in bytes
+ */
+template<size_t N>
+class SecureKey {
+    public:
+        SecureKey() : bytes{} {}
+
+        /**
+         * Constructs a key from the first N bytes at data.
+         */
+        explicit SecureKey(const unsigned char *data) {
+            std::copy_n(data, N, bytes.begin());
+        }
+
+        SecureKey(const SecureKey &other) = default;
+
+        SecureKey(SecureKey &&other) noexcept : bytes(other.bytes) {
+            other.erase();
+        }
+
+        SecureKey &operator=(const SecureKey &other) = default;
+
+        SecureKey &operator=(SecureKey &&other) noexcept {
+            if (this != &other) {
+                bytes = other.bytes;
+                other.erase();
+            }
+            return *this;
+        }
+
+        ~SecureKey() {
+            erase();
+        }
+
+        static constexpr size_t size() { return N; }
+
+        unsigned char *data() { return bytes.data(); }
+
+        const unsigned char *data() const { return bytes.data(); }
+
+        bool operator==(const SecureKey &rhs) const { return bytes == rhs.bytes; }
+
+        bool operator!=(const SecureKey &rhs) const { return bytes != rhs.bytes; }
+
+        /**
+         * @return a copy of the key in a SecureByteBuffer
+         */
+        SecureByteBuffer toBuffer() const {
+            SecureByteBuffer buffer(N);
+            std::copy_n(bytes.begin(), N, buffer.data());
+            return buffer;
+        }
+
+    private:
+        std::array<unsigned char, N> bytes;
+
+        void erase() {
+            secure_memzero(bytes.data(), N);
+        }
+};
+
+#endif//PUNCTURABLE_KEY_WRAPPING_CPP_SECURE_KEY_H
@@ -0,0 +1,106 @@
+#include "pkw/pprf/ggm_pprf.h"
+#include "pkw/pprf/pprf_exceptions.h"
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
+
+static const int KEY_LEN = 128;
+static const int TAG_LEN = 64;
+static const int PUNCS = 10000;
+static const int EVALS = 100000;
+
+struct Result {
+    int arity;
+    size_t nodes;
+    size_t serializedBytes;
+    double nodesPerPunc;
+    double bytesPerPunc;
+    /* average times in microseconds */
+    double puncTime;
+    double evalTime;
+    double expectedEvalDerivations;
+};
+
+/**
+ * Punctures a fresh key of the given arity on random tags and evaluates it on other random tags, measuring the trade-off
+ * of the arity: an evaluation takes TAG_LEN / log2(arity) derivations, while a puncture adds arity - 1 nodes per level.
+ */
+Result measure(int arity, std::mt19937_64 &rng) {
+    GGM_PPRF prf(PPRFKey(KEY_LEN, TAG_LEN, PRGType::FIXED_KEY_AES, arity));
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < PUNCS; ++i) {
+        prf.punc(Tag(rng()));
+    }
+    std::chrono::nanoseconds puncTime = std::chrono::high_resolution_clock::now() - start;
+
+    std::vector<Tag> tags;
+    for (int i = 0; i < EVALS; ++i) {
+        tags.emplace_back(rng());
+    }
+    start = std::chrono::high_resolution_clock::now();
+    for (const Tag &tag: tags) {
+        try {
+            prf.eval(tag);
+        } catch (TagException &e) {
+            std::cerr << "Already punc-ed!" << std::endl;
+        }
+    }
+    std::chrono::nanoseconds evalTime = std::chrono::high_resolution_clock::now() - start;
+
+    KeyStats stats = prf.keyStats();
+    size_t serializedBytes = prf.serializeKey().size();
+    return {arity,
+            stats.nodes,
+            serializedBytes,
+            static_cast<double>(stats.nodes) / PUNCS,
+            static_cast<double>(serializedBytes) / PUNCS,
+            puncTime.count() / 1e3 / PUNCS,
+            evalTime.count() / 1e3 / EVALS,
+            stats.expectedEvalDerivations};
+}
+
+int main() {
+    std::cout << "Starting benchmark." << std::endl;
+    std::mt19937_64 rng(42);
+    std::vector<Result> results;
+    for (int arity: {2, 4, 16, 256}) {
+        Result res = measure(arity, rng);
+        std::cout << "arity " << res.arity << ":\t punc " << res.puncTime << "us,\t eval " << res.evalTime << "us ("
+                  << res.expectedEvalDerivations << " derivations),\t " << res.nodesPerPunc << " nodes and "
+                  << res.bytesPerPunc << "B per punc" << std::endl;
+        results.push_back(res);
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/arityBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "arity"
+        << "\t"
+        << "nodes"
+        << "\t"
+        << "serialized_bytes"
+        << "\t"
+        << "nodes_per_punc"
+        << "\t"
+        << "bytes_per_punc"
+        << "\t"
+        << "punc_time_us"
+        << "\t"
+        << "eval_time_us"
+        << "\t"
+        << "expected_eval_derivations" << std::endl;
+    for (auto &res: results) {
+        out << res.arity << "\t" << res.nodes << "\t" << res.serializedBytes << "\t" << res.nodesPerPunc << "\t"
+            << res.bytesPerPunc << "\t" << res.puncTime << "\t" << res.evalTime << "\t" << res.expectedEvalDerivations
+            << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
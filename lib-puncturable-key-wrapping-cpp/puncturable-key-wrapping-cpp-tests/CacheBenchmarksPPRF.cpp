@@ -0,0 +1,122 @@
+#include "pkw/pprf/ggm_pprf.h"
+#include "pkw/pprf/pprf_exceptions.h"
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
+
+static const int KEY_LEN = 256;
+static const int TAG_LEN = 256;
+static const int NUM_FILES = 2000;
+static const int NUM_OPS = 20000;
+/* gets go to one of the most recently added files */
+static const int WORKING_SET = 200;
+
+struct Result {
+    PRGType prg;
+    int shredPercent;
+    size_t budget;
+    double evalTime;
+    double puncTime;
+    double hitRate;
+    size_t cacheBytes;
+};
+
+/**
+ * Replays a workload as produced by a client with sequentially allocated tags (as the FlatIdProvider): files are
+ * added with consecutive tags, read repeatedly while they are recent and shredded at random.
+ * Measures the average time (in microseconds) of an eval and a punc, and the hit rate of the cache.
+ * @param shredPercent the share of operations shredding a file
+ */
+Result measure(PRGType prgType, int shredPercent, size_t budget) {
+    std::mt19937_64 rng(42);
+    GGM_PPRF prf(PPRFKey(KEY_LEN, TAG_LEN, prgType));
+    if (budget > 0) {
+        prf.enableCache(budget);
+    }
+    std::vector<Tag> live;
+    uint64_t nextTag = 0;
+    std::chrono::nanoseconds evalTime(0);
+    std::chrono::nanoseconds puncTime(0);
+    int evals = 0;
+    int puncs = 0;
+    for (int i = 0; i < NUM_OPS; ++i) {
+        uint64_t op = rng() % 100;
+        if (live.empty() || (op < 10 && live.size() < NUM_FILES)) {
+            live.emplace_back(nextTag++);
+            continue;
+        }
+        if (op >= 100 - shredPercent) {
+            size_t victim = rng() % live.size();
+            auto start = std::chrono::high_resolution_clock::now();
+            prf.punc(live[victim]);
+            puncTime += std::chrono::high_resolution_clock::now() - start;
+            ++puncs;
+            live[victim] = live.back();
+            live.pop_back();
+            continue;
+        }
+        size_t recent = std::min<size_t>(live.size(), WORKING_SET);
+        const Tag &tag = live[live.size() - 1 - rng() % recent];
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            prf.eval(tag);
+        } catch (TagException &e) {
+            std::cerr << "Already punc-ed!" << std::endl;
+        }
+        evalTime += std::chrono::high_resolution_clock::now() - start;
+        ++evals;
+    }
+    NodeCache::Stats stats = prf.cacheStats();
+    return {prgType, shredPercent, budget, evalTime.count() / 1000.0 / evals,
+            puncs == 0 ? 0 : puncTime.count() / 1000.0 / puncs, stats.hitRate(), stats.bytes};
+}
+
+std::string prgName(PRGType prg) {
+    return prg == PRGType::HKDF_SHA256 ? "HKDF_SHA256" : "FIXED_KEY_AES";
+}
+
+int main() {
+    std::cout << "Starting benchmark." << std::endl;
+    std::vector<Result> results;
+    for (PRGType prg: {PRGType::HKDF_SHA256, PRGType::FIXED_KEY_AES}) {
+        for (int shredPercent: {0, 10}) {
+            for (size_t budget: {0, 1 << 12, 1 << 16, 1 << 20}) {
+                Result res = measure(prg, shredPercent, budget);
+                std::cout << prgName(prg) << ", " << shredPercent << "% shreds, cache budget " << budget
+                          << "B:\t eval " << res.evalTime << "us,\t punc " << res.puncTime << "us,\t hit rate "
+                          << res.hitRate << ",\t cache size " << res.cacheBytes << "B" << std::endl;
+                results.push_back(res);
+            }
+        }
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/cacheBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "prg"
+        << "\t"
+        << "shred_percent"
+        << "\t"
+        << "cache_budget"
+        << "\t"
+        << "eval_time"
+        << "\t"
+        << "punc_time"
+        << "\t"
+        << "hit_rate"
+        << "\t"
+        << "cache_bytes" << std::endl;
+    for (auto &res: results) {
+        out << prgName(res.prg) << "\t" << res.shredPercent << "\t" << res.budget << "\t" << res.evalTime << "\t" << res.puncTime << "\t"
+            << res.hitRate << "\t" << res.cacheBytes << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
@@ -0,0 +1,107 @@
+#include "pkw/pkw/pprf_aead_pkw.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
+#include <thread>
+
+static const int KEY_LEN = 256;
+static const int TAG_LEN = 256;
+static const int NUM_FILES = 10000;
+static const int INITIAL_PUNCS = 10000;
+static const std::chrono::milliseconds DURATION(2000);
+
+struct Result {
+    int threads;
+    bool puncturing;
+    double unwrapsPerSecond;
+    double puncsPerSecond;
+};
+
+/**
+ * Unwraps keys of random files from several threads for a fixed time, optionally while another thread keeps shredding
+ * files. Measures the throughput of unwraps and punctures.
+ */
+Result measure(int threads, bool puncturing) {
+    PPRF_AEAD_PKW pkw(TAG_LEN, KEY_LEN, PRGType::FIXED_KEY_AES);
+    std::vector<unsigned char> header = {'h'};
+    std::vector<unsigned char> key(32, 'k');
+    std::vector<ciphertext> wrapped;
+    /* files use the even tags, shredding punctures the odd ones */
+    for (int i = 0; i < NUM_FILES; ++i) {
+        wrapped.push_back(pkw.wrap(2 * i, header, key));
+    }
+    std::vector<Tag> initial;
+    for (int i = 0; i < INITIAL_PUNCS; ++i) {
+        initial.emplace_back(2 * (NUM_FILES + i) + 1);
+    }
+    pkw.puncBatch(initial);
+
+    std::atomic<bool> done = false;
+    std::atomic<size_t> unwraps = 0;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < threads; ++t) {
+        readers.emplace_back([&, t]() {
+            std::mt19937_64 rng(t);
+            size_t count = 0;
+            while (!done) {
+                size_t i = rng() % NUM_FILES;
+                pkw.unwrap(2 * i, header, wrapped[i]);
+                ++count;
+            }
+            unwraps += count;
+        });
+    }
+    size_t puncs = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < DURATION) {
+        if (puncturing) {
+            pkw.punc(2 * (puncs++ % NUM_FILES) + 1);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    done = true;
+    for (auto &reader: readers) {
+        reader.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {threads, puncturing, unwraps / seconds, puncs / seconds};
+}
+
+int main() {
+    std::cout << "Starting benchmark on " << std::thread::hardware_concurrency() << " hardware threads." << std::endl;
+    std::vector<Result> results;
+    for (bool puncturing: {false, true}) {
+        for (int threads: {1, 2, 4, 8, 16}) {
+            Result res = measure(threads, puncturing);
+            std::cout << threads << " threads" << (puncturing ? ", shredding" : "") << ":\t "
+                      << res.unwrapsPerSecond << " unwraps/s,\t " << res.puncsPerSecond << " puncs/s" << std::endl;
+            results.push_back(res);
+        }
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/concurrencyBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "threads"
+        << "\t"
+        << "puncturing"
+        << "\t"
+        << "unwraps_per_s"
+        << "\t"
+        << "puncs_per_s" << std::endl;
+    for (auto &res: results) {
+        out << res.threads << "\t" << res.puncturing << "\t" << res.unwrapsPerSecond << "\t" << res.puncsPerSecond
+            << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
@@ -0,0 +1,111 @@
+#include "pkw/pprf/ggm_pprf.h"
+#include "pkw/pprf/pprf_exceptions.h"
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
+
+static const int KEY_LEN = 128;
+static const int TAG_LEN = 64;
+static const size_t TRACE_LEN = 10000000;
+/* the prefix of the trace replayed with derivations, which take too long for the whole trace */
+static const size_t DERIVED_LEN = 1000000;
+
+struct Operation {
+    bool punc;
+    Tag tag;
+};
+
+struct Result {
+    std::string mode;
+    size_t operations;
+    size_t nodes;
+    size_t serializedBytes;
+    /* in seconds */
+    double time;
+};
+
+/**
+ * A trace of a file store: each operation adds a file under the next sequential tag (an evaluation), reads a random
+ * live file (an evaluation) or deletes one (a puncture), such that the number of live files grows slowly.
+ */
+std::vector<Operation> createTrace(std::mt19937_64 &rng) {
+    std::vector<Operation> trace;
+    trace.reserve(TRACE_LEN);
+    std::vector<uint64_t> live;
+    uint64_t next = 0;
+    std::uniform_int_distribution<int> kind(0, 99);
+    while (trace.size() < TRACE_LEN) {
+        const int k = kind(rng);
+        if (live.empty() || k < 30) {
+            live.push_back(next);
+            trace.push_back({false, Tag(next++)});
+        } else if (k < 75) {
+            trace.push_back({false, Tag(live[rng() % live.size()])});
+        } else {
+            const size_t i = rng() % live.size();
+            trace.push_back({true, Tag(live[i])});
+            live[i] = live.back();
+            live.pop_back();
+        }
+    }
+    return trace;
+}
+
+Result replay(const std::string &mode, GGM_PPRF prf, const std::vector<Operation> &trace, size_t operations) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < operations; ++i) {
+        try {
+            if (trace[i].punc) {
+                prf.punc(trace[i].tag);
+            } else {
+                prf.eval(trace[i].tag);
+            }
+        } catch (TagException &e) {
+            std::cerr << "Already punc-ed!" << std::endl;
+        }
+    }
+    std::chrono::nanoseconds time = std::chrono::high_resolution_clock::now() - start;
+    return {mode, operations, prf.keyStats().nodes, prf.serializedKeySize(), time.count() / 1e9};
+}
+
+int main() {
+    std::cout << "Starting benchmark." << std::endl;
+    std::mt19937_64 rng(42);
+    std::vector<Operation> trace = createTrace(rng);
+    std::vector<Result> results;
+    results.push_back(replay("HKDF_SHA256", GGM_PPRF(PPRFKey(KEY_LEN, TAG_LEN)), trace, DERIVED_LEN));
+    results.push_back(
+            replay("FIXED_KEY_AES", GGM_PPRF(PPRFKey(KEY_LEN, TAG_LEN, PRGType::FIXED_KEY_AES)), trace, DERIVED_LEN));
+    results.push_back(replay("DRY_RUN", GGM_PPRF::dryRun(KEY_LEN, TAG_LEN), trace, DERIVED_LEN));
+    results.push_back(replay("DRY_RUN", GGM_PPRF::dryRun(KEY_LEN, TAG_LEN), trace, TRACE_LEN));
+    for (auto &res: results) {
+        std::cout << res.mode << ", " << res.operations << " operations:\t " << res.time << "s,\t " << res.nodes
+                  << " nodes,\t " << res.serializedBytes << "B" << std::endl;
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/dryRunBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "mode"
+        << "\t"
+        << "operations"
+        << "\t"
+        << "time_s"
+        << "\t"
+        << "nodes"
+        << "\t"
+        << "serialized_bytes" << std::endl;
+    for (auto &res: results) {
+        out << res.mode << "\t" << res.operations << "\t" << res.time << "\t" << res.nodes << "\t"
+            << res.serializedBytes << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
@@ -0,0 +1,105 @@
+#include "pkw/pprf/ggm_pprf.h"
+#include "pkw/pprf/pprf_exceptions.h"
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
+
+static const int KEY_LEN = 256;
+static const int TAG_LEN = 256;
+static const int SHRED_PERCENT = 10;
+
+struct Result {
+    PRGType prg;
+    size_t files;
+    double evalTime;
+    double enumTime;
+};
+
+/**
+ * Measures the time (in milliseconds) to derive the wrapping keys of all live files as a key rotation does: under the
+ * old key, whose files were allocated sequential tags (as by the FlatIdProvider) and partly shredded, and under a fresh
+ * key. Compares a full evaluation per file with one traversal of each key.
+ */
+Result measure(PRGType prgType, size_t files) {
+    std::mt19937_64 rng(42);
+    GGM_PPRF old(PPRFKey(KEY_LEN, TAG_LEN, prgType));
+    GGM_PPRF fresh(PPRFKey(KEY_LEN, TAG_LEN, prgType));
+    std::vector<Tag> tags;
+    std::vector<Tag> shredded;
+    for (size_t i = 0; i < files; ++i) {
+        tags.emplace_back(i);
+        if (rng() % 100 < SHRED_PERCENT) {
+            shredded.emplace_back(i);
+        }
+    }
+    old.puncBatch(shredded);
+
+    size_t live = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const Tag &tag: tags) {
+        try {
+            old.eval(tag);
+            fresh.eval(tag);
+            ++live;
+        } catch (TagException &e) {
+            /* shredded */
+        }
+    }
+    std::chrono::nanoseconds evalTime = std::chrono::high_resolution_clock::now() - start;
+
+    size_t visited = 0;
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<Tag> liveTags;
+    liveTags.reserve(live);
+    old.forEachLiveLeaf(tags, [&tags, &liveTags](size_t i, const SecureByteBuffer &) { liveTags.push_back(tags[i]); });
+    fresh.forEachLiveLeaf(liveTags, [&visited](size_t, const SecureByteBuffer &) { ++visited; });
+    std::chrono::nanoseconds enumTime = std::chrono::high_resolution_clock::now() - start;
+    if (visited != live) {
+        std::cerr << "Enumeration missed live files!" << std::endl;
+    }
+    return {prgType, files, evalTime.count() / 1e6, enumTime.count() / 1e6};
+}
+
+std::string prgName(PRGType prg) {
+    return prg == PRGType::HKDF_SHA256 ? "HKDF_SHA256" : "FIXED_KEY_AES";
+}
+
+int main() {
+    std::cout << "Starting benchmark." << std::endl;
+    std::vector<Result> results;
+    for (PRGType prg: {PRGType::HKDF_SHA256, PRGType::FIXED_KEY_AES}) {
+        for (size_t files: {10000, 100000, 1000000}) {
+            if (prg == PRGType::HKDF_SHA256 && files > 100000) {
+                /* a full evaluation per file takes about an hour */
+                continue;
+            }
+            Result res = measure(prg, files);
+            std::cout << prgName(prg) << ", " << res.files << " files:\t eval " << res.evalTime << "ms,\t enumeration "
+                      << res.enumTime << "ms (" << res.evalTime / res.enumTime << "x)" << std::endl;
+            results.push_back(res);
+        }
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/enumerationBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "prg"
+        << "\t"
+        << "files"
+        << "\t"
+        << "eval_time"
+        << "\t"
+        << "enum_time" << std::endl;
+    for (auto &res: results) {
+        out << prgName(res.prg) << "\t" << res.files << "\t" << res.evalTime << "\t" << res.enumTime << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
@@ -48,6 +48,21 @@ TEST(ConstructionH, EvalTestFromTwoNodes) {
     ASSERT_THAT(pprf.eval({0, 1, 0, 1, 1, 0, 0, 1, 0, 0}), ::testing::Eq(exp_vect));
 }
 
+TEST(ConstructionH, EvalTestFromTwoNodesFixedKeyAES) {
+    SecretRoot n1 = SecretRoot("0101", SecureByteBuffer(TEST_KEY_LEN / 8));
+    SecretRoot n2 = SecretRoot("001", SecureByteBuffer(TEST_KEY_LEN / 8));
+    GGM_HPPRF pprf(PPRFKey(TEST_KEY_LEN, 10, 0, {{n1.getPrefix(), n1},
+                                                 {n2.getPrefix(), n2}},
+                           PRGType::FIXED_KEY_AES));
+
+    /* Value found by manual inspection: aes_prg_derivation.py */
+    unsigned char exp[] = "\xbb\x39\x08\xe1\xbb\xaf\x71\x37\x99\x65\x20\x37\x57\xe4\xd7\x70";
+
+    SecureByteBuffer exp_vect(16);
+    std::copy(exp, exp + 16, exp_vect.data());
+    ASSERT_THAT(pprf.eval({0, 1, 0, 1, 1, 0, 0, 1, 0, 0}), ::testing::Eq(exp_vect));
+}
+
 // No disallowed tags anymore!
 //TEST_F(GGMHPPRFTest, TestEvalLessMin) {
 //    ASSERT_THROW(pprf.eval(), TagException);
@@ -115,6 +130,55 @@ TEST_F(GGMHPPRFTest, TestHierarchPunc) {
 }
 
 
+TEST_F(GGMHPPRFTest, TestEvalBatchMatchesEval) {
+    pprf.punc({1, 1});
+    std::vector<std::vector<bool>> tags = {{0, 1, 1}, {0}, {0, 1}, {1, 0, 1}, {0, 1}, {0, 0, 0, 1}, {1, 0}};
+    std::vector<SecureByteBuffer> res = pprf.evalBatch(tags);
+    ASSERT_EQ(res.size(), tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        ASSERT_EQ(res[i], pprf.eval(tags[i])) << "tag " << i;
+    }
+    tags.push_back({1, 1, 0});
+    ASSERT_THROW(pprf.evalBatch(tags), TagException);
+}
+
+TEST_F(GGMHPPRFTest, TestForEachLiveLeafSkipsPunctured) {
+    pprf.punc({1, 1});
+    std::vector<std::vector<bool>> tags = {{0, 1, 1}, {1, 1, 0}, {0}, {1, 0, 1}, {1, 1}, {0, 0, 0, 1}};
+    std::vector<size_t> visited;
+    pprf.forEachLiveLeaf(tags, [this, &tags, &visited](size_t i, const SecureByteBuffer &value) {
+        ASSERT_EQ(value, pprf.eval(tags[i])) << "tag " << i;
+        visited.push_back(i);
+    });
+    ASSERT_EQ(visited, std::vector<size_t>({2, 5, 0, 3}));
+}
+
+TEST(CacheH, TestCachedEvalMatchesEval) {
+    GGM_HPPRF cached(PPRFKey(TEST_KEY_LEN, 64));
+    GGM_HPPRF uncached(cached);
+    cached.enableCache(1 << 16);
+    std::vector<Tag> tags{{1, 0, 1, 1}, {1, 0, 1}, {1, 0, 1, 1, 0}, {0}, {1, 0, 1, 1}};
+    for (auto &tag: tags) {
+        ASSERT_EQ(cached.eval(tag), uncached.eval(tag));
+    }
+    ASSERT_EQ(cached.cacheStats().hits, 3);
+}
+
+TEST(CacheH, TestHierarchPuncEvictsSubtree) {
+    GGM_HPPRF cached(PPRFKey(TEST_KEY_LEN, 64));
+    cached.enableCache(1 << 16);
+    cached.eval({1, 0, 1, 1});
+    cached.eval({1, 1});
+    cached.punc({1, 0});
+    ASSERT_THROW(cached.eval({1, 0}), TagException);
+    ASSERT_THROW(cached.eval({1, 0, 1, 1}), TagException);
+    ASSERT_THROW(cached.eval({1, 0, 1, 1, 1}), TagException);
+    ASSERT_NO_THROW(cached.eval({1, 1}));
+    cached.punc({1});
+    ASSERT_THROW(cached.eval({1, 1, 0}), TagException);
+    ASSERT_EQ(cached.cacheStats().entries, 0);
+}
+
 TEST_F(GGMHPPRFTest, TestLargeTagSize) {
     auto start_time = std::chrono::high_resolution_clock::now();
     GGM_HPPRF pprf2(PPRFKey(TEST_KEY_LEN, 256));
@@ -154,6 +218,25 @@ TEST(SerializationH, TestSerializeDeserialize) {
                                 << "Nodes should be deserialized in same order with same values";
 }
 
+TEST(SerializationH, TestReplayDeltas) {
+    GGM_HPPRF pprf(PPRFKey(TEST_KEY_LEN, 64));
+    SecureByteBuffer snapshot = pprf.serializeKey();
+    pprf.trackChanges();
+    std::vector<SecureByteBuffer> deltas;
+    pprf.punc({1, 0, 1});
+    deltas.push_back(pprf.takeDelta());
+    pprf.punc({1, 0});
+    deltas.push_back(pprf.takeDelta());
+
+    GGM_HPPRF replayed(PPRFKey::fromSerialized(snapshot));
+    for (auto &delta: deltas) {
+        replayed.applyDelta(delta);
+    }
+    ASSERT_EQ(replayed.serializeKey(), pprf.serializeKey());
+    ASSERT_THROW(replayed.eval({1, 0, 0}), TagException);
+    ASSERT_EQ(replayed.eval({1, 1}), pprf.eval({1, 1}));
+}
+
 TEST(BadInitializationH, TestZeroTagLength) {
     ASSERT_THROW(GGM_HPPRF(PPRFKey(TEST_KEY_LEN, 0)), InitializationException);
 }
@@ -184,4 +267,27 @@ TEST(ConstructionH, TestPuncFromNonExistant) {
 
     ASSERT_NO_THROW(pprf.eval({1}));
     ASSERT_NO_THROW(pprf.eval({1, 0}));
-}
\ No newline at end of file
+}
+TEST(DryRunH, TestStructureMatchesRealKey) {
+    GGM_HPPRF real(PPRFKey(TEST_KEY_LEN, 1));
+    GGM_HPPRF dry = GGM_HPPRF::dryRun(TEST_KEY_LEN);
+    for (int i = 0; i < 100; ++i) {
+        std::vector<bool> tag = int2vec(i * 7919);
+        tag.resize(10 + i % 7);
+        tag[0] = false;
+        real.punc(tag);
+        dry.punc(tag);
+    }
+    ASSERT_EQ(dry.keyStats().depthHistogram, real.keyStats().depthHistogram);
+    ASSERT_EQ(dry.serializedKeySize(), real.serializeKey().size());
+    ASSERT_EQ(dry.serializeKey().size(), real.serializeKey().size());
+    std::vector<bool> punctured = int2vec(0);
+    punctured.resize(10);
+    ASSERT_THROW(dry.eval(punctured), TagException);
+    /* only tags starting with a zero are punctured */
+    std::vector<bool> live = int2vec(1);
+    live.resize(20);
+    ASSERT_EQ(dry.eval(live), SecureByteBuffer(TEST_KEY_LEN / 8));
+    SecureByteBuffer serialized = dry.serializeKey();
+    ASSERT_THROW(PPRFKey::fromSerialized(serialized), PPRFDeserializationError);
+}
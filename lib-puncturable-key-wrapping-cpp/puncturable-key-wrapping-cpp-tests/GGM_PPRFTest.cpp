@@ -1,10 +1,15 @@
 #include <gtest/gtest.h>
 
 #include <gmock/gmock-matchers.h>
+#include <pkw/pprf/compact_key_view.h>
 #include <pkw/pprf/ggm_pprf.h>
+#include <pkw/pprf/ggm_prg.h>
 #include <pkw/pprf/pprf_exceptions.h>
 #include <pkw/pprf/pprf_key_serializer.h>
 #include <pkw/pprf/secret_root.h>
+#include <atomic>
+#include <bit>
+#include <thread>
 
 static const int TEST_KEY_LEN = 128;
 
@@ -36,6 +41,39 @@ TEST(Construction, EvalTestFromTwoNodes) {
     ASSERT_THAT(pprf.eval(356), ::testing::Eq(exp_vect));
 }
 
+TEST(Construction, EvalTestFromTwoNodesFixedKeyAES) {
+    SecretRoot n1 = SecretRoot("0101", SecureByteBuffer(TEST_KEY_LEN / 8));
+    SecretRoot n2 = SecretRoot("001", SecureByteBuffer(TEST_KEY_LEN / 8));
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 10, 0, {{n1.getPrefix(), n1},
+                                                {n2.getPrefix(), n2}},
+                          PRGType::FIXED_KEY_AES));
+
+    /* Value found by manual inspection: aes_prg_derivation.py */
+    unsigned char exp[] = "\x47\x1e\x07\x14\xc4\x42\x88\x9f\xb5\xf8\xef\xcf\xda\xa1\xd0\x66";
+
+    SecureByteBuffer exp_vect(16);
+    std::copy(exp, exp + 16, exp_vect.data());
+    ASSERT_THAT(pprf.eval(356), ::testing::Eq(exp_vect));
+}
+
+TEST(Construction, TestPuncPreservesEvalFixedKeyAES) {
+    GGM_PPRF pprf(PPRFKey(256, 32, PRGType::FIXED_KEY_AES));
+    std::vector<SecureByteBuffer> before;
+    for (int i = 0; i < 64; ++i) {
+        before.push_back(pprf.eval(i));
+    }
+    for (int i = 0; i < 64; i += 3) {
+        pprf.punc(i);
+    }
+    for (int i = 0; i < 64; ++i) {
+        if (i % 3 == 0) {
+            ASSERT_THROW(pprf.eval(i), TagException) << i << " was punctured";
+        } else {
+            ASSERT_EQ(pprf.eval(i), before[i]) << "Value of " << i << " should not change";
+        }
+    }
+}
+
 TEST_F(GGMPPRFTest, TestEvalLessMin) {
     ASSERT_THROW(pprf.eval(-1), TagException);
 }
@@ -103,10 +141,418 @@ TEST_F(GGMPPRFTest, TestPuncSameValue) {
 }
 
 
+TEST_F(GGMPPRFTest, TestEvalBatchMatchesEval) {
+    pprf.punc(3);
+    pprf.punc(700);
+    std::vector<Tag> tags = {1023, 5, 4, 0, 5, 512, 701, 2, 1};
+    std::vector<SecureByteBuffer> res = pprf.evalBatch(tags);
+    ASSERT_EQ(res.size(), tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        ASSERT_EQ(res[i], pprf.eval(tags[i])) << "tag " << tags[i].to_ulong();
+    }
+}
+
+TEST_F(GGMPPRFTest, TestEvalBatchPunctured) {
+    pprf.punc(3);
+    std::vector<Tag> tags = {1, 2, 3, 4};
+    ASSERT_THROW(pprf.evalBatch(tags), TagException);
+    ASSERT_THROW(pprf.evalBatch(std::vector<Tag>{2 << 12}), TagException);
+}
+
+TEST_F(GGMPPRFTest, TestForEachLiveLeafSkipsPunctured) {
+    pprf.punc(3);
+    pprf.puncRange(100, 200);
+    std::vector<Tag> tags = {1023, 5, 3, 4, 150, 0, 6, 512, 99, 2, 1};
+    std::vector<size_t> visited;
+    pprf.forEachLiveLeaf(tags, [this, &tags, &visited](size_t i, const SecureByteBuffer &value) {
+        ASSERT_EQ(value, pprf.eval(tags[i])) << "tag " << tags[i].to_ulong();
+        visited.push_back(i);
+    });
+    // in ascending order of the tags
+    ASSERT_EQ(visited, std::vector<size_t>({5, 10, 9, 3, 1, 6, 8, 7, 0}));
+    ASSERT_THROW(pprf.forEachLiveLeaf(std::vector<Tag>{2 << 12}, [](size_t, const SecureByteBuffer &) {}),
+                 TagException);
+}
+
+TEST(PuncBatch, TestPuncBatchMatchesPunc) {
+    PPRFKey key(TEST_KEY_LEN, 10);
+    GGM_PPRF single(key);
+    GGM_PPRF batch(key);
+    single.punc(17);
+    batch.punc(17);
+    std::vector<Tag> tags = {1023, 5, 4, 0, 5, 512, 513, 17, 16, 2, 1, 3};
+    for (auto &t: tags) {
+        single.punc(t);
+    }
+    batch.puncBatch(tags);
+    ASSERT_EQ(batch.getNumPuncs(), single.getNumPuncs());
+    ASSERT_EQ(batch.serializeKey(), single.serializeKey()) << "Batch should produce the same nodes";
+    for (int i = 0; i < 1024; ++i) {
+        if (std::count(tags.begin(), tags.end(), Tag(i)) > 0) {
+            ASSERT_THROW(batch.eval(i), TagException) << i << " was punctured";
+        }
+    }
+}
+
+TEST(PuncBatch, TestPuncBatchWholeSubtree) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 4));
+    std::vector<Tag> tags = {8, 9, 10, 11, 12, 13, 14, 15};
+    pprf.puncBatch(tags);
+    SecureByteBuffer serialized = pprf.serializeKey();
+    auto key = PPRFKeySerializer::deserialize(serialized);
+    ASSERT_EQ(key.nodes.size(), 1) << "Only the left child of the root should remain";
+    ASSERT_TRUE(key.nodes.contains("0"));
+    ASSERT_THROW(pprf.puncBatch(std::vector<Tag>{1, 2 << 12}), TagException);
+    ASSERT_NO_THROW(pprf.eval(1)) << "Key should not be modified if a tag is invalid";
+}
+
+TEST(PuncRange, TestPuncRange) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 10));
+    std::vector<SecureByteBuffer> before;
+    for (int i = 0; i < 1024; ++i) {
+        before.push_back(pprf.eval(i));
+    }
+    pprf.punc(3);
+    pprf.punc(200);
+    pprf.punc(900);
+    pprf.puncRange(101, 837);
+    ASSERT_EQ(pprf.getNumPuncs(), 4);
+    for (int i = 0; i < 1024; ++i) {
+        if ((i >= 101 && i <= 837) || i == 3 || i == 900) {
+            ASSERT_THROW(pprf.eval(i), TagException) << i << " was punctured";
+        } else {
+            ASSERT_EQ(pprf.eval(i), before[i]) << "Value of " << i << " should not change";
+        }
+    }
+}
+
+TEST(PuncRange, TestPuncRangeKeySize) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 64));
+    pprf.puncRange(1000, 1000000000);
+    SecureByteBuffer serialized = pprf.serializeKey();
+    auto key = PPRFKeySerializer::deserialize(serialized);
+    ASSERT_LE(key.nodes.size(), 2 * 64) << "Only the boundary nodes should remain";
+    ASSERT_NO_THROW(pprf.eval(999));
+    ASSERT_NO_THROW(pprf.eval(1000000001));
+    ASSERT_THROW(pprf.eval(5000000), TagException);
+    ASSERT_THROW(pprf.puncRange(5, 4), TagException);
+}
+
+TEST(PuncRange, TestPuncRangeAll) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 10));
+    pprf.punc(5);
+    pprf.puncRange(0, 1023);
+    SecureByteBuffer serialized = pprf.serializeKey();
+    ASSERT_EQ(PPRFKeySerializer::deserialize(serialized).nodes.size(), 0);
+    ASSERT_THROW(pprf.eval(6), TagException);
+    ASSERT_EQ(pprf.getNumPuncs(), 2);
+}
+
+TEST(PuncRange, TestPuncRangeWithoutLiveTagsIsNotCounted) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 10));
+    pprf.puncRange(100, 200);
+    pprf.puncRange(120, 150);
+    pprf.punc(150);
+    ASSERT_EQ(pprf.getNumPuncs(), 1);
+    pprf.puncRange(0, 1023);
+    pprf.puncRange(0, 1023);
+    ASSERT_EQ(pprf.getNumPuncs(), 2);
+}
+
+TEST(Arity, TestKaryPuncturing) {
+    for (PRGType prg: {PRGType::HKDF_SHA256, PRGType::FIXED_KEY_AES}) {
+        for (int arity: {4, 16, 256}) {
+            GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 8, prg, arity));
+            ASSERT_EQ(pprf.arity(), arity);
+            std::vector<SecureByteBuffer> before;
+            for (int i = 0; i < 256; ++i) {
+                before.push_back(pprf.eval(i));
+                ASSERT_EQ(std::count(before.begin(), before.end(), before.back()), 1) << "Leaves should differ";
+            }
+            pprf.punc(77);
+            const size_t levels = 8 / std::countr_zero(static_cast<unsigned>(arity));
+            ASSERT_EQ(pprf.keyStats().nodes, levels * (arity - 1)) << "A puncture adds the siblings of each level";
+            std::vector<Tag> batch = {200, 3, 201, 77};
+            pprf.puncBatch(batch);
+            pprf.puncRange(100, 150);
+            ASSERT_EQ(pprf.getNumPuncs(), 5);
+            for (int i = 0; i < 256; ++i) {
+                if (i == 77 || i == 3 || i == 200 || i == 201 || (i >= 100 && i <= 150)) {
+                    ASSERT_THROW(pprf.eval(i), TagException) << i << " was punctured";
+                } else {
+                    ASSERT_EQ(pprf.eval(i), before[i]) << "Value of " << i << " should not change";
+                }
+            }
+        }
+    }
+}
+
+TEST(Arity, TestKaryBatchesMatchSingleTags) {
+    PPRFKey key(TEST_KEY_LEN, 16, PRGType::FIXED_KEY_AES, 16);
+    GGM_PPRF single(key);
+    GGM_PPRF batch(key);
+    std::vector<Tag> tags = {60000, 5, 4, 0, 5, 512, 513, 17};
+    for (auto &t: tags) {
+        single.punc(t);
+    }
+    batch.puncBatch(tags);
+    ASSERT_EQ(batch.serializeKey(), single.serializeKey()) << "Batch should produce the same nodes";
+    std::vector<Tag> live = {6, 60001, 18};
+    std::vector<SecureByteBuffer> values = batch.evalBatch(live);
+    for (size_t i = 0; i < live.size(); ++i) {
+        ASSERT_EQ(values[i], single.eval(live[i]));
+    }
+    ASSERT_THROW(batch.evalBatch(tags), TagException);
+    size_t visited = 0;
+    batch.forEachLiveLeaf(tags, [&visited](size_t, const SecureByteBuffer &) { ++visited; });
+    ASSERT_EQ(visited, 0);
+}
+
+TEST(Arity, TestKarySerialization) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 32, PRGType::FIXED_KEY_AES, 4));
+    pprf.trackChanges();
+    GGM_PPRF replica = GGM_PPRF::fromSerialized(pprf.serializeKey());
+    for (uint32_t i = 0; i < 100; ++i) {
+        pprf.punc(i * 2654435761u);
+    }
+    for (KeyFormat format: {KeyFormat::PLAIN, KeyFormat::COMPACT}) {
+        SecureByteBuffer serialized = PPRFKeySerializer(PPRFKeySerializer::deserialize(pprf.serializeKey())).serialize(format);
+        PPRFKey key = PPRFKeySerializer::deserialize(serialized);
+        ASSERT_EQ(key.arityBits, 2);
+        /* a compact key which is not loaded is evaluated with the same arity */
+        GGM_PPRF lazy = GGM_PPRF::fromSerialized(serialized);
+        ASSERT_EQ(lazy.arity(), 4);
+        ASSERT_EQ(lazy.eval(12345), pprf.eval(12345));
+        ASSERT_EQ(GGM_PPRF(key).eval(12345), pprf.eval(12345));
+        ASSERT_THROW(lazy.eval(2654435761u), TagException);
+    }
+    replica.applyDelta(pprf.takeDelta());
+    ASSERT_EQ(replica.serializeKey(), pprf.serializeKey());
+    /* binary keys are written as before the arity was configurable */
+    SecureByteBuffer binary = GGM_PPRF(PPRFKey(TEST_KEY_LEN, 32, PRGType::FIXED_KEY_AES)).serializeKey();
+    ASSERT_EQ(std::count(binary.data() + 8, binary.data() + 15, 0), 7);
+    ASSERT_EQ(binary.data()[15], static_cast<unsigned char>(PRGType::FIXED_KEY_AES));
+}
+
+TEST(Arity, TestInvalidArity) {
+    ASSERT_THROW(PPRFKey(TEST_KEY_LEN, 8, PRGType::HKDF_SHA256, 3), InitializationException);
+    ASSERT_THROW(PPRFKey(TEST_KEY_LEN, 8, PRGType::HKDF_SHA256, 1), InitializationException);
+    ASSERT_THROW(PPRFKey(TEST_KEY_LEN, 16, PRGType::HKDF_SHA256, 512), InitializationException);
+    ASSERT_THROW(PPRFKey(TEST_KEY_LEN, 10, PRGType::HKDF_SHA256, 16), InitializationException)
+            << "log2 of the arity has to divide the tag length";
+    SecureByteBuffer serialized = GGM_PPRF(PPRFKey(TEST_KEY_LEN, 8, PRGType::HKDF_SHA256, 16)).serializeKey();
+    /* the arity is stored in the second byte of the PRG word */
+    serialized.data()[8 + 6] = 9;
+    ASSERT_THROW(GGM_PPRF::fromSerialized(serialized), PPRFDeserializationError);
+}
+
+TEST(GrowTagLen, TestGrowingKeepsEvaluations) {
+    for (int arity: {2, 16}) {
+        GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 8, PRGType::FIXED_KEY_AES, arity, 64));
+        ASSERT_EQ(pprf.maxTagLen(), 64);
+        std::vector<SecureByteBuffer> before;
+        for (int i = 0; i < 256; ++i) {
+            before.push_back(pprf.eval(i));
+        }
+        pprf.punc(7);
+        ASSERT_THROW(pprf.eval(256), TagException);
+        pprf.growTagLen(16);
+        ASSERT_EQ(pprf.tagLen(), 16);
+        ASSERT_EQ(pprf.getNumPuncs(), 1) << "Growing should not count as a puncture";
+        for (int i = 0; i < 256; ++i) {
+            if (i == 7) {
+                ASSERT_THROW(pprf.eval(i), TagException) << "Punctured tags should stay punctured";
+            } else {
+                ASSERT_EQ(pprf.eval(i), before[i]) << "Value of " << i << " should not change";
+            }
+        }
+        SecureByteBuffer grown = pprf.eval(256);
+        ASSERT_EQ(std::count(before.begin(), before.end(), grown), 0);
+        pprf.punc(300);
+        ASSERT_THROW(pprf.eval(300), TagException);
+        ASSERT_EQ(pprf.eval(256), grown);
+        ASSERT_THROW(pprf.growTagLen(8), TagException);
+        ASSERT_THROW(pprf.growTagLen(72), TagException);
+    }
+    ASSERT_THROW(GGM_PPRF(PPRFKey(TEST_KEY_LEN, 8, PRGType::FIXED_KEY_AES, 16, 10)), InitializationException)
+            << "The tree grows by whole levels";
+    GGM_PPRF fixed(PPRFKey(TEST_KEY_LEN, 8));
+    ASSERT_EQ(fixed.maxTagLen(), 8);
+    ASSERT_THROW(fixed.growTagLen(16), TagException);
+}
+
+TEST(GrowTagLen, TestGrowingCostsLevelsOfLargestTag) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 8, PRGType::FIXED_KEY_AES, 2, 256));
+    pprf.punc(3);
+    const size_t nodes = pprf.keyStats().nodes;
+    pprf.growTagLen(20);
+    /* the former tree is the left-most subtree, next to a random sibling on each added level */
+    ASSERT_EQ(pprf.keyStats().nodes, nodes + 12);
+    ASSERT_EQ(pprf.keyStats().depthHistogram[1], 1);
+    pprf.punc(1000000);
+    ASSERT_EQ(pprf.keyStats().nodes, nodes + 12 + 18) << "The node at depth 1 should be replaced by its co-path";
+}
+
+TEST(GrowTagLen, TestGrowingIsSerializedAndReplayed) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 16, PRGType::FIXED_KEY_AES, 4, 128));
+    pprf.punc(5);
+    pprf.trackChanges();
+    GGM_PPRF replica = GGM_PPRF::fromSerialized(pprf.serializeKey());
+    pprf.growTagLen(40);
+    pprf.punc(Tag(1) << 35);
+    replica.applyDelta(pprf.takeDelta());
+    ASSERT_EQ(replica.tagLen(), 40);
+    ASSERT_EQ(replica.serializeKey(), pprf.serializeKey());
+    for (KeyFormat format: {KeyFormat::PLAIN, KeyFormat::COMPACT}) {
+        SecureByteBuffer serialized = PPRFKeySerializer(PPRFKeySerializer::deserialize(pprf.serializeKey())).serialize(format);
+        GGM_PPRF lazy = GGM_PPRF::fromSerialized(serialized);
+        ASSERT_EQ(lazy.maxTagLen(), 128);
+        ASSERT_EQ(lazy.tagLen(), 40);
+        ASSERT_EQ(lazy.eval(6), pprf.eval(6));
+        ASSERT_THROW(lazy.eval(Tag(1) << 35), TagException);
+        lazy.growTagLen(128);
+        ASSERT_EQ(lazy.eval(6), pprf.eval(6));
+    }
+    /* a delta growing the tree beyond the maximal tag length is rejected */
+    GGM_PPRF grower(PPRFKey(TEST_KEY_LEN, 16, PRGType::FIXED_KEY_AES, 4, 128));
+    grower.trackChanges();
+    grower.growTagLen(24);
+    GGM_PPRF small(PPRFKey(TEST_KEY_LEN, 16, PRGType::FIXED_KEY_AES, 4, 20));
+    ASSERT_THROW(small.applyDelta(grower.takeDelta()), PPRFDeserializationError);
+}
+
+TEST(Cache, TestCachedEvalMatchesEval) {
+    GGM_PPRF cached(PPRFKey(TEST_KEY_LEN, 64));
+    GGM_PPRF uncached(cached);
+    cached.enableCache(1 << 16);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(cached.eval(i), uncached.eval(i));
+    }
+    ASSERT_EQ(cached.eval(5), uncached.eval(5));
+    NodeCache::Stats stats = cached.cacheStats();
+    ASSERT_EQ(stats.hits, 100) << "All evals but the first should start from a cached node";
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_LE(stats.bytes, 1 << 16);
+}
+
+TEST(Cache, TestCacheRespectsBudget) {
+    GGM_PPRF cached(PPRFKey(TEST_KEY_LEN, 256));
+    GGM_PPRF uncached(cached);
+    const size_t budget = 100 * (TEST_KEY_LEN / 8 + NodeCache::ENTRY_OVERHEAD);
+    cached.enableCache(budget);
+    for (int i = 0; i < 20; ++i) {
+        Tag tag = Tag(i) << 200 | Tag(i * 7);
+        ASSERT_EQ(cached.eval(tag), uncached.eval(tag));
+        ASSERT_LE(cached.cacheStats().bytes, budget);
+    }
+    ASSERT_EQ(cached.cacheStats().entries, 100);
+}
+
+TEST(Cache, TestPuncEvictsCachedPath) {
+    GGM_PPRF cached(PPRFKey(TEST_KEY_LEN, 64));
+    GGM_PPRF uncached(cached);
+    cached.enableCache(1 << 16);
+    cached.eval(4);
+    cached.punc(5);
+    uncached.punc(5);
+    ASSERT_THROW(cached.eval(5), TagException);
+    ASSERT_EQ(cached.eval(4), uncached.eval(4));
+    cached.puncBatch(std::vector<Tag>{4, 7});
+    ASSERT_THROW(cached.eval(4), TagException);
+    ASSERT_THROW(cached.eval(7), TagException);
+    ASSERT_NO_THROW(cached.eval(6));
+    cached.puncRange(0, 100);
+    ASSERT_THROW(cached.eval(6), TagException);
+    ASSERT_EQ(cached.cacheStats().entries, 0);
+}
+
+TEST(Cache, TestCopiesShareCache) {
+    GGM_PPRF original(PPRFKey(TEST_KEY_LEN, 16, PRGType::HKDF_SHA256, 2, 32));
+    GGM_PPRF uncached(original);
+    original.enableCache(1 << 16);
+    original.eval(4);
+    GGM_PPRF copy(original);
+    copy.eval(5);
+    ASSERT_EQ(original.cacheStats().hits, 1) << "The copy should start from the nodes cached by the original";
+    copy.growTagLen(24);
+    ASSERT_EQ(original.eval(6), uncached.eval(6)) << "The original must not use nodes cached under the grown prefixes";
+    ASSERT_EQ(original.cacheStats().hits, 1);
+    copy.eval(7);
+    copy.eval(7);
+    ASSERT_EQ(copy.cacheStats().hits, 2) << "The copy should keep using the cache after modifying it";
+    original.punc(8);
+    ASSERT_EQ(original.cacheStats().entries, 0) << "The original diverged from the copy and starts with an empty cache";
+    ASSERT_GT(copy.cacheStats().entries, 0);
+}
+
+TEST(Snapshot, TestPuncturedCopyLeavesOriginal) {
+    GGM_PPRF original(PPRFKey(TEST_KEY_LEN, 64));
+    for (int i = 0; i < 1000; i += 3) {
+        original.punc(i);
+    }
+    SecureByteBuffer expected = original.eval(1);
+    GGM_PPRF copy(original);
+    copy.puncBatch(std::vector<Tag>{1, 2, 4});
+    copy.puncRange(500, 600);
+    ASSERT_THROW(copy.eval(1), TagException);
+    ASSERT_EQ(original.eval(1), expected) << "Modifying a copy must not modify the nodes shared with the original";
+    ASSERT_EQ(original.eval(502), GGM_PPRF(PPRFKeySerializer::deserialize(original.serializeKey())).eval(502));
+}
+
+TEST(Snapshot, TestConcurrentCachedEval) {
+    GGM_PPRF cached(PPRFKey(TEST_KEY_LEN, 64));
+    GGM_PPRF uncached(cached);
+    cached.enableCache(1 << 12);
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches = 0;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 200; ++i) {
+                Tag tag = Tag(i % 50) << 20 | Tag(t);
+                if (cached.eval(tag) != uncached.eval(tag)) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_EQ(mismatches, 0);
+    ASSERT_EQ(cached.cacheStats().hits + cached.cacheStats().misses, 800);
+}
+
 TEST_F(GGMPPRFTest, TestTagTooLarge) {
     ASSERT_THROW(pprf.eval(2 << 12), TagException);
 }
 
+TEST(Construction, TestSpecializedTagLengthsMatchDerivation) {
+    /* 32, 64, 128 and 256 bit tags take specialized paths, 100 bits the generic one */
+    for (size_t tagLen: {32, 64, 100, 128, 256}) {
+        SecureByteBuffer rootValue(TEST_KEY_LEN / 8, 7);
+        GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, tagLen, 0, {{"1", SecretRoot("1", rootValue)}}, PRGType::FIXED_KEY_AES));
+        Tag tag;
+        for (size_t i = 0; i < tagLen; i += 3) {
+            tag.set(i);
+        }
+        tag.set(tagLen - 1);
+
+        const GGM_PRG &prg = GGM_PRG::forType(PRGType::FIXED_KEY_AES);
+        SecureByteBuffer exp = rootValue;
+        SecureByteBuffer child(exp.size());
+        for (size_t i = 1; i < tagLen; ++i) {
+            prg.deriveChild(exp.data(), exp.size(), tag[tagLen - 1 - i], child.data());
+            std::swap(exp, child);
+        }
+        ASSERT_EQ(pprf.eval(tag), exp) << "tag length " << tagLen;
+        ASSERT_THROW(pprf.eval(tag.reset(tagLen - 1)), TagException) << "tag length " << tagLen;
+        if (tagLen < MAX_TAG_LEN) {
+            ASSERT_THROW(pprf.eval(Tag(1) << tagLen), TagException) << "tag length " << tagLen;
+            ASSERT_THROW(pprf.punc(Tag(1) << tagLen), TagException) << "tag length " << tagLen;
+        }
+    }
+}
+
 TEST_F(GGMPPRFTest, TestLargeTagSize) {
     auto start_time = std::chrono::high_resolution_clock::now();
     GGM_PPRF pprf2(PPRFKey(TEST_KEY_LEN, 256));
@@ -146,6 +592,356 @@ TEST(Serialization, TestSerializeDeserialize) {
                                 << "Nodes should be deserialized in same order with same values";
 }
 
+TEST(Serialization, TestReplayDeltas) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 64));
+    pprf.punc(3);
+    SecureByteBuffer snapshot = pprf.serializeKey();
+    pprf.trackChanges();
+    std::vector<SecureByteBuffer> deltas;
+    pprf.punc(17);
+    deltas.push_back(pprf.takeDelta());
+    pprf.puncBatch(std::vector<Tag>{100, 101, 1000});
+    deltas.push_back(pprf.takeDelta());
+    pprf.puncRange(200, 300);
+    deltas.push_back(pprf.takeDelta());
+    pprf.punc(17);
+    deltas.push_back(pprf.takeDelta());
+
+    GGM_PPRF replayed(PPRFKey::fromSerialized(snapshot));
+    for (auto &delta: deltas) {
+        replayed.applyDelta(delta);
+    }
+    ASSERT_EQ(replayed.serializeKey(), pprf.serializeKey());
+    ASSERT_EQ(replayed.getNumPuncs(), pprf.getNumPuncs());
+    ASSERT_THROW(replayed.eval(250), TagException);
+    ASSERT_EQ(replayed.eval(50), pprf.eval(50));
+
+    /* replaying on a later snapshot yields the same key */
+    GGM_PPRF again(PPRFKey::fromSerialized(snapshot));
+    again.applyDelta(deltas[0]);
+    again.applyDelta(deltas[1]);
+    for (auto &delta: deltas) {
+        again.applyDelta(delta);
+    }
+    ASSERT_EQ(again.serializeKey(), pprf.serializeKey());
+}
+
+TEST(Serialization, TestRejectDeltaBelowLeaves) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 64));
+    pprf.trackChanges();
+    pprf.punc(17);
+    SecureByteBuffer delta = pprf.takeDelta();
+    /* the co-path of a 64 bit tag does not fit into a tree of 32 bit tags */
+    GGM_PPRF shorter(PPRFKey(TEST_KEY_LEN, 32));
+    ASSERT_THROW(shorter.applyDelta(delta), PPRFDeserializationError);
+}
+
+TEST(Serialization, TestDeltaSizeIndependentOfKeySize) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 256));
+    pprf.trackChanges();
+    pprf.punc(0);
+    size_t firstSize = pprf.takeDelta().size();
+    for (int i = 1; i < 200; ++i) {
+        pprf.punc(Tag(i) << 100);
+    }
+    pprf.takeDelta();
+    pprf.punc(Tag(1) << 255);
+    SecureByteBuffer delta = pprf.takeDelta();
+    ASSERT_LE(delta.size(), firstSize);
+    ASSERT_LT(delta.size(), 256 * (TEST_KEY_LEN / 8 + 16)) << "A delta should take O(tagLen) bytes";
+    ASSERT_LT(delta.size(), pprf.serializeKey().size() / 10);
+}
+
+TEST(Serialization, TestApplyMalformedDelta) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 64));
+    pprf.trackChanges();
+    pprf.punc(5);
+    SecureByteBuffer delta = pprf.takeDelta();
+    GGM_PPRF other(PPRFKey(TEST_KEY_LEN, 64));
+    SecureByteBuffer truncated(delta.size() - 1);
+    std::copy_n(delta.data(), truncated.size(), truncated.data());
+    ASSERT_THROW(other.applyDelta(truncated), PPRFDeserializationError);
+}
+
+TEST(Serialization, TestSerializeDeserializeKeepsPRG) {
+    GGM_PPRF pprf1(PPRFKey(TEST_KEY_LEN, 16, PRGType::FIXED_KEY_AES));
+    pprf1.punc(5);
+    SecureByteBuffer serialized = pprf1.serializeKey();
+    auto key = PPRFKeySerializer::deserialize(serialized);
+    ASSERT_EQ(key.prg, PRGType::FIXED_KEY_AES);
+    GGM_PPRF pprf2(key);
+    ASSERT_EQ(pprf2.eval(6), pprf1.eval(6));
+    ASSERT_THROW(pprf2.eval(5), TagException);
+}
+
+TEST(Serialization, TestDeserializeUnversionedKey) {
+    /* tagLen, keyLen, puncs, number of nodes, prefix length, prefix "1", value */
+    std::vector<unsigned char> legacy;
+    for (uint64_t i: {64, 64, 1, 1, 1}) {
+        for (int b = 7; b >= 0; --b) {
+            legacy.push_back((i >> (8 * b)) & 0xFF);
+        }
+    }
+    legacy.push_back('1');
+    legacy.insert(legacy.end(), 8, 0);
+    SecureByteBuffer serialized(legacy);
+    auto key = PPRFKeySerializer::deserialize(serialized);
+    ASSERT_EQ(key.prg, PRGType::HKDF_SHA256);
+    ASSERT_EQ(key.tagLen, 64);
+    ASSERT_EQ(key.puncs, 1);
+    ASSERT_EQ(key.nodes["1"].getValue(), SecureByteBuffer(8));
+}
+
+TEST(Serialization, TestDeserializeUnorderedNodes) {
+    /* tagLen, keyLen, puncs, number of nodes, then the nodes "11", "0" and "10" */
+    std::vector<unsigned char> unordered;
+    auto writeInt = [&unordered](uint64_t i) {
+        for (int b = 7; b >= 0; --b) {
+            unordered.push_back((i >> (8 * b)) & 0xFF);
+        }
+    };
+    for (uint64_t i: {8, 64, 1, 3}) {
+        writeInt(i);
+    }
+    for (std::string prefix: {"11", "0", "10"}) {
+        writeInt(prefix.size());
+        unordered.insert(unordered.end(), prefix.begin(), prefix.end());
+        unordered.insert(unordered.end(), 8, prefix.size());
+    }
+    SecureByteBuffer serialized(unordered);
+    auto key = PPRFKeySerializer::deserialize(serialized);
+    ASSERT_EQ(key.nodes.size(), 3);
+    ASSERT_EQ(key.nodes["0"].getValue(), SecureByteBuffer(8, 1));
+    ASSERT_EQ(key.nodes["10"].getValue(), SecureByteBuffer(8, 2));
+    ASSERT_EQ(key.nodes["11"].getValue(), SecureByteBuffer(8, 2));
+}
+
+TEST(Serialization, TestDeserializeMalformedKey) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 16));
+    pprf.punc(5);
+    SecureByteBuffer compact = pprf.serializeKey();
+    SecureByteBuffer serialized = PPRFKeySerializer(PPRFKeySerializer::deserialize(compact)).serialize(KeyFormat::PLAIN);
+    /* the first prefix starts after the header and its length */
+    SecureByteBuffer invalidPrefix = serialized;
+    invalidPrefix.data()[7 * 8] = '2';
+    ASSERT_THROW(PPRFKeySerializer::deserialize(invalidPrefix), PPRFDeserializationError);
+    std::vector<unsigned char> truncated(serialized.begin(), serialized.end() - 1);
+    SecureByteBuffer truncatedKey(truncated);
+    ASSERT_THROW(PPRFKeySerializer::deserialize(truncatedKey), PPRFDeserializationError);
+    /* a prefix length exceeding the input must not be read */
+    SecureByteBuffer hugePrefix = serialized;
+    hugePrefix.data()[6 * 8] = 0x7F;
+    ASSERT_THROW(PPRFKeySerializer::deserialize(hugePrefix), PPRFDeserializationError);
+}
+
+TEST(Serialization, TestDeserializeUnknownPRG) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 16));
+    SecureByteBuffer serialized = pprf.serializeKey();
+    serialized.data()[15] = 0x7F;
+    ASSERT_THROW(PPRFKeySerializer::deserialize(serialized), PPRFDeserializationError);
+}
+
+static GGM_PPRF punctureSpread(int tagLen, int puncs) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, tagLen, PRGType::FIXED_KEY_AES));
+    for (uint64_t i = 0; i < puncs; ++i) {
+        pprf.punc(Tag(i * 0x9E3779B97F4A7C15 >> (64 - tagLen)));
+    }
+    return pprf;
+}
+
+TEST(CompactKey, TestCompactKeyIsSmaller) {
+    GGM_PPRF pprf = punctureSpread(64, 500);
+    SecureByteBuffer compact = pprf.serializeKey();
+    PPRFKey key = PPRFKeySerializer::deserialize(compact);
+    SecureByteBuffer plain = PPRFKeySerializer(key).serialize(KeyFormat::PLAIN);
+    ASSERT_TRUE(CompactKeyView::isCompact(std::span<const uint8_t>(compact.data(), compact.size())));
+    ASSERT_LT(compact.size() * 3, plain.size());
+    ASSERT_EQ(PPRFKeySerializer(PPRFKeySerializer::deserialize(plain)).serialize(), compact);
+}
+
+TEST(CompactKey, TestLazyEvalMatchesLoadedKey) {
+    GGM_PPRF loaded = punctureSpread(32, 300);
+    GGM_PPRF lazy = GGM_PPRF::fromSerialized(loaded.serializeKey());
+    std::vector<Tag> tags;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        Tag tag(i * 0x9E3779B97F4A7C15 >> 32 ^ i);
+        tags.push_back(tag);
+        try {
+            SecureByteBuffer expected = loaded.eval(tag);
+            ASSERT_EQ(lazy.eval(tag), expected);
+        } catch (TagException &e) {
+            ASSERT_THROW(lazy.eval(tag), TagException);
+        }
+    }
+    ASSERT_THROW(lazy.eval(Tag(0)), TagException);
+    ASSERT_THROW(lazy.eval(Tag(0x9E3779B9)), TagException);
+    ASSERT_EQ(lazy.getNumPuncs(), 300);
+    std::vector<Tag> live;
+    std::copy_if(tags.begin(), tags.end(), std::back_inserter(live), [&loaded](const Tag &t) {
+        try {
+            loaded.eval(t);
+            return true;
+        } catch (TagException &e) {
+            return false;
+        }
+    });
+    ASSERT_EQ(lazy.evalBatch(live), loaded.evalBatch(live));
+}
+
+TEST(KeyStats, TestStatsOfPuncturedKey) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 10));
+    KeyStats fresh = pprf.keyStats();
+    ASSERT_EQ(fresh.nodes, 1);
+    ASSERT_EQ(fresh.depthHistogram, std::vector<uint64_t>({1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}));
+    ASSERT_EQ(fresh.averageMatchDepth, 0);
+    ASSERT_EQ(fresh.expectedEvalDerivations, 10);
+
+    pprf.punc(0);
+    KeyStats punctured = pprf.keyStats();
+    ASSERT_EQ(punctured.nodes, 10);
+    ASSERT_EQ(punctured.depthHistogram, std::vector<uint64_t>({0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}));
+    /* a tag is derived from the node at depth d with probability 2^-d / (1 - 2^-10) */
+    double expected = 0;
+    for (int d = 1; d <= 10; ++d) {
+        expected += d * std::ldexp(1, -d);
+    }
+    expected /= 1 - std::ldexp(1, -10);
+    ASSERT_NEAR(punctured.averageMatchDepth, expected, 1e-9);
+    ASSERT_NEAR(punctured.expectedEvalDerivations, 10 - expected, 1e-9);
+    ASSERT_GT(punctured.residentBytes, 0);
+}
+
+TEST(KeyStats, TestIncrementalStatsMatchSerializedKey) {
+    GGM_PPRF pprf = punctureSpread(32, 300);
+    std::vector<Tag> batch;
+    for (uint64_t i = 0; i < 50; ++i) {
+        batch.emplace_back(i * 7919);
+    }
+    pprf.puncBatch(batch);
+    pprf.puncRange(Tag(1000), Tag(200000));
+    /* the histogram of a compact key which is not loaded is counted from the serialized nodes */
+    GGM_PPRF lazy = GGM_PPRF::fromSerialized(pprf.serializeKey());
+    ASSERT_EQ(pprf.keyStats().depthHistogram, lazy.keyStats().depthHistogram);
+    ASSERT_EQ(pprf.keyStats().nodes, PPRFKeySerializer::deserialize(pprf.serializeKey()).nodes.size());
+}
+
+TEST(KeyStats, TestKeySubtrees) {
+    GGM_PPRF pprf(PPRFKey(TEST_KEY_LEN, 10));
+    pprf.punc(0);
+    std::vector<Tag> tags = {Tag(600), Tag(2), Tag(1)};
+    /* the nodes of the co-path of 0 branch below each prefix 0...0 of length 0 to 8 */
+    std::vector<GGM_PPRF::Subtree> subtrees = pprf.keySubtrees(tags, 2);
+    ASSERT_EQ(subtrees.size(), 9);
+    ASSERT_EQ(subtrees.front().first, Tag(0));
+    ASSERT_EQ(subtrees.front().last, Tag(3));
+    ASSERT_EQ(subtrees.front().keyNodes, 2);
+    ASSERT_EQ(subtrees.front().tags, 2);
+    ASSERT_EQ(subtrees.back().last, Tag(1023));
+    ASSERT_EQ(subtrees.back().keyNodes, 10);
+    ASSERT_EQ(subtrees.back().tags, 3);
+    ASSERT_EQ(pprf.keySubtrees(tags, 4).size(), 7);
+    /* a compact key which is not loaded lists the same subtrees */
+    GGM_PPRF lazy = GGM_PPRF::fromSerialized(pprf.serializeKey());
+    ASSERT_EQ(lazy.keySubtrees(tags, 2).size(), 9);
+    ASSERT_EQ(lazy.keySubtrees(tags, 2)[4].first, subtrees[4].first);
+
+    /* puncturing a subtree removes its nodes and adds none */
+    const GGM_PPRF::Subtree &left = subtrees[subtrees.size() - 2];
+    ASSERT_EQ(left.last, Tag(511));
+    pprf.puncRange(left.first, left.last);
+    ASSERT_EQ(pprf.keyStats().nodes, 1);
+    ASSERT_TRUE(pprf.keySubtrees(tags, 2).empty());
+}
+
+TEST(CompactKey, TestModifyingLoadsKey) {
+    GGM_PPRF loaded = punctureSpread(32, 100);
+    GGM_PPRF lazy = GGM_PPRF::fromSerialized(loaded.serializeKey());
+    lazy.trackChanges();
+    GGM_PPRF replica = GGM_PPRF::fromSerialized(loaded.serializeKey());
+    ASSERT_EQ(lazy.takeDelta().size(), 16) << "A delta without changes only holds the header";
+    lazy.punc(12345);
+    loaded.punc(12345);
+    ASSERT_THROW(lazy.eval(12345), TagException);
+    ASSERT_EQ(lazy.eval(12346), loaded.eval(12346));
+    ASSERT_EQ(lazy.serializeKey(), loaded.serializeKey());
+    replica.applyDelta(lazy.takeDelta());
+    ASSERT_EQ(replica.serializeKey(), loaded.serializeKey());
+}
+
+TEST(CompactKey, TestMalformedIndex) {
+    GGM_PPRF pprf = punctureSpread(32, 100);
+    SecureByteBuffer serialized = pprf.serializeKey();
+    /* the second entry of the index, which follows the header of seven integers */
+    SecureByteBuffer decreasing = serialized;
+    std::fill_n(decreasing.data() + 8 * 8, 8, 0);
+    ASSERT_THROW(GGM_PPRF::fromSerialized(decreasing), PPRFDeserializationError);
+    SecureByteBuffer outOfBounds = serialized;
+    outOfBounds.data()[8 * 8] = 0x7F;
+    ASSERT_THROW(GGM_PPRF::fromSerialized(outOfBounds), PPRFDeserializationError);
+    std::vector<unsigned char> truncated(serialized.begin(), serialized.end() - 1);
+    ASSERT_THROW(PPRFKeySerializer::deserialize(SecureByteBuffer(truncated)), PPRFDeserializationError);
+}
+
 TEST(BadInitialization, TestZeroTagLength) {
     ASSERT_THROW(GGM_PPRF(PPRFKey(TEST_KEY_LEN, 0)), InitializationException);
-}
\ No newline at end of file
+}
+
+TEST(Serialization, TestSerializedSize) {
+    GGM_PPRF pprf = punctureSpread(32, 300);
+    PPRFKey key = PPRFKeySerializer::deserialize(pprf.serializeKey());
+    for (KeyFormat format: {KeyFormat::PLAIN, KeyFormat::COMPACT}) {
+        ASSERT_EQ(PPRFKeySerializer(key).serializedSize(format), PPRFKeySerializer(key).serialize(format).size());
+    }
+    ASSERT_EQ(pprf.serializedKeySize(), pprf.serializeKey().size());
+    GGM_PPRF lazy = GGM_PPRF::fromSerialized(pprf.serializeKey());
+    ASSERT_EQ(lazy.serializedKeySize(), pprf.serializeKey().size());
+}
+
+static void applyOperations(GGM_PPRF &pprf) {
+    for (uint64_t i = 0; i < 200; ++i) {
+        pprf.punc(Tag(i * 0x9E3779B97F4A7C15 >> 32));
+    }
+    std::vector<Tag> batch;
+    for (uint64_t i = 0; i < 50; ++i) {
+        batch.emplace_back(i * 7919);
+    }
+    pprf.puncBatch(batch);
+    pprf.puncRange(Tag(1000), Tag(200000));
+}
+
+TEST(DryRun, TestStructureMatchesRealKey) {
+    for (int arity: {2, 4}) {
+        GGM_PPRF real(PPRFKey(TEST_KEY_LEN, 32, PRGType::FIXED_KEY_AES, arity, 40));
+        GGM_PPRF dry = GGM_PPRF::dryRun(TEST_KEY_LEN, 32, arity, 40);
+        applyOperations(real);
+        applyOperations(dry);
+        real.growTagLen(36);
+        dry.growTagLen(36);
+        real.punc(Tag(1) << 34);
+        dry.punc(Tag(1) << 34);
+        ASSERT_EQ(dry.keyStats().depthHistogram, real.keyStats().depthHistogram);
+        ASSERT_EQ(dry.getNumPuncs(), real.getNumPuncs());
+        ASSERT_EQ(dry.serializedKeySize(), real.serializeKey().size());
+        ASSERT_EQ(dry.serializeKey().size(), real.serializeKey().size());
+    }
+}
+
+TEST(DryRun, TestEvalFollowsPunctures) {
+    GGM_PPRF dry = GGM_PPRF::dryRun(TEST_KEY_LEN, 32);
+    applyOperations(dry);
+    ASSERT_THROW(dry.eval(Tag(7919)), TagException);
+    ASSERT_THROW(dry.eval(Tag(5000)), TagException);
+    ASSERT_EQ(dry.eval(Tag(999)), SecureByteBuffer(TEST_KEY_LEN / 8));
+    std::vector<Tag> tags = {Tag(3), Tag(999), Tag(200001)};
+    ASSERT_EQ(dry.evalBatch(tags), std::vector<SecureByteBuffer>(3, SecureByteBuffer(TEST_KEY_LEN / 8)));
+}
+
+TEST(DryRun, TestKeysWithoutRandomnessAreRejected) {
+    GGM_PPRF dry = GGM_PPRF::dryRun(TEST_KEY_LEN, 32);
+    dry.punc(Tag(5));
+    /* the serialized key carries PRG id 2 */
+    SecureByteBuffer serialized = dry.serializeKey();
+    ASSERT_THROW(PPRFKeySerializer::deserialize(serialized), PPRFDeserializationError);
+    ASSERT_THROW(GGM_PPRF::fromSerialized(serialized), PPRFDeserializationError);
+    ASSERT_THROW(PPRFKey(TEST_KEY_LEN, 32, PRGType::STRUCTURE_ONLY), InitializationException);
+}
@@ -1,7 +1,9 @@
 #include "pkw/pkw/hpprf_aead_pkw.h"
 #include "pkw/pkw/exceptions.h"
+#include <atomic>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <bitset>
 
@@ -27,6 +29,20 @@ class HPPRF_AEAD_PKWTest : public ::testing::Test {
         HPPRF_AEAD_PKW pkw;
 };
 
+TEST_F(HPPRF_AEAD_PKWTest, TestWrapBatchThenUnwrapBatch) {
+    std::vector<Tag> tags = {int2vec(7), int2vec(1), {1, 0}, int2vec(2)};
+    std::vector<std::vector<unsigned char>> keys, heads;
+    for (int i = 0; i < tags.size(); ++i) {
+        keys.push_back({'k', 'e', 'y', (unsigned char) i});
+        heads.push_back({'h', (unsigned char) i});
+    }
+    std::vector<ciphertext> wrapped = pkw.wrapBatch(tags, heads, keys);
+    ASSERT_EQ(pkw.unwrapBatch(tags, heads, wrapped), keys);
+    ASSERT_EQ(pkw.unwrap(tags[2], heads[2], wrapped[2]), keys[2]);
+    pkw.punc({1});
+    ASSERT_THROW(pkw.unwrapBatch(tags, heads, wrapped), IllegalTagException);
+}
+
 TEST_F(HPPRF_AEAD_PKWTest, TestWrapThenUnwrap) {
     std::string key_str = "mykey";
     std::vector<unsigned char> key(key_str.begin(), key_str.end());
@@ -57,6 +73,43 @@ TEST_F(HPPRF_AEAD_PKWTest, TestWrapPuncThenUnwrap) {
     ASSERT_THROW(pkw.unwrap(int2vec(1), head, wrapped), IllegalTagException);
 }
 
+TEST_F(HPPRF_AEAD_PKWTest, TestConcurrentUnwrapDuringPunc) {
+    std::vector<unsigned char> head = {'h'};
+    std::vector<std::vector<unsigned char>> keys;
+    std::vector<ciphertext> wrapped;
+    for (int i = 0; i < 32; ++i) {
+        keys.push_back({'k', (unsigned char) i});
+        wrapped.push_back(pkw.wrap(int2vec(2 * i), head, keys[i]));
+    }
+    std::atomic<bool> done = false;
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&]() {
+            while (!done) {
+                for (int i = 0; i < 32; ++i) {
+                    try {
+                        if (pkw.unwrap(int2vec(2 * i), head, wrapped[i]) != keys[i]) {
+                            ++failures;
+                        }
+                    } catch (std::exception &e) {
+                        ++failures;
+                    }
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 32; ++i) {
+        pkw.punc(int2vec(2 * i + 1));
+    }
+    done = true;
+    for (auto &reader: readers) {
+        reader.join();
+    }
+    ASSERT_EQ(failures, 0);
+    ASSERT_THROW(pkw.unwrap(int2vec(1), head, wrapped[0]), IllegalTagException);
+}
+
 TEST_F(HPPRF_AEAD_PKWTest, TestNumberPunctures) {
     ASSERT_EQ(pkw.getNumPuncs(), 0);
     for (int i = 0; i < 1024; ++i) {
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include <pkw/pprf/node_store.h>
+
+static const size_t TEST_VALUE_LEN = 16;
+
+static SecureByteBuffer valueOf(unsigned char c) {
+    SecureByteBuffer v(TEST_VALUE_LEN);
+    std::fill(v.data(), v.data() + v.size(), c);
+    return v;
+}
+
+static NodeStore::Handle findLongest(const NodeStore &store, const std::string &path, size_t &depth) {
+    return store.findLongestPrefix(path.size(), [&path](size_t i) { return path[i] == '1'; }, depth);
+}
+
+TEST(NodeStoreTest, TestInsertAndLookup) {
+    NodeStore store(TEST_VALUE_LEN);
+    store.insert("01", valueOf(1));
+    store.insert("1", valueOf(2));
+    ASSERT_EQ(store.size(), 2);
+    ASSERT_TRUE(store.contains("01"));
+    ASSERT_FALSE(store.contains("0"));
+    ASSERT_EQ(store["1"].getValue(), valueOf(2));
+    ASSERT_EQ(store["1"].getPrefix(), "1");
+    ASSERT_EQ(store["00"].getValue().size(), 0) << "Missing node should be empty";
+}
+
+TEST(NodeStoreTest, TestFindLongestPrefix) {
+    NodeStore store(TEST_VALUE_LEN);
+    store.insert("01", valueOf(1));
+    store.insert("1", valueOf(2));
+    size_t depth;
+    NodeStore::Handle h = findLongest(store, "0110", depth);
+    ASSERT_NE(h, NodeStore::NONE);
+    ASSERT_EQ(depth, 2);
+    ASSERT_EQ(store.getValue(h), valueOf(1));
+    ASSERT_EQ(findLongest(store, "0010", depth), NodeStore::NONE);
+}
+
+TEST(NodeStoreTest, TestEraseSubtree) {
+    NodeStore store(TEST_VALUE_LEN);
+    store.insert("000", valueOf(1));
+    store.insert("0011", valueOf(2));
+    store.insert("01", valueOf(3));
+    store.insert("1", valueOf(4));
+    NodeStore::Handle h = store.find(2, [](size_t) { return false; });
+    ASSERT_NE(h, NodeStore::NONE);
+    store.eraseSubtree(h);
+    ASSERT_EQ(store.size(), 2);
+    ASSERT_FALSE(store.contains("000"));
+    ASSERT_FALSE(store.contains("0011"));
+    ASSERT_EQ(store.find(2, [](size_t) { return false; }), NodeStore::NONE) << "Empty subtree should be removed";
+    ASSERT_TRUE(store.contains("01"));
+}
+
+TEST(NodeStoreTest, TestForEachInOrder) {
+    NodeStore store(TEST_VALUE_LEN);
+    store.insert("1", valueOf(4));
+    store.insert("0011", valueOf(2));
+    store.insert("01", valueOf(3));
+    store.insert("000", valueOf(1));
+    std::vector<std::string> prefixes;
+    store.forEach([&prefixes](const BitPrefix &prefix, const unsigned char *value) {
+        prefixes.push_back(prefix.toString());
+    });
+    ASSERT_EQ(prefixes, std::vector<std::string>({"000", "0011", "01", "1"}));
+}
+
+TEST(NodeStoreTest, TestCopyAndMove) {
+    NodeStore store(TEST_VALUE_LEN);
+    store.insert("01", valueOf(1));
+    NodeStore copy(store);
+    store.erase("01");
+    ASSERT_TRUE(copy.contains("01"));
+    NodeStore moved(std::move(copy));
+    ASSERT_EQ(moved["01"].getValue(), valueOf(1));
+    ASSERT_EQ(moved.size(), 1);
+}
+
+TEST(NodeStoreTest, TestTrackedChangesReplay) {
+    NodeStore store(TEST_VALUE_LEN);
+    store.insert("000", valueOf(1));
+    store.insert("0011", valueOf(2));
+    store.insert("1", valueOf(3));
+    NodeStore replica(store);
+    store.trackChanges(true);
+    store.insert("01", valueOf(4));
+    store.insert("1", valueOf(5));
+    store.erase("000");
+    store.eraseSubtree(store.find(2, [](size_t) { return false; }));
+    std::vector<NodeDelta> changes = store.takeChanges();
+    ASSERT_EQ(changes.size(), 4);
+    ASSERT_TRUE(store.takeChanges().empty());
+    for (auto &change: changes) {
+        replica.apply(change);
+    }
+    std::vector<std::string> prefixes;
+    replica.forEach([&prefixes](const BitPrefix &prefix, const unsigned char *value) {
+        prefixes.push_back(prefix.toString());
+    });
+    ASSERT_EQ(prefixes, std::vector<std::string>({"01", "1"}));
+    ASSERT_EQ(replica["1"].getValue(), valueOf(5));
+}
+
+TEST(NodeStoreTest, TestPrependZeros) {
+    NodeStore store(TEST_VALUE_LEN);
+    store.insert("01", valueOf(1));
+    store.insert("1", valueOf(2));
+    NodeStore replica(store);
+    store.trackChanges(true);
+    store.prependZeros(3);
+    ASSERT_EQ(store.size(), 2);
+    ASSERT_EQ(store["00001"].getValue(), valueOf(1));
+    ASSERT_EQ(store["0001"].getValue(), valueOf(2));
+    ASSERT_EQ(store.depthHistogram()[4], 1);
+    std::vector<NodeDelta> changes = store.takeChanges();
+    ASSERT_EQ(changes.size(), 1);
+    replica.apply(changes[0]);
+    ASSERT_TRUE(replica.contains("00001"));
+    ASSERT_FALSE(replica.contains("01"));
+
+    NodeStore empty(TEST_VALUE_LEN);
+    empty.prependZeros(2);
+    ASSERT_TRUE(empty.empty());
+    ASSERT_EQ(empty.find(1, [](size_t) { return false; }), NodeStore::NONE) << "No trie nodes should be left behind";
+}
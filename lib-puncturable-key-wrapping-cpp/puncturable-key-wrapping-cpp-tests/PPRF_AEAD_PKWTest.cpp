@@ -1,7 +1,9 @@
 #include "pkw/pkw/pprf_aead_pkw.h"
 #include "pkw/pkw/exceptions.h"
+#include <atomic>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 
@@ -45,6 +47,202 @@ TEST_F(PPRF_AEAD_PKWTest, TestWrapPuncThenUnwrap) {
     ASSERT_THROW(pkw.unwrap(1, head, wrapped), IllegalTagException);
 }
 
+TEST_F(PPRF_AEAD_PKWTest, TestWrapBatchThenUnwrap) {
+    std::vector<Tag> tags = {7, 1, 2, 1000};
+    std::vector<std::vector<unsigned char>> keys, heads;
+    for (int i = 0; i < tags.size(); ++i) {
+        keys.push_back({'k', 'e', 'y', (unsigned char) i});
+        heads.push_back({'h', (unsigned char) i});
+    }
+    std::vector<ciphertext> wrapped = pkw.wrapBatch(tags, heads, keys);
+    ASSERT_EQ(wrapped.size(), tags.size());
+    for (int i = 0; i < tags.size(); ++i) {
+        ASSERT_EQ(pkw.unwrap(tags[i], heads[i], wrapped[i]), keys[i]);
+    }
+    ASSERT_EQ(pkw.unwrapBatch(tags, heads, wrapped), keys);
+    pkw.punc(2);
+    ASSERT_THROW(pkw.unwrapBatch(tags, heads, wrapped), IllegalTagException);
+    ASSERT_THROW(pkw.wrapBatch(tags, heads, keys), IllegalTagException);
+}
+
+TEST_F(PPRF_AEAD_PKWTest, TestUnwrapLiveBatchSkipsPunctured) {
+    std::vector<Tag> tags = {7, 1, 2, 1000};
+    std::vector<std::vector<unsigned char>> keys, heads;
+    for (int i = 0; i < tags.size(); ++i) {
+        keys.push_back({'k', 'e', 'y', (unsigned char) i});
+        heads.push_back({'h', (unsigned char) i});
+    }
+    std::vector<ciphertext> wrapped = pkw.wrapBatch(tags, heads, keys);
+    pkw.punc(2);
+    wrapped[3][0] ^= 1;
+    auto unwrapped = pkw.unwrapLiveBatch(tags, heads, wrapped);
+    ASSERT_EQ(unwrapped.size(), tags.size());
+    ASSERT_EQ(unwrapped[0], keys[0]);
+    ASSERT_EQ(unwrapped[1], keys[1]);
+    ASSERT_FALSE(unwrapped[2].has_value()) << "the tag was punctured";
+    ASSERT_FALSE(unwrapped[3].has_value()) << "the ciphertext was modified";
+}
+
+TEST_F(PPRF_AEAD_PKWTest, TestPuncRangeThenUnwrap) {
+    std::vector<unsigned char> key{'k', 'e', 'y'};
+    std::vector<unsigned char> head{'h'};
+    std::vector<unsigned char> wrapped = pkw.wrap(99, head, key);
+    std::vector<unsigned char> wrappedInRange = pkw.wrap(150, head, key);
+    pkw.puncRange(100, 1u << 20);
+    ASSERT_EQ(pkw.unwrap(99, head, wrapped), key);
+    ASSERT_THROW(pkw.unwrap(150, head, wrappedInRange), IllegalTagException);
+    Tag t;
+    t.set(128, true);
+    ASSERT_THROW(pkw.puncRange(0, t), IllegalTagException);
+}
+
+TEST_F(PPRF_AEAD_PKWTest, TestSequentialWrapUsesCursor) {
+    std::vector<unsigned char> key = {'k', 'e', 'y'};
+    std::vector<unsigned char> head = {'h'};
+    std::vector<ciphertext> wrapped;
+    for (int i = 0; i < 1024; ++i) {
+        wrapped.push_back(pkw.wrap(i, head, key));
+    }
+    EvalCursor::Stats stats = pkw.cursorStats();
+    ASSERT_EQ(stats.anchors, 1);
+    ASSERT_LE(stats.derivations, 128 + 2 * 1024);
+    PPRF_AEAD_PKW imported(pkw.serializeKey());
+    for (int i = 0; i < 1024; ++i) {
+        ASSERT_EQ(imported.unwrap(i, head, wrapped[i]), key) << "tag " << i;
+    }
+}
+
+TEST_F(PPRF_AEAD_PKWTest, TestPuncInvalidatesCursor) {
+    std::vector<unsigned char> key = {'k', 'e', 'y'};
+    std::vector<unsigned char> head = {'h'};
+    pkw.wrap(4, head, key);
+    pkw.punc(5);
+    ASSERT_THROW(pkw.wrap(5, head, key), IllegalTagException);
+    ciphertext wrapped = pkw.wrap(6, head, key);
+    ASSERT_EQ(pkw.unwrap(6, head, wrapped), key);
+
+    pkw.puncRange(7, 20);
+    ASSERT_THROW(pkw.wrap(8, head, key), IllegalTagException);
+    std::vector<Tag> tags = {22, 30};
+    pkw.wrap(21, head, key);
+    pkw.puncBatch(tags);
+    ASSERT_THROW(pkw.wrap(22, head, key), IllegalTagException);
+    wrapped = pkw.wrap(23, head, key);
+    ASSERT_EQ(pkw.unwrap(23, head, wrapped), key);
+    ASSERT_EQ(pkw.cursorStats().anchors, 4);
+}
+
+TEST(PPRF_AEAD_PKWGrowingTest, TestWrapGrowsTagLen) {
+    PPRF_AEAD_PKW pkw(8, 128, PRGType::FIXED_KEY_AES, 2, 128);
+    std::vector<unsigned char> key = {'k', 'e', 'y'};
+    std::vector<unsigned char> head = {'h'};
+    ciphertext first = pkw.wrap(200, head, key);
+    ASSERT_EQ(pkw.keyStats().tagLen, 8);
+    ASSERT_EQ(pkw.getNumGrowths(), 0);
+    ciphertext second = pkw.wrap(1000, head, key);
+    ASSERT_EQ(pkw.keyStats().tagLen, 10) << "The tree should grow to the bit length of the tag";
+    ASSERT_EQ(pkw.getNumGrowths(), 1);
+    ASSERT_EQ(pkw.unwrap(200, head, first), key) << "Keys wrapped before growing should stay valid";
+    std::vector<Tag> tags = {Tag(1) << 40, Tag(5)};
+    std::vector<std::vector<unsigned char>> heads = {head, head};
+    std::vector<std::vector<unsigned char>> keys = {key, key};
+    std::vector<ciphertext> batch = pkw.wrapBatch(tags, heads, keys);
+    ASSERT_EQ(pkw.keyStats().tagLen, 41);
+    ASSERT_EQ(pkw.getNumGrowths(), 2);
+    pkw.punc(200);
+    PPRF_AEAD_PKW imported(pkw.serializeKey());
+    ASSERT_THROW(imported.unwrap(200, head, first), IllegalTagException);
+    ASSERT_EQ(imported.unwrap(1000, head, second), key);
+    ASSERT_EQ(imported.unwrap(Tag(1) << 40, head, batch[0]), key);
+    ASSERT_THROW(imported.wrap(Tag(1) << 200, head, key), IllegalTagException) << "The tree should not exceed 128 bits";
+    ASSERT_EQ(imported.keyStats().tagLen, 41);
+}
+
+TEST_F(PPRF_AEAD_PKWTest, TestNumKeyNodes) {
+    AbstractPKW<Tag, ciphertext> &abstractPKW = pkw;
+    ASSERT_EQ(abstractPKW.getNumKeyNodes(), 1);
+    pkw.punc(5);
+    ASSERT_EQ(abstractPKW.getNumKeyNodes(), pkw.keyStats().nodes);
+    ASSERT_GT(abstractPKW.getNumKeyNodes(), 1);
+}
+
+TEST_F(PPRF_AEAD_PKWTest, TestConcurrentUnwrapDuringPunc) {
+    pkw.enableCache(1 << 14);
+    std::vector<unsigned char> head = {'h'};
+    std::vector<std::vector<unsigned char>> keys;
+    std::vector<ciphertext> wrapped;
+    for (int i = 0; i < 64; ++i) {
+        keys.push_back({'k', (unsigned char) i});
+        wrapped.push_back(pkw.wrap(2 * i, head, keys[i]));
+    }
+    std::atomic<bool> done = false;
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&]() {
+            while (!done) {
+                for (int i = 0; i < 64; ++i) {
+                    try {
+                        if (pkw.unwrap(2 * i, head, wrapped[i]) != keys[i]) {
+                            ++failures;
+                        }
+                    } catch (std::exception &e) {
+                        ++failures;
+                    }
+                }
+            }
+        });
+    }
+    /* the odd tags share all but the last node of their paths with the wrapped keys */
+    for (int i = 0; i < 64; ++i) {
+        pkw.punc(2 * i + 1);
+    }
+    pkw.puncRange(1000, 2000);
+    done = true;
+    for (auto &reader: readers) {
+        reader.join();
+    }
+    ASSERT_EQ(failures, 0);
+    ASSERT_EQ(pkw.getNumPuncs(), 65);
+    ASSERT_THROW(pkw.unwrap(1, head, wrapped[0]), IllegalTagException);
+    ASSERT_EQ(pkw.unwrap(0, head, wrapped[0]), keys[0]);
+}
+
+TEST_F(PPRF_AEAD_PKWTest, TestConcurrentWrapDuringPunc) {
+    std::vector<unsigned char> key = {'k', 'e', 'y'};
+    std::vector<unsigned char> head = {'h'};
+    std::atomic<bool> done = false;
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&]() {
+            while (!done) {
+                for (int i = 0; i < 64; ++i) {
+                    /* once the puncture is visible, the tag must not be derived from a path cached before */
+                    const bool punctured = pkw.getNumPuncs() > i;
+                    try {
+                        pkw.wrap(2 * i, head, key);
+                        if (punctured) {
+                            ++failures;
+                        }
+                    } catch (IllegalTagException &e) {
+                    }
+                    pkw.wrap(2 * i + 1, head, key);
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 64; ++i) {
+        pkw.punc(2 * i);
+        EXPECT_THROW(pkw.wrap(2 * i, head, key), IllegalTagException);
+    }
+    done = true;
+    for (auto &writer: writers) {
+        writer.join();
+    }
+    ASSERT_EQ(failures, 0);
+}
+
 TEST_F(PPRF_AEAD_PKWTest, TestNumberPunctures) {
     ASSERT_EQ(pkw.getNumPuncs(), 0);
     for (long i = 0; i < 1024; ++i) {
@@ -77,6 +275,27 @@ TEST_F(PPRF_AEAD_PKWTest, TestExportImportKey) {
     ASSERT_THROW(pkw2->wrap(12, empty, empty), IllegalTagException) << "Should throw exception";
 }
 
+TEST(PPRF_AEAD_PKWDryRunTest, TestNoKeyWithoutRandomness) {
+    ASSERT_THROW(PPRF_AEAD_PKW(64, 128, PRGType::STRUCTURE_ONLY), InitializationException);
+}
+
+TEST(PPRF_AEAD_PKWGrowingTest, TestSerializeKeyAndResetDelta) {
+    PPRF_AEAD_PKW pkw(8, 128, PRGType::HKDF_SHA256, 2, 128);
+    std::vector<unsigned char> key = {'k', 'e', 'y'};
+    std::vector<unsigned char> head = {'h'};
+    pkw.trackKeyChanges();
+    ciphertext wrapped = pkw.wrap(1000, head, key);
+    pkw.punc(3);
+    SecureByteBuffer snapshot = pkw.serializeKeyAndResetDelta();
+    pkw.punc(5);
+    /* the growth and the first puncture are contained in the snapshot only, replaying them would grow the tree twice */
+    PPRF_AEAD_PKW restored(std::move(snapshot));
+    restored.applyKeyDelta(pkw.takeKeyDelta());
+    ASSERT_EQ(restored.serializeKey(), pkw.serializeKey());
+    ASSERT_EQ(restored.getNumPuncs(), 2);
+    ASSERT_EQ(restored.unwrap(1000, head, wrapped), key);
+}
+
 TEST_F(PPRF_AEAD_PKWTest, TestWrapExportImportKeyUnwrap) {
     std::string key_str = "mykey";
     std::vector<unsigned char> dek(key_str.begin(), key_str.end());
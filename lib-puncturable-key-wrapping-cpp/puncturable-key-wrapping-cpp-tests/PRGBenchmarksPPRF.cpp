@@ -0,0 +1,96 @@
+#include "pkw/pprf/ggm_pprf.h"
+#include "pkw/pprf/pprf_exceptions.h"
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
+
+static const int KEY_LEN = 256;
+static const int NUM_OPS = 2000;
+
+struct Result {
+    int tagLen;
+    PRGType prg;
+    double evalTime;
+    double puncTime;
+};
+
+std::vector<Tag> getRandomTags(int tagLen, int n, std::mt19937_64 &rng) {
+    std::vector<Tag> tags;
+    for (int i = 0; i < n; ++i) {
+        Tag t;
+        for (size_t w = 0; w < MAX_TAG_LEN / 64; ++w) {
+            t <<= 64;
+            t |= Tag(rng());
+        }
+        tags.push_back(t >> (MAX_TAG_LEN - tagLen));
+    }
+    return tags;
+}
+
+/**
+ * Measures the average time (in microseconds) of an eval and a punc, performing evals and puncs alternately on
+ * random tags.
+ */
+Result measure(int tagLen, PRGType prgType) {
+    std::mt19937_64 rng(tagLen);
+    GGM_PPRF prf(PPRFKey(KEY_LEN, tagLen, prgType));
+    std::vector<Tag> toPunc = getRandomTags(tagLen, NUM_OPS, rng);
+    std::vector<Tag> toEval = getRandomTags(tagLen, NUM_OPS, rng);
+    std::chrono::nanoseconds evalTime(0);
+    std::chrono::nanoseconds puncTime(0);
+    for (int i = 0; i < NUM_OPS; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            prf.eval(toEval[i]);
+        } catch (TagException &e) {
+            std::cerr << "Already punc-ed!" << std::endl;
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        prf.punc(toPunc[i]);
+        auto end = std::chrono::high_resolution_clock::now();
+        evalTime += mid - start;
+        puncTime += end - mid;
+    }
+    return {tagLen, prgType, evalTime.count() / 1000.0 / NUM_OPS, puncTime.count() / 1000.0 / NUM_OPS};
+}
+
+std::string prgName(PRGType prg) {
+    return prg == PRGType::HKDF_SHA256 ? "HKDF_SHA256" : "FIXED_KEY_AES";
+}
+
+int main() {
+    std::cout << "Starting benchmark." << std::endl;
+    std::vector<Result> results;
+    for (int tagLen: {32, 64, 128, 256}) {
+        Result hkdf = measure(tagLen, PRGType::HKDF_SHA256);
+        Result aes = measure(tagLen, PRGType::FIXED_KEY_AES);
+        std::cout << "tag length " << tagLen << ":\t eval " << hkdf.evalTime << "us -> " << aes.evalTime << "us (x"
+                  << hkdf.evalTime / aes.evalTime << "),\t punc " << hkdf.puncTime << "us -> " << aes.puncTime
+                  << "us (x" << hkdf.puncTime / aes.puncTime << ")" << std::endl;
+        results.push_back(hkdf);
+        results.push_back(aes);
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/prgBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "tag_len"
+        << "\t"
+        << "prg"
+        << "\t"
+        << "eval_time"
+        << "\t"
+        << "punc_time" << std::endl;
+    for (auto &res: results) {
+        out << res.tagLen << "\t" << prgName(res.prg) << "\t" << res.evalTime << "\t" << res.puncTime << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
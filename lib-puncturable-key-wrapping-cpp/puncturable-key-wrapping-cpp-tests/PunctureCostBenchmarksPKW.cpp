@@ -0,0 +1,88 @@
+#include "pkw/pkw/pprf_aead_pkw.h"
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+static const int KEY_LEN = 128;
+static const int TAG_LEN = 64;
+static const int PUNCS = 2000;
+static const size_t CACHE_BUDGET = 1 << 20;
+
+struct Result {
+    std::string mode;
+    size_t keyNodes;
+    /* in microseconds */
+    double puncTime;
+};
+
+/**
+ * Grows a key to the given number of punctured tags, every other tag such that each puncture leaves its co-path in the
+ * key, and measures the time of single punctures afterwards. Every puncture publishes a new version of the key, whose
+ * cost should not depend on the size of the key.
+ * @param tracking whether the changes of the key are tracked and never taken, such that they pile up
+ * @param cache whether the cache is enabled and filled by evaluations between the punctures
+ */
+Result measure(const std::string &mode, size_t keyPuncs, bool tracking, bool cache) {
+    PPRF_AEAD_PKW pkw(TAG_LEN, KEY_LEN, PRGType::FIXED_KEY_AES);
+    if (tracking) {
+        pkw.trackKeyChanges();
+    }
+    if (cache) {
+        pkw.enableCache(CACHE_BUDGET);
+    }
+    std::vector<Tag> initial;
+    initial.reserve(keyPuncs);
+    for (size_t i = 0; i < keyPuncs; ++i) {
+        initial.emplace_back(2 * i + 1);
+    }
+    pkw.puncBatch(initial);
+    const size_t keyNodes = pkw.getNumKeyNodes();
+
+    std::vector<unsigned char> header = {'h'};
+    std::vector<unsigned char> key(32, 'k');
+    std::chrono::nanoseconds time(0);
+    for (int i = 0; i < PUNCS; ++i) {
+        const Tag tag(2 * (keyPuncs + i) + 1);
+        if (cache) {
+            pkw.wrap(Tag(2 * (keyPuncs + i)), header, key);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        pkw.punc(tag);
+        time += std::chrono::high_resolution_clock::now() - start;
+    }
+    return {mode, keyNodes, time.count() / 1e3 / PUNCS};
+}
+
+int main() {
+    std::cout << "Starting benchmark." << std::endl;
+    std::vector<Result> results;
+    for (size_t keyPuncs = 1 << 10; keyPuncs <= 1 << 18; keyPuncs <<= 2) {
+        results.push_back(measure("PLAIN", keyPuncs, false, false));
+        results.push_back(measure("TRACKING", keyPuncs, true, false));
+        results.push_back(measure("CACHE", keyPuncs, false, true));
+    }
+    for (auto &res: results) {
+        std::cout << res.mode << ", " << res.keyNodes << " key nodes:\t " << res.puncTime << "us per puncture"
+                  << std::endl;
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/punctureCostBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "mode"
+        << "\t"
+        << "key_nodes"
+        << "\t"
+        << "punc_time_us" << std::endl;
+    for (auto &res: results) {
+        out << res.mode << "\t" << res.keyNodes << "\t" << res.puncTime << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
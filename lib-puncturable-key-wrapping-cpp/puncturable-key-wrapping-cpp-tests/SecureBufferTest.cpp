@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+
+#include <pkw/secure_byte_buffer.h>
+#include <pkw/secure_key.h>
+#include <utility>
+
+TEST(SecureByteBufferTest, TestMoveTransfersMemory) {
+    SecureByteBuffer buffer(16, 7);
+    const unsigned char *data = buffer.data();
+    SecureByteBuffer moved(std::move(buffer));
+    ASSERT_EQ(moved.data(), data) << "Moving should not copy the buffer";
+    ASSERT_EQ(moved, SecureByteBuffer(16, 7));
+    ASSERT_EQ(buffer.size(), 0);
+
+    SecureByteBuffer assigned(8, 1);
+    assigned = std::move(moved);
+    ASSERT_EQ(assigned.data(), data) << "Move assignment should not copy the buffer";
+    ASSERT_EQ(assigned, SecureByteBuffer(16, 7));
+    ASSERT_EQ(moved.size(), 0);
+}
+
+TEST(SecureByteBufferTest, TestCopyAssign) {
+    SecureByteBuffer buffer(16, 7);
+    SecureByteBuffer copy(32, 1);
+    copy = buffer;
+    ASSERT_EQ(copy, buffer);
+    ASSERT_NE(copy.data(), buffer.data());
+    copy = copy;
+    ASSERT_EQ(copy, buffer);
+}
+
+TEST(SecureKeyTest, TestMoveErasesSource) {
+    SecureByteBuffer value(16, 7);
+    SecureKey<16> key(value.data());
+    ASSERT_EQ(key.toBuffer(), value);
+    SecureKey<16> moved(std::move(key));
+    ASSERT_EQ(moved.toBuffer(), value);
+    ASSERT_EQ(key, SecureKey<16>()) << "The source of a move should be erased";
+
+    SecureKey<16> assigned;
+    assigned = std::move(moved);
+    ASSERT_EQ(assigned.toBuffer(), value);
+    ASSERT_EQ(moved, SecureKey<16>());
+}
@@ -0,0 +1,134 @@
+#include "pkw/pprf/ggm_pprf.h"
+#include "pkw/pprf/pprf_exceptions.h"
+#include "pkw/pprf/pprf_key_serializer.h"
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sys/stat.h>
+
+static const int KEY_LEN = 128;
+static const int TAG_LEN = 64;
+static const int BATCH_SIZE = 4096;
+static const int REPETITIONS = 3;
+
+struct Result {
+    KeyFormat format;
+    size_t nodes;
+    size_t serializedBytes;
+    double serializeTime;
+    double deserializeTime;
+    /* the time to construct a PPRF from the serialized key and evaluate it on a single tag */
+    double firstEvalTime;
+};
+
+/**
+ * Punctures random tags until the key holds about the given number of nodes. A random puncture adds about
+ * TAG_LEN - log2(puncs) nodes to the key.
+ */
+PPRFKey createKey(size_t targetNodes, std::mt19937_64 &rng) {
+    double puncs = std::max(1.0, static_cast<double>(targetNodes) / TAG_LEN);
+    for (int i = 0; i < 4; ++i) {
+        puncs = static_cast<double>(targetNodes) / (TAG_LEN - std::log2(puncs));
+    }
+    GGM_PPRF prf(PPRFKey(KEY_LEN, TAG_LEN, PRGType::FIXED_KEY_AES));
+    std::vector<Tag> tags;
+    for (size_t done = 0; done < static_cast<size_t>(puncs); done += tags.size()) {
+        tags.clear();
+        for (size_t i = done; i < static_cast<size_t>(puncs) && tags.size() < BATCH_SIZE; ++i) {
+            tags.emplace_back(rng());
+        }
+        prf.puncBatch(tags);
+    }
+    return PPRFKeySerializer::deserialize(prf.serializeKey());
+}
+
+/**
+ * Measures the average time (in milliseconds) to deserialize a key in the given format and to serialize it again, and
+ * the time until the first evaluation.
+ */
+Result measure(const PPRFKey &key, KeyFormat format, std::mt19937_64 &rng) {
+    SecureByteBuffer serialized = PPRFKeySerializer(key).serialize(format);
+    std::chrono::nanoseconds serializeTime(0);
+    std::chrono::nanoseconds deserializeTime(0);
+    std::chrono::nanoseconds firstEvalTime(0);
+    for (int i = 0; i < REPETITIONS; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        PPRFKey deserialized = PPRFKeySerializer::deserialize(serialized);
+        deserializeTime += std::chrono::high_resolution_clock::now() - start;
+        start = std::chrono::high_resolution_clock::now();
+        SecureByteBuffer reserialized = PPRFKeySerializer(deserialized).serialize(format);
+        serializeTime += std::chrono::high_resolution_clock::now() - start;
+        if (reserialized != serialized) {
+            std::cerr << "Serialization is not stable!" << std::endl;
+        }
+        start = std::chrono::high_resolution_clock::now();
+        GGM_PPRF prf = GGM_PPRF::fromSerialized(serialized);
+        try {
+            prf.eval(Tag(rng()));
+        } catch (TagException &e) {
+            std::cerr << "Already punc-ed!" << std::endl;
+        }
+        firstEvalTime += std::chrono::high_resolution_clock::now() - start;
+    }
+    return {format, key.nodes.size(), serialized.size(), serializeTime.count() / 1e6 / REPETITIONS,
+            deserializeTime.count() / 1e6 / REPETITIONS, firstEvalTime.count() / 1e6 / REPETITIONS};
+}
+
+double throughput(const Result &res, double time) {
+    return res.serializedBytes / 1e6 / (time / 1000);
+}
+
+std::string formatName(KeyFormat format) {
+    return format == KeyFormat::COMPACT ? "COMPACT" : "PLAIN";
+}
+
+int main() {
+    std::cout << "Starting benchmark." << std::endl;
+    std::mt19937_64 rng(42);
+    std::vector<Result> results;
+    for (size_t nodes: {10000, 100000, 1000000, 10000000}) {
+        PPRFKey key = createKey(nodes, rng);
+        for (KeyFormat format: {KeyFormat::PLAIN, KeyFormat::COMPACT}) {
+            Result res = measure(key, format, rng);
+            std::cout << formatName(format) << ", " << res.nodes << " nodes, " << res.serializedBytes
+                      << "B:\t serialize " << res.serializeTime << "ms (" << throughput(res, res.serializeTime)
+                      << "MB/s),\t deserialize " << res.deserializeTime << "ms ("
+                      << throughput(res, res.deserializeTime) << "MB/s),\t first eval " << res.firstEvalTime << "ms"
+                      << std::endl;
+            results.push_back(res);
+        }
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/serializationThroughputBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "format"
+        << "\t"
+        << "nodes"
+        << "\t"
+        << "serialized_bytes"
+        << "\t"
+        << "serialize_time"
+        << "\t"
+        << "deserialize_time"
+        << "\t"
+        << "serialize_mb_per_s"
+        << "\t"
+        << "deserialize_mb_per_s"
+        << "\t"
+        << "first_eval_time" << std::endl;
+    for (auto &res: results) {
+        out << formatName(res.format) << "\t" << res.nodes << "\t" << res.serializedBytes << "\t" << res.serializeTime << "\t" << res.deserializeTime << "\t"
+            << throughput(res, res.serializeTime) << "\t" << throughput(res, res.deserializeTime) << "\t"
+            << res.firstEvalTime << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
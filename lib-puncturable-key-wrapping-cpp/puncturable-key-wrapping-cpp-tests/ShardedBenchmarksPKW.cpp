@@ -0,0 +1,90 @@
+#include "pkw/pkw/pprf_aead_pkw.h"
+#include "pkw/pkw/sharded_pprf_aead_pkw.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sys/stat.h>
+#include <thread>
+
+static const int KEY_LEN = 256;
+static const int TAG_LEN = 64;
+static const int SHARD_BITS = 5;
+static const std::chrono::milliseconds DURATION(1000);
+
+struct Result {
+    std::string pkw;
+    int threads;
+    double opsPerSecond;
+};
+
+/**
+ * Each thread repeatedly adds a file (wrap), reads it (unwrap) and shreds it (punc), on tags allocated round-robin over
+ * the shards as by the FlatIdProvider. Measures the throughput of these operations over all threads.
+ */
+Result measure(const std::string &name, AbstractPKW<Tag, ciphertext> &pkw, int threads) {
+    std::vector<unsigned char> header = {'h'};
+    std::vector<unsigned char> key(32, 'k');
+    std::atomic<bool> done = false;
+    std::atomic<uint64_t> counter = 0;
+    std::atomic<size_t> ops = 0;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            size_t count = 0;
+            while (!done) {
+                uint64_t c = counter++;
+                Tag tag = Tag(c >> SHARD_BITS) | Tag(c & ((1 << SHARD_BITS) - 1)) << (TAG_LEN - SHARD_BITS);
+                ciphertext wrapped = pkw.wrap(tag, header, key);
+                pkw.unwrap(tag, header, wrapped);
+                pkw.punc(tag);
+                count += 3;
+            }
+            ops += count;
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(DURATION);
+    done = true;
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {name, threads, ops / seconds};
+}
+
+int main() {
+    std::cout << "Starting benchmark on " << std::thread::hardware_concurrency() << " hardware threads." << std::endl;
+    std::vector<Result> results;
+    for (int threads: {1, 2, 4, 8, 16, 32}) {
+        PPRF_AEAD_PKW single(TAG_LEN, KEY_LEN, PRGType::FIXED_KEY_AES);
+        ShardedPPRF_AEAD_PKW sharded(TAG_LEN, KEY_LEN, SHARD_BITS, PRGType::FIXED_KEY_AES);
+        for (auto [name, pkw]: {std::pair<std::string, AbstractPKW<Tag, ciphertext> *>{"PPRF_AEAD_PKW", &single},
+                                {"ShardedPPRF_AEAD_PKW", &sharded}}) {
+            Result res = measure(name, *pkw, threads);
+            std::cout << name << ", " << threads << " threads:\t " << res.opsPerSecond << " ops/s" << std::endl;
+            results.push_back(res);
+        }
+    }
+
+    std::time_t time = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y_%m_%d_%Hh%M", std::localtime(&time));
+    mkdir("out", 0777);
+    std::string path = "out/shardedBenchmark_" + std::string(date) + ".txt";
+    std::ofstream out(path, std::ofstream::out);
+    out << "pkw"
+        << "\t"
+        << "threads"
+        << "\t"
+        << "ops_per_s" << std::endl;
+    for (auto &res: results) {
+        out << res.pkw << "\t" << res.threads << "\t" << res.opsPerSecond << std::endl;
+    }
+    out.close();
+    std::cout << "Finished benchmark." << std::endl;
+    std::cout << "Output file at: " << path;
+}
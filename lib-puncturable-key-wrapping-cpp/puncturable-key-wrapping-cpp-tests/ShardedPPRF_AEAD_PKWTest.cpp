@@ -0,0 +1,155 @@
+#include "pkw/pkw/exceptions.h"
+#include "pkw/pkw/sharded_pprf_aead_pkw.h"
+#include "pkw/pprf/pprf_exceptions.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+static const int SHARD_BITS = 3;
+
+class ShardedPPRF_AEAD_PKWTest : public ::testing::Test {
+
+    protected:
+    public:
+        ShardedPPRF_AEAD_PKWTest() : pkw(64, 128, SHARD_BITS) {
+        }
+
+        /**
+         * @return a tag in the given shard
+         */
+        static Tag inShard(size_t shard, uint64_t local) {
+            return Tag(shard) << (64 - SHARD_BITS) | Tag(local);
+        }
+
+        ShardedPPRF_AEAD_PKW pkw;
+        std::vector<unsigned char> head = {'h', 'e', 'a', 'd'};
+        std::vector<unsigned char> key = {'k', 'e', 'y'};
+};
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestWrapThenUnwrap) {
+    for (size_t shard = 0; shard < pkw.numShards(); ++shard) {
+        Tag tag = inShard(shard, 5);
+        ASSERT_EQ(pkw.shardOf(tag), shard);
+        ciphertext wrapped = pkw.wrap(tag, head, key);
+        ASSERT_EQ(pkw.unwrap(tag, head, wrapped), key);
+    }
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestShardsAreDerivedLazily) {
+    ASSERT_EQ(pkw.usedShards(), 0);
+    ciphertext wrapped = pkw.wrap(inShard(2, 1), head, key);
+    pkw.punc(inShard(2, 7));
+    ASSERT_EQ(pkw.usedShards(), 1);
+    pkw.punc(inShard(5, 7));
+    ASSERT_EQ(pkw.usedShards(), 2);
+    ASSERT_EQ(pkw.unwrap(inShard(2, 1), head, wrapped), key);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestPuncOnlyAffectsTag) {
+    ciphertext same = pkw.wrap(inShard(1, 3), head, key);
+    ciphertext other = pkw.wrap(inShard(6, 3), head, key);
+    pkw.punc(inShard(1, 3));
+    ASSERT_THROW(pkw.unwrap(inShard(1, 3), head, same), IllegalTagException);
+    ASSERT_THROW(pkw.wrap(inShard(1, 3), head, key), IllegalTagException);
+    ASSERT_EQ(pkw.unwrap(inShard(6, 3), head, other), key);
+    ASSERT_EQ(pkw.getNumPuncs(), 1);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestBatchAcrossShards) {
+    std::vector<Tag> tags = {inShard(7, 1), inShard(0, 1), inShard(7, 2), inShard(3, 9)};
+    std::vector<std::vector<unsigned char>> keys, heads;
+    for (int i = 0; i < tags.size(); ++i) {
+        keys.push_back({'k', (unsigned char) i});
+        heads.push_back({'h', (unsigned char) i});
+    }
+    std::vector<ciphertext> wrapped = pkw.wrapBatch(tags, heads, keys);
+    for (int i = 0; i < tags.size(); ++i) {
+        ASSERT_EQ(pkw.unwrap(tags[i], heads[i], wrapped[i]), keys[i]);
+    }
+    ASSERT_EQ(pkw.unwrapBatch(tags, heads, wrapped), keys);
+    pkw.puncBatch(std::vector<Tag>{inShard(7, 2), inShard(0, 1)});
+    ASSERT_EQ(pkw.getNumPuncs(), 2);
+    ASSERT_THROW(pkw.unwrapBatch(tags, heads, wrapped), IllegalTagException);
+    ASSERT_EQ(pkw.unwrap(tags[0], heads[0], wrapped[0]), keys[0]);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestKeyStatsCombineShards) {
+    KeyStats fresh = pkw.keyStats();
+    ASSERT_EQ(fresh.nodes, 1);
+    ASSERT_EQ(fresh.expectedEvalDerivations, fresh.tagLen);
+    pkw.wrap(Tag(0), head, key);
+    pkw.punc(Tag(0));
+    KeyStats stats = pkw.keyStats();
+    /* the root key holds the co-path of the shard, the shard key the co-path of the tag below it */
+    ASSERT_EQ(stats.nodes, fresh.tagLen);
+    for (size_t d = 1; d <= stats.tagLen; ++d) {
+        ASSERT_EQ(stats.depthHistogram[d], 1) << "depth " << d;
+    }
+    ASSERT_EQ(stats.depthHistogram[0], 0);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestTagTooLarge) {
+    ASSERT_THROW(pkw.wrap(Tag(1) << 64, head, key), IllegalTagException);
+    ASSERT_THROW(pkw.punc(Tag(1) << 64), IllegalTagException);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestInvalidShardBits) {
+    ASSERT_THROW(ShardedPPRF_AEAD_PKW(64, 128, 0), InitializationException);
+    ASSERT_THROW(ShardedPPRF_AEAD_PKW(8, 128, 8), InitializationException);
+    ASSERT_THROW(ShardedPPRF_AEAD_PKW(64, 128, ShardedPPRF_AEAD_PKW::MAX_SHARD_BITS + 1), InitializationException);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestExportImportKey) {
+    ciphertext wrapped = pkw.wrap(inShard(4, 10), head, key);
+    ciphertext untouched = pkw.wrap(inShard(4, 11), head, key);
+    pkw.punc(inShard(4, 10));
+    pkw.punc(inShard(1, 10));
+    auto exp = pkw.serializeKey();
+    auto pkw2 = ShardedPPRF_AEAD_PKW_Factory().fromSerialized(exp);
+    ASSERT_EQ(pkw2->getNumPuncs(), 2);
+    ASSERT_THROW(pkw2->unwrap(inShard(4, 10), head, wrapped), IllegalTagException);
+    ASSERT_EQ(pkw2->unwrap(inShard(4, 11), head, untouched), key);
+    ASSERT_EQ(pkw2->serializeKey(), exp);
+
+    exp.data()[0] ^= 1;
+    ASSERT_THROW(ShardedPPRF_AEAD_PKW_Factory().fromSerialized(exp), DeserializationError);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestImportRejectsMismatchingShards) {
+    pkw.wrap(inShard(4, 10), head, key);
+    const SecureByteBuffer exp = pkw.serializeKey();
+    /* the header: magic | tagLen | keyLen | shardBits | PRG, the integers are big-endian */
+    SecureByteBuffer otherKeyLen = exp;
+    otherKeyLen.data()[14] = 1;
+    otherKeyLen.data()[15] = 0;
+    ASSERT_THROW(ShardedPPRF_AEAD_PKW_Factory().fromSerialized(otherKeyLen), DeserializationError);
+    SecureByteBuffer otherPRG = exp;
+    otherPRG.data()[20] = static_cast<unsigned char>(PRGType::FIXED_KEY_AES);
+    ASSERT_THROW(ShardedPPRF_AEAD_PKW_Factory().fromSerialized(otherPRG), DeserializationError);
+}
+
+TEST_F(ShardedPPRF_AEAD_PKWTest, TestConcurrentPuncInDifferentShards) {
+    std::vector<ciphertext> wrapped;
+    for (size_t shard = 0; shard < pkw.numShards(); ++shard) {
+        wrapped.push_back(pkw.wrap(inShard(shard, 0), head, key));
+    }
+    std::atomic<int> failures = 0;
+    std::vector<std::thread> threads;
+    for (size_t shard = 0; shard < pkw.numShards(); ++shard) {
+        threads.emplace_back([&, shard]() {
+            for (uint64_t i = 1; i <= 50; ++i) {
+                pkw.punc(inShard(shard, i));
+                if (pkw.unwrap(inShard(shard, 0), head, wrapped[shard]) != key) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_EQ(failures, 0);
+    ASSERT_EQ(pkw.getNumPuncs(), 50 * pkw.numShards());
+    ASSERT_EQ(pkw.usedShards(), pkw.numShards());
+}
@@ -0,0 +1,31 @@
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+
+# for (h)pprf construction test using the fixed-key AES PRG
+
+FIXED_KEY = bytes.fromhex("243f6a8885a308d313198a2e03707344")
+left = 0
+right = 1
+out = 2
+
+
+def prg(seed, function):
+    res = b""
+    for block in range(0, len(seed), 16):
+        x = bytearray(seed[block:block + 16].ljust(16, b"\x00"))
+        x[15] ^= function
+        x[14] ^= block // 16
+        encryptor = Cipher(algorithms.AES(FIXED_KEY), modes.ECB()).encryptor()
+        y = encryptor.update(bytes(x)) + encryptor.finalize()
+        res += bytes(a ^ b for a, b in zip(x, y))
+    return res[:len(seed)]
+
+
+if __name__ == '__main__':
+    evals = [right, left, left, right, left, left]
+    derived = b"\x00" * 16
+    for eval in evals:
+        derived = prg(derived, eval)
+    print('\\x'.join('{:02x}'.format(x) for x in derived))
+    derived = prg(derived, out)
+
+    print('\\x'.join('{:02x}'.format(x) for x in derived))
@@ -0,0 +1,93 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#ifndef SECURECLOUDSTORAGE_ROTATION_POLICY_H
+#define SECURECLOUDSTORAGE_ROTATION_POLICY_H
+
+#include <chrono>
+#include <cstddef>
+#include <pkw/pkw/pkw.h>
+
+namespace secure_cloud_storage {
+
+    /**
+     * The size of a PKW key, as far as it is relevant for deciding when to rotate.
+     */
+    struct KeyGrowth {
+        long puncs = 0;
+        /**
+         * the number of nodes of the key, 0 if the PKW does not consist of nodes
+         */
+        size_t nodes = 0;
+        /**
+         * the (estimated) size of the serialized key in bytes
+         */
+        size_t serialized_bytes = 0;
+    };
+
+    /**
+     * When and how a ClientOperator rotates its key without being asked to. A threshold of 0 is disabled; a rotation
+     * is due as soon as one of the enabled thresholds is reached.
+     */
+    struct RotationPolicy {
+        long max_puncs = 0;
+        size_t max_nodes = 0;
+        size_t max_serialized_bytes = 0;
+        /**
+         * if not zero, a due rotation only starts once no file was put, read or shredded for this long
+         */
+        std::chrono::milliseconds idle_window{0};
+        /**
+         * the maximal number of headers rewritten per second during a rotation, 0 for no limit
+         */
+        double max_header_rewrites_per_second = 0;
+        /**
+         * the minimal time between two measurements of the key, as measuring may serialize it
+         */
+        std::chrono::milliseconds check_interval{1000};
+
+        [[nodiscard]] bool is_due(const KeyGrowth &growth) const {
+            return (max_puncs > 0 && growth.puncs >= max_puncs) || (max_nodes > 0 && growth.nodes >= max_nodes) ||
+                   (max_serialized_bytes > 0 && growth.serialized_bytes >= max_serialized_bytes);
+        }
+    };
+
+    /**
+     * Measures the key of a PKW. If the key consists of nodes, the serialized size is estimated from their number,
+     * which the PPRF-based PKWs maintain incrementally; other keys are serialized.
+     * @param pkw the PKW.
+     * @param tag_len the length of tags.
+     * @param key_len the length of keys.
+     */
+    template<class T, class C>
+    KeyGrowth measure_key_growth(AbstractPKW<T, C> &pkw, int tag_len, int key_len) {
+        KeyGrowth growth;
+        growth.puncs = pkw.getNumPuncs();
+        growth.nodes = pkw.getNumKeyNodes();
+        if (growth.nodes > 0) {
+            // an upper bound: each node is stored with its value and a prefix of at most tag_len bits
+            growth.serialized_bytes = growth.nodes * (key_len / 8 + (tag_len + 7) / 8);
+        } else {
+            growth.serialized_bytes = pkw.serializeKey().size();
+        }
+        return growth;
+    }
+
+} // secure_cloud_storage
+
+#endif //SECURECLOUDSTORAGE_ROTATION_POLICY_H
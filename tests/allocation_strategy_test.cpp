@@ -0,0 +1,99 @@
+// Copyright 2023. Younis Khalil
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+//  persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+//  Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+//  BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+//  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <gtest/gtest.h>
+
+#include "../allocation_strategy.h"
+#include "../flat_id_provider.h"
+#include <pkw/pprf/ggm_pprf.h>
+
+namespace scs = secure_cloud_storage;
+
+TEST(AllocationStrategyTest, SequentialIsDefault) {
+    scs::FlatIdProvider idProvider(16);
+    ASSERT_EQ(idProvider.get_id("a/foo").getLocalId(), Tag(1));
+    ASSERT_EQ(idProvider.get_id("b/bar").getLocalId(), Tag(2));
+    ASSERT_EQ(idProvider.get_id("a/baz").getLocalId(), Tag(3));
+    ASSERT_FALSE(idProvider.may_allocate_between(Tag(0), Tag(2)));
+    ASSERT_TRUE(idProvider.may_allocate_between(Tag(0), Tag(4)));
+}
+
+TEST(AllocationStrategyTest, ClusterByDirectory) {
+    scs::FlatIdProvider idProvider(16, 0, std::make_shared<scs::ClusteredAllocation>(16, 2));
+    ASSERT_EQ(idProvider.get_id("a/foo").getLocalId(), Tag(0));
+    ASSERT_EQ(idProvider.get_id("b/foo").getLocalId(), Tag(4));
+    ASSERT_EQ(idProvider.get_id("a/bar").getLocalId(), Tag(1));
+    ASSERT_EQ(idProvider.get_id("a/baz").getLocalId(), Tag(2));
+    ASSERT_EQ(idProvider.get_id("a/qux").getLocalId(), Tag(3));
+    // the region of a is full
+    ASSERT_EQ(idProvider.get_id("a/quux").getLocalId(), Tag(8));
+    ASSERT_EQ(idProvider.get_id("b/bar").getLocalId(), Tag(5));
+
+    ASSERT_FALSE(idProvider.may_allocate_between(Tag(0), Tag(3)));
+    // the regions of b and a are open
+    ASSERT_TRUE(idProvider.may_allocate_between(Tag(6), Tag(6)));
+    ASSERT_TRUE(idProvider.may_allocate_between(Tag(9), Tag(11)));
+    ASSERT_TRUE(idProvider.may_allocate_between(Tag(12), Tag(12)));
+}
+
+TEST(AllocationStrategyTest, ClusterByLifetime) {
+    auto by_extension = [](const std::filesystem::path &p) {
+        return p.extension().string();
+    };
+    scs::FlatIdProvider idProvider(16, 0, std::make_shared<scs::ClusteredAllocation>(16, 4, by_extension));
+    ASSERT_EQ(idProvider.get_id("a/foo.tmp").getLocalId(), Tag(0));
+    ASSERT_EQ(idProvider.get_id("b/foo.txt").getLocalId(), Tag(16));
+    ASSERT_EQ(idProvider.get_id("c/bar.tmp").getLocalId(), Tag(1));
+}
+
+TEST(AllocationStrategyTest, ClusteredAfterReload) {
+    std::map<std::filesystem::path, Id<Tag>> lookup_table;
+    {
+        scs::FlatIdProvider idProvider(16, 0, std::make_shared<scs::ClusteredAllocation>(16, 2));
+        for (auto &p: {"a/foo", "b/foo", "c/foo"}) {
+            lookup_table[p] = idProvider.get_id(p);
+        }
+    }
+    scs::FlatIdProvider idProvider(lookup_table, 16, 0, std::make_shared<scs::ClusteredAllocation>(16, 2));
+    // every cluster continues in a fresh region
+    ASSERT_EQ(idProvider.get_id("a/bar").getLocalId(), Tag(12));
+    ASSERT_EQ(idProvider.get_id("a/foo").getLocalId(), Tag(0));
+
+    idProvider.compact_local_ids();
+    // the local ids 1 to 4 are in use, the remote id of tag 8 is still used by c/foo
+    ASSERT_EQ(idProvider.get_id("a/baz").getLocalId(), Tag(9));
+}
+
+TEST(AllocationStrategyTest, ClusteredDirectoryDeleteSavesNodes) {
+    scs::FlatIdProvider sequential(16);
+    scs::FlatIdProvider clustered(16, 0, std::make_shared<scs::ClusteredAllocation>(16, 3));
+    GGM_PPRF sequentialPRF(PPRFKey(128, 16, PRGType::FIXED_KEY_AES));
+    GGM_PPRF clusteredPRF(PPRFKey(128, 16, PRGType::FIXED_KEY_AES));
+    // the files of both directories are added alternately, the directory a is deleted
+    for (int i = 0; i < 8; ++i) {
+        for (auto &dir: {"a/", "b/"}) {
+            sequential.get_id(dir + std::to_string(i));
+            clustered.get_id(dir + std::to_string(i));
+        }
+    }
+    for (int i = 0; i < 8; ++i) {
+        sequentialPRF.punc(sequential.get_id("a/" + std::to_string(i)).getLocalId());
+        clusteredPRF.punc(clustered.get_id("a/" + std::to_string(i)).getLocalId());
+    }
+    // a single dead subtree, whose sibling is on the co-path
+    ASSERT_EQ(clusteredPRF.keyStats().nodes, 13);
+    ASSERT_LT(clusteredPRF.keyStats().nodes, sequentialPRF.keyStats().nodes);
+}
@@ -0,0 +1,520 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+#include <gtest/gtest.h>
+#include <atomic>
+#include "../client_operator.h"
+#include "../flat_dir_id_provider.h"
+#include "../flat_id_provider.h"
+#include "../util/key_journal.h"
+#include "../util/rate_limiter.h"
+#include "../util/rotation_checkpoint.h"
+#include "in_memory_cloud_communicator.h"
+#include <pkw/pkw/pprf_aead_pkw.h>
+
+namespace scs = secure_cloud_storage;
+
+class ClientOperatorRotationTest : public ::testing::Test {
+    protected:
+        ClientOperatorRotationTest() : comm(std::make_shared<scs::InMemoryCloudCommunicator<Tag>>()),
+                                       co(256, 256, comm, std::make_shared<scs::FlatIdProvider>(256),
+                                          std::make_shared<PPRF_AEAD_PKW>(256, 256)) {};
+
+        std::shared_ptr<scs::InMemoryCloudCommunicator<Tag>> comm;
+        scs::ClientOperator<Tag> co;
+
+        void put_files(int n) {
+            for (int i = 0; i < n; ++i) {
+                std::vector<unsigned char> content(i + 1, static_cast<unsigned char>(i));
+                co.put("file" + std::to_string(i), content);
+            }
+        }
+
+        static std::shared_ptr<AbstractPKW<Tag, scs::ciphertext>> fresh_pkw() {
+            return std::make_shared<PPRF_AEAD_PKW>(256, 256);
+        }
+
+        static bool eventually(const std::function<bool()> &condition) {
+            for (int i = 0; i < 500 && !condition(); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return condition();
+        }
+};
+
+TEST_F(ClientOperatorRotationTest, AutoRotationKeepsKeyBounded) {
+    scs::RotationPolicy policy;
+    policy.max_puncs = 4;
+    policy.check_interval = std::chrono::milliseconds(1);
+    std::atomic<int> rotations = 0;
+    co.enable_auto_rotation(policy, fresh_pkw, [&rotations](const auto &, size_t) { ++rotations; });
+    put_files(20);
+    for (int i = 0; i < 12; ++i) {
+        co.shred(co.get_id("file" + std::to_string(i)));
+    }
+    ASSERT_TRUE(eventually([this] { return co.key_growth().puncs < 4; }));
+    co.disable_auto_rotation();
+    ASSERT_GE(rotations, 1);
+    ASSERT_EQ(co.list_files().size(), 8);
+    for (int i = 12; i < 20; ++i) {
+        ASSERT_EQ(co.get(co.get_id("file" + std::to_string(i))),
+                  std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+    }
+}
+
+TEST_F(ClientOperatorRotationTest, AutoRotationWaitsForIdleWindow) {
+    scs::RotationPolicy policy;
+    policy.max_puncs = 1;
+    policy.check_interval = std::chrono::milliseconds(1);
+    policy.idle_window = std::chrono::milliseconds(300);
+    std::atomic<int> rotations = 0;
+    put_files(4);
+    co.enable_auto_rotation(policy, fresh_pkw, [&rotations](const auto &, size_t) { ++rotations; });
+    co.shred(co.get_id("file0"));
+    const auto busy_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (std::chrono::steady_clock::now() < busy_until) {
+        co.get(co.get_id("file1"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    ASSERT_EQ(rotations, 0);
+    ASSERT_TRUE(eventually([&rotations] { return rotations > 0; }));
+    ASSERT_EQ(co.key_growth().puncs, 0);
+}
+
+TEST_F(ClientOperatorRotationTest, AutoRotationLimitsHeaderRewrites) {
+    scs::RotationPolicy policy;
+    policy.max_puncs = 1;
+    policy.check_interval = std::chrono::milliseconds(1);
+    policy.max_header_rewrites_per_second = 50;
+    put_files(11);
+    std::atomic<bool> rotated = false;
+    const auto start = std::chrono::steady_clock::now();
+    co.enable_auto_rotation(policy, fresh_pkw, [&rotated](const auto &, size_t) { rotated = true; });
+    co.shred(co.get_id("file0"));
+    ASSERT_TRUE(eventually([&rotated] { return rotated.load(); }));
+    // 10 headers at 50 per second
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(180));
+    ASSERT_EQ(comm->num_header_writes(), 10);
+}
+
+TEST(RateLimiter, SpacesOutOperations) {
+    scs::RateLimiter limiter(100);
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 11; ++i) {
+        limiter.acquire();
+    }
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+}
+
+TEST_F(ClientOperatorRotationTest, OperationsContinueDuringRotation) {
+    put_files(16);
+    scs::RotationPolicy policy;
+    policy.max_puncs = 2;
+    policy.check_interval = std::chrono::milliseconds(1);
+    policy.max_header_rewrites_per_second = 40;
+    std::atomic<bool> rotated = false;
+    co.enable_auto_rotation(policy, fresh_pkw, [&rotated](const auto &, size_t) { rotated = true; });
+    co.shred(co.get_id("file0"));
+    co.shred(co.get_id("file1"));
+    ASSERT_TRUE(eventually([this] { return co.remaining_headers() > 0; }));
+    // headers of both epochs are read, new files are wrapped under the new key
+    std::vector<unsigned char> content = {'n', 'e', 'w'};
+    co.put("new_file", content);
+    co.shred(co.get_id("file2"));
+    while (!rotated) {
+        for (int i = 3; i < 16; ++i) {
+            ASSERT_EQ(co.get(co.get_id("file" + std::to_string(i))),
+                      std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+        }
+        ASSERT_EQ(co.get(co.get_id("new_file")), content);
+    }
+    co.disable_auto_rotation();
+    ASSERT_EQ(co.get_epoch(), 1);
+    ASSERT_EQ(co.remaining_headers(), 0);
+    ASSERT_EQ(co.list_files().size(), 14);
+    ASSERT_THROW(co.get_id("file2"), std::runtime_error);
+}
+
+TEST_F(ClientOperatorRotationTest, HeadersOfLaterEpochsAreMarked) {
+    put_files(1);
+    const std::string legacy = comm->read_from_cloud(comm->id_to_cloud_header(co.get_id("file0")));
+    ASSERT_EQ(legacy.size(), 256 / 8 + WRAP_TAG_LEN);
+    co.start_rotation(fresh_pkw());
+    ASSERT_EQ(co.wait_for_rotation(), 1);
+    std::vector<unsigned char> content = {'n', 'e', 'w'};
+    co.put("new_file", content);
+    for (const std::string file: {"file0", "new_file"}) {
+        const std::string header = comm->read_from_cloud(comm->id_to_cloud_header(co.get_id(file)));
+        ASSERT_EQ(header.size(), 1 + EPOCH_LEN + legacy.size());
+        ASSERT_EQ(header.substr(0, 1 + EPOCH_LEN), std::string({EPOCH_HEADER_VERSION, 0, 0, 0, 1}));
+    }
+    ASSERT_EQ(co.get(co.get_id("new_file")), content);
+}
+
+TEST_F(ClientOperatorRotationTest, StartRotationAcrossEpochs) {
+    put_files(8);
+    co.start_rotation(fresh_pkw());
+    std::vector<unsigned char> content = {'n', 'e', 'w'};
+    co.put("new_file", content);
+    ASSERT_EQ(co.wait_for_rotation(), 9);
+    co.start_rotation(fresh_pkw());
+    co.shred(co.get_id("file0"));
+    ASSERT_EQ(co.wait_for_rotation(), 8);
+    ASSERT_EQ(co.get_epoch(), 2);
+
+    // the key is restored together with its epoch
+    SecureByteBuffer key = co.export_key();
+    std::map<std::filesystem::path, Id<Tag>> lookup_table;
+    for (auto &file: co.list_files()) {
+        lookup_table.insert({file, co.get_id(file)});
+    }
+    scs::ClientOperator<Tag> restored(std::make_shared<PPRF_AEAD_PKW>(std::move(key)),
+                                      std::make_shared<scs::FlatIdProvider>(lookup_table, 256), 256, 256, comm,
+                                      co.get_epoch());
+    ASSERT_EQ(restored.get(restored.get_id("new_file")), content);
+    for (int i = 1; i < 8; ++i) {
+        ASSERT_EQ(restored.get(restored.get_id("file" + std::to_string(i))),
+                  std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+    }
+}
+
+/**
+ * Keeps the checkpoint in memory; saves fail once fail_after checkpoints were saved, as if the client crashed.
+ */
+class FailingCheckpointStore : public scs::RotationCheckpointStore {
+    public:
+        explicit FailingCheckpointStore(int fail_after) : fail_after(fail_after) {}
+
+        void save(const scs::RotationCheckpoint &c) override {
+            if (saves++ >= fail_after) {
+                throw std::runtime_error("crashed");
+            }
+            checkpoint = c;
+        }
+
+        std::optional<scs::RotationCheckpoint> load() override {
+            return checkpoint;
+        }
+
+        void clear() override {
+            checkpoint.reset();
+        }
+
+        int saves = 0;
+
+    private:
+        int fail_after;
+        std::optional<scs::RotationCheckpoint> checkpoint;
+};
+
+TEST_F(ClientOperatorRotationTest, ResumeInterruptedRotation) {
+    put_files(10);
+    SecureByteBuffer stored_key = co.export_key();
+    // the checkpoint before the first batch and after the first batch are saved, saving the second one fails
+    auto checkpoints = std::make_shared<FailingCheckpointStore>(2);
+    co.set_rotation_checkpoints(checkpoints, 3);
+    ASSERT_THROW(co.rotate_keys(fresh_pkw()), std::runtime_error);
+    std::optional<scs::RotationCheckpoint> checkpoint = checkpoints->load();
+    ASSERT_TRUE(checkpoint.has_value());
+    ASSERT_EQ(checkpoint->epoch, 1);
+    ASSERT_FALSE(checkpoint->last_remote_id.empty());
+
+    // resume with the stored key, the lookup table and the checkpoint
+    std::map<std::filesystem::path, Id<Tag>> lookup_table;
+    for (auto &file: co.list_files()) {
+        lookup_table.insert({file, co.get_id(file)});
+    }
+    scs::ClientOperator<Tag> restored(std::make_shared<PPRF_AEAD_PKW>(std::move(stored_key)),
+                                      std::make_shared<scs::FlatIdProvider>(lookup_table, 256), 256, 256, comm, 0);
+    auto resumed_checkpoints = std::make_shared<FailingCheckpointStore>(100);
+    restored.set_rotation_checkpoints(resumed_checkpoints, 3);
+    ASSERT_EQ(restored.resume_rotation(std::make_shared<PPRF_AEAD_PKW>(checkpoint->key), checkpoint->last_remote_id),
+              10);
+    ASSERT_EQ(restored.get_epoch(), 1);
+    // the remaining 7 headers are rewrapped in 3 batches
+    ASSERT_EQ(resumed_checkpoints->saves, 4);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(restored.get(restored.get_id("file" + std::to_string(i))),
+                  std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+    }
+}
+
+TEST_F(ClientOperatorRotationTest, ShredDuringRotationUpdatesCheckpoint) {
+    put_files(4);
+    auto checkpoints = std::make_shared<FailingCheckpointStore>(100);
+    co.set_rotation_checkpoints(checkpoints, 4);
+    scs::RotationPolicy policy;
+    policy.max_puncs = 1;
+    policy.check_interval = std::chrono::milliseconds(1);
+    // the first batch takes more than a second, no checkpoint is saved for it meanwhile
+    policy.max_header_rewrites_per_second = 2;
+    co.enable_auto_rotation(policy, fresh_pkw, [](const auto &, size_t) {});
+    co.shred(co.get_id("file0"));
+    ASSERT_TRUE(eventually([this] { return co.remaining_headers() > 0; }));
+    const Id<Tag> id = co.get_id("file3");
+    const int saves = checkpoints->saves;
+    co.shred(id);
+    ASSERT_EQ(checkpoints->saves, saves + 1);
+    // a rotation resumed from the checkpoint cannot derive the shredded tag from either key
+    std::optional<scs::RotationCheckpoint> checkpoint = checkpoints->load();
+    std::vector<unsigned char> head = {0};
+    std::vector<unsigned char> key = {'k'};
+    ASSERT_THROW(PPRF_AEAD_PKW(checkpoint->key).wrap(id.getLocalId(), head, key), IllegalTagException);
+    ASSERT_THROW(PPRF_AEAD_PKW(checkpoint->previous_key).wrap(id.getLocalId(), head, key), IllegalTagException);
+    co.disable_auto_rotation();
+}
+
+TEST_F(ClientOperatorRotationTest, CompactTagsDuringRotation) {
+    put_files(20);
+    std::map<std::string, std::string> remote_ids;
+    for (int i = 0; i < 20; ++i) {
+        const std::string file = "file" + std::to_string(i);
+        if (i % 3 == 0) {
+            co.shred(co.get_id(file));
+        } else {
+            remote_ids[file] = co.get_id(file).getRemoteId();
+        }
+    }
+    ASSERT_EQ(co.rotate_keys(fresh_pkw(), true), remote_ids.size());
+
+    // the files keep their objects and are assigned the local ids 1, 2, ... in the order of their remote ids
+    std::map<std::string, Tag> local_ids;
+    for (auto &[file, remote_id]: remote_ids) {
+        Id<Tag> id = co.get_id(file);
+        ASSERT_EQ(id.getRemoteId(), remote_id);
+        local_ids[remote_id] = id.getLocalId();
+    }
+    size_t rank = 0;
+    for (auto &[remote_id, local_id]: local_ids) {
+        ASSERT_EQ(local_id, Tag(++rank));
+    }
+    for (int i = 1; i < 20; i += 3) {
+        ASSERT_EQ(co.get(co.get_id("file" + std::to_string(i))),
+                  std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+    }
+
+    // fresh ids follow the compacted ones and do not reuse the remote ids of the files
+    std::vector<unsigned char> content{42};
+    co.put("new_file", content);
+    Id<Tag> id = co.get_id("new_file");
+    ASSERT_GT(id.getLocalId().to_ulong(), remote_ids.size());
+    ASSERT_EQ(local_ids.count(id.getRemoteId()), 0);
+    ASSERT_EQ(co.get(id), content);
+    ASSERT_EQ(co.get(co.get_id("file1")), std::vector<unsigned char>(2, 1));
+}
+
+TEST_F(ClientOperatorRotationTest, ResumeInterruptedCompaction) {
+    put_files(10);
+    co.shred(co.get_id("file0"));
+    SecureByteBuffer stored_key = co.export_key();
+    std::map<std::filesystem::path, Id<Tag>> lookup_table;
+    for (auto &file: co.list_files()) {
+        lookup_table.insert({file, co.get_id(file)});
+    }
+    auto checkpoints = std::make_shared<FailingCheckpointStore>(2);
+    co.set_rotation_checkpoints(checkpoints, 3);
+    ASSERT_THROW(co.rotate_keys(fresh_pkw(), true), std::runtime_error);
+    std::optional<scs::RotationCheckpoint> checkpoint = checkpoints->load();
+    ASSERT_TRUE(checkpoint->compact_tags);
+
+    // the lookup table stored before the rotation still holds the previous local ids
+    scs::ClientOperator<Tag> restored(std::make_shared<PPRF_AEAD_PKW>(std::move(stored_key)),
+                                      std::make_shared<scs::FlatIdProvider>(lookup_table, 256), 256, 256, comm, 0);
+    restored.set_rotation_checkpoints(std::make_shared<FailingCheckpointStore>(100), 3);
+    ASSERT_EQ(restored.resume_rotation(std::make_shared<PPRF_AEAD_PKW>(checkpoint->key), checkpoint->last_remote_id,
+                                       checkpoint->compact_tags),
+              9);
+    for (int i = 1; i < 10; ++i) {
+        Id<Tag> id = restored.get_id("file" + std::to_string(i));
+        ASSERT_LE(id.getLocalId().to_ulong(), 9);
+        ASSERT_EQ(restored.get(id), std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+    }
+}
+
+TEST_F(ClientOperatorRotationTest, CompactTagsRequiresSupport) {
+    scs::ClientOperator<Tag> unsupported(256, 256, comm, std::make_shared<scs::FlatDirIdProvider>(256),
+                                         fresh_pkw());
+    ASSERT_THROW(unsupported.rotate_keys(fresh_pkw(), true), std::runtime_error);
+}
+
+TEST_F(ClientOperatorRotationTest, RekeySubtreeReclaimsKeyNodes) {
+    put_files(100);
+    // shred every other file of the first ones, each of which leaves its neighbour as a node of the key
+    std::map<std::string, std::string> remote_ids;
+    for (int i = 0; i < 100; ++i) {
+        const std::string file = "file" + std::to_string(i);
+        if (i < 64 && i % 2 == 1) {
+            co.shred(co.get_id(file));
+        } else {
+            remote_ids[file] = co.get_id(file).getRemoteId();
+        }
+    }
+    const size_t nodes = co.key_growth().nodes;
+    const size_t header_writes = comm->num_header_writes();
+    size_t moved = co.rekey_subtrees(1, 2);
+    ASSERT_GT(moved, 0);
+    ASSERT_LE(co.key_growth().nodes + moved, nodes);
+    // only the headers of the moved files are rewritten
+    ASSERT_EQ(comm->num_header_writes() - header_writes, moved);
+    ASSERT_EQ(co.list_files().size(), remote_ids.size());
+    for (auto &[file, remote_id]: remote_ids) {
+        const int i = std::stoi(file.substr(4));
+        Id<Tag> id = co.get_id(file);
+        ASSERT_EQ(id.getRemoteId(), remote_id);
+        ASSERT_EQ(co.get(id), std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+    }
+    std::vector<unsigned char> content{42};
+    co.put("new_file", content);
+    ASSERT_EQ(co.get(co.get_id("new_file")), content);
+}
+
+TEST_F(ClientOperatorRotationTest, RekeySubtreeSparesUnallocatedIds) {
+    put_files(4);
+    co.shred(co.get_id("file3"));
+    // the subtrees of the key holding more than one node span ids still to be allocated
+    ASSERT_EQ(co.rekey_subtrees(1, 2), 0);
+    ASSERT_EQ(co.get(co.get_id("file2")), std::vector<unsigned char>(3, 2));
+    std::vector<unsigned char> content{42};
+    co.put("new_file", content);
+    ASSERT_EQ(co.get(co.get_id("new_file")), content);
+}
+
+class MemoryRekeyCheckpointStore : public scs::RekeyCheckpointStore<Tag> {
+    public:
+        int saves = 0;
+
+        void save(const scs::RekeyCheckpoint<Tag> &c) override {
+            checkpoint = c;
+            ++saves;
+        }
+
+        std::optional<scs::RekeyCheckpoint<Tag>> load() override {
+            return checkpoint;
+        }
+
+        void clear() override {
+            checkpoint.reset();
+        }
+
+    private:
+        std::optional<scs::RekeyCheckpoint<Tag>> checkpoint;
+};
+
+TEST_F(ClientOperatorRotationTest, ResumeInterruptedRekey) {
+    put_files(100);
+    for (int i = 1; i < 64; i += 2) {
+        co.shred(co.get_id("file" + std::to_string(i)));
+    }
+    SecureByteBuffer stored_key = co.export_key();
+    std::map<std::filesystem::path, Id<Tag>> lookup_table;
+    for (auto &file: co.list_files()) {
+        lookup_table.insert({file, co.get_id(file)});
+    }
+    auto checkpoints = std::make_shared<MemoryRekeyCheckpointStore>();
+    co.set_rekey_checkpoints(checkpoints);
+    // the crash happens after some of the headers have been written under the new local ids
+    comm->fail_header_writes_after(comm->num_header_writes() + 5);
+    ASSERT_THROW(co.rekey_subtrees(1, 2), std::runtime_error);
+    comm->fail_header_writes_after(std::nullopt);
+    std::optional<scs::RekeyCheckpoint<Tag>> checkpoint = checkpoints->load();
+    ASSERT_TRUE(checkpoint.has_value());
+    ASSERT_EQ(checkpoint->subtrees.size(), 1);
+    const size_t moves = checkpoint->subtrees[0].moved.size();
+    ASSERT_GT(moves, 5);
+
+    // resume with the stored key and lookup table, which hold the previous local ids
+    scs::ClientOperator<Tag> restored(std::make_shared<PPRF_AEAD_PKW>(std::move(stored_key)),
+                                      std::make_shared<scs::FlatIdProvider>(lookup_table, 256), 256, 256, comm, 0);
+    const size_t nodes = restored.key_growth().nodes;
+    ASSERT_EQ(restored.resume_rekey(*checkpoint), moves);
+    ASSERT_LT(restored.key_growth().nodes, nodes);
+    for (const Id<Tag> &moved: checkpoint->subtrees[0].moved) {
+        ASSERT_EQ(restored.get_id(restored.get_file_name(moved)), moved);
+    }
+    for (int i = 0; i < 100; ++i) {
+        if (i < 64 && i % 2 == 1) {
+            continue;
+        }
+        ASSERT_EQ(restored.get(restored.get_id("file" + std::to_string(i))),
+                  std::vector<unsigned char>(i + 1, static_cast<unsigned char>(i)));
+    }
+    // fresh ids follow the ones of the checkpoint
+    std::vector<unsigned char> content{42};
+    restored.put("new_file", content);
+    ASSERT_EQ(restored.get(restored.get_id("new_file")), content);
+    ASSERT_EQ(restored.get(restored.get_id("file0")), std::vector<unsigned char>(1, 0));
+}
+
+TEST_F(ClientOperatorRotationTest, RekeySubtreeKeepsIdsWhenUsedUp) {
+    // 255 local ids, of which the subtree of the first 64 ones needs more than are left
+    scs::ClientOperator<Tag> small(8, 256, comm, std::make_shared<scs::FlatIdProvider>(8),
+                                   std::make_shared<PPRF_AEAD_PKW>(8, 256));
+    std::vector<unsigned char> content{42};
+    for (int i = 0; i < 250; ++i) {
+        small.put("file" + std::to_string(i), content);
+    }
+    for (int i = 1; i < 64; i += 2) {
+        small.shred(small.get_id("file" + std::to_string(i)));
+    }
+    ASSERT_EQ(small.rekey_subtrees(1, 2), 0);
+    ASSERT_EQ(small.get(small.get_id("file0")), content);
+    // none of the remaining ids was used up by the attempt
+    for (int i = 250; i < 255; ++i) {
+        small.put("file" + std::to_string(i), content);
+    }
+    ASSERT_EQ(small.get(small.get_id("file254")), content);
+}
+
+TEST(ClientOperatorKeyGrowthTest, GrowthIsJournaledBeforeHeaderIsWritten) {
+    const std::filesystem::path journal_path = std::filesystem::temp_directory_path() / "key_growth_test.journal";
+    std::filesystem::remove(journal_path);
+    auto comm = std::make_shared<scs::InMemoryCloudCommunicator<Tag>>();
+    // the tree of the key starts with 2^16 tags, the second directory is given ids beyond them
+    auto pkw = std::make_shared<PPRF_AEAD_PKW>(16, 256, PRGType::HKDF_SHA256, 2, 32);
+    pkw->trackKeyChanges();
+    SecureByteBuffer stored_key = pkw->serializeKeyAndResetDelta();
+    scs::KeyJournal journal(journal_path, SecureByteBuffer(32, 7));
+    scs::ClientOperator<Tag> co(32, 256, comm,
+                                std::make_shared<scs::FlatIdProvider>(
+                                        32, 0, std::make_shared<scs::ClusteredAllocation>(32, 16)),
+                                pkw);
+    co.set_key_growth_handler([&pkw, &journal] {
+        SecureByteBuffer delta = pkw->takeKeyDelta();
+        journal.append(delta);
+    });
+    std::vector<unsigned char> content{42};
+    co.put("a/file", content);
+    ASSERT_EQ(journal.size(), 0);
+    co.put("b/file", content);
+    ASSERT_GE(co.get_id("b/file").getLocalId().to_ulong(), 1ul << 16);
+    ASSERT_EQ(journal.size(), 1);
+
+    // crash: the key is restored from the stored snapshot and the journal
+    std::map<std::filesystem::path, Id<Tag>> lookup_table;
+    for (auto &file: co.list_files()) {
+        lookup_table.insert({file, co.get_id(file)});
+    }
+    auto restored_pkw = std::make_shared<PPRF_AEAD_PKW>(std::move(stored_key));
+    for (auto &delta: scs::KeyJournal(journal_path, SecureByteBuffer(32, 7)).read()) {
+        restored_pkw->applyKeyDelta(delta);
+    }
+    scs::ClientOperator<Tag> restored(restored_pkw, std::make_shared<scs::FlatIdProvider>(lookup_table, 32), 32, 256,
+                                      comm, 0);
+    ASSERT_EQ(restored.get(restored.get_id("a/file")), content);
+    ASSERT_EQ(restored.get(restored.get_id("b/file")), content);
+    std::filesystem::remove(journal_path);
+}
@@ -0,0 +1,144 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#ifndef SECURECLOUDSTORAGE_IN_MEMORY_CLOUD_COMMUNICATOR_H
+#define SECURECLOUDSTORAGE_IN_MEMORY_CLOUD_COMMUNICATOR_H
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include "../cloud_communicator.h"
+
+namespace secure_cloud_storage {
+
+    /*
+     * A cloud service adapter which keeps the objects in memory, for tests which need to read back what was written.
+     */
+    template<class T>
+    class InMemoryCloudCommunicator : public CloudCommunicator<T> {
+        public:
+            void enqueue_delete(const Id<T> &t) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                delete_queue.emplace_back(id_to_name(t, ".f"));
+                delete_queue.emplace_back(id_to_name(t, ".h"));
+            }
+
+            void handle_delete_queue() override {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto &name: delete_queue) {
+                    objects.erase(name);
+                }
+                delete_queue.clear();
+            }
+
+            void write_to_cloud(const Id<T> &id, const std::vector<unsigned char> &wrapped_key,
+                                const std::vector<unsigned char> &encrypted_file, SecureByteBuffer &file_nonce) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                objects[id_to_name(id, ".f")] = std::string(file_nonce.begin(), file_nonce.end()) +
+                                                std::string(encrypted_file.begin(), encrypted_file.end());
+                objects[id_to_name(id, ".h")] = std::string(wrapped_key.begin(), wrapped_key.end());
+            }
+
+            void write_header_to_cloud(const Id<T> &id, const std::vector<unsigned char> &wrapped_key) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (max_header_writes && header_writes >= *max_header_writes) {
+                    throw std::runtime_error("Cannot write header for id " + id.getRemoteId());
+                }
+                objects[id_to_name(id, ".h")] = std::string(wrapped_key.begin(), wrapped_key.end());
+                ++header_writes;
+            }
+
+            void write_lookup_table_to_cloud(const std::string &encrypted) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                objects["T"] = encrypted;
+            }
+
+            std::string read_lookup_table_from_cloud() override {
+                return read_from_cloud("T");
+            }
+
+            std::string read_from_cloud(const std::string &name) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto object = objects.find(name);
+                if (object == objects.end()) {
+                    throw std::runtime_error("Cannot find file for id " + name);
+                }
+                return object->second;
+            }
+
+            std::string id_to_cloud_name(const Id<T> &id) override {
+                return id_to_name(id, ".f");
+            }
+
+            std::string id_to_cloud_header(const Id<T> &id) override {
+                return id_to_name(id, ".h");
+            }
+
+            size_t clean_storage(std::vector<Id<T>> known_ids) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                size_t deleted = 0;
+                for (auto it = objects.begin(); it != objects.end();) {
+                    const std::string remote_id = it->first.substr(0, it->first.length() - 2);
+                    if (it->first != "T" && std::none_of(known_ids.begin(), known_ids.end(), [&remote_id](const auto &id) {
+                        return id.getRemoteId() == remote_id;
+                    })) {
+                        it = objects.erase(it);
+                        ++deleted;
+                    } else {
+                        ++it;
+                    }
+                }
+                return deleted;
+            }
+
+            size_t num_objects() {
+                std::lock_guard<std::mutex> lock(mutex);
+                return objects.size();
+            }
+
+            size_t num_header_writes() {
+                std::lock_guard<std::mutex> lock(mutex);
+                return header_writes;
+            }
+
+            /*
+             * Lets header writes fail once the given number of headers has been written, e.g. to interrupt an operation
+             * midway; none to let them succeed again.
+             */
+            void fail_header_writes_after(std::optional<size_t> writes) {
+                std::lock_guard<std::mutex> lock(mutex);
+                max_header_writes = writes;
+            }
+
+        private:
+            std::mutex mutex;
+            std::map<std::string, std::string> objects;
+            std::vector<std::string> delete_queue;
+            size_t header_writes = 0;
+            std::optional<size_t> max_header_writes;
+
+            static std::string id_to_name(const Id<T> &id, const std::string &suffix) {
+                return id.getRemoteId() + suffix;
+            }
+    };
+
+} // secure_cloud_storage
+
+#endif //SECURECLOUDSTORAGE_IN_MEMORY_CLOUD_COMMUNICATOR_H
@@ -0,0 +1,104 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <pkw/pkw/exceptions.h>
+#include "../../util/key_journal.h"
+
+namespace fs = std::filesystem;
+using secure_cloud_storage::KeyJournal;
+
+class KeyJournalTest : public ::testing::Test {
+    protected:
+        fs::path path = fs::temp_directory_path() / "key_journal_test.journal";
+        SecureByteBuffer key = SecureByteBuffer(32, 7);
+
+        void SetUp() override {
+            fs::remove(path);
+        }
+
+        void TearDown() override {
+            fs::remove(path);
+        }
+
+        static SecureByteBuffer record(unsigned char value, size_t size) {
+            return {size, value};
+        }
+};
+
+TEST_F(KeyJournalTest, AppendThenRead) {
+    KeyJournal journal(path, key);
+    for (unsigned char i = 0; i < 5; ++i) {
+        SecureByteBuffer r = record(i, 10 + i);
+        journal.append(r);
+    }
+    ASSERT_EQ(journal.size(), 5);
+    KeyJournal reopened(path, key);
+    ASSERT_EQ(reopened.size(), 5);
+    std::vector<SecureByteBuffer> records = reopened.read();
+    ASSERT_EQ(records.size(), 5);
+    for (unsigned char i = 0; i < 5; ++i) {
+        ASSERT_EQ(records[i], record(i, 10 + i));
+    }
+}
+
+TEST_F(KeyJournalTest, PartialRecordIsDropped) {
+    KeyJournal journal(path, key);
+    SecureByteBuffer r = record(1, 100);
+    journal.append(r);
+    journal.append(r);
+    fs::resize_file(path, fs::file_size(path) - 3);
+    KeyJournal reopened(path, key);
+    ASSERT_EQ(reopened.size(), 1);
+    ASSERT_EQ(reopened.read().size(), 1);
+    reopened.append(r);
+    ASSERT_EQ(KeyJournal(path, key).read().size(), 2) << "Appending after a dropped record should succeed";
+}
+
+TEST_F(KeyJournalTest, ClearRemovesRecords) {
+    KeyJournal journal(path, key);
+    SecureByteBuffer r = record(1, 100);
+    journal.append(r);
+    journal.clear();
+    ASSERT_EQ(journal.size(), 0);
+    ASSERT_EQ(fs::file_size(path), 0);
+    journal.append(r);
+    ASSERT_EQ(KeyJournal(path, key).read().size(), 1);
+}
+
+TEST_F(KeyJournalTest, WrongKeyFails) {
+    KeyJournal journal(path, key);
+    SecureByteBuffer r = record(1, 100);
+    journal.append(r);
+    ASSERT_THROW(KeyJournal(path, SecureByteBuffer(32, 8)).read(), ImportException);
+}
+
+TEST_F(KeyJournalTest, ReorderedRecordsFail) {
+    KeyJournal journal(path, key);
+    SecureByteBuffer r1 = record(1, 20);
+    SecureByteBuffer r2 = record(2, 20);
+    journal.append(r1);
+    journal.append(r2);
+    std::vector<char> contents(fs::file_size(path));
+    std::ifstream(path, std::ios::binary).read(contents.data(), static_cast<std::streamsize>(contents.size()));
+    std::vector<char> swapped(contents.begin() + contents.size() / 2, contents.end());
+    swapped.insert(swapped.end(), contents.begin(), contents.begin() + contents.size() / 2);
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(swapped.data(), static_cast<std::streamsize>(swapped.size()));
+    ASSERT_THROW(KeyJournal(path, key).read(), ImportException);
+}
@@ -0,0 +1,104 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#include <gtest/gtest.h>
+#include <pkw/pkw/exceptions.h>
+#include "../../util/rekey_checkpoint.h"
+#include "../../util/rotation_checkpoint.h"
+
+namespace fs = std::filesystem;
+using secure_cloud_storage::FileRotationCheckpointStore;
+using secure_cloud_storage::RotationCheckpoint;
+
+class RotationCheckpointTest : public ::testing::Test {
+    protected:
+        fs::path path = fs::temp_directory_path() / "rotation_checkpoint_test.checkpoint";
+        SecureByteBuffer key = SecureByteBuffer(32, 7);
+
+        void SetUp() override {
+            fs::remove(path);
+        }
+
+        void TearDown() override {
+            fs::remove(path);
+        }
+
+        static RotationCheckpoint checkpoint(uint32_t epoch, const std::string &last_remote_id) {
+            RotationCheckpoint c;
+            c.epoch = epoch;
+            c.last_remote_id = last_remote_id;
+            c.previous_key = SecureByteBuffer(100, 1);
+            c.key = SecureByteBuffer(50, 2);
+            return c;
+        }
+};
+
+TEST_F(RotationCheckpointTest, SaveThenLoad) {
+    FileRotationCheckpointStore store(path, key);
+    ASSERT_FALSE(store.load().has_value());
+    store.save(checkpoint(3, "remote_id"));
+    std::optional<RotationCheckpoint> loaded = FileRotationCheckpointStore(path, key).load();
+    ASSERT_TRUE(loaded.has_value());
+    ASSERT_EQ(loaded->epoch, 3);
+    ASSERT_FALSE(loaded->compact_tags);
+    ASSERT_EQ(loaded->last_remote_id, "remote_id");
+    ASSERT_EQ(loaded->previous_key, SecureByteBuffer(100, 1));
+    ASSERT_EQ(loaded->key, SecureByteBuffer(50, 2));
+}
+
+TEST_F(RotationCheckpointTest, SaveThenLoadCompaction) {
+    FileRotationCheckpointStore store(path, key);
+    RotationCheckpoint compaction = checkpoint(2, "remote_id");
+    compaction.compact_tags = true;
+    store.save(compaction);
+    ASSERT_TRUE(store.load()->compact_tags);
+}
+
+TEST_F(RotationCheckpointTest, SaveReplacesCheckpoint) {
+    FileRotationCheckpointStore store(path, key);
+    store.save(checkpoint(1, ""));
+    store.save(checkpoint(1, "next"));
+    ASSERT_EQ(store.load()->last_remote_id, "next");
+    store.clear();
+    ASSERT_FALSE(store.load().has_value());
+}
+
+TEST_F(RotationCheckpointTest, WrongKeyFails) {
+    FileRotationCheckpointStore(path, key).save(checkpoint(1, ""));
+    ASSERT_THROW(FileRotationCheckpointStore(path, SecureByteBuffer(32, 8)).load(), ImportException);
+}
+
+TEST_F(RotationCheckpointTest, SaveThenLoadRekey) {
+    secure_cloud_storage::FileRekeyCheckpointStore store(path, key);
+    ASSERT_FALSE(store.load().has_value());
+    secure_cloud_storage::RekeyCheckpoint<Tag> rekey;
+    rekey.subtrees.push_back({Tag(0), Tag(63), {Id<Tag>(Tag(300), "a"), Id<Tag>(Tag(1) << 200, "b")}});
+    rekey.subtrees.push_back({Tag(128), Tag(255), {}});
+    store.save(rekey);
+    std::optional<secure_cloud_storage::RekeyCheckpoint<Tag>> loaded =
+            secure_cloud_storage::FileRekeyCheckpointStore(path, key).load();
+    ASSERT_TRUE(loaded.has_value());
+    ASSERT_EQ(loaded->subtrees.size(), 2);
+    ASSERT_EQ(loaded->subtrees[0].first, Tag(0));
+    ASSERT_EQ(loaded->subtrees[0].last, Tag(63));
+    ASSERT_EQ(loaded->subtrees[0].moved, rekey.subtrees[0].moved);
+    ASSERT_EQ(loaded->subtrees[1].last, Tag(255));
+    ASSERT_TRUE(loaded->subtrees[1].moved.empty());
+    store.clear();
+    ASSERT_FALSE(store.load().has_value());
+}
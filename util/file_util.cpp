@@ -18,6 +18,8 @@
 
 #include "file_util.h"
 #include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
@@ -36,6 +38,18 @@ namespace secure_cloud_storage {
         f << std::string{contents.begin(), contents.end()};
     }
 
+    void FileUtil::sync(const fs::path &path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open " + path.string());
+        }
+        const int res = fsync(fd);
+        close(fd);
+        if (res != 0) {
+            throw std::runtime_error("Could not sync " + path.string());
+        }
+    }
+
     std::vector<unsigned char> FileUtil::read_file(const fs::path &path) {
         if (!fs::exists(path) || !fs::is_regular_file(path)) {
             throw std::runtime_error("File does not exist: " + path.string());
@@ -30,6 +30,9 @@ namespace secure_cloud_storage {
 
             static void
             write_file(std::vector<unsigned char> &contents, bool overwrite, const std::filesystem::path &path);
+
+            // flushes the file or directory to the storage device, e.g. before and after it replaces another by renaming
+            static void sync(const std::filesystem::path &path);
     };
 
 } // secure_cloud_storage
@@ -0,0 +1,128 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#include "key_journal.h"
+#include <fstream>
+#include <pkw/pkw/helpers/password_encrypt.h>
+#include <cryptopp/osrng.h>
+
+namespace fs = std::filesystem;
+
+namespace secure_cloud_storage {
+    static const size_t IV_LEN = 16;
+    static const size_t LENGTH_LEN = 4;
+
+    KeyJournal::KeyJournal(fs::path path, SecureByteBuffer key) : path(std::move(path)), key(std::move(key)) {
+        if (!fs::exists(this->path)) {
+            return;
+        }
+        std::ifstream f(this->path, std::ios::in | std::ios::binary);
+        if (!f) {
+            throw std::runtime_error("Could not open key journal: " + this->path.string());
+        }
+        // count the complete records, a record at the end may only be partially written
+        const size_t total = fs::file_size(this->path);
+        unsigned char length_bytes[LENGTH_LEN];
+        while (file_size + LENGTH_LEN <= total) {
+            f.seekg(static_cast<std::streamoff>(file_size));
+            f.read(reinterpret_cast<char *>(length_bytes), LENGTH_LEN);
+            size_t length = 0;
+            for (unsigned char b: length_bytes) {
+                length = (length << 8) | b;
+            }
+            if (file_size + LENGTH_LEN + IV_LEN + length > total) {
+                break;
+            }
+            file_size += LENGTH_LEN + IV_LEN + length;
+            ++num_records;
+        }
+        f.close();
+        if (file_size < total) {
+            fs::resize_file(this->path, file_size);
+        }
+    }
+
+    void KeyJournal::append(SecureByteBuffer &record) {
+        SecureByteBuffer iv(IV_LEN);
+        CryptoPP::OS_GenerateRandomBlock(false, iv.data(), iv.size());
+        std::vector<unsigned char> ciphertext = encrypt(record, key, iv, position_aad(num_records));
+
+        std::vector<unsigned char> entry;
+        entry.reserve(LENGTH_LEN + IV_LEN + ciphertext.size());
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            entry.push_back((ciphertext.size() >> shift) & 0xFF);
+        }
+        entry.insert(entry.end(), iv.begin(), iv.end());
+        entry.insert(entry.end(), ciphertext.begin(), ciphertext.end());
+
+        if (!path.parent_path().empty() && !fs::exists(path.parent_path())) {
+            fs::create_directories(path.parent_path());
+        }
+        std::ofstream f(path, std::ios::out | std::ios::app | std::ios::binary);
+        f.write(reinterpret_cast<const char *>(entry.data()), static_cast<std::streamsize>(entry.size()));
+        f.flush();
+        if (!f) {
+            throw std::runtime_error("Could not write key journal: " + path.string());
+        }
+        file_size += entry.size();
+        ++num_records;
+    }
+
+    std::vector<SecureByteBuffer> KeyJournal::read() {
+        std::vector<SecureByteBuffer> records;
+        if (num_records == 0) {
+            return records;
+        }
+        std::ifstream f(path, std::ios::in | std::ios::binary);
+        std::vector<unsigned char> contents(file_size);
+        f.read(reinterpret_cast<char *>(contents.data()), static_cast<std::streamsize>(file_size));
+        if (!f) {
+            throw std::runtime_error("Could not read key journal: " + path.string());
+        }
+        size_t offset = 0;
+        for (size_t i = 0; i < num_records; ++i) {
+            size_t length = 0;
+            for (size_t b = 0; b < LENGTH_LEN; ++b) {
+                length = (length << 8) | contents[offset++];
+            }
+            SecureByteBuffer iv(IV_LEN);
+            std::copy_n(contents.begin() + static_cast<long>(offset), IV_LEN, iv.data());
+            offset += IV_LEN;
+            std::vector<unsigned char> ciphertext(contents.begin() + static_cast<long>(offset),
+                                                  contents.begin() + static_cast<long>(offset + length));
+            offset += length;
+            records.push_back(decrypt(SecureByteBuffer(ciphertext), key, iv, position_aad(i)));
+        }
+        return records;
+    }
+
+    void KeyJournal::clear() {
+        // truncate, such that the records do not remain in the file system
+        std::ofstream f(path, std::ios::out | std::ios::trunc | std::ios::binary);
+        num_records = 0;
+        file_size = 0;
+    }
+
+    std::vector<unsigned char> KeyJournal::position_aad(size_t position) {
+        std::vector<unsigned char> aad;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            aad.push_back((static_cast<uint64_t>(position) >> shift) & 0xFF);
+        }
+        return aad;
+    }
+} // secure_cloud_storage
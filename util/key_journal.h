@@ -0,0 +1,85 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#ifndef SECURECLOUDSTORAGE_KEY_JOURNAL_H
+#define SECURECLOUDSTORAGE_KEY_JOURNAL_H
+
+#include <filesystem>
+#include <vector>
+#include <pkw/secure_byte_buffer.h>
+
+namespace secure_cloud_storage {
+
+    /**
+     * An encrypted, append-only journal, used to persist the changes made to a PKW key since its last snapshot.
+     * <br>
+     * Each record is encrypted with AES-GCM under a fresh IV and authenticated together with its position in the
+     * journal, such that records cannot be modified, reordered or removed from the middle of the journal without
+     * detection. A record which was only partially written (e.g. on a crash) is dropped when the journal is opened.
+     * <br>
+     * File format: records (length of the ciphertext as big-endian 32 bit value | IV | ciphertext)
+     */
+    class KeyJournal {
+        public:
+            /**
+             * Opens the journal stored at path, creating it on the first append.
+             * @param path the path of the journal file
+             * @param key the key used to encrypt the records
+             * @throws std::runtime_error if the journal cannot be read
+             */
+            KeyJournal(std::filesystem::path path, SecureByteBuffer key);
+
+            /**
+             * Encrypts the record and appends it to the journal.
+             * @throws std::runtime_error if the record cannot be written
+             */
+            void append(SecureByteBuffer &record);
+
+            /**
+             * Reads and decrypts all records of the journal, in the order they were appended.
+             * @throws ImportException if a record cannot be decrypted
+             */
+            std::vector<SecureByteBuffer> read();
+
+            /**
+             * Removes all records, e.g. after a new snapshot of the key has been stored.
+             */
+            void clear();
+
+            /**
+             * @return the number of records in the journal
+             */
+            [[nodiscard]] size_t size() const { return num_records; }
+
+            /**
+             * @return the size of the journal file in bytes
+             */
+            [[nodiscard]] size_t size_bytes() const { return file_size; }
+
+        private:
+            std::filesystem::path path;
+            SecureByteBuffer key;
+            size_t num_records = 0;
+            size_t file_size = 0;
+
+            static std::vector<unsigned char> position_aad(size_t position);
+    };
+
+} // secure_cloud_storage
+
+#endif //SECURECLOUDSTORAGE_KEY_JOURNAL_H
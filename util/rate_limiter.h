@@ -0,0 +1,68 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#ifndef SECURECLOUDSTORAGE_RATE_LIMITER_H
+#define SECURECLOUDSTORAGE_RATE_LIMITER_H
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace secure_cloud_storage {
+
+    /**
+     * Spaces out operations such that at most a given number of them start per second. Thread-safe; callers that
+     * exceed the rate are put to sleep until their slot.
+     */
+    class RateLimiter {
+        public:
+            /**
+             * @param per_second the maximal number of operations per second, 0 for no limit.
+             */
+            explicit RateLimiter(double per_second) : interval(per_second > 0 ? std::chrono::duration_cast<
+                    std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / per_second))
+                                                                              : std::chrono::steady_clock::duration::zero()) {}
+
+            /**
+             * Blocks until the next operation may start.
+             */
+            void acquire() {
+                if (interval == std::chrono::steady_clock::duration::zero()) {
+                    return;
+                }
+                std::chrono::steady_clock::time_point slot;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    // do not accumulate credit while idle
+                    next = std::max(next, std::chrono::steady_clock::now());
+                    slot = next;
+                    next += interval;
+                }
+                std::this_thread::sleep_until(slot);
+            }
+
+        private:
+            const std::chrono::steady_clock::duration interval;
+            std::chrono::steady_clock::time_point next;
+            std::mutex mutex;
+    };
+
+} // secure_cloud_storage
+
+#endif //SECURECLOUDSTORAGE_RATE_LIMITER_H
@@ -0,0 +1,66 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#ifndef SECURECLOUDSTORAGE_REKEY_CHECKPOINT_H
+#define SECURECLOUDSTORAGE_REKEY_CHECKPOINT_H
+
+#include <filesystem>
+#include <optional>
+#include <pkw/pprf/ggm_pprf.h>
+#include <pkw/secure_byte_buffer.h>
+#include "rotation_checkpoint.h"
+
+namespace secure_cloud_storage {
+
+    /**
+     * Stores a re-keying checkpoint in a local file like FileRotationCheckpointStore, with which it shares the
+     * handling of the file (see rotation_checkpoint.cpp).
+     * <br>
+     * File format: IV | ciphertext of (number of subtrees | per subtree: first | last | number of moved files | per
+     * moved file: local id | remote id), with numbers as big-endian 32 bit values and ids as base64 strings, each
+     * preceded by its length
+     */
+    class FileRekeyCheckpointStore : public RekeyCheckpointStore<Tag> {
+        public:
+            /**
+             * @param path the path of the checkpoint file
+             * @param key the key used to encrypt the checkpoint
+             */
+            FileRekeyCheckpointStore(std::filesystem::path path, SecureByteBuffer key);
+
+            /**
+             * @throws std::runtime_error if the checkpoint cannot be written
+             */
+            void save(const RekeyCheckpoint<Tag> &checkpoint) override;
+
+            /**
+             * @throws ImportException if the checkpoint cannot be decrypted
+             * @throws std::runtime_error if the checkpoint is malformed
+             */
+            std::optional<RekeyCheckpoint<Tag>> load() override;
+
+            void clear() override;
+
+        private:
+            std::filesystem::path path;
+            SecureByteBuffer key;
+    };
+
+} // secure_cloud_storage
+
+#endif //SECURECLOUDSTORAGE_REKEY_CHECKPOINT_H
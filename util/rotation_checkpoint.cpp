@@ -0,0 +1,198 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#include "rotation_checkpoint.h"
+#include "rekey_checkpoint.h"
+#include "tag_util.h"
+#include <fstream>
+#include <pkw/pkw/helpers/password_encrypt.h>
+#include <cryptopp/osrng.h>
+
+namespace fs = std::filesystem;
+
+namespace secure_cloud_storage {
+    static const size_t IV_LEN = 16;
+    static const size_t LENGTH_LEN = 4;
+
+    static void append_length(std::vector<unsigned char> &out, size_t length) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back((length >> shift) & 0xFF);
+        }
+    }
+
+    static size_t read_length(const SecureByteBuffer &in, size_t &offset) {
+        if (offset + LENGTH_LEN > in.size()) {
+            throw std::runtime_error("Malformed checkpoint");
+        }
+        size_t length = 0;
+        for (size_t b = 0; b < LENGTH_LEN; ++b) {
+            length = (length << 8) | in.data()[offset++];
+        }
+        return length;
+    }
+
+    static SecureByteBuffer read_bytes(const SecureByteBuffer &in, size_t &offset, size_t length) {
+        if (offset + length > in.size()) {
+            throw std::runtime_error("Malformed checkpoint");
+        }
+        SecureByteBuffer bytes(length);
+        std::copy_n(in.begin() + static_cast<long>(offset), length, bytes.data());
+        offset += length;
+        return bytes;
+    }
+
+    static void append_string(std::vector<unsigned char> &out, const std::string &s) {
+        append_length(out, s.size());
+        out.insert(out.end(), s.begin(), s.end());
+    }
+
+    static std::string read_string(const SecureByteBuffer &in, size_t &offset) {
+        SecureByteBuffer bytes = read_bytes(in, offset, read_length(in, offset));
+        return {bytes.begin(), bytes.end()};
+    }
+
+    /**
+     * Encrypts the checkpoint and replaces the file at path with it.
+     */
+    static void write_encrypted(const fs::path &path, SecureByteBuffer &key, SecureByteBuffer plaintext) {
+        SecureByteBuffer iv(IV_LEN);
+        CryptoPP::OS_GenerateRandomBlock(false, iv.data(), iv.size());
+        std::vector<unsigned char> ciphertext = encrypt(plaintext, key, iv, {0});
+
+        if (!path.parent_path().empty() && !fs::exists(path.parent_path())) {
+            fs::create_directories(path.parent_path());
+        }
+        const fs::path tmp_path = fs::path(path.string() + ".tmp");
+        std::ofstream f(tmp_path, std::ios::out | std::ios::trunc | std::ios::binary);
+        f.write(reinterpret_cast<const char *>(iv.data()), static_cast<std::streamsize>(iv.size()));
+        f.write(reinterpret_cast<const char *>(ciphertext.data()), static_cast<std::streamsize>(ciphertext.size()));
+        f.close();
+        if (!f) {
+            throw std::runtime_error("Could not write checkpoint: " + path.string());
+        }
+        fs::rename(tmp_path, path);
+    }
+
+    /**
+     * @return the decrypted checkpoint stored at path, if any
+     */
+    static std::optional<SecureByteBuffer> read_encrypted(const fs::path &path, SecureByteBuffer &key) {
+        if (!fs::exists(path)) {
+            return std::nullopt;
+        }
+        const size_t size = fs::file_size(path);
+        if (size < IV_LEN) {
+            throw std::runtime_error("Malformed checkpoint");
+        }
+        std::ifstream f(path, std::ios::in | std::ios::binary);
+        SecureByteBuffer iv(IV_LEN);
+        std::vector<unsigned char> ciphertext(size - IV_LEN);
+        f.read(reinterpret_cast<char *>(iv.data()), static_cast<std::streamsize>(iv.size()));
+        f.read(reinterpret_cast<char *>(ciphertext.data()), static_cast<std::streamsize>(ciphertext.size()));
+        if (!f) {
+            throw std::runtime_error("Could not read checkpoint: " + path.string());
+        }
+        return decrypt(SecureByteBuffer(ciphertext), key, iv, {0});
+    }
+
+    FileRotationCheckpointStore::FileRotationCheckpointStore(fs::path path, SecureByteBuffer key)
+            : path(std::move(path)), key(std::move(key)) {}
+
+    void FileRotationCheckpointStore::save(const RotationCheckpoint &checkpoint) {
+        std::vector<unsigned char> plain;
+        plain.reserve(4 * LENGTH_LEN + 1 + checkpoint.last_remote_id.size() + checkpoint.previous_key.size() +
+                      checkpoint.key.size());
+        append_length(plain, checkpoint.epoch);
+        plain.push_back(checkpoint.compact_tags ? 1 : 0);
+        append_length(plain, checkpoint.last_remote_id.size());
+        plain.insert(plain.end(), checkpoint.last_remote_id.begin(), checkpoint.last_remote_id.end());
+        append_length(plain, checkpoint.previous_key.size());
+        plain.insert(plain.end(), checkpoint.previous_key.begin(), checkpoint.previous_key.end());
+        plain.insert(plain.end(), checkpoint.key.begin(), checkpoint.key.end());
+        write_encrypted(path, key, SecureByteBuffer(plain));
+    }
+
+    std::optional<RotationCheckpoint> FileRotationCheckpointStore::load() {
+        std::optional<SecureByteBuffer> stored = read_encrypted(path, key);
+        if (!stored) {
+            return std::nullopt;
+        }
+        const SecureByteBuffer &plain = *stored;
+
+        RotationCheckpoint checkpoint;
+        size_t offset = 0;
+        checkpoint.epoch = read_length(plain, offset);
+        checkpoint.compact_tags = read_bytes(plain, offset, 1).data()[0] != 0;
+        SecureByteBuffer remote_id = read_bytes(plain, offset, read_length(plain, offset));
+        checkpoint.last_remote_id = std::string(remote_id.begin(), remote_id.end());
+        checkpoint.previous_key = read_bytes(plain, offset, read_length(plain, offset));
+        checkpoint.key = read_bytes(plain, offset, plain.size() - offset);
+        return checkpoint;
+    }
+
+    void FileRotationCheckpointStore::clear() {
+        fs::remove(path);
+    }
+
+    FileRekeyCheckpointStore::FileRekeyCheckpointStore(fs::path path, SecureByteBuffer key)
+            : path(std::move(path)), key(std::move(key)) {}
+
+    void FileRekeyCheckpointStore::save(const RekeyCheckpoint<Tag> &checkpoint) {
+        std::vector<unsigned char> plain;
+        append_length(plain, checkpoint.subtrees.size());
+        for (const auto &subtree: checkpoint.subtrees) {
+            append_string(plain, tag_to_base64(subtree.first));
+            append_string(plain, tag_to_base64(subtree.last));
+            append_length(plain, subtree.moved.size());
+            for (const Id<Tag> &id: subtree.moved) {
+                append_string(plain, tag_to_base64(id.getLocalId()));
+                append_string(plain, id.getRemoteId());
+            }
+        }
+        write_encrypted(path, key, SecureByteBuffer(plain));
+    }
+
+    std::optional<RekeyCheckpoint<Tag>> FileRekeyCheckpointStore::load() {
+        std::optional<SecureByteBuffer> stored = read_encrypted(path, key);
+        if (!stored) {
+            return std::nullopt;
+        }
+        const SecureByteBuffer &plain = *stored;
+
+        RekeyCheckpoint<Tag> checkpoint;
+        size_t offset = 0;
+        for (size_t subtrees = read_length(plain, offset); subtrees > 0; --subtrees) {
+            RekeyCheckpoint<Tag>::Subtree subtree;
+            subtree.first = tag_from_base64(read_string(plain, offset));
+            subtree.last = tag_from_base64(read_string(plain, offset));
+            for (size_t moved = read_length(plain, offset); moved > 0; --moved) {
+                Tag local_id = tag_from_base64(read_string(plain, offset));
+                subtree.moved.emplace_back(local_id, read_string(plain, offset));
+            }
+            checkpoint.subtrees.push_back(std::move(subtree));
+        }
+        if (offset != plain.size()) {
+            throw std::runtime_error("Malformed checkpoint");
+        }
+        return checkpoint;
+    }
+
+    void FileRekeyCheckpointStore::clear() {
+        fs::remove(path);
+    }
+} // secure_cloud_storage
@@ -0,0 +1,142 @@
+// Copyright 2023 Younis Khalil
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+// persons to whom the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//
+
+#ifndef SECURECLOUDSTORAGE_ROTATION_CHECKPOINT_H
+#define SECURECLOUDSTORAGE_ROTATION_CHECKPOINT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include <pkw/secure_byte_buffer.h>
+#include "../id.h"
+
+namespace secure_cloud_storage {
+
+    /**
+     * The progress of a key rotation: all headers up to the remote id last_remote_id are wrapped under the key of
+     * the epoch, the following ones may still be wrapped under the previous key. If compact_tags is set, the
+     * rotation assigns dense local ids.
+     */
+    struct RotationCheckpoint {
+        uint32_t epoch = 0;
+        bool compact_tags = false;
+        std::string last_remote_id;
+        SecureByteBuffer previous_key;
+        SecureByteBuffer key;
+    };
+
+    /**
+     * Persists the progress of key rotations, such that a rotation can be resumed after a crash.
+     */
+    class RotationCheckpointStore {
+        public:
+            virtual ~RotationCheckpointStore() = default;
+
+            /**
+             * Replaces the stored checkpoint.
+             */
+            virtual void save(const RotationCheckpoint &checkpoint) = 0;
+
+            /**
+             * @return the stored checkpoint, if a rotation was interrupted.
+             */
+            virtual std::optional<RotationCheckpoint> load() = 0;
+
+            /**
+             * Removes the stored checkpoint, once a rotation has completed.
+             */
+            virtual void clear() = 0;
+    };
+
+    /**
+     * Stores a checkpoint in a local file, encrypted with AES-GCM. A checkpoint is written to a temporary file which
+     * replaces the previous one, such that a crash leaves either of them intact.
+     * <br>
+     * File format: IV | ciphertext of (epoch | length of the remote id | remote id | length of the previous key |
+     * previous key | key), with lengths and epoch as big-endian 32 bit values
+     */
+    class FileRotationCheckpointStore : public RotationCheckpointStore {
+        public:
+            /**
+             * @param path the path of the checkpoint file
+             * @param key the key used to encrypt the checkpoint
+             */
+            FileRotationCheckpointStore(std::filesystem::path path, SecureByteBuffer key);
+
+            /**
+             * @throws std::runtime_error if the checkpoint cannot be written
+             */
+            void save(const RotationCheckpoint &checkpoint) override;
+
+            /**
+             * @throws ImportException if the checkpoint cannot be decrypted
+             * @throws std::runtime_error if the checkpoint is malformed
+             */
+            std::optional<RotationCheckpoint> load() override;
+
+            void clear() override;
+
+        private:
+            std::filesystem::path path;
+            SecureByteBuffer key;
+    };
+
+    /**
+     * The files moved by re-keying subtrees of the tag space: the files of each subtree [first, last] are moved to the
+     * local ids of moved, keeping their remote ids, and the subtree is punctured. Until the lookup table and the key
+     * have been stored, the header of a moved file may be wrapped under its previous or its new local id.
+     */
+    template<class T>
+    struct RekeyCheckpoint {
+        struct Subtree {
+            T first;
+            T last;
+            std::vector<Id<T>> moved;
+        };
+        std::vector<Subtree> subtrees;
+    };
+
+    /**
+     * Persists the files moved by re-keying subtrees, such that the moves can be completed after a crash.
+     */
+    template<class T>
+    class RekeyCheckpointStore {
+        public:
+            virtual ~RekeyCheckpointStore() = default;
+
+            /**
+             * Replaces the stored checkpoint.
+             */
+            virtual void save(const RekeyCheckpoint<T> &checkpoint) = 0;
+
+            /**
+             * @return the stored checkpoint, if a re-keying was interrupted.
+             */
+            virtual std::optional<RekeyCheckpoint<T>> load() = 0;
+
+            /**
+             * Removes the stored checkpoint, once the lookup table and the key have been stored.
+             */
+            virtual void clear() = 0;
+    };
+
+} // secure_cloud_storage
+
+#endif //SECURECLOUDSTORAGE_ROTATION_CHECKPOINT_H